@@ -7,6 +7,8 @@
 #include <setjmp.h>
 #include <malloc.h>
 
+#include "recomp_rdram.h"
+
 #if 0 // treat GPRs as 32-bit, should be better codegen
 typedef uint32_t gpr;
 
@@ -25,6 +27,32 @@ typedef uint64_t gpr;
 #define SUB32(a, b) \
     ((gpr)(int32_t)((a) - (b)))
 
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+// RDRAM is stored big-endian (see recomp_rdram.h), so bytes need no address adjustment and wider values are byteswapped by
+// the references these produce. Doublewords are a single access.
+#define MEM_W(offset, reg) \
+    (*(recomp::rdram::BigEndian<int32_t>*)(rdram + ((((reg) + (offset))) - 0xFFFFFFFF80000000)))
+
+#define MEM_H(offset, reg) \
+    (*(recomp::rdram::BigEndian<int16_t>*)(rdram + ((((reg) + (offset))) - 0xFFFFFFFF80000000)))
+
+#define MEM_B(offset, reg) \
+    (*(int8_t*)(rdram + ((((reg) + (offset))) - 0xFFFFFFFF80000000)))
+
+#define MEM_HU(offset, reg) \
+    (*(recomp::rdram::BigEndian<uint16_t>*)(rdram + ((((reg) + (offset))) - 0xFFFFFFFF80000000)))
+
+#define MEM_BU(offset, reg) \
+    (*(uint8_t*)(rdram + ((((reg) + (offset))) - 0xFFFFFFFF80000000)))
+
+#define SD(val, offset, reg) { \
+    *(recomp::rdram::BigEndian<uint64_t>*)(rdram + ((((reg) + (offset))) - 0xFFFFFFFF80000000)) = (uint64_t)(gpr)(val); \
+}
+
+static inline uint64_t load_doubleword(uint8_t* rdram, gpr reg, gpr offset) {
+    return *(recomp::rdram::BigEndian<uint64_t>*)(rdram + ((reg + offset) - 0xFFFFFFFF80000000));
+}
+#else
 #define MEM_W(offset, reg) \
     (*(int32_t*)(rdram + ((((reg) + (offset))) - 0xFFFFFFFF80000000)))
     //(*(int32_t*)(rdram + ((((reg) + (offset))) & 0x3FFFFFF)))
@@ -62,6 +90,7 @@ static inline uint64_t load_doubleword(uint8_t* rdram, gpr reg, gpr offset) {
     ret = (lo << 0) | (hi << 32);
     return ret;
 }
+#endif
 
 #define LD(offset, reg) \
     load_doubleword(rdram, offset, reg)
@@ -269,7 +298,16 @@ recomp_func_t* get_function(int32_t vram);
 #define LOOKUP_FUNC(val) \
     get_function((int32_t)(val))
 
-extern int32_t section_addresses[];
+// Thread-local storage that needs no initialization, usable from both C and C++ without going through C++'s thread_local
+// initialization wrappers.
+#if defined(_MSC_VER)
+#define RECOMP_THREAD_LOCAL __declspec(thread)
+#else
+#define RECOMP_THREAD_LOCAL __thread
+#endif
+
+// Points at the section address table of the runtime instance the calling thread belongs to.
+extern RECOMP_THREAD_LOCAL int32_t* section_addresses;
 
 #define LO16(x) \
     ((x) & 0xFFFF)
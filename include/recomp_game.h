@@ -33,6 +33,15 @@ namespace recomp {
 	void do_rom_read(uint8_t* rdram, gpr ram_address, uint32_t physical_addr, size_t num_bytes);
 	void start(ultramodern::WindowHandle window_handle, const ultramodern::audio_callbacks_t& audio_callbacks, const ultramodern::input_callbacks_t& input_callbacks, const ultramodern::gfx_callbacks_t& gfx_callbacks);
 	void start_game(Game game);
+	// A copy of the game started with start_instance.
+	struct InstanceHandle;
+	// Starts another copy of the game next to the one started by `start`, which has to have loaded the ROM already. The copy
+	// has its own RDRAM, game threads, audio and input callbacks and save file (the default save file if the path is empty),
+	// and renders to its own window. The ROM, shader cache and recompiled code are shared with the first copy. The menus
+	// aren't drawn while more than one copy is running. Runs until stop_instance is called with the returned handle or
+	// until `start` returns. Returns null if the ROM hasn't been loaded.
+	InstanceHandle* start_instance(Game game, ultramodern::WindowHandle window_handle, const ultramodern::audio_callbacks_t& audio_callbacks, const ultramodern::input_callbacks_t& input_callbacks, const std::filesystem::path& save_file_path);
+	void stop_instance(InstanceHandle* instance);
 	void message_box(const char* message);
 }
 
@@ -120,7 +120,10 @@ namespace recomp {
     void get_n64_input(uint16_t* buttons_out, float* x_out, float* y_out);
     void set_rumble(bool);
     void update_rumble();
+    // Blocks until there are events to handle and then handles all of them.
     void handle_events();
+    // Makes a blocked call to handle_events return. Safe to call from any thread.
+    void wake_event_loop();
     
     // Rumble strength ranges from 0 to 100.
     int get_rumble_strength();
@@ -0,0 +1,202 @@
+#ifndef __RECOMP_RDRAM_H__
+#define __RECOMP_RDRAM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Byte order of RDRAM on the host.
+//
+// By default RDRAM is stored as native 32-bit words, which is the layout RT64 and the RSP microcode expect. Words are accessed
+// directly, but halfwords live at address ^ 2, bytes at address ^ 3, and doublewords are split into two words.
+//
+// Builds with RECOMP_RDRAM_BIG_ENDIAN (see the CMake option of the same name) store RDRAM in the console's own big-endian order
+// instead. Bytes are accessed directly and wider values are byteswapped on access, which compiles to movbe where the target
+// has it. Stores through a byteswap can't be written as C lvalues, so in this mode the recompiled code is compiled as C++ and
+// RDRAM values are accessed through BigEndian references. This mode is experimental: RT64 is given a word-swapped mirror of RDRAM
+// that's merged with the game's RDRAM in both directions before each display list (see ultramodern/rdram_mirror.hpp).
+//
+// Host code should read and write RDRAM contents through the MEM_* macros, the structs in ultra64.h or the functions below
+// rather than indexing RDRAM itself, so that it works with either layout.
+
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+#   if !defined(__cplusplus)
+#       error "Big-endian RDRAM is accessed through C++ references, so code that uses it has to be compiled as C++"
+#   endif
+#   define RDRAM_BYTE_XOR 0
+#   define RDRAM_HALF_XOR 0
+#else
+#   define RDRAM_BYTE_XOR 3
+#   define RDRAM_HALF_XOR 2
+#endif
+
+#ifdef __cplusplus
+#include <type_traits>
+
+namespace recomp {
+    namespace rdram {
+        template <typename T>
+        inline T byteswap(T value) {
+            static_assert(std::is_integral_v<T>, "Only integers can be byteswapped");
+            if constexpr (sizeof(T) == 1) {
+                return value;
+            }
+#if defined(_MSC_VER) && !defined(__clang__)
+            else if constexpr (sizeof(T) == 2) {
+                return static_cast<T>(_byteswap_ushort(static_cast<uint16_t>(value)));
+            }
+            else if constexpr (sizeof(T) == 4) {
+                return static_cast<T>(_byteswap_ulong(static_cast<uint32_t>(value)));
+            }
+            else {
+                return static_cast<T>(_byteswap_uint64(static_cast<uint64_t>(value)));
+            }
+#else
+            else if constexpr (sizeof(T) == 2) {
+                return static_cast<T>(__builtin_bswap16(static_cast<uint16_t>(value)));
+            }
+            else if constexpr (sizeof(T) == 4) {
+                return static_cast<T>(__builtin_bswap32(static_cast<uint32_t>(value)));
+            }
+            else {
+                return static_cast<T>(__builtin_bswap64(static_cast<uint64_t>(value)));
+            }
+#endif
+        }
+
+        // An integer stored in big-endian order. Kept trivial so that it can be overlaid on RDRAM and used as a field of the
+        // structs that the game shares with the runtime.
+        template <typename T>
+        class BigEndian {
+        public:
+            operator T() const { return byteswap(raw_); }
+            BigEndian& operator=(T value) { raw_ = byteswap(value); return *this; }
+            BigEndian& operator+=(T value) { return *this = static_cast<T>(T(*this) + value); }
+            BigEndian& operator-=(T value) { return *this = static_cast<T>(T(*this) - value); }
+            BigEndian& operator++() { return *this += 1; }
+            BigEndian& operator--() { return *this -= 1; }
+            T operator++(int) { T ret = *this; *this += 1; return ret; }
+            T operator--(int) { T ret = *this; *this -= 1; return ret; }
+        private:
+            T raw_;
+        };
+
+        // How a value of type T is stored in RDRAM.
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+        template <typename T>
+        using Value = std::conditional_t<sizeof(T) == 1, T, BigEndian<T>>;
+#else
+        template <typename T>
+        using Value = T;
+#endif
+
+        // Converts an address in any of the forms the game uses (a sign-extended register value, a PTR or a plain 32-bit
+        // KSEG0 address) into an offset into RDRAM.
+        inline uint64_t host_offset(uint64_t vaddr) {
+            return static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(vaddr))) - 0xFFFFFFFF80000000ULL;
+        }
+
+        inline uint8_t read_u8(const uint8_t* rdram, uint64_t vaddr) {
+            return rdram[host_offset(vaddr ^ RDRAM_BYTE_XOR)];
+        }
+
+        inline uint16_t read_u16(const uint8_t* rdram, uint64_t vaddr) {
+            return *reinterpret_cast<const Value<uint16_t>*>(rdram + host_offset(vaddr ^ RDRAM_HALF_XOR));
+        }
+
+        inline uint32_t read_u32(const uint8_t* rdram, uint64_t vaddr) {
+            return *reinterpret_cast<const Value<uint32_t>*>(rdram + host_offset(vaddr));
+        }
+
+        inline uint64_t read_u64(const uint8_t* rdram, uint64_t vaddr) {
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+            return *reinterpret_cast<const Value<uint64_t>*>(rdram + host_offset(vaddr));
+#else
+            return (uint64_t{ read_u32(rdram, vaddr) } << 32) | read_u32(rdram, vaddr + 4);
+#endif
+        }
+
+        inline void write_u8(uint8_t* rdram, uint64_t vaddr, uint8_t value) {
+            rdram[host_offset(vaddr ^ RDRAM_BYTE_XOR)] = value;
+        }
+
+        inline void write_u16(uint8_t* rdram, uint64_t vaddr, uint16_t value) {
+            *reinterpret_cast<Value<uint16_t>*>(rdram + host_offset(vaddr ^ RDRAM_HALF_XOR)) = value;
+        }
+
+        inline void write_u32(uint8_t* rdram, uint64_t vaddr, uint32_t value) {
+            *reinterpret_cast<Value<uint32_t>*>(rdram + host_offset(vaddr)) = value;
+        }
+
+        inline void write_u64(uint8_t* rdram, uint64_t vaddr, uint64_t value) {
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+            *reinterpret_cast<Value<uint64_t>*>(rdram + host_offset(vaddr)) = value;
+#else
+            write_u32(rdram, vaddr, static_cast<uint32_t>(value >> 32));
+            write_u32(rdram, vaddr + 4, static_cast<uint32_t>(value));
+#endif
+        }
+
+        // Reads element `index` of an array of halfwords in RDRAM, given a host pointer to the array's word-aligned start
+        // (e.g. from TO_PTR).
+        inline uint16_t read_halfword_array(const void* array, size_t index) {
+            return *reinterpret_cast<const Value<uint16_t>*>(static_cast<const uint8_t*>(array) + 2 * (index ^ (RDRAM_HALF_XOR >> 1)));
+        }
+
+        // Copies big-endian data (e.g. ROM or save data) into RDRAM. The word-swapped layout is filled a word at a time where
+        // the data allows it.
+        inline void copy_in(uint8_t* rdram, uint64_t vaddr, const void* src, size_t size) {
+            const uint8_t* src_bytes = static_cast<const uint8_t*>(src);
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+            memcpy(rdram + host_offset(vaddr), src_bytes, size);
+#else
+            size_t i = 0;
+            for (; i < size && ((vaddr + i) & 3) != 0; i++) {
+                write_u8(rdram, vaddr + i, src_bytes[i]);
+            }
+            for (; i + 4 <= size; i += 4) {
+                uint32_t word;
+                memcpy(&word, src_bytes + i, sizeof(word));
+                *reinterpret_cast<uint32_t*>(rdram + host_offset(vaddr + i)) = byteswap(word);
+            }
+            for (; i < size; i++) {
+                write_u8(rdram, vaddr + i, src_bytes[i]);
+            }
+#endif
+        }
+
+        // Copies data out of RDRAM in big-endian order.
+        inline void copy_out(const uint8_t* rdram, uint64_t vaddr, void* dst, size_t size) {
+            uint8_t* dst_bytes = static_cast<uint8_t*>(dst);
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+            memcpy(dst_bytes, rdram + host_offset(vaddr), size);
+#else
+            size_t i = 0;
+            for (; i < size && ((vaddr + i) & 3) != 0; i++) {
+                dst_bytes[i] = read_u8(rdram, vaddr + i);
+            }
+            for (; i + 4 <= size; i += 4) {
+                uint32_t word = byteswap(*reinterpret_cast<const uint32_t*>(rdram + host_offset(vaddr + i)));
+                memcpy(dst_bytes + i, &word, sizeof(word));
+            }
+            for (; i < size; i++) {
+                dst_bytes[i] = read_u8(rdram, vaddr + i);
+            }
+#endif
+        }
+
+        // Byteswaps every 32-bit word, which converts between the two layouts in either direction. size must be a multiple
+        // of 4.
+        inline void swap_words(uint8_t* dst, const uint8_t* src, size_t size) {
+            for (size_t i = 0; i < size; i += 4) {
+                uint32_t word;
+                memcpy(&word, src + i, sizeof(word));
+                word = byteswap(word);
+                memcpy(dst + i, &word, sizeof(word));
+            }
+        }
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef __RECOMP_TRAINING_H__
+#define __RECOMP_TRAINING_H__
+
+#include <cstdint>
+#include <cstdio>
+
+#include "../ultramodern/ultramodern.hpp"
+
+// Training mode runs a fixed workload without a visible window and then exits, so that profile-guided builds (see the
+// RECOMP_PGO CMake option) can collect a profile that's reproducible from one build to the next. It's started with
+// `--training [script]`, which boots the game straight away instead of showing the launcher.
+//
+// The workload is driven by the game's controller reads, so it runs the same regardless of the framerate. Scripts have one
+// command per line, with # starting a comment:
+//   wait <polls>                       neutral input for a number of controller reads
+//   hold <polls> [button...] [stick <x> <y>]
+//                                      holds buttons (A, B, Z, START, L, R, C_UP, DPAD_LEFT, ...) and the stick
+//   warp <area> <scene> [entrance]     debug warp using the indices in scene_table.cpp, which applies during gameplay
+//   replay <path>                      replays input recorded with RECOMP_INPUT_RECORD
+//   quit                               ends the run, which also happens at the end of the script
+// Without a script, the built-in workload boots into the title sequence and then warps through a spread of scenes from every
+// area in scene_table.cpp, walking around in each.
+//
+// Once the game has quit, the run's CPU time, frame times and (on Linux) TLB and instruction cache misses are reported, which
+// is how builds with and without profile-guided optimization, function ordering or huge pages are compared. The misses are
+// also reported every RECOMP_TRAINING_REPORT_INTERVAL controller reads (1200 by default, 0 to turn it off) while the workload
+// runs, so that they can be lined up with the scenes being visited.
+//
+// Independently of training mode, setting RECOMP_INPUT_RECORD to a path records every controller read to it for replaying.
+// Setting RECOMP_RDRAM_HASH to a path writes a hash of RDRAM's contents at every controller read to it. Replaying the same
+// recording in builds with and without RECOMP_RDRAM_BIG_ENDIAN and comparing the two files, which the compare_rdram_layouts
+// tool does, finds the first controller read where the layouts diverged. Thread timing isn't replayed, so hashes from long runs can drift apart even when both are correct.
+namespace recomp {
+    namespace training {
+        // Parses the command line. Returns false if the arguments were invalid, in which case the error has been printed.
+        bool parse_args(int argc, char** argv);
+        bool active();
+        // Prints the measurements for a training run. Does nothing outside of training mode.
+        void report(FILE* out);
+        // Returns the input callback to give to ultramodern, which is recomp::get_n64_input unless input is being scripted or
+        // recorded.
+        ultramodern::input_callbacks_t::get_input_t* get_input_callback();
+    }
+}
+
+#endif
@@ -73,6 +73,8 @@ namespace recomp {
 	void update_supported_options();
 	void toggle_fullscreen();
 	void update_rml_display_refresh_rate();
+	// Makes the UI update and render on the next frame instead of reusing the previously rendered one.
+	void invalidate_ui();
 
 	extern const std::unordered_map<ButtonVariant, std::string> button_variants;
 
@@ -13,7 +13,8 @@ enum class RspExitReason {
     Unsupported
 };
 
-extern uint8_t dmem[];
+// Each runtime instance has its own RSP task thread, so DMEM is per thread.
+extern RECOMP_THREAD_LOCAL uint8_t dmem[];
 extern uint16_t rspReciprocals[512];
 extern uint16_t rspInverseSquareRoots[512];
 
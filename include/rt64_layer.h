@@ -1,8 +1,13 @@
 #ifndef __RT64_LAYER_H__
 #define __RT64_LAYER_H__
 
+#include <filesystem>
+#include <fstream>
+
 #include "../ultramodern/ultramodern.hpp"
 #include "../ultramodern/config.hpp"
+#include "../ultramodern/dl_capture.hpp"
+#include "../ultramodern/rdram_mirror.hpp"
 
 namespace RT64 {
     struct Application;
@@ -10,6 +15,43 @@ namespace RT64 {
 
 namespace ultramodern {
     struct WindowHandle;
+
+    // The RSP memory and RDP/VI registers that RT64 reads. RT64 keeps pointers to these, and the VI registers are written by
+    // the game's threads through the osVi functions, so each instance has its own set.
+    struct HardwareRegisters {
+        uint8_t DMEM[0x1000];
+        uint8_t IMEM[0x1000];
+
+        unsigned int MI_INTR_REG = 0;
+
+        unsigned int DPC_START_REG = 0;
+        unsigned int DPC_END_REG = 0;
+        unsigned int DPC_CURRENT_REG = 0;
+        unsigned int DPC_STATUS_REG = 0;
+        unsigned int DPC_CLOCK_REG = 0;
+        unsigned int DPC_BUFBUSY_REG = 0;
+        unsigned int DPC_PIPEBUSY_REG = 0;
+        unsigned int DPC_TMEM_REG = 0;
+
+        unsigned int VI_STATUS_REG = 0;
+        unsigned int VI_ORIGIN_REG = 0;
+        unsigned int VI_WIDTH_REG = 0;
+        unsigned int VI_INTR_REG = 0;
+        unsigned int VI_V_CURRENT_LINE_REG = 0;
+        unsigned int VI_TIMING_REG = 0;
+        unsigned int VI_V_SYNC_REG = 0;
+        unsigned int VI_H_SYNC_REG = 0;
+        unsigned int VI_LEAP_REG = 0;
+        unsigned int VI_H_START_REG = 0;
+        unsigned int VI_V_START_REG = 0;
+        unsigned int VI_V_BURST_REG = 0;
+        unsigned int VI_X_SCALE_REG = 0;
+        unsigned int VI_Y_SCALE_REG = 0;
+    };
+
+    // Returns the calling thread's instance's registers.
+    HardwareRegisters& hardware_registers();
+
     struct RT64Context {
         public:
             ~RT64Context();
@@ -23,9 +65,28 @@ namespace ultramodern {
             void shutdown();
             void set_dummy_vi();
             uint32_t get_display_framerate();
-            void load_shader_cache(std::span<const char> cache_binary);
+            void load_shader_cache(std::span<const char> cache_binary, const std::filesystem::path& user_cache_path);
+            // Sets every VI register at once, used when replaying a display list capture.
+            void set_vi_registers(const dl_capture::ViRegisters& vi_regs);
+            // RDRAM as RT64 sees it, which is the game's RDRAM unless it's stored big-endian.
+            uint8_t* rdram();
+            // Brings RT64's mirror of RDRAM and the game's RDRAM back in line in big-endian RDRAM builds, which has to happen
+            // before each display list. Does nothing otherwise.
+            void sync_rdram();
         private:
+            void finish_dl_capture();
+
+            HardwareRegisters* registers = nullptr;
+            // Word-swapped copy of RDRAM that RT64 uses in big-endian RDRAM builds.
+            std::unique_ptr<RdramMirror> rdram_mirror;
+
             std::unique_ptr<RT64::Application> app;
+            // Stream that shaders compiled at runtime are recorded to, so they can be loaded up front next time.
+            std::unique_ptr<std::ofstream> user_shader_cache_stream;
+            // Display list capture enabled with RECOMP_DL_CAPTURE, see dl_capture.hpp.
+            std::unique_ptr<dl_capture::Writer> dl_capture_writer;
+            std::filesystem::path dl_capture_path;
+            uint32_t dl_capture_frame_limit = 0;
     };
     
     RT64::UserConfiguration::Antialiasing RT64MaxMSAA();
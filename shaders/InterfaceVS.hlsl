@@ -1,6 +1,8 @@
 struct Input {
     float4x4 transform;
     float2 translation;
+    float2 uvOffset;
+    float2 uvScale;
 };
 
 [[vk::push_constant]]
@@ -19,5 +21,5 @@ void VSMain(
 	oPosition = mul(gInput.transform, float4(translatedPos, 0, 1));
 
 	oColor = iColor;
-	oUV = iUV;
+	oUV = iUV * gInput.uvScale + gInput.uvOffset;
 }
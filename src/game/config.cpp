@@ -27,6 +27,8 @@ constexpr auto rr_default             = RT64::UserConfiguration::RefreshRate::Di
 constexpr int ds_default              = 1;
 constexpr int rr_manual_default       = 60;
 constexpr bool developer_mode_default = false;
+constexpr int max_frames_in_flight_default = 2;
+constexpr auto frame_queue_mode_default = ultramodern::FrameQueueMode::Block;
 
 static bool is_steam_deck = false;
 
@@ -95,6 +97,8 @@ namespace ultramodern {
             {"rr_option",       config.rr_option},
             {"rr_manual_value", config.rr_manual_value},
             {"developer_mode",  config.developer_mode},
+            {"max_frames_in_flight", config.max_frames_in_flight},
+            {"frame_queue_mode", config.frame_queue_mode},
         };
     }
 
@@ -109,6 +113,8 @@ namespace ultramodern {
         config.rr_option        = from_or_default(j, "rr_option",       rr_default);
         config.rr_manual_value  = from_or_default(j, "rr_manual_value", rr_manual_default);
         config.developer_mode   = from_or_default(j, "developer_mode",  developer_mode_default);
+        config.max_frames_in_flight = from_or_default(j, "max_frames_in_flight", max_frames_in_flight_default);
+        config.frame_queue_mode = from_or_default(j, "frame_queue_mode", frame_queue_mode_default);
     }
 }
 
@@ -247,6 +253,8 @@ void reset_graphics_options() {
     new_config.rr_option = rr_default;
     new_config.rr_manual_value = rr_manual_default;
     new_config.developer_mode = developer_mode_default;
+    new_config.max_frames_in_flight = max_frames_in_flight_default;
+    new_config.frame_queue_mode = frame_queue_mode_default;
     ultramodern::set_graphics_config(new_config);
 }
 
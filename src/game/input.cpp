@@ -2,6 +2,7 @@
 #include <mutex>
 
 #include "../ultramodern/ultramodern.hpp"
+#include "../ultramodern/sync_stats.hpp"
 #include "recomp.h"
 #include "recomp_input.h"
 #include "recomp_ui.h"
@@ -28,13 +29,13 @@ static struct {
     SDL_Keymod keymod = SDL_Keymod::KMOD_NONE;
     int numkeys = 0;
     std::atomic_int32_t mouse_wheel_pos = 0;
-    std::mutex cur_controllers_mutex;
+    ultramodern::InstrumentedMutex cur_controllers_mutex{ "cur_controllers_mutex" };
     std::vector<SDL_GameController*> cur_controllers{};
     std::unordered_map<SDL_JoystickID, ControllerState> controller_states;
     
     std::array<float, 2> rotation_delta{};
     std::array<float, 2> mouse_delta{};
-    std::mutex pending_input_mutex;
+    ultramodern::InstrumentedMutex pending_input_mutex{ "pending_input_mutex" };
     std::array<float, 2> pending_rotation_delta{};
     std::array<float, 2> pending_mouse_delta{};
 
@@ -82,7 +83,10 @@ void queue_if_enabled(SDL_Event* event) {
 static std::atomic_bool cursor_enabled = true;
 
 void recomp::set_cursor_visible(bool visible) {
-    cursor_enabled.store(visible);
+    // The cursor state is only applied when the event loop runs, so wake it up if the state changed.
+    if (cursor_enabled.exchange(visible) != visible) {
+        recomp::wake_event_loop();
+    }
 }
 
 bool should_override_keystate(SDL_Scancode key, SDL_Keymod mod) {
@@ -245,11 +249,29 @@ bool sdl_event_filter(void* userdata, SDL_Event* event) {
     return false;
 }
 
+// Event type pushed by wake_event_loop. It carries no data and only serves to return from the wait in handle_events.
+constexpr Uint32 wake_event_type = SDL_USEREVENT;
+
+void recomp::wake_event_loop() {
+    SDL_Event wake_event{};
+    wake_event.type = wake_event_type;
+    SDL_PushEvent(&wake_event);
+}
+
 void recomp::handle_events() {
     SDL_Event cur_event;
     static bool exited = false;
+
+    // Sleep until SDL has an event for this thread instead of polling on a fixed interval. Anything that needs the loop to run
+    // without an SDL event of its own (a quit request or a change to the cursor state) wakes it up with wake_event_loop.
+    if (!exited && !SDL_WaitEvent(nullptr)) {
+        return;
+    }
+
     while (SDL_PollEvent(&cur_event) && !exited) {
-        exited = sdl_event_filter(nullptr, &cur_event);
+        if (cur_event.type != wake_event_type) {
+            exited = sdl_event_filter(nullptr, &cur_event);
+        }
 
         // Lock the cursor if all three conditions are true: mouse aiming is enabled, game input is not disabled, and the game has been started. 
         bool cursor_locked = (recomp::get_mouse_sensitivity() != 0) && !recomp::game_input_disabled() && ultramodern::is_game_started();
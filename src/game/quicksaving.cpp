@@ -51,7 +51,7 @@ extern "C" void recomp_handle_quicksave_actions(uint8_t* rdram, recomp_context*
         PTR(OSMesgQueue) quicksave_enter_mq = _arg<0, PTR(OSMesgQueue)>(rdram, ctx);
         PTR(OSMesgQueue) quicksave_exit_mq = _arg<1, PTR(OSMesgQueue)>(rdram, ctx);
 
-        printf("saving context for thread %d\n", TO_PTR(OSThread, ultramodern::this_thread())->id);
+        printf("saving context for thread %d\n", int32_t{ TO_PTR(OSThread, ultramodern::this_thread())->id });
 
         // Save or load the thread's context as needed based on the action.
         if (action == QuicksaveAction::Save) {
@@ -1,3 +1,4 @@
+#include <bit>
 #include <cmath>
 
 #include "recomp.h"
@@ -30,17 +31,23 @@ extern "C" void recomp_exit(uint8_t* rdram, recomp_context* ctx) {
 }
 
 extern "C" void recomp_get_gyro_deltas(uint8_t* rdram, recomp_context* ctx) {
-    float* x_out = _arg<0, float*>(rdram, ctx);
-    float* y_out = _arg<1, float*>(rdram, ctx);
+    PTR(float) x_out = _arg<0, PTR(float)>(rdram, ctx);
+    PTR(float) y_out = _arg<1, PTR(float)>(rdram, ctx);
 
-    recomp::get_gyro_deltas(x_out, y_out);
+    float x, y;
+    recomp::get_gyro_deltas(&x, &y);
+    recomp::rdram::write_u32(rdram, x_out, std::bit_cast<uint32_t>(x));
+    recomp::rdram::write_u32(rdram, y_out, std::bit_cast<uint32_t>(y));
 }
 
 extern "C" void recomp_get_mouse_deltas(uint8_t* rdram, recomp_context* ctx) {
-    float* x_out = _arg<0, float*>(rdram, ctx);
-    float* y_out = _arg<1, float*>(rdram, ctx);
+    PTR(float) x_out = _arg<0, PTR(float)>(rdram, ctx);
+    PTR(float) y_out = _arg<1, PTR(float)>(rdram, ctx);
 
-    recomp::get_mouse_deltas(x_out, y_out);
+    float x, y;
+    recomp::get_mouse_deltas(&x, &y);
+    recomp::rdram::write_u32(rdram, x_out, std::bit_cast<uint32_t>(x));
+    recomp::rdram::write_u32(rdram, y_out, std::bit_cast<uint32_t>(y));
 }
 
 extern "C" void recomp_powf(uint8_t* rdram, recomp_context* ctx) {
@@ -0,0 +1,465 @@
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "recomp_debug.h"
+#include "recomp_input.h"
+#include "recomp_rdram.h"
+#include "recomp_training.h"
+#include "../ultramodern/instance.hpp"
+#include "../ultramodern/perf_metrics.hpp"
+#include "xxHash/xxh3.h"
+
+#if defined(__linux__)
+#   include <linux/perf_event.h>
+#   include <sys/resource.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+namespace {
+    // Recorded input files start with this header and then hold one InputRecord per controller read.
+    constexpr char input_record_magic[4] = { 'R', 'I', 'N', 'P' };
+    constexpr uint32_t input_record_version = 1;
+
+    struct InputRecord {
+        uint16_t buttons;
+        uint16_t padding;
+        float x;
+        float y;
+    };
+    static_assert(sizeof(InputRecord) == 12);
+
+    enum class CommandType {
+        Wait,
+        Hold,
+        Warp,
+        Replay,
+        Quit,
+    };
+
+    struct Command {
+        CommandType type;
+        uint32_t polls = 0;
+        uint16_t buttons = 0;
+        float x = 0.0f;
+        float y = 0.0f;
+        int area = 0;
+        int scene = 0;
+        int entrance = 0;
+        std::vector<InputRecord> inputs{};
+    };
+
+    #define DEFINE_INPUT(name, value, readable) std::pair<const char*, uint16_t>{ #name, uint16_t(value##u) },
+    const std::array button_values = {
+        DEFINE_N64_BUTTON_INPUTS()
+    };
+    #undef DEFINE_INPUT
+
+    struct TrainingState {
+        bool active = false;
+        std::vector<Command> commands{};
+        size_t cur_command = 0;
+        // Controller reads into the current command.
+        size_t progress = 0;
+        uint64_t total_polls = 0;
+        bool finished = false;
+        std::chrono::steady_clock::time_point start_time{};
+        double workload_seconds = 0.0;
+        std::ofstream record_stream{};
+        // RDRAM hashes, one per controller read, and the big-endian copy of RDRAM that they're computed from.
+        FILE* hash_file = nullptr;
+        std::unique_ptr<uint8_t[]> hash_buffer{};
+        uint64_t hashed_polls = 0;
+        // Controller reads between progress reports, or 0 to only report at the end.
+        uint64_t report_interval = 1200;
+        uint64_t last_report_polls = 0;
+        std::chrono::steady_clock::time_point last_report_time{};
+#if defined(__linux__)
+        // Counters for the whole process, opened before any other thread exists so that they're inherited by all of them.
+        int itlb_miss_counter = -1;
+        int dtlb_miss_counter = -1;
+        int icache_miss_counter = -1;
+        // The counters' values at the last progress report.
+        std::array<uint64_t, 3> last_misses{};
+#endif
+    };
+
+    // Only used by the thread that reads the controller, aside from being set up before the game starts.
+    TrainingState training_state{};
+
+    bool read_input_record(const std::string& path, std::vector<InputRecord>& inputs) {
+        std::ifstream input_file{ path, std::ios::binary };
+        char magic[sizeof(input_record_magic)];
+        uint32_t version = 0;
+        if (!input_file.read(magic, sizeof(magic)) || !input_file.read(reinterpret_cast<char*>(&version), sizeof(version)) ||
+            memcmp(magic, input_record_magic, sizeof(magic)) != 0 || version != input_record_version)
+        {
+            return false;
+        }
+
+        InputRecord record;
+        while (input_file.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+            inputs.push_back(record);
+        }
+        return true;
+    }
+
+    bool parse_button(const std::string& name, uint16_t& buttons) {
+        for (const auto& [button_name, value] : button_values) {
+            if (name == button_name) {
+                buttons |= value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parse_script(std::istream& script, std::vector<Command>& commands) {
+        std::string line;
+        size_t line_number = 0;
+        while (std::getline(script, line)) {
+            line_number++;
+            line = line.substr(0, line.find('#'));
+            std::istringstream words{ line };
+            std::string type;
+            if (!(words >> type)) {
+                continue;
+            }
+
+            Command command{};
+            bool valid = true;
+            if (type == "wait") {
+                command.type = CommandType::Wait;
+                valid = static_cast<bool>(words >> command.polls);
+            }
+            else if (type == "hold") {
+                command.type = CommandType::Hold;
+                valid = static_cast<bool>(words >> command.polls);
+                std::string word;
+                while (valid && words >> word) {
+                    if (word == "stick") {
+                        valid = static_cast<bool>(words >> command.x >> command.y);
+                    }
+                    else {
+                        valid = parse_button(word, command.buttons);
+                    }
+                }
+            }
+            else if (type == "warp") {
+                command.type = CommandType::Warp;
+                valid = static_cast<bool>(words >> command.area >> command.scene);
+                if (valid && !(words >> command.entrance)) {
+                    command.entrance = 0;
+                }
+                valid = valid && command.area >= 0 && command.area < static_cast<int>(recomp::game_warps.size()) &&
+                    command.scene >= 0 && command.scene < static_cast<int>(recomp::game_warps[command.area].scenes.size()) &&
+                    command.entrance >= 0 && command.entrance < static_cast<int>(recomp::game_warps[command.area].scenes[command.scene].entrances.size());
+            }
+            else if (type == "replay") {
+                command.type = CommandType::Replay;
+                std::string path;
+                valid = static_cast<bool>(words >> path);
+                if (valid && !read_input_record(path, command.inputs)) {
+                    fprintf(stderr, "[Training] Failed to read input recording %s\n", path.c_str());
+                    return false;
+                }
+            }
+            else if (type == "quit") {
+                command.type = CommandType::Quit;
+            }
+            else {
+                valid = false;
+            }
+
+            if (!valid) {
+                fprintf(stderr, "[Training] Invalid command on line %zu: %s\n", line_number, line.c_str());
+                return false;
+            }
+            commands.emplace_back(std::move(command));
+        }
+        return true;
+    }
+
+    // Boots into the title sequence and then visits the first, middle and last scene of every area, moving and attacking in
+    // each so that the player, collision and effect code runs as well as scene loading and rendering.
+    std::vector<Command> default_workload() {
+        std::vector<Command> commands{};
+        auto add_hold = [&commands](uint32_t polls, uint16_t buttons, float x, float y) {
+            commands.emplace_back(Command{ .type = CommandType::Hold, .polls = polls, .buttons = buttons, .x = x, .y = y });
+        };
+
+        commands.emplace_back(Command{ .type = CommandType::Wait, .polls = 400 });
+        for (size_t area = 0; area < recomp::game_warps.size(); area++) {
+            size_t scene_count = recomp::game_warps[area].scenes.size();
+            size_t last_scene = SIZE_MAX;
+            for (size_t scene : { size_t{ 0 }, scene_count / 2, scene_count - 1 }) {
+                if (scene == last_scene || scene >= scene_count) {
+                    continue;
+                }
+                last_scene = scene;
+                commands.emplace_back(Command{ .type = CommandType::Warp, .area = static_cast<int>(area), .scene = static_cast<int>(scene) });
+                commands.emplace_back(Command{ .type = CommandType::Wait, .polls = 60 });
+                add_hold(80, 0, 0.0f, 1.0f);
+                add_hold(20, 0x4000, 0.0f, 0.0f); // B
+                add_hold(60, 0, 1.0f, 0.3f);
+                add_hold(40, 0x2000, -1.0f, 0.0f); // Z
+            }
+        }
+        return commands;
+    }
+
+#if defined(__linux__)
+    int open_cache_miss_counter(uint64_t cache) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    // Reading an inherited counter sums it over every thread that inherited it, including the ones that are still running.
+    bool read_counter(int counter, uint64_t& value) {
+        return counter >= 0 && read(counter, &value, sizeof(value)) == sizeof(value);
+    }
+#endif
+
+    // Prints the misses per controller read since the last progress report, so that a part of the workload that behaves
+    // differently from the rest (e.g. one heavy scene) shows up while the run is going rather than being averaged into the
+    // totals at the end.
+    void report_progress(FILE* out) {
+        TrainingState& state = training_state;
+        auto now = std::chrono::steady_clock::now();
+        uint64_t polls = state.total_polls - state.last_report_polls;
+        fprintf(out, "[Training] Reads %" PRIu64 "-%" PRIu64 " in %.1f s:", state.last_report_polls, state.total_polls,
+            std::chrono::duration<double>(now - state.last_report_time).count());
+#if defined(__linux__)
+        const std::array<std::pair<const char*, int>, 3> counters = {{
+            { "iTLB", state.itlb_miss_counter },
+            { "dTLB", state.dtlb_miss_counter },
+            { "L1i", state.icache_miss_counter },
+        }};
+        for (size_t i = 0; i < counters.size(); i++) {
+            uint64_t misses = 0;
+            if (read_counter(counters[i].second, misses)) {
+                fprintf(out, " %s %.1f", counters[i].first, double(misses - state.last_misses[i]) / polls);
+                state.last_misses[i] = misses;
+            }
+            else {
+                fprintf(out, " %s n/a", counters[i].first);
+            }
+        }
+        fprintf(out, " misses per read");
+#endif
+        fprintf(out, "\n");
+        fflush(out);
+        state.last_report_polls = state.total_polls;
+        state.last_report_time = now;
+    }
+
+    void finish_training() {
+        TrainingState& state = training_state;
+        state.finished = true;
+        state.workload_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - state.start_time).count();
+        if (state.hash_file != nullptr) {
+            fflush(state.hash_file);
+        }
+        ultramodern::quit();
+    }
+
+    void scripted_input(uint16_t* buttons_out, float* x_out, float* y_out) {
+        TrainingState& state = training_state;
+        *buttons_out = 0;
+        *x_out = 0.0f;
+        *y_out = 0.0f;
+        if (state.finished) {
+            return;
+        }
+        if (state.total_polls == 0) {
+            state.start_time = std::chrono::steady_clock::now();
+            state.last_report_time = state.start_time;
+#if defined(__linux__)
+            // Leave the misses from booting out of the first progress report.
+            read_counter(state.itlb_miss_counter, state.last_misses[0]);
+            read_counter(state.dtlb_miss_counter, state.last_misses[1]);
+            read_counter(state.icache_miss_counter, state.last_misses[2]);
+#endif
+        }
+        state.total_polls++;
+        if (state.report_interval != 0 && state.total_polls % state.report_interval == 0) {
+            report_progress(stdout);
+        }
+
+        while (state.cur_command < state.commands.size()) {
+            const Command& command = state.commands[state.cur_command];
+            switch (command.type) {
+                case CommandType::Wait:
+                case CommandType::Hold:
+                    if (state.progress < command.polls) {
+                        state.progress++;
+                        *buttons_out = command.buttons;
+                        *x_out = command.x;
+                        *y_out = command.y;
+                        return;
+                    }
+                    break;
+                case CommandType::Replay:
+                    if (state.progress < command.inputs.size()) {
+                        const InputRecord& record = command.inputs[state.progress++];
+                        *buttons_out = record.buttons;
+                        *x_out = record.x;
+                        *y_out = record.y;
+                        return;
+                    }
+                    break;
+                case CommandType::Warp:
+                    recomp::do_warp(command.area, command.scene, command.entrance);
+                    break;
+                case CommandType::Quit:
+                    state.cur_command = state.commands.size();
+                    continue;
+            }
+            state.cur_command++;
+            state.progress = 0;
+        }
+
+        finish_training();
+    }
+
+    void get_input(uint16_t* buttons_out, float* x_out, float* y_out) {
+        TrainingState& state = training_state;
+        if (state.active) {
+            scripted_input(buttons_out, x_out, y_out);
+        }
+        else {
+            recomp::get_n64_input(buttons_out, x_out, y_out);
+        }
+
+        if (state.record_stream.is_open()) {
+            InputRecord record{ *buttons_out, 0, *x_out, *y_out };
+            state.record_stream.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+
+        if (state.hash_file != nullptr) {
+            // Hashed in the console's byte order so that builds with either RDRAM layout produce the same hashes.
+            recomp::rdram::copy_out(ultramodern::current_instance().rdram(), 0x80000000, state.hash_buffer.get(), ultramodern::rdram_size);
+            uint64_t hash = XXH3_64bits(state.hash_buffer.get(), ultramodern::rdram_size);
+            fprintf(state.hash_file, "%" PRIu64 " %016" PRIX64 "\n", state.hashed_polls++, hash);
+        }
+    }
+}
+
+bool recomp::training::parse_args(int argc, char** argv) {
+    TrainingState& state = training_state;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--training") != 0) {
+            continue;
+        }
+        state.active = true;
+        if (i + 1 < argc && argv[i + 1][0] != '-') {
+            const char* script_path = argv[++i];
+            std::ifstream script{ script_path };
+            if (!script.good()) {
+                fprintf(stderr, "[Training] Failed to open script %s\n", script_path);
+                return false;
+            }
+            if (!parse_script(script, state.commands)) {
+                return false;
+            }
+        }
+        else {
+            state.commands = default_workload();
+        }
+    }
+
+    if (const char* interval = getenv("RECOMP_TRAINING_REPORT_INTERVAL"); interval != nullptr && interval[0] != '\0') {
+        state.report_interval = strtoull(interval, nullptr, 10);
+    }
+
+#if defined(__linux__)
+    if (state.active) {
+        state.itlb_miss_counter = open_cache_miss_counter(PERF_COUNT_HW_CACHE_ITLB);
+        state.dtlb_miss_counter = open_cache_miss_counter(PERF_COUNT_HW_CACHE_DTLB);
+        state.icache_miss_counter = open_cache_miss_counter(PERF_COUNT_HW_CACHE_L1I);
+    }
+#endif
+
+    if (const char* record_path = getenv("RECOMP_INPUT_RECORD"); record_path != nullptr && record_path[0] != '\0') {
+        state.record_stream.open(record_path, std::ios::binary);
+        if (!state.record_stream.good()) {
+            fprintf(stderr, "[Training] Failed to open %s for recording input\n", record_path);
+            return false;
+        }
+        state.record_stream.write(input_record_magic, sizeof(input_record_magic));
+        state.record_stream.write(reinterpret_cast<const char*>(&input_record_version), sizeof(input_record_version));
+    }
+
+    if (const char* hash_path = getenv("RECOMP_RDRAM_HASH"); hash_path != nullptr && hash_path[0] != '\0') {
+        state.hash_file = fopen(hash_path, "w");
+        if (state.hash_file == nullptr) {
+            fprintf(stderr, "[Training] Failed to open %s for RDRAM hashes\n", hash_path);
+            return false;
+        }
+        state.hash_buffer = std::make_unique<uint8_t[]>(ultramodern::rdram_size);
+    }
+    return true;
+}
+
+void recomp::training::report(FILE* out) {
+    TrainingState& state = training_state;
+    if (!state.active) {
+        return;
+    }
+
+    fprintf(out, "[Training] %" PRIu64 " controller reads in %.1f s%s\n", state.total_polls, state.workload_seconds,
+        state.finished ? "" : " (quit before the workload finished)");
+
+    ultramodern::perf::TimingSummary frame_time = ultramodern::perf::snapshot().timings[static_cast<size_t>(ultramodern::perf::Timing::FrameTime)];
+    fprintf(out, "[Training] Frame time over the last %zu frames: avg %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+        ultramodern::perf::history_size, frame_time.average_ms, frame_time.p50_ms, frame_time.p99_ms, frame_time.max_ms);
+
+#if defined(__linux__)
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    fprintf(out, "[Training] CPU time: %.2f s\n", cpu_seconds);
+
+    auto report_counter = [out, &state](const char* name, int counter) {
+        uint64_t misses = 0;
+        if (read_counter(counter, misses)) {
+            fprintf(out, "[Training] %s misses: %" PRIu64 " (%.1f per controller read)\n", name, misses,
+                state.total_polls != 0 ? double(misses) / state.total_polls : 0.0);
+        }
+        else {
+            fprintf(out, "[Training] %s misses: unavailable (check perf_event_paranoid)\n", name);
+        }
+    };
+    report_counter("iTLB", state.itlb_miss_counter);
+    report_counter("dTLB", state.dtlb_miss_counter);
+    report_counter("L1i", state.icache_miss_counter);
+#endif
+    fflush(out);
+}
+
+bool recomp::training::active() {
+    return training_state.active;
+}
+
+ultramodern::input_callbacks_t::get_input_t* recomp::training::get_input_callback() {
+    if (training_state.active || training_state.record_stream.is_open() || training_state.hash_file != nullptr) {
+        return get_input;
+    }
+    return recomp::get_n64_input;
+}
@@ -11,6 +11,7 @@
 
 #include "../../ultramodern/ultra64.h"
 #include "../../ultramodern/ultramodern.hpp"
+#include "../../ultramodern/alloc_audit.hpp"
 #define SDL_MAIN_HANDLED
 #ifdef _WIN32
 #include "SDL.h"
@@ -23,6 +24,8 @@
 #include "recomp_input.h"
 #include "recomp_config.h"
 #include "recomp_game.h"
+#include "recomp_training.h"
+#include "recomp_rdram.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -110,7 +113,9 @@ bool SetImageAsIcon(const char* filename, SDL_Window* window)
 SDL_Window* window;
 
 ultramodern::WindowHandle create_window(ultramodern::gfx_callbacks_t::gfx_data_t) {
-    window = SDL_CreateWindow("Zelda 64: Recompiled", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1600, 960, SDL_WINDOW_RESIZABLE );
+    // Training runs still render, but there's nothing to look at so the window is kept hidden.
+    uint32_t window_flags = SDL_WINDOW_RESIZABLE | (recomp::training::active() ? SDL_WINDOW_HIDDEN : 0);
+    window = SDL_CreateWindow("Zelda 64: Recompiled", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1600, 960, window_flags);
 #if defined(__linux__)
     SetImageAsIcon("icons/512.png",window);
     if (ultramodern::get_graphics_config().wm_option == ultramodern::WindowMode::Fullscreen) { // TODO: Remove once RT64 gets native fullscreen support on Linux
@@ -143,6 +148,10 @@ void update_gfx(void*) {
     recomp::handle_events();
 }
 
+void wake_gfx(void*) {
+    recomp::wake_event_loop();
+}
+
 static SDL_AudioCVT audio_convert;
 static SDL_AudioDeviceID audio_device = 0;
 
@@ -180,11 +189,10 @@ void queue_samples(int16_t* audio_data, size_t sample_count) {
         swap_buffer[i] = duplicated_sample_buffer[i];
     }
 
-    // Convert the audio from 16-bit values to floats and swap the audio channels into the
-    // swap buffer to correct for the address xor caused by endianness handling.
+    // Convert the audio from 16-bit values in RDRAM's byte order to floats in the swap buffer.
     for (size_t i = 0; i < sample_count; i += input_channels) {
-        swap_buffer[i + 0 + duplicated_input_frames * input_channels] = audio_data[i + 1] * (0.5f / 32768.0f);
-        swap_buffer[i + 1 + duplicated_input_frames * input_channels] = audio_data[i + 0] * (0.5f / 32768.0f);
+        swap_buffer[i + 0 + duplicated_input_frames * input_channels] = int16_t(recomp::rdram::read_halfword_array(audio_data, i + 0)) * (0.5f / 32768.0f);
+        swap_buffer[i + 1 + duplicated_input_frames * input_channels] = int16_t(recomp::rdram::read_halfword_array(audio_data, i + 1)) * (0.5f / 32768.0f);
     }
     
     // TODO handle cases where a chunk is smaller than the duplicated frame count.
@@ -292,6 +300,9 @@ void reset_audio(uint32_t output_freq) {
 }
 
 int main(int argc, char** argv) {
+    if (!recomp::training::parse_args(argc, argv)) {
+        return EXIT_FAILURE;
+    }
 
 #ifdef _WIN32
     // Set up console output to accept UTF-8 on windows
@@ -324,6 +335,7 @@ int main(int argc, char** argv) {
         .create_gfx = create_gfx,
         .create_window = create_window,
         .update_gfx = update_gfx,
+        .wake_gfx = wake_gfx,
     };
 
     ultramodern::audio_callbacks_t audio_callbacks{
@@ -334,13 +346,28 @@ int main(int argc, char** argv) {
 
     ultramodern::input_callbacks_t input_callbacks{
         .poll_input = recomp::poll_inputs,
-        .get_input = recomp::get_n64_input,
+        .get_input = recomp::training::get_input_callback(),
         .set_rumble = recomp::set_rumble,
     };
 
+    // Training runs skip the launcher, so they need a ROM that was already selected in it.
+    if (recomp::training::active()) {
+        recomp::check_all_stored_roms();
+        if (!recomp::is_rom_valid(recomp::Game::MM)) {
+            exit_error("Training mode needs a ROM, select one in the launcher first\n");
+        }
+        recomp::start_game(recomp::Game::MM);
+    }
+
     recomp::start({}, audio_callbacks, input_callbacks, gfx_callbacks);
     
     NFD_Quit();
 
+    recomp::training::report(stdout);
+
+    if (!ultramodern::alloc_audit::report(stdout)) {
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
@@ -1,12 +1,22 @@
 #include "../ultramodern/ultramodern.hpp"
+#include "../ultramodern/instance.hpp"
 #include "recomp_helpers.h"
 
-static ultramodern::input_callbacks_t input_callbacks;
+namespace {
+    // Per-instance controller state. Each instance reads its input through its own callbacks.
+    struct InputContext {
+        ultramodern::input_callbacks_t callbacks{};
+        std::chrono::high_resolution_clock::time_point poll_time{};
+        int max_controllers = 0;
+    };
+}
 
-std::chrono::high_resolution_clock::time_point input_poll_time;
+static InputContext& input_context() {
+    return ultramodern::current_instance().state<InputContext>();
+}
 
 void update_poll_time() {
-    input_poll_time = std::chrono::high_resolution_clock::now();
+    input_context().poll_time = std::chrono::high_resolution_clock::now();
 }
 
 extern "C" void recomp_set_current_frame_poll_id(uint8_t* rdram, recomp_context* ctx) {
@@ -18,16 +28,15 @@ extern "C" void recomp_measure_latency(uint8_t* rdram, recomp_context* ctx) {
 }
 
 void ultramodern::measure_input_latency() {
-    // printf("Delta: %ld micros\n", std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - input_poll_time));    
+    // printf("Delta: %ld micros\n", std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - input_context().poll_time));    
 }
 
 void set_input_callbacks(const ultramodern::input_callbacks_t& callbacks) {
-    input_callbacks = callbacks;
+    input_context().callbacks = callbacks;
 }
 
-static int max_controllers = 0;
-
 extern "C" void osContInit_recomp(uint8_t* rdram, recomp_context* ctx) {
+    InputContext& input = input_context();
     PTR(void) bitpattern = _arg<1, PTR(void)>(rdram, ctx);
     PTR(void) status = _arg<2, PTR(void)>(rdram, ctx);
 
@@ -39,10 +48,10 @@ extern "C" void osContInit_recomp(uint8_t* rdram, recomp_context* ctx) {
     MEM_B(2, status) = 0x00; // status: 0 (from joybus)
     MEM_B(3, status) = 0x00; // errno: 0 (from libultra)
 
-    max_controllers = 4;
+    input.max_controllers = 4;
 
     // Mark controllers 1-3 as not connected
-    for (size_t controller = 1; controller < max_controllers; controller++) {
+    for (size_t controller = 1; controller < input.max_controllers; controller++) {
         // Libultra doesn't write status or type for absent controllers
         MEM_B(4 * controller + 3, status) = 0x80 >> 4; // errno: CONT_NO_RESPONSE_ERROR >> 4
     }
@@ -51,8 +60,9 @@ extern "C" void osContInit_recomp(uint8_t* rdram, recomp_context* ctx) {
 }
 
 extern "C" void osContStartReadData_recomp(uint8_t* rdram, recomp_context* ctx) {
-    if (input_callbacks.poll_input) {
-        input_callbacks.poll_input();
+    InputContext& input = input_context();
+    if (input.callbacks.poll_input) {
+        input.callbacks.poll_input();
     }
     update_poll_time();
 
@@ -60,17 +70,18 @@ extern "C" void osContStartReadData_recomp(uint8_t* rdram, recomp_context* ctx)
 }
 
 extern "C" void osContGetReadData_recomp(uint8_t* rdram, recomp_context* ctx) {
+    InputContext& input = input_context();
     PTR(void) pad = _arg<0, PTR(void)>(rdram, ctx);
 
     uint16_t buttons = 0;
     float x = 0.0f;
     float y = 0.0f;
 
-    if (input_callbacks.get_input) {
-        input_callbacks.get_input(&buttons, &x, &y);
+    if (input.callbacks.get_input) {
+        input.callbacks.get_input(&buttons, &x, &y);
     }
 
-    if (max_controllers > 0) {
+    if (input.max_controllers > 0) {
         // button
         MEM_H(0, pad) = buttons;
         // stick_x
@@ -80,7 +91,7 @@ extern "C" void osContGetReadData_recomp(uint8_t* rdram, recomp_context* ctx) {
         // errno
         MEM_B(4, pad) = 0;
     }
-    for (int controller = 1; controller < max_controllers; controller++) {
+    for (int controller = 1; controller < input.max_controllers; controller++) {
         MEM_B(6 * controller + 4, pad) = 0x80 >> 4; // errno: CONT_NO_RESPONSE_ERROR >> 4
     }
 }
@@ -90,6 +101,7 @@ extern "C" void osContStartQuery_recomp(uint8_t * rdram, recomp_context * ctx) {
 }
 
 extern "C" void osContGetQuery_recomp(uint8_t * rdram, recomp_context * ctx) {
+    InputContext& input = input_context();
     PTR(void) status = _arg<0, PTR(void)>(rdram, ctx);
 
     // Mark controller 0 as present
@@ -98,25 +110,27 @@ extern "C" void osContGetQuery_recomp(uint8_t * rdram, recomp_context * ctx) {
     MEM_B(3, status) = 0x00; // errno: 0 (from libultra)
 
     // Mark controllers 1-3 as not connected
-    for (size_t controller = 1; controller < max_controllers; controller++) {
+    for (size_t controller = 1; controller < input.max_controllers; controller++) {
         // Libultra doesn't write status or type for absent controllers
         MEM_B(4 * controller + 3, status) = 0x80 >> 4; // errno: CONT_NO_RESPONSE_ERROR >> 4
     }
 }
 
 extern "C" void osContSetCh_recomp(uint8_t* rdram, recomp_context* ctx) {
-    max_controllers = std::min(_arg<0, u8>(rdram, ctx), u8(4));
+    InputContext& input = input_context();
+    input.max_controllers = std::min(_arg<0, u8>(rdram, ctx), u8(4));
     _return<s32>(ctx, 0);
 }
 
 extern "C" void __osMotorAccess_recomp(uint8_t* rdram, recomp_context* ctx) {
+    InputContext& input = input_context();
     PTR(void) pfs = _arg<0, PTR(void)>(rdram, ctx);
     s32 flag = _arg<1, s32>(rdram, ctx);
     s32 channel = MEM_W(8, pfs);
 
     // Only respect accesses to controller 0.
     if (channel == 0) {
-        input_callbacks.set_rumble(flag);
+        input.callbacks.set_rumble(flag);
     }
 
     _return<s32>(ctx, 0);
@@ -131,24 +145,26 @@ extern "C" void osMotorInit_recomp(uint8_t* rdram, recomp_context* ctx) {
 }
 
 extern "C" void osMotorStart_recomp(uint8_t* rdram, recomp_context* ctx) {
+    InputContext& input = input_context();
     PTR(void) pfs = _arg<0, PTR(void)>(rdram, ctx);
     s32 channel = MEM_W(8, pfs);
 
     // Only respect accesses to controller 0.
     if (channel == 0) {
-        input_callbacks.set_rumble(true);
+        input.callbacks.set_rumble(true);
     }
 
     _return<s32>(ctx, 0);
 }
 
 extern "C" void osMotorStop_recomp(uint8_t* rdram, recomp_context* ctx) {
+    InputContext& input = input_context();
     PTR(void) pfs = _arg<0, PTR(void)>(rdram, ctx);
     s32 channel = MEM_W(8, pfs);
 
     // Only respect accesses to controller 0.
     if (channel == 0) {
-        input_callbacks.set_rumble(false);
+        input.callbacks.set_rumble(false);
     }
 
     _return<s32>(ctx, 0);
@@ -1,4 +1,5 @@
 #include "recomp.h"
+#include "../ultramodern/instance.hpp"
 
 enum class RDPStatusBit {
 	XbusDmem = 0,
@@ -27,18 +28,28 @@ constexpr void update_bit(uint32_t& state, uint32_t flags, RDPStatusBit bit) {
 	}
 }
 
-uint32_t rdp_state = 1 << (int)RDPStatusBit::BufferReady;
+namespace {
+	// Per-instance RDP status register.
+	struct RDPState {
+		uint32_t status = 1 << (int)RDPStatusBit::BufferReady;
+	};
+}
+
+static uint32_t& rdp_state() {
+	return ultramodern::current_instance().state<RDPState>().status;
+}
 
 extern "C" void osDpSetNextBuffer_recomp(uint8_t* rdram, recomp_context* ctx) {
     assert(false);
 }
 
 extern "C" void osDpGetStatus_recomp(uint8_t* rdram, recomp_context* ctx) {
-	ctx->r2 = rdp_state;
+	ctx->r2 = rdp_state();
 }
 
 extern "C" void osDpSetStatus_recomp(uint8_t* rdram, recomp_context* ctx) {
-	update_bit(rdp_state, ctx->r4, RDPStatusBit::XbusDmem);
-	update_bit(rdp_state, ctx->r4, RDPStatusBit::Freeze);
-	update_bit(rdp_state, ctx->r4, RDPStatusBit::Flush);
+	uint32_t& state = rdp_state();
+	update_bit(state, ctx->r4, RDPStatusBit::XbusDmem);
+	update_bit(state, ctx->r4, RDPStatusBit::Freeze);
+	update_bit(state, ctx->r4, RDPStatusBit::Flush);
 }
@@ -97,9 +97,7 @@ extern "C" void osFlashWriteBuffer_recomp(uint8_t * rdram, recomp_context * ctx)
 	PTR(OSMesgQueue) mq = ctx->r7;
 	
 	// Copy the input data into the write buffer
-	for (size_t i = 0; i < page_size; i++) {
-		write_buffer[i] = MEM_B(i, dramAddr);
-	}
+	recomp::rdram::copy_out(rdram, dramAddr, write_buffer.data(), page_size);
 
 	// Send the message indicating write completion
 	osSendMesg(PASS_RDRAM mq, 0, OS_MESG_NOBLOCK);
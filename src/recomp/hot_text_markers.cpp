@@ -0,0 +1,5 @@
+// Empty functions that the linker places directly before and after the functions listed in RECOMP_FUNC_ORDER_FILE, so that the
+// range the hot code was linked into can be found at runtime for RECOMP_HUGE_TEXT. They're compiled into their own sections
+// and added to the ordering file by CMakeLists.txt.
+extern "C" void recomp_hot_text_begin() {}
+extern "C" void recomp_hot_text_end() {}
@@ -1,50 +1,305 @@
-#include <unordered_map>
 #include <algorithm>
 #include <vector>
+#include <array>
+#include <mutex>
+#include <string>
 #include "recomp.h"
+#include "../ultramodern/perf_metrics.hpp"
+#include "../ultramodern/instance.hpp"
+#include "../ultramodern/guest_faults.hpp"
 #include "../RecompiledFuncs/recomp_overlays.inl"
 
 constexpr size_t num_code_sections = ARRLEN(section_table);
 
 // SectionTableEntry sections[] defined in recomp_overlays.inl
 
-struct LoadedSection {
-    int32_t loaded_ram_addr;
-    size_t section_table_index;
+namespace {
+    // A section's functions sorted by their offset into the section, so that loading or unloading the section is a single
+    // operation and its functions are found by binary search rather than being hashed one at a time.
+    struct SectionFunctions {
+        std::vector<uint32_t> offsets{};
+        std::vector<recomp_func_t*> funcs{};
 
-    LoadedSection(int32_t loaded_ram_addr_, size_t section_table_index_) {
-        loaded_ram_addr = loaded_ram_addr_;
-        section_table_index = section_table_index_;
+        SectionFunctions(const SectionTableEntry& section) {
+            std::vector<FuncEntry> sorted{ section.funcs, section.funcs + section.num_funcs };
+            std::stable_sort(sorted.begin(), sorted.end(), [](const FuncEntry& a, const FuncEntry& b) { return a.offset < b.offset; });
+            offsets.reserve(sorted.size());
+            funcs.reserve(sorted.size());
+            for (const FuncEntry& func : sorted) {
+                offsets.push_back(func.offset);
+                funcs.push_back(func.func);
+            }
+        }
+
+        recomp_func_t* find(uint32_t offset) const {
+            auto find_it = std::lower_bound(offsets.begin(), offsets.end(), offset);
+            if (find_it == offsets.end() || *find_it != offset) {
+                return nullptr;
+            }
+            return funcs[find_it - offsets.begin()];
+        }
+    };
+
+    // Function tables for section_table, in the same order. Built once the table has been sorted by init_overlays.
+    std::vector<SectionFunctions> code_section_functions{};
+
+    struct ResidentSection {
+        uint32_t start;
+        uint32_t end;
+        // Largest end of this section and every one before it, which bounds how far back an overlap query has to look.
+        uint32_t max_end;
+        // Sections loaded later take precedence where they overlap, as they overwrote the earlier ones.
+        uint64_t load_order;
+        size_t section_table_index;
+        const SectionFunctions* functions;
+        // How many unloaded sections have hidden some of this section's functions.
+        uint32_t hidden_count;
+    };
+
+    // Unloading a section removes every function at the addresses of its functions, including ones that overlapping sections
+    // have there, and those don't come back until their section is loaded again. Rather than recording each hidden function,
+    // the unloaded section is recorded against each section it overlapped, and a function is hidden if the unloaded section
+    // had one at the same address.
+    struct UnloadedSection {
+        uint32_t start;
+        const SectionFunctions* functions;
+
+        bool hides(uint32_t addr) const {
+            return addr >= start && functions->find(addr - start) != nullptr;
+        }
+
+        bool operator==(const UnloadedSection& rhs) const = default;
+    };
+
+    struct HiddenBy {
+        // The section whose functions are hidden.
+        uint64_t load_order;
+        UnloadedSection unloaded;
+    };
+
+    // Resident sections sorted by the RAM address they're loaded at. Storage for every section is reserved up front, so loads
+    // and unloads don't allocate.
+    class ResidentSections {
+    public:
+        void reserve(size_t count) {
+            sections.reserve(count);
+            hidden.reserve(count);
+        }
+
+        void insert(uint32_t start, uint32_t size, size_t section_table_index, const SectionFunctions* functions) {
+            auto insert_it = std::upper_bound(sections.begin(), sections.end(), start,
+                [](uint32_t start, const ResidentSection& section) { return start < section.start; });
+            size_t index = insert_it - sections.begin();
+            sections.insert(insert_it, ResidentSection{ start, start + size, 0, next_load_order++, section_table_index, functions, 0 });
+            update_max_end(index);
+        }
+
+        // Finds a resident copy of a section by the address it's loaded at.
+        const ResidentSection* find(size_t section_table_index, uint32_t start) const {
+            auto find_it = std::lower_bound(sections.begin(), sections.end(), start,
+                [](const ResidentSection& section, uint32_t start) { return section.start < start; });
+            for (; find_it != sections.end() && find_it->start == start; ++find_it) {
+                if (find_it->section_table_index == section_table_index) {
+                    return &*find_it;
+                }
+            }
+            return nullptr;
+        }
+
+        void erase(const ResidentSection* section) {
+            size_t index = section - sections.data();
+            remove(index);
+            update_max_end(index);
+        }
+
+        // Removes every section that overlaps [first, last], calling `func` on each one first. Sections are visited from the
+        // highest address down.
+        template <typename F>
+        void erase_overlapping(uint32_t first, uint32_t last, F&& func) {
+            size_t lowest_erased = sections.size();
+            for (size_t index = end_of_candidates(last); index > 0 && sections[index - 1].max_end > first; index--) {
+                const ResidentSection& section = sections[index - 1];
+                if (section.end > first) {
+                    func(section);
+                    remove(index - 1);
+                    lowest_erased = index - 1;
+                }
+            }
+            update_max_end(lowest_erased);
+        }
+
+        recomp_func_t* find_function(uint32_t addr) const {
+            recomp_func_t* ret = nullptr;
+            uint64_t ret_load_order = 0;
+            for (size_t index = end_of_candidates(addr); index > 0 && sections[index - 1].max_end > addr; index--) {
+                const ResidentSection& section = sections[index - 1];
+                if (section.end > addr && (ret == nullptr || section.load_order > ret_load_order)) {
+                    recomp_func_t* func = section.functions->find(addr - section.start);
+                    if (func != nullptr && !is_hidden(section, addr)) {
+                        ret = func;
+                        ret_load_order = section.load_order;
+                    }
+                }
+            }
+            return ret;
+        }
+    private:
+        bool is_hidden(const ResidentSection& section, uint32_t addr) const {
+            if (section.hidden_count == 0) {
+                return false;
+            }
+            for (const HiddenBy& hidden_by : hidden) {
+                if (hidden_by.load_order == section.load_order && hidden_by.unloaded.hides(addr)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Records the removed section against every other section it overlaps, which hides their functions at the same
+        // addresses as its own, then removes the section along with what was recorded against it. Other sections' maximum
+        // ends may be left too large, which only makes queries look further back than they need to until update_max_end runs.
+        void remove(size_t index) {
+            const ResidentSection& removed = sections[index];
+            for (size_t other = end_of_candidates(removed.end - 1); other > 0 && sections[other - 1].max_end > removed.start; other--) {
+                ResidentSection& section = sections[other - 1];
+                if (other - 1 == index || section.end <= removed.start) {
+                    continue;
+                }
+                // The same section unloaded from the same place again hides the same functions.
+                UnloadedSection unloaded{ removed.start, removed.functions };
+                bool recorded = std::any_of(hidden.begin(), hidden.end(), [&](const HiddenBy& hidden_by) {
+                    return hidden_by.load_order == section.load_order && hidden_by.unloaded == unloaded;
+                });
+                if (!recorded) {
+                    hidden.emplace_back(HiddenBy{ section.load_order, unloaded });
+                    section.hidden_count++;
+                }
+            }
+
+            if (removed.hidden_count != 0) {
+                uint64_t load_order = removed.load_order;
+                std::erase_if(hidden, [load_order](const HiddenBy& hidden_by) { return hidden_by.load_order == load_order; });
+            }
+            sections.erase(sections.begin() + index);
+        }
+
+        // One past the last section that starts at or before addr.
+        size_t end_of_candidates(uint32_t addr) const {
+            return std::upper_bound(sections.begin(), sections.end(), addr,
+                [](uint32_t addr, const ResidentSection& section) { return addr < section.start; }) - sections.begin();
+        }
+
+        void update_max_end(size_t first_changed) {
+            uint32_t max_end = first_changed == 0 ? 0 : sections[first_changed - 1].max_end;
+            for (size_t index = first_changed; index < sections.size(); index++) {
+                max_end = std::max(max_end, sections[index].end);
+                sections[index].max_end = max_end;
+            }
+        }
+
+        std::vector<ResidentSection> sections{};
+        // Only overlapping sections ever hide each other's functions, so this stays short enough to search linearly.
+        std::vector<HiddenBy> hidden{};
+        uint64_t next_load_order = 0;
+    };
+
+    struct SpecialSection {
+        uint32_t start;
+        uint32_t end;
+        SectionFunctions functions;
+        // Game code unloaded from over this section, which hides this section's functions at the same addresses as its own.
+        std::vector<UnloadedSection> hidden_by{};
+
+        recomp_func_t* find(uint32_t addr) const {
+            for (const UnloadedSection& unloaded : hidden_by) {
+                if (unloaded.hides(addr)) {
+                    return nullptr;
+                }
+            }
+            return functions.find(addr - start);
+        }
+    };
+
+    struct CachedFunction {
+        uint32_t addr;
+        uint32_t generation;
+        recomp_func_t* func;
+    };
+
+    constexpr size_t function_cache_size = 1024;
+
+    // Per-instance record of which overlays are loaded where.
+    struct OverlayContext {
+        ResidentSections resident_sections{};
+        // Sections loaded with load_special_overlay, i.e. the patches, which stay loaded and are overridden by any game code
+        // loaded over them. Unloading that game code hides the patch functions at the same addresses, as with any other section.
+        std::vector<SpecialSection> special_sections{};
+        std::array<int32_t, num_sections> section_addresses{};
+        // Recent get_function results, as indirect calls keep going to the same few functions. Every load and unload starts a
+        // new generation, which makes all existing entries stale at once. Only game threads look functions up, and they run one
+        // at a time, so the cache isn't locked.
+        std::array<CachedFunction, function_cache_size> function_cache{};
+        uint32_t generation = 1;
+    };
+}
+
+// The calling thread's instance's overlay state, set by bind_overlays so that get_function doesn't have to look up the instance
+// on every indirect call.
+static RECOMP_THREAD_LOCAL OverlayContext* bound_overlay_context = nullptr;
+
+static OverlayContext& overlay_context() {
+    if (bound_overlay_context != nullptr) {
+        return *bound_overlay_context;
     }
+    return ultramodern::current_instance().state<OverlayContext>();
+}
 
-    bool operator<(const LoadedSection& rhs) {
-        return loaded_ram_addr < rhs.loaded_ram_addr;
+static void invalidate_function_cache(OverlayContext& overlays) {
+    overlays.generation++;
+    // Entries from the previous time the counter had this value would look current again after it wraps around.
+    if (overlays.generation == 0) {
+        overlays.function_cache = {};
+        overlays.generation = 1;
     }
-};
+}
 
-std::vector<LoadedSection> loaded_sections{};
-std::unordered_map<int32_t, recomp_func_t*> func_map{};
+// Hides the special sections' functions that are at the same address as one of an unloaded section's functions.
+static void hide_special_functions(OverlayContext& overlays, const ResidentSection& unloaded) {
+    for (SpecialSection& special : overlays.special_sections) {
+        if (special.end <= unloaded.start || special.start >= unloaded.end) {
+            continue;
+        }
+        UnloadedSection hider{ unloaded.start, unloaded.functions };
+        if (std::find(special.hidden_by.begin(), special.hidden_by.end(), hider) == special.hidden_by.end()) {
+            special.hidden_by.push_back(hider);
+        }
+    }
+}
 
 void load_overlay(size_t section_table_index, int32_t ram) {
+    OverlayContext& overlays = overlay_context();
     const SectionTableEntry& section = section_table[section_table_index];
-    for (size_t function_index = 0; function_index < section.num_funcs; function_index++) {
-        const FuncEntry& func = section.funcs[function_index];
-        func_map[ram + func.offset] = func.func;
-    }
-    loaded_sections.emplace_back(ram, section_table_index);
-    section_addresses[section.index] = ram;
+    overlays.resident_sections.insert(ram, section.size, section_table_index, &code_section_functions[section_table_index]);
+    overlays.section_addresses[section.index] = ram;
+    invalidate_function_cache(overlays);
+    ultramodern::perf::count_overlay_load();
 }
 
 void load_special_overlay(const SectionTableEntry& section, int32_t ram) {
-    for (size_t function_index = 0; function_index < section.num_funcs; function_index++) {
-        const FuncEntry& func = section.funcs[function_index];
-        func_map[ram + func.offset] = func.func;
-    }
+    OverlayContext& overlays = overlay_context();
+    overlays.special_sections.emplace_back(SpecialSection{ static_cast<uint32_t>(ram), static_cast<uint32_t>(ram) + section.size, SectionFunctions{ section } });
+    invalidate_function_cache(overlays);
 }
 
 
 extern "C" {
-int32_t section_addresses[num_sections];
+RECOMP_THREAD_LOCAL int32_t* section_addresses = nullptr;
+}
+
+void bind_overlays(ultramodern::Instance& instance) {
+    bound_overlay_context = &instance.state<OverlayContext>();
+    section_addresses = bound_overlay_context->section_addresses.data();
 }
 
 extern "C" void load_overlays(uint32_t rom, int32_t ram_addr, uint32_t size) {
@@ -69,29 +324,28 @@ extern "C" void load_overlays(uint32_t rom, int32_t ram_addr, uint32_t size) {
 extern "C" void unload_overlays(int32_t ram_addr, uint32_t size);
 
 extern "C" void unload_overlay_by_id(uint32_t id) {
+    OverlayContext& overlays = overlay_context();
     uint32_t section_table_index = overlay_sections_by_index[id];
     const SectionTableEntry& section = section_table[section_table_index];
 
-    auto find_it = std::find_if(loaded_sections.begin(), loaded_sections.end(), [section_table_index](const LoadedSection& s) { return s.section_table_index == section_table_index; });
+    const ResidentSection* resident = overlays.resident_sections.find(section_table_index, overlays.section_addresses[section.index]);
 
-    if (find_it != loaded_sections.end()) {
-        // Determine where each function was loaded to and remove that entry from the function map
-        for (size_t func_index = 0; func_index < section.num_funcs; func_index++) {
-            const auto& func = section.funcs[func_index];
-            uint32_t func_address = func.offset + find_it->loaded_ram_addr;
-            func_map.erase(func_address);
-        }
+    if (resident != nullptr) {
         // Reset the section's address in the address table
-        section_addresses[section.index] = section.ram_addr;
-        // Remove the section from the loaded section map
-        loaded_sections.erase(find_it);
+        overlays.section_addresses[section.index] = section.ram_addr;
+        // Remove the section, along with all of its functions, from the resident sections
+        hide_special_functions(overlays, *resident);
+        overlays.resident_sections.erase(resident);
+        invalidate_function_cache(overlays);
+        ultramodern::perf::count_overlay_unload();
     }
 }
 
 extern "C" void load_overlay_by_id(uint32_t id, uint32_t ram_addr) {
+    OverlayContext& overlays = overlay_context();
     uint32_t section_table_index = overlay_sections_by_index[id];
     const SectionTableEntry& section = section_table[section_table_index];
-    int32_t prev_address = section_addresses[section.index];
+    int32_t prev_address = overlays.section_addresses[section.index];
     if (/*ram_addr >= 0x80000000 && ram_addr < 0x81000000) {*/ prev_address == section.ram_addr) {
         load_overlay(section_table_index, ram_addr);
     }
@@ -103,62 +357,173 @@ extern "C" void load_overlay_by_id(uint32_t id, uint32_t ram_addr) {
 }
 
 extern "C" void unload_overlays(int32_t ram_addr, uint32_t size) {
-    for (auto it = loaded_sections.begin(); it != loaded_sections.end();) {
-        const auto& section = section_table[it->section_table_index];
-
-        // Check if the unloaded region overlaps with the loaded section
-        if (ram_addr < (it->loaded_ram_addr + section.size) && (ram_addr + size) >= it->loaded_ram_addr) {
-            // Check if the section isn't entirely in the loaded region
-            if (ram_addr > it->loaded_ram_addr || (ram_addr + size) < (it->loaded_ram_addr + section.size)) {
-                fprintf(stderr,
-                    "Cannot partially unload section\n"
-                    "  rom: 0x%08X size: 0x%08X loaded_addr: 0x%08X\n"
-                    "  unloaded_ram: 0x%08X unloaded_size : 0x%08X\n",
-                        section.rom_addr, section.size, it->loaded_ram_addr, ram_addr, size);
-                assert(false);
-                std::exit(EXIT_FAILURE);
-            }
-            // Determine where each function was loaded to and remove that entry from the function map
-            for (size_t func_index = 0; func_index < section.num_funcs; func_index++) {
-                const auto& func = section.funcs[func_index];
-                uint32_t func_address = func.offset + it->loaded_ram_addr;
-                func_map.erase(func_address);
-            }
-            // Reset the section's address in the address table
-            section_addresses[section.index] = section.ram_addr;
-            // Remove the section from the loaded section map
-            it = loaded_sections.erase(it);
-            // Skip incrementing the iterator
-            continue;
+    OverlayContext& overlays = overlay_context();
+    // Sections that end exactly where the unloaded region starts aren't affected, but ones that start exactly where it ends are.
+    overlays.resident_sections.erase_overlapping(ram_addr, ram_addr + size, [&](const ResidentSection& resident) {
+        const auto& section = section_table[resident.section_table_index];
+
+        // Check if the section isn't entirely in the loaded region
+        if (static_cast<uint32_t>(ram_addr) > resident.start || (ram_addr + size) < resident.end) {
+            fprintf(stderr,
+                "Cannot partially unload section\n"
+                "  rom: 0x%08X size: 0x%08X loaded_addr: 0x%08X\n"
+                "  unloaded_ram: 0x%08X unloaded_size : 0x%08X\n",
+                    section.rom_addr, section.size, resident.start, ram_addr, size);
+            assert(false);
+            std::exit(EXIT_FAILURE);
         }
-        ++it;
-    }
+        // Reset the section's address in the address table
+        overlays.section_addresses[section.index] = section.ram_addr;
+        hide_special_functions(overlays, resident);
+        invalidate_function_cache(overlays);
+        ultramodern::perf::count_overlay_unload();
+    });
 }
 
 void load_patch_functions();
 
 void init_overlays() {
+    OverlayContext& overlays = overlay_context();
     for (size_t section_index = 0; section_index < num_code_sections; section_index++) {
-        section_addresses[section_table[section_index].index] = section_table[section_index].ram_addr;
+        overlays.section_addresses[section_table[section_index].index] = section_table[section_index].ram_addr;
     }
 
-    // Sort the executable sections by rom address
-    std::sort(&section_table[0], &section_table[num_code_sections],
-        [](const SectionTableEntry& a, const SectionTableEntry& b) {
-            return a.rom_addr < b.rom_addr;
+    // Sort the executable sections by rom address and build their function tables. The section table is shared by every
+    // instance, so this is only done once.
+    static std::once_flag sorted_sections;
+    std::call_once(sorted_sections, []() {
+        std::sort(&section_table[0], &section_table[num_code_sections],
+            [](const SectionTableEntry& a, const SectionTableEntry& b) {
+                return a.rom_addr < b.rom_addr;
+            }
+        );
+        code_section_functions.reserve(num_code_sections);
+        for (size_t section_index = 0; section_index < num_code_sections; section_index++) {
+            code_section_functions.emplace_back(section_table[section_index]);
         }
-    );
+    });
+    overlays.resident_sections.reserve(num_code_sections);
 
     load_patch_functions();
 }
 
+namespace {
+    struct HostFunction {
+        uintptr_t address;
+        uint32_t section_table_index;
+        uint32_t offset;
+    };
+
+    // Upper bound on the size of the last recompiled function in host code, as function sizes aren't recorded anywhere.
+    constexpr uintptr_t max_last_function_size = 64 * 1024;
+}
+
+// Recompiled functions sorted by their host address, for turning sampled host PCs back into game functions.
+static const std::vector<HostFunction>& host_function_table() {
+    static const std::vector<HostFunction> table = []() {
+        std::vector<HostFunction> ret{};
+        for (size_t section_index = 0; section_index < num_code_sections; section_index++) {
+            const SectionTableEntry& section = section_table[section_index];
+            for (size_t function_index = 0; function_index < section.num_funcs; function_index++) {
+                const FuncEntry& func = section.funcs[function_index];
+                ret.emplace_back(HostFunction{ reinterpret_cast<uintptr_t>(func.func), static_cast<uint32_t>(section_index), func.offset });
+            }
+        }
+        std::sort(ret.begin(), ret.end(), [](const HostFunction& a, const HostFunction& b) { return a.address < b.address; });
+        return ret;
+    }();
+    return table;
+}
+
+// Whether each entry of the section table is an overlay.
+static const std::vector<bool>& overlay_sections() {
+    static const std::vector<bool> ret = []() {
+        std::vector<bool> ret(num_code_sections, false);
+        for (size_t id = 0; id < ARRLEN(overlay_sections_by_index); id++) {
+            ret[overlay_sections_by_index[id]] = true;
+        }
+        return ret;
+    }();
+    return ret;
+}
+
+bool symbolize_recompiled_function(uintptr_t pc, std::string& name) {
+    const std::vector<HostFunction>& table = host_function_table();
+    auto find_it = std::upper_bound(table.begin(), table.end(), pc, [](uintptr_t pc, const HostFunction& func) { return pc < func.address; });
+    if (find_it == table.begin()) {
+        return false;
+    }
+    --find_it;
+    if (std::next(find_it) == table.end() && pc - find_it->address > max_last_function_size) {
+        return false;
+    }
+
+    // Overlays share VRAM, so their functions are named after the overlay along with the address the overlay is currently
+    // loaded at (or its link address if it isn't loaded).
+    const SectionTableEntry& section = section_table[find_it->section_table_index];
+    int32_t section_address = section.ram_addr;
+    ultramodern::Instance* instance = ultramodern::try_current_instance();
+    if (instance != nullptr) {
+        section_address = instance->state<OverlayContext>().section_addresses[section.index];
+    }
+
+    char buffer[64];
+    if (overlay_sections()[find_it->section_table_index]) {
+        snprintf(buffer, sizeof(buffer), "ovl%zu:func_%08X", section.index, static_cast<uint32_t>(section_address + find_it->offset));
+    }
+    else {
+        snprintf(buffer, sizeof(buffer), "func_%08X", static_cast<uint32_t>(section_address + find_it->offset));
+    }
+    name = buffer;
+    return true;
+}
+
+// Every recompiled function along with its link address, for the guest fault handler to name functions without having to look
+// anything up in the overlay state.
+std::vector<ultramodern::guest_faults::HostFunction> recompiled_host_functions() {
+    std::vector<ultramodern::guest_faults::HostFunction> ret{};
+    for (size_t section_index = 0; section_index < num_code_sections; section_index++) {
+        const SectionTableEntry& section = section_table[section_index];
+        int32_t overlay_index = overlay_sections()[section_index] ? static_cast<int32_t>(section.index) : -1;
+        for (size_t function_index = 0; function_index < section.num_funcs; function_index++) {
+            const FuncEntry& func = section.funcs[function_index];
+            ret.emplace_back(ultramodern::guest_faults::HostFunction{ reinterpret_cast<uintptr_t>(func.func),
+                static_cast<uint32_t>(section.ram_addr + func.offset), overlay_index });
+        }
+    }
+    return ret;
+}
+
+static recomp_func_t* find_function(OverlayContext& overlays, uint32_t addr) {
+    recomp_func_t* func = overlays.resident_sections.find_function(addr);
+    for (auto it = overlays.special_sections.rbegin(); func == nullptr && it != overlays.special_sections.rend(); ++it) {
+        if (addr >= it->start && addr < it->end) {
+            func = it->find(addr);
+        }
+    }
+    return func;
+}
+
+// Looks up the function at an address without going through the cache, returning null if there isn't one.
+recomp_func_t* find_function(int32_t addr) {
+    return find_function(overlay_context(), static_cast<uint32_t>(addr));
+}
+
 extern "C" recomp_func_t * get_function(int32_t addr) {
-    auto func_find = func_map.find(addr);
-    if (func_find == func_map.end()) {
+    OverlayContext& overlays = overlay_context();
+    uint32_t addr_unsigned = static_cast<uint32_t>(addr);
+    CachedFunction& cached = overlays.function_cache[(addr_unsigned >> 2) % function_cache_size];
+    if (cached.addr == addr_unsigned && cached.generation == overlays.generation) {
+        return cached.func;
+    }
+
+    recomp_func_t* func = find_function(overlays, addr_unsigned);
+    if (func == nullptr) {
         fprintf(stderr, "Failed to find function at 0x%08X\n", addr);
         assert(false);
         std::exit(EXIT_FAILURE);
     }
-    return func_find->second;
+    cached = CachedFunction{ addr_unsigned, overlays.generation, func };
+    return func;
 }
 
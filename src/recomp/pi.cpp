@@ -4,11 +4,14 @@
 #include <cstring>
 #include <string>
 #include <mutex>
+#include <atomic>
 #include "recomp.h"
 #include "recomp_game.h"
 #include "recomp_config.h"
 #include "../ultramodern/ultra64.h"
 #include "../ultramodern/ultramodern.hpp"
+#include "../ultramodern/sync_stats.hpp"
+#include "../ultramodern/instance.hpp"
 
 static std::vector<uint8_t> rom;
 
@@ -48,127 +51,24 @@ extern "C" void osCreatePiManager_recomp(uint8_t* rdram, recomp_context* ctx) {
 }
 
 void recomp::do_rom_read(uint8_t* rdram, gpr ram_address, uint32_t physical_addr, size_t num_bytes) {
-    // TODO use word copies when possible
-
     // TODO handle misaligned DMA
     assert((physical_addr & 0x1) == 0 && "Only PI DMA from aligned ROM addresses is currently supported");
     assert((ram_address & 0x7) == 0 && "Only PI DMA to aligned RDRAM addresses is currently supported");
     assert((num_bytes & 0x1) == 0 && "Only PI DMA with aligned sizes is currently supported");
     uint8_t* rom_addr = rom.data() + physical_addr - rom_base;
-    for (size_t i = 0; i < num_bytes; i++) {
-        MEM_B(i, ram_address) = *rom_addr;
-        rom_addr++;
-    }
+    recomp::rdram::copy_in(rdram, ram_address, rom_addr, num_bytes);
 }
 
-struct {
-    std::array<char, 0x20000> save_buffer;
-    std::thread saving_thread;
-    moodycamel::LightweightSemaphore write_sempahore;
-    std::mutex save_buffer_mutex;
-} save_context;
-
 const std::u8string save_folder = u8"saves";
 const std::u8string save_filename = std::u8string{recomp::mm_game_id} + u8".bin";
 
-std::filesystem::path get_save_file_path() {
+// Where saves go for instances that don't have their own save path, see saves.cpp.
+std::filesystem::path default_save_file_path() {
     return recomp::get_app_folder_path() / save_folder / save_filename;
 }
 
-void update_save_file() {
-    std::ofstream save_file{ get_save_file_path(), std::ios_base::binary };
-
-    if (save_file.good()) {
-        std::lock_guard lock{ save_context.save_buffer_mutex };
-        save_file.write(save_context.save_buffer.data(), save_context.save_buffer.size());
-    } else {
-        fprintf(stderr, "Failed to save!\n");
-        std::exit(EXIT_FAILURE);
-    }
-}
-
-extern std::atomic_bool exited;
-
-void saving_thread_func(RDRAM_ARG1) {
-    while (!exited) {
-        bool save_buffer_updated = false;
-        // Repeatedly wait for a new action to be sent.
-        constexpr int64_t wait_time_microseconds = 10000;
-        constexpr int max_actions = 128;
-        int num_actions = 0;
-
-        // Wait up to the given timeout for a write to come in. Allow multiple writes to coalesce together into a single save.
-        // Cap the number of coalesced writes to guarantee that the save buffer eventually gets written out to the file even if the game
-        // is constantly sending writes.
-        while (save_context.write_sempahore.wait(wait_time_microseconds) && num_actions < max_actions) {
-            save_buffer_updated = true;
-            num_actions++;
-        }
-
-        // If an action came through that affected the save file, save the updated contents.
-        if (save_buffer_updated) {
-            update_save_file();
-        }
-    }
-}
-
-void save_write_ptr(const void* in, uint32_t offset, uint32_t count) {
-    {
-        std::lock_guard lock { save_context.save_buffer_mutex };
-        memcpy(&save_context.save_buffer[offset], in, count);
-    }
-    
-    save_context.write_sempahore.signal();
-}
-
-void save_write(RDRAM_ARG PTR(void) rdram_address, uint32_t offset, uint32_t count) {
-    {
-        std::lock_guard lock { save_context.save_buffer_mutex };
-        for (uint32_t i = 0; i < count; i++) {
-            save_context.save_buffer[offset + i] = MEM_B(i, rdram_address);
-        }
-    }
-
-    save_context.write_sempahore.signal();
-}
-
-void save_read(RDRAM_ARG PTR(void) rdram_address, uint32_t offset, uint32_t count) {
-    std::lock_guard lock { save_context.save_buffer_mutex };
-    for (size_t i = 0; i < count; i++) {
-        MEM_B(i, rdram_address) = save_context.save_buffer[offset + i];
-    }
-}
-
-void save_clear(uint32_t start, uint32_t size, char value) {
-    {
-        std::lock_guard lock { save_context.save_buffer_mutex };
-        std::fill_n(save_context.save_buffer.begin() + start, size, value);
-    }
-
-    save_context.write_sempahore.signal();
-}
-
-void ultramodern::init_saving(RDRAM_ARG1) {
-    std::filesystem::path save_file_path = get_save_file_path();
-
-    // Ensure the save file directory exists.
-    std::filesystem::create_directories(save_file_path.parent_path());
-
-    // Read the save file if it exists.
-    std::ifstream save_file{ save_file_path, std::ios_base::binary };
-    if (save_file.good()) {
-        save_file.read(save_context.save_buffer.data(), save_context.save_buffer.size());
-    } else {
-        // Otherwise clear the save file to all zeroes.
-        save_context.save_buffer.fill(0);
-    }
-
-    save_context.saving_thread = std::thread{saving_thread_func, PASS_RDRAM};
-}
-
-void ultramodern::join_saving_thread() {
-    save_context.saving_thread.join();
-}
+void save_write(RDRAM_ARG PTR(void) rdram_address, uint32_t offset, uint32_t count);
+void save_read(RDRAM_ARG PTR(void) rdram_address, uint32_t offset, uint32_t count);
 
 void do_dma(RDRAM_ARG PTR(OSMesgQueue) mq, gpr rdram_address, uint32_t physical_addr, uint32_t size, uint32_t direction) {
     // TODO asynchronous transfer
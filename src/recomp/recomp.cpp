@@ -5,6 +5,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
 #include <cmath>
 #include <unordered_map>
 #include <unordered_set>
@@ -15,9 +19,21 @@
 #include "recomp_config.h"
 #include "xxHash/xxh3.h"
 #include "../ultramodern/ultramodern.hpp"
+#include "../ultramodern/sync_stats.hpp"
+#include "../ultramodern/instance.hpp"
+#include "../ultramodern/profiler.hpp"
+#include "../ultramodern/func_counters.hpp"
+#include "../ultramodern/huge_pages.hpp"
+#include "../ultramodern/guest_faults.hpp"
 #include "../../RecompiledPatches/patches_bin.h"
 #include "mm_shader_cache.h"
 
+#ifdef RECOMP_HOT_TEXT_MARKERS
+// Linked directly before and after the functions in RECOMP_FUNC_ORDER_FILE, see hot_text_markers.cpp.
+extern "C" void recomp_hot_text_begin();
+extern "C" void recomp_hot_text_end();
+#endif
+
 #ifdef _MSC_VER
 inline uint32_t byteswap(uint32_t val) {
     return _byteswap_ulong(val);
@@ -302,13 +318,14 @@ extern "C" void recomp_entrypoint(uint8_t * rdram, recomp_context * ctx);
 gpr get_entrypoint_address();
 const char* get_rom_name();
 void init_overlays();
+void bind_overlays(ultramodern::Instance& instance);
+bool symbolize_recompiled_function(uintptr_t pc, std::string& name);
+std::vector<ultramodern::guest_faults::HostFunction> recompiled_host_functions();
 extern "C" void load_overlays(uint32_t rom, int32_t ram_addr, uint32_t size);
 extern "C" void unload_overlays(int32_t ram_addr, uint32_t size);
 
 void read_patch_data(uint8_t* rdram, gpr patch_data_address) {
-    for (size_t i = 0; i < sizeof(mm_patches_bin); i++) {
-        MEM_B(i, patch_data_address) = mm_patches_bin[i];
-    }
+    recomp::rdram::copy_in(rdram, patch_data_address, mm_patches_bin, sizeof(mm_patches_bin));
 }
 
 void init(uint8_t* rdram, recomp_context* ctx) {
@@ -349,33 +366,174 @@ void init(uint8_t* rdram, recomp_context* ctx) {
     MEM_W(osMemSize, 0) = 8 * 1024 * 1024; // 8MB
 }
 
-std::atomic<recomp::Game> game_started = recomp::Game::None;
+namespace {
+    // Per-instance run state: which game the instance has been asked to start and whether it's been asked to quit.
+    struct RunContext {
+        std::atomic<recomp::Game> game_started = recomp::Game::None;
+        std::atomic_bool exited = false;
+        ultramodern::gfx_callbacks_t::wake_gfx_t* wake_gfx_callback = nullptr;
+        ultramodern::gfx_callbacks_t::gfx_data_t wake_gfx_data{};
+    };
+}
+
+static RunContext& run_context() {
+    return ultramodern::current_instance().state<RunContext>();
+}
 
 void recomp::start_game(recomp::Game game) {
-    game_started.store(game);
-    game_started.notify_all();
+    RunContext& run = run_context();
+    run.game_started.store(game);
+    run.game_started.notify_all();
+    // The cursor is locked once the game has started, which the main thread only applies when it wakes up.
+    if (run.wake_gfx_callback != nullptr) {
+        run.wake_gfx_callback(run.wake_gfx_data);
+    }
 }
 
 bool ultramodern::is_game_started() {
-    return game_started.load() != recomp::Game::None;
+    // The UI can ask before the runtime has been started.
+    ultramodern::Instance* instance = ultramodern::try_current_instance();
+    return instance != nullptr && instance->state<RunContext>().game_started.load() != recomp::Game::None;
 }
 
 void set_audio_callbacks(const ultramodern::audio_callbacks_t& callbacks);
 void set_input_callbacks(const ultramodern::input_callbacks_t& callback);
 
-std::atomic_bool exited = false;
-
 void ultramodern::quit() {
-    exited.store(true);
+    // Nothing has been started yet, so there's nothing to stop.
+    if (ultramodern::try_current_instance() == nullptr) {
+        return;
+    }
+
+    RunContext& run = run_context();
+    run.exited.store(true);
+    run.exited.notify_all();
     recomp::Game desired = recomp::Game::None;
-    game_started.compare_exchange_strong(desired, recomp::Game::Quit);
-    game_started.notify_all();
+    run.game_started.compare_exchange_strong(desired, recomp::Game::Quit);
+    run.game_started.notify_all();
+
+    // None of the service threads poll for the quit request, so wake each of them up to let them see it.
+    ultramodern::wake_event_threads();
+    ultramodern::wake_thread_cleaner_thread();
+    ultramodern::wake_saving_thread();
+    if (run.wake_gfx_callback != nullptr) {
+        run.wake_gfx_callback(run.wake_gfx_data);
+    }
+}
+
+bool ultramodern::quit_requested() {
+    return run_context().exited.load();
+}
+
+static ultramodern::huge_pages::Allocation allocate_rdram() {
+    // Guest memory accesses are spread across all of RDRAM, so it's put on huge pages where possible. Recompiled code
+    // addresses RDRAM with a sign-extended 32-bit address plus a 16-bit displacement, relative to 0x80000000, so it's placed
+    // inside a reservation covering all of the 4GB (and the displacement past either end) that this can reach. Invalid game
+    // pointers then fault instead of silently reading or corrupting host memory.
+    constexpr size_t rdram_reserve_before = 64 * 1024;
+    constexpr size_t rdram_reserve_after = 0x100000000ULL + 64 * 1024 - ultramodern::rdram_size;
+    return ultramodern::huge_pages::allocate(ultramodern::rdram_size, rdram_reserve_before, rdram_reserve_after);
+}
+
+// Runs on each instance's game start thread. The ROM is shared between instances, so only the first one loads it.
+static void run_game(ultramodern::WindowHandle window_handle, uint8_t* rdram, bool load_rom) {
+    debug_printf("[Recomp] Starting\n");
+    
+    ultramodern::set_native_thread_name("Game Start Thread");
+    
+    ultramodern::preinit(rdram, window_handle);
+
+    RunContext& run = run_context();
+    run.game_started.wait(recomp::Game::None);
+    recomp_context context{};
+
+    switch (run.game_started.load()) {
+        case recomp::Game::MM:
+            if (load_rom && !recomp::load_stored_rom(recomp::Game::MM)) {
+                recomp::message_box("Error opening stored ROM! Please restart this program.");
+            }
+            ultramodern::load_shader_cache({mm_shader_cache_bytes, sizeof(mm_shader_cache_bytes)}, recomp::get_app_folder_path() / "mm_shader_cache_user.bin");
+            init(rdram, &context);
+            try {
+                recomp_entrypoint(rdram, &context);
+            } catch (ultramodern::thread_terminated& terminated) {
+
+            } 
+            break;
+        case recomp::Game::Quit:
+            break;
+    }
+    
+    debug_printf("[Recomp] Quitting\n");
+}
+
+// Waits for the calling thread's instance to finish shutting down after it's been asked to quit.
+static void join_instance_threads(std::thread& game_thread) {
+    game_thread.join();
+    ultramodern::join_event_threads();
+    ultramodern::join_thread_cleaner_thread();
+    ultramodern::join_saving_thread();
+    ultramodern::join_timer_thread();
+}
+
+struct recomp::InstanceHandle {
+    ultramodern::huge_pages::Allocation rdram;
+    std::unique_ptr<ultramodern::Instance> instance;
+    std::thread game_thread;
+};
+
+// Instances started with start_instance that haven't been stopped yet.
+static std::mutex extra_instances_mutex;
+static std::vector<std::unique_ptr<recomp::InstanceHandle>> extra_instances;
+
+recomp::InstanceHandle* recomp::start_instance(recomp::Game game, ultramodern::WindowHandle window_handle, const ultramodern::audio_callbacks_t& audio_callbacks, const ultramodern::input_callbacks_t& input_callbacks, const std::filesystem::path& save_file_path) {
+    if (!recomp::is_rom_loaded()) {
+        return nullptr;
+    }
+
+    auto handle = std::make_unique<recomp::InstanceHandle>();
+    handle->rdram = allocate_rdram();
+    ultramodern::guest_faults::add_reservation(handle->rdram.get(), handle->rdram.reservation(), handle->rdram.reservation_size());
+    handle->instance = std::make_unique<ultramodern::Instance>(handle->rdram.get());
+    handle->instance->save_file_path = save_file_path;
+
+    {
+        // Bind the calling thread to the new instance while setting it up, which also makes the game thread inherit it.
+        ultramodern::InstanceScope instance_scope{ *handle->instance };
+        set_audio_callbacks(audio_callbacks);
+        set_input_callbacks(input_callbacks);
+        recomp::start_game(game);
+        handle->game_thread = ultramodern::create_instance_thread(run_game, window_handle, handle->rdram.get(), false);
+    }
+
+    std::lock_guard lock{ extra_instances_mutex };
+    return extra_instances.emplace_back(std::move(handle)).get();
+}
+
+static void stop_extra_instance(std::unique_ptr<recomp::InstanceHandle> handle) {
+    ultramodern::InstanceScope instance_scope{ *handle->instance };
+    ultramodern::quit();
+    join_instance_threads(handle->game_thread);
+    ultramodern::guest_faults::remove_reservation(handle->rdram.get());
+}
+
+void recomp::stop_instance(recomp::InstanceHandle* instance) {
+    std::unique_ptr<recomp::InstanceHandle> handle;
+    {
+        std::lock_guard lock{ extra_instances_mutex };
+        auto it = std::find_if(extra_instances.begin(), extra_instances.end(),
+            [instance](const std::unique_ptr<recomp::InstanceHandle>& cur) { return cur.get() == instance; });
+        if (it == extra_instances.end()) {
+            return;
+        }
+        handle = std::move(*it);
+        extra_instances.erase(it);
+    }
+    stop_extra_instance(std::move(handle));
 }
 
 void recomp::start(ultramodern::WindowHandle window_handle, const ultramodern::audio_callbacks_t& audio_callbacks, const ultramodern::input_callbacks_t& input_callbacks, const ultramodern::gfx_callbacks_t& gfx_callbacks_) {
     recomp::check_all_stored_roms();
-    set_audio_callbacks(audio_callbacks);
-    set_input_callbacks(input_callbacks);
 
     ultramodern::gfx_callbacks_t gfx_callbacks = gfx_callbacks_;
 
@@ -394,48 +552,60 @@ void recomp::start(ultramodern::WindowHandle window_handle, const ultramodern::a
         }
     }
 
-    // Allocate rdram_buffer
-    std::unique_ptr<uint8_t[]> rdram_buffer = std::make_unique<uint8_t[]>(ultramodern::rdram_size);
-    std::memset(rdram_buffer.get(), 0, ultramodern::rdram_size);
-
-    std::thread game_thread{[](ultramodern::WindowHandle window_handle, uint8_t* rdram) {
-        debug_printf("[Recomp] Starting\n");
-        
-        ultramodern::set_native_thread_name("Game Start Thread");
-        
-        ultramodern::preinit(rdram, window_handle);
-
-        game_started.wait(recomp::Game::None);
-        recomp_context context{};
-
-        switch (game_started.load()) {
-            case recomp::Game::MM:
-                if (!recomp::load_stored_rom(recomp::Game::MM)) {
-                    recomp::message_box("Error opening stored ROM! Please restart this program.");
-                }
-                ultramodern::load_shader_cache({mm_shader_cache_bytes, sizeof(mm_shader_cache_bytes)});
-                init(rdram, &context);
-                try {
-                    recomp_entrypoint(rdram, &context);
-                } catch (ultramodern::thread_terminated& terminated) {
-
-                } 
-                break;
-            case recomp::Game::Quit:
-                break;
-        }
-        
-        debug_printf("[Recomp] Quitting\n");
-    }, window_handle, rdram_buffer.get()};
+    // Remapping the code has to happen before the game's threads start running it.
+#ifdef RECOMP_HOT_TEXT_MARKERS
+    ultramodern::huge_pages::remap_hot_code(stdout, reinterpret_cast<const void*>(&recomp_hot_text_begin),
+        reinterpret_cast<const void*>(&recomp_hot_text_end));
+#else
+    ultramodern::huge_pages::remap_hot_code(stdout, nullptr, nullptr);
+#endif
 
-    while (!exited) {
-        ultramodern::sleep_milliseconds(1);
+    ultramodern::huge_pages::Allocation rdram_buffer = allocate_rdram();
+    rdram_buffer.report(stdout, "RDRAM");
+    ultramodern::guest_faults::install(rdram_buffer.get(), rdram_buffer.reservation(), rdram_buffer.reservation_size(),
+        recompiled_host_functions());
+
+    // All of the game's runtime state lives in this instance. The main thread is bound to it as well, since the UI and input
+    // handling running on it talk to the instance's event threads.
+    ultramodern::Instance::add_thread_bind_callback(bind_overlays);
+    ultramodern::profiler::set_symbolizer(symbolize_recompiled_function);
+    ultramodern::Instance instance{ rdram_buffer.get() };
+    ultramodern::InstanceScope instance_scope{ instance };
+
+    set_audio_callbacks(audio_callbacks);
+    set_input_callbacks(input_callbacks);
+
+    RunContext& run = run_context();
+    run.wake_gfx_data = gfx_data;
+    run.wake_gfx_callback = gfx_callbacks.wake_gfx;
+
+    std::thread game_thread = ultramodern::create_instance_thread(run_game, window_handle, rdram_buffer.get(), true);
+
+    // update_gfx blocks until the main thread has something to do, and quit() wakes it up through wake_gfx.
+    while (!run.exited) {
         if (gfx_callbacks.update_gfx != nullptr) {
             gfx_callbacks.update_gfx(gfx_data);
         }
+        else {
+            run.exited.wait(false);
+        }
     }
-    game_thread.join();
-    ultramodern::join_event_threads();
-    ultramodern::join_thread_cleaner_thread();
-    ultramodern::join_saving_thread();
+
+    // Stop any other instances first, as they share the UI and the ROM with this one.
+    std::vector<std::unique_ptr<recomp::InstanceHandle>> remaining_instances;
+    {
+        std::lock_guard lock{ extra_instances_mutex };
+        remaining_instances = std::move(extra_instances);
+        extra_instances.clear();
+    }
+    for (std::unique_ptr<recomp::InstanceHandle>& handle : remaining_instances) {
+        stop_extra_instance(std::move(handle));
+    }
+
+    join_instance_threads(game_thread);
+    ultramodern::profiler::stop_and_report(stdout);
+    ultramodern::func_counters::report(stdout);
+    ultramodern::func_counters::write_function_order();
+
+    ultramodern::sync_stats::dump(stdout);
 }
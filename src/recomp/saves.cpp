@@ -0,0 +1,144 @@
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include "recomp.h"
+#include "../ultramodern/ultra64.h"
+#include "../ultramodern/ultramodern.hpp"
+#include "../ultramodern/sync_stats.hpp"
+#include "../ultramodern/instance.hpp"
+
+// The save buffer that backs SRAM, flashram and EEPROM, and the thread that writes it out to the save file. Kept apart from
+// the rest of the PI code so that it builds without the rest of the runtime.
+
+namespace {
+    // Per-instance save data.
+    struct SaveContext {
+        std::array<char, 0x20000> save_buffer;
+        std::thread saving_thread;
+        moodycamel::LightweightSemaphore write_sempahore;
+        ultramodern::InstrumentedMutex save_buffer_mutex{ "save_buffer_mutex" };
+        // Set by every write to the save buffer. The semaphore is also signaled on quit, so this tells the two apart.
+        std::atomic_bool save_buffer_dirty = false;
+    };
+}
+
+static SaveContext& save_context() {
+    return ultramodern::current_instance().state<SaveContext>();
+}
+
+std::filesystem::path default_save_file_path();
+
+std::filesystem::path get_save_file_path() {
+    const std::filesystem::path& instance_save_path = ultramodern::current_instance().save_file_path;
+    if (!instance_save_path.empty()) {
+        return instance_save_path;
+    }
+    return default_save_file_path();
+}
+
+void update_save_file() {
+    SaveContext& saves = save_context();
+    std::ofstream save_file{ get_save_file_path(), std::ios_base::binary };
+
+    if (save_file.good()) {
+        std::lock_guard lock{ saves.save_buffer_mutex };
+        save_file.write(saves.save_buffer.data(), saves.save_buffer.size());
+    } else {
+        fprintf(stderr, "Failed to save!\n");
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+void saving_thread_func(RDRAM_ARG1) {
+    SaveContext& saves = save_context();
+    while (!ultramodern::quit_requested()) {
+        // Sleep until the first write comes in. Quitting signals the semaphore as well, so this doesn't need a timeout.
+        saves.write_sempahore.wait();
+
+        constexpr int64_t wait_time_microseconds = 10000;
+        constexpr int max_actions = 128;
+        int num_actions = 1;
+
+        // Wait up to the given timeout for further writes to come in. Allow multiple writes to coalesce together into a single save.
+        // Cap the number of coalesced writes to guarantee that the save buffer eventually gets written out to the file even if the game
+        // is constantly sending writes.
+        while (!ultramodern::quit_requested() && num_actions < max_actions && saves.write_sempahore.wait(wait_time_microseconds)) {
+            num_actions++;
+        }
+
+        // If an action came through that affected the save file, save the updated contents. This also flushes any pending writes on quit.
+        if (saves.save_buffer_dirty.exchange(false)) {
+            update_save_file();
+        }
+    }
+}
+
+void save_write_ptr(const void* in, uint32_t offset, uint32_t count) {
+    SaveContext& saves = save_context();
+    {
+        std::lock_guard lock { saves.save_buffer_mutex };
+        memcpy(&saves.save_buffer[offset], in, count);
+    }
+    
+    saves.save_buffer_dirty.store(true);
+    saves.write_sempahore.signal();
+}
+
+void save_write(RDRAM_ARG PTR(void) rdram_address, uint32_t offset, uint32_t count) {
+    SaveContext& saves = save_context();
+    {
+        std::lock_guard lock { saves.save_buffer_mutex };
+        recomp::rdram::copy_out(rdram, rdram_address, saves.save_buffer.data() + offset, count);
+    }
+
+    saves.save_buffer_dirty.store(true);
+    saves.write_sempahore.signal();
+}
+
+void save_read(RDRAM_ARG PTR(void) rdram_address, uint32_t offset, uint32_t count) {
+    SaveContext& saves = save_context();
+    std::lock_guard lock { saves.save_buffer_mutex };
+    recomp::rdram::copy_in(rdram, rdram_address, saves.save_buffer.data() + offset, count);
+}
+
+void save_clear(uint32_t start, uint32_t size, char value) {
+    SaveContext& saves = save_context();
+    {
+        std::lock_guard lock { saves.save_buffer_mutex };
+        std::fill_n(saves.save_buffer.begin() + start, size, value);
+    }
+
+    saves.save_buffer_dirty.store(true);
+    saves.write_sempahore.signal();
+}
+
+void ultramodern::init_saving(RDRAM_ARG1) {
+    SaveContext& saves = save_context();
+    std::filesystem::path save_file_path = get_save_file_path();
+
+    // Ensure the save file directory exists.
+    std::filesystem::create_directories(save_file_path.parent_path());
+
+    // Read the save file if it exists.
+    std::ifstream save_file{ save_file_path, std::ios_base::binary };
+    if (save_file.good()) {
+        save_file.read(saves.save_buffer.data(), saves.save_buffer.size());
+    } else {
+        // Otherwise clear the save file to all zeroes.
+        saves.save_buffer.fill(0);
+    }
+
+    saves.saving_thread = ultramodern::create_instance_thread(saving_thread_func, PASS_RDRAM1);
+}
+
+void ultramodern::wake_saving_thread() {
+    save_context().write_sempahore.signal();
+}
+
+void ultramodern::join_saving_thread() {
+    save_context().saving_thread.join();
+}
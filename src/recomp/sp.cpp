@@ -22,13 +22,11 @@ extern "C" void osSpTaskStartGo_recomp(uint8_t* rdram, recomp_context* ctx) {
         char addr_str[32];
         constexpr size_t ram_size = 0x800000;
         std::unique_ptr<char[]> ram_unswapped = std::make_unique<char[]>(ram_size);
-        snprintf(addr_str, sizeof(addr_str) - 1, "%08X", task->t.data_ptr);
+        snprintf(addr_str, sizeof(addr_str) - 1, "%08X", (uint32_t)task->t.data_ptr);
         addr_str[sizeof(addr_str) - 1] = '\0';
         std::ofstream dump_file{ "ramdump" + std::string{ addr_str } + ".bin", std::ios::binary};
 
-        for (size_t i = 0; i < ram_size; i++) {
-            ram_unswapped[i] = rdram[i ^ 3];
-        }
+        recomp::rdram::copy_out(rdram, 0x80000000, ram_unswapped.get(), ram_size);
 
         dump_file.write(ram_unswapped.get(), ram_size);
         dump_frame = false;
@@ -0,0 +1,173 @@
+#ifndef UI_ATLAS_PACKER_H
+#define UI_ATLAS_PACKER_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace RecompRml {
+    // Shelf packer for a fixed-size texture atlas. Rectangles are placed left to right on horizontal shelves, with each shelf
+    // being as tall as the first rectangle placed on it. Released rectangles leave a free span on their shelf that later
+    // rectangles of a similar height can reuse, and a shelf with nothing left on it can be reused for any height that fits.
+    class ShelfPacker {
+    public:
+        struct Rect {
+            uint32_t x;
+            uint32_t y;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        ShelfPacker(uint32_t width, uint32_t height) : width_(width), height_(height) {}
+
+        bool pack(uint32_t width, uint32_t height, Rect& out) {
+            if (width == 0 || height == 0 || width > width_ || height > height_) {
+                return false;
+            }
+
+            // Pick the shortest shelf that fits the rectangle without wasting too much of its height.
+            Shelf* best_shelf = nullptr;
+            for (Shelf& shelf : shelves_) {
+                if (shelf.height < height || (shelf.live_count != 0 && shelf.height > height + height / 2 + shelf_height_granularity)) {
+                    continue;
+                }
+
+                if (shelf.live_count != 0 && !shelf.has_room(width)) {
+                    continue;
+                }
+
+                if (best_shelf == nullptr || shelf.height < best_shelf->height) {
+                    best_shelf = &shelf;
+                }
+            }
+
+            // Open a new shelf if none of the existing ones had room.
+            if (best_shelf == nullptr) {
+                uint32_t shelf_height = std::min(round_up(height, shelf_height_granularity), height_ - next_y_);
+                if (next_y_ >= height_ || shelf_height < height) {
+                    return false;
+                }
+
+                best_shelf = &shelves_.emplace_back(Shelf{ .y = next_y_, .height = shelf_height, .atlas_width = width_ });
+                next_y_ += shelf_height;
+            }
+
+            out.x = best_shelf->allocate(width);
+            out.y = best_shelf->y;
+            out.width = width;
+            out.height = height;
+            used_area_ += uint64_t(width) * height;
+            return true;
+        }
+
+        void release(const Rect& rect) {
+            auto shelf_it = std::find_if(shelves_.begin(), shelves_.end(), [&rect](const Shelf& shelf) { return shelf.y == rect.y; });
+            if (shelf_it == shelves_.end()) {
+                return;
+            }
+
+            used_area_ -= uint64_t(rect.width) * rect.height;
+            shelf_it->free(rect.x, rect.width);
+
+            // Give trailing empty shelves back to the unallocated space at the bottom of the atlas so they can be resized.
+            while (!shelves_.empty() && shelves_.back().live_count == 0) {
+                next_y_ = shelves_.back().y;
+                shelves_.pop_back();
+            }
+        }
+
+        uint64_t used_area() const { return used_area_; }
+        uint64_t total_area() const { return uint64_t(width_) * height_; }
+        bool empty() const { return used_area_ == 0; }
+    private:
+        static constexpr uint32_t shelf_height_granularity = 4;
+
+        struct Span {
+            uint32_t x;
+            uint32_t width;
+        };
+
+        struct Shelf {
+            uint32_t y;
+            uint32_t height;
+            uint32_t cursor_x = 0;
+            uint32_t live_count = 0;
+            uint32_t atlas_width = 0;
+            std::vector<Span> free_spans{};
+
+            bool has_room(uint32_t width) const {
+                if (atlas_width - cursor_x >= width) {
+                    return true;
+                }
+                return std::any_of(free_spans.begin(), free_spans.end(), [width](const Span& span) { return span.width >= width; });
+            }
+
+            uint32_t allocate(uint32_t width) {
+                live_count++;
+
+                // Reuse a released span if one is large enough, otherwise take space from the end of the shelf.
+                for (auto it = free_spans.begin(); it != free_spans.end(); ++it) {
+                    if (it->width >= width) {
+                        uint32_t x = it->x;
+                        it->x += width;
+                        it->width -= width;
+                        if (it->width == 0) {
+                            free_spans.erase(it);
+                        }
+                        return x;
+                    }
+                }
+
+                uint32_t x = cursor_x;
+                cursor_x += width;
+                return x;
+            }
+
+            void free(uint32_t x, uint32_t width) {
+                live_count--;
+
+                if (live_count == 0) {
+                    cursor_x = 0;
+                    free_spans.clear();
+                    return;
+                }
+
+                // Merge the span with any neighbouring free spans.
+                for (auto it = free_spans.begin(); it != free_spans.end();) {
+                    if (it->x + it->width == x) {
+                        x = it->x;
+                        width += it->width;
+                        it = free_spans.erase(it);
+                    }
+                    else if (x + width == it->x) {
+                        width += it->width;
+                        it = free_spans.erase(it);
+                    }
+                    else {
+                        ++it;
+                    }
+                }
+
+                // Spans that reach the end of the used part of the shelf just move the cursor back.
+                if (x + width == cursor_x) {
+                    cursor_x = x;
+                }
+                else {
+                    free_spans.emplace_back(Span{ x, width });
+                }
+            }
+        };
+
+        static uint32_t round_up(uint32_t value, uint32_t multiple) {
+            return ((value + multiple - 1) / multiple) * multiple;
+        }
+
+        uint32_t width_;
+        uint32_t height_;
+        uint32_t next_y_ = 0;
+        uint64_t used_area_ = 0;
+        std::vector<Shelf> shelves_{};
+    };
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "RmlUi/Core.h"
+#include "RmlUi/Core/MeshUtilities.h"
+#include "lunasvg.h"
+
+#include "ui_cached_svg.hpp"
+#include "ui_raster_cache.hpp"
+
+namespace {
+    // Same behavior as the SVG plugin's ElementSVG, except that rasterized bitmaps are looked up in the raster cache first.
+    class ElementCachedSVG : public Rml::Element {
+    public:
+        ElementCachedSVG(const Rml::String& tag) : Rml::Element(tag) {}
+
+        bool GetIntrinsicDimensions(Rml::Vector2f& dimensions, float& ratio) override {
+            if (source_dirty_) {
+                load_source();
+            }
+
+            dimensions = intrinsic_dimensions_;
+            if (const Rml::Variant* width = GetAttribute("width")) {
+                dimensions.x = width->Get<float>();
+            }
+            if (const Rml::Variant* height = GetAttribute("height")) {
+                dimensions.y = height->Get<float>();
+            }
+            if (dimensions.y > 0) {
+                ratio = dimensions.x / dimensions.y;
+            }
+            return true;
+        }
+
+    protected:
+        void OnRender() override {
+            if (svg_document_ == nullptr) {
+                return;
+            }
+            if (geometry_dirty_) {
+                generate_geometry();
+            }
+            update_texture();
+            geometry_.Render(GetAbsoluteOffset(Rml::BoxArea::Content), texture_);
+        }
+
+        void OnResize() override {
+            geometry_dirty_ = true;
+            texture_dirty_ = true;
+        }
+
+        void OnAttributeChange(const Rml::ElementAttributes& changed_attributes) override {
+            Rml::Element::OnAttributeChange(changed_attributes);
+            if (changed_attributes.count("src") != 0) {
+                source_dirty_ = true;
+                DirtyLayout();
+            }
+            if (changed_attributes.count("width") != 0 || changed_attributes.count("height") != 0) {
+                DirtyLayout();
+            }
+        }
+
+        void OnPropertyChange(const Rml::PropertyIdSet& changed_properties) override {
+            Rml::Element::OnPropertyChange(changed_properties);
+            if (changed_properties.Contains(Rml::PropertyId::ImageColor) || changed_properties.Contains(Rml::PropertyId::Opacity)) {
+                geometry_dirty_ = true;
+            }
+        }
+
+    private:
+        void load_source() {
+            source_dirty_ = false;
+            texture_dirty_ = true;
+            intrinsic_dimensions_ = Rml::Vector2f{};
+            svg_document_.reset();
+            asset_hash_ = 0;
+
+            const Rml::String src = GetAttribute<Rml::String>("src", "");
+            if (src.empty()) {
+                return;
+            }
+
+            Rml::String path = src;
+            if (Rml::ElementDocument* document = GetOwnerDocument()) {
+                const Rml::String document_url = Rml::StringUtilities::Replace(document->GetSourceURL(), '|', ':');
+                Rml::GetSystemInterface()->JoinPath(path, document_url, src);
+            }
+
+            Rml::String svg_data;
+            if (path.empty() || !Rml::GetFileInterface()->LoadFile(path, svg_data)) {
+                Rml::Log::Message(Rml::Log::LT_WARNING, "Could not load SVG file %s", path.c_str());
+                return;
+            }
+
+            // The document is still parsed to lay the element out, but parsing is cheap next to rendering it.
+            svg_document_ = lunasvg::Document::loadFromData(svg_data);
+            if (svg_document_ == nullptr) {
+                Rml::Log::Message(Rml::Log::LT_WARNING, "Could not parse SVG file %s", path.c_str());
+                return;
+            }
+
+            asset_hash_ = RecompRml::raster_cache_asset_hash(svg_data.data(), svg_data.size());
+            intrinsic_dimensions_.x = Rml::Math::Max(float(svg_document_->width()), 1.0f);
+            intrinsic_dimensions_.y = Rml::Math::Max(float(svg_document_->height()), 1.0f);
+        }
+
+        void generate_geometry() {
+            Rml::RenderManager* render_manager = GetRenderManager();
+            if (render_manager == nullptr) {
+                return;
+            }
+
+            Rml::Mesh mesh = geometry_.Release(Rml::Geometry::ReleaseMode::ClearMesh);
+            const Rml::ComputedValues& computed = GetComputedValues();
+            Rml::ColourbytePremultiplied colour = computed.image_color().ToPremultiplied(computed.opacity());
+            Rml::MeshUtilities::GenerateQuad(mesh, Rml::Vector2f{ 0, 0 }, GetBox().GetSize(Rml::BoxArea::Content).Round(), colour);
+            geometry_ = render_manager->MakeGeometry(std::move(mesh));
+            geometry_dirty_ = false;
+        }
+
+        void update_texture() {
+            if (!texture_dirty_) {
+                return;
+            }
+            Rml::RenderManager* render_manager = GetRenderManager();
+            if (render_manager == nullptr) {
+                return;
+            }
+
+            const Rml::Vector2i dimensions = Rml::Vector2i(GetBox().GetSize(Rml::BoxArea::Content).Round());
+            Rml::Context* context = GetContext();
+            float dpi_scale = context != nullptr ? context->GetDensityIndependentPixelRatio() : 1.0f;
+
+            texture_ = render_manager->MakeCallbackTexture([this, dimensions, dpi_scale](const Rml::CallbackTextureInterface& texture_interface) -> bool {
+                if (dimensions.x <= 0 || dimensions.y <= 0) {
+                    return false;
+                }
+
+                uint64_t key = RecompRml::raster_cache_key(asset_hash_, dimensions.x, dimensions.y, dpi_scale);
+                RecompRml::RasterCacheEntry entry{};
+                if (asset_hash_ != 0 && RecompRml::raster_cache_load(key, entry) &&
+                    entry.width == uint32_t(dimensions.x) && entry.height == uint32_t(dimensions.y))
+                {
+                    return texture_interface.GenerateTexture({ entry.pixels(), size_t(entry.width) * entry.height * 4 }, dimensions);
+                }
+
+                lunasvg::Bitmap bitmap = svg_document_->renderToBitmap(dimensions.x, dimensions.y);
+                if (bitmap.data() == nullptr) {
+                    return false;
+                }
+
+                // lunasvg renders premultiplied BGRA, while textures are premultiplied RGBA.
+                std::vector<Rml::byte> pixels(size_t(dimensions.x) * dimensions.y * 4);
+                for (int row = 0; row < dimensions.y; row++) {
+                    const uint8_t* src_row = bitmap.data() + size_t(row) * bitmap.stride();
+                    Rml::byte* dst_row = pixels.data() + size_t(row) * dimensions.x * 4;
+                    for (int col = 0; col < dimensions.x; col++) {
+                        dst_row[col * 4 + 0] = src_row[col * 4 + 2];
+                        dst_row[col * 4 + 1] = src_row[col * 4 + 1];
+                        dst_row[col * 4 + 2] = src_row[col * 4 + 0];
+                        dst_row[col * 4 + 3] = src_row[col * 4 + 3];
+                    }
+                }
+
+                if (asset_hash_ != 0) {
+                    RecompRml::raster_cache_store(key, pixels.data(), dimensions.x, dimensions.y);
+                }
+                return texture_interface.GenerateTexture({ pixels.data(), pixels.size() }, dimensions);
+            });
+            texture_dirty_ = false;
+        }
+
+        bool source_dirty_ = true;
+        bool geometry_dirty_ = true;
+        bool texture_dirty_ = true;
+        uint64_t asset_hash_ = 0;
+        Rml::Vector2f intrinsic_dimensions_{};
+        std::unique_ptr<lunasvg::Document> svg_document_{};
+        Rml::Geometry geometry_{};
+        Rml::CallbackTexture texture_{};
+    };
+
+    Rml::ElementInstancerGeneric<ElementCachedSVG> cached_svg_instancer{};
+}
+
+void RecompRml::register_cached_svg_element() {
+    Rml::Factory::RegisterElementInstancer("svg", &cached_svg_instancer);
+}
@@ -0,0 +1,11 @@
+#ifndef UI_CACHED_SVG_H
+#define UI_CACHED_SVG_H
+
+namespace RecompRml {
+    // Replaces the SVG plugin's <svg> element with one that takes its rasterized bitmaps from the raster cache, so lunasvg only
+    // renders an image the first time it's shown at a given size and DPI scale. Must be called after Rml::Initialise, which is
+    // where the plugin registers its own element.
+    void register_cached_svg_element();
+}
+
+#endif
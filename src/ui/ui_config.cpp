@@ -31,6 +31,7 @@ namespace recomp {
 	void PromptContext::close_prompt() {
 		open = false;
 		model_handle.DirtyVariable("prompt__open");
+		recomp::invalidate_ui();
 	}
 
 	void PromptContext::open_prompt(
@@ -62,6 +63,7 @@ namespace recomp {
 		model_handle.DirtyVariable("prompt__content");
 		model_handle.DirtyVariable("prompt__confirmLabel");
 		model_handle.DirtyVariable("prompt__cancelLabel");
+		recomp::invalidate_ui();
 		shouldFocus = true;
 	}
 
@@ -170,6 +172,7 @@ void recomp::finish_scanning_input(recomp::InputField scanned_field) {
 	controls_model_handle.DirtyVariable("inputs");
 	controls_model_handle.DirtyVariable("active_binding_input");
 	controls_model_handle.DirtyVariable("active_binding_slot");
+	recomp::invalidate_ui();
 }
 
 void recomp::cancel_scanning_input() {
@@ -179,6 +182,7 @@ void recomp::cancel_scanning_input() {
 	controls_model_handle.DirtyVariable("inputs");
 	controls_model_handle.DirtyVariable("active_binding_input");
 	controls_model_handle.DirtyVariable("active_binding_slot");
+	recomp::invalidate_ui();
 }
 
 void recomp::config_menu_set_cont_or_kb(bool cont_interacted) {
@@ -194,6 +198,8 @@ void recomp::config_menu_set_cont_or_kb(bool cont_interacted) {
 		if (graphics_model_handle) {
 			graphics_model_handle.DirtyVariable("gfx_help__apply");
 		}
+
+		recomp::invalidate_ui();
 	}
 }
 
@@ -289,6 +295,7 @@ void recomp::set_rumble_strength(int strength) {
 	control_options_context.rumble_strength = strength;
 	if (general_model_handle) {
 		general_model_handle.DirtyVariable("rumble_strength");
+		recomp::invalidate_ui();
 	}
 }
 
@@ -304,13 +311,24 @@ void recomp::set_gyro_sensitivity(int sensitivity) {
 	control_options_context.gyro_sensitivity = sensitivity;
 	if (general_model_handle) {
 		general_model_handle.DirtyVariable("gyro_sensitivity");
+		recomp::invalidate_ui();
 	}
 }
 
-void recomp::set_mouse_sensitivity(int sensitivity) {
+// Mouse aiming locks the cursor, which the event loop only applies when it runs, so wake it up when aiming is turned on or off.
+static void store_mouse_sensitivity(int sensitivity) {
+	bool was_enabled = control_options_context.mouse_sensitivity != 0;
 	control_options_context.mouse_sensitivity = sensitivity;
+	if (was_enabled != (sensitivity != 0)) {
+		recomp::wake_event_loop();
+	}
+}
+
+void recomp::set_mouse_sensitivity(int sensitivity) {
+	store_mouse_sensitivity(sensitivity);
 	if (general_model_handle) {
 		general_model_handle.DirtyVariable("mouse_sensitivity");
+		recomp::invalidate_ui();
 	}
 }
 
@@ -322,6 +340,7 @@ void recomp::set_targeting_mode(recomp::TargetingMode mode) {
 	control_options_context.targeting_mode = mode;
 	if (general_model_handle) {
 		general_model_handle.DirtyVariable("targeting_mode");
+		recomp::invalidate_ui();
 	}
 }
 
@@ -333,6 +352,7 @@ void recomp::set_background_input_mode(recomp::BackgroundInputMode mode) {
 	control_options_context.background_input_mode = mode;
 	if (general_model_handle) {
 		general_model_handle.DirtyVariable("background_input_mode");
+		recomp::invalidate_ui();
 	}
 	SDL_SetHint(
 		SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS,
@@ -350,6 +370,7 @@ void recomp::set_autosave_mode(recomp::AutosaveMode mode) {
 	control_options_context.autosave_mode = mode;
 	if (general_model_handle) {
 		general_model_handle.DirtyVariable("autosave_mode");
+		recomp::invalidate_ui();
 	}
 }
 
@@ -371,6 +392,7 @@ void recomp::reset_sound_settings() {
 	sound_options_context.reset();
 	if (sound_options_model_handle) {
 		sound_options_model_handle.DirtyAllVariables();
+		recomp::invalidate_ui();
 	}
 }
 
@@ -378,6 +400,7 @@ void recomp::set_bgm_volume(int volume) {
     sound_options_context.bgm_volume.store(volume);
 	if (sound_options_model_handle) {
 		sound_options_model_handle.DirtyVariable("bgm_volume");
+		recomp::invalidate_ui();
 	}
 }
 
@@ -389,6 +412,7 @@ void recomp::set_low_health_beeps_enabled(bool enabled) {
     sound_options_context.low_health_beeps_enabled.store((int)enabled);
 	if (sound_options_model_handle) {
 		sound_options_model_handle.DirtyVariable("low_health_beeps_enabled");
+		recomp::invalidate_ui();
 	}
 }
 
@@ -433,6 +457,7 @@ void recomp::update_rml_display_refresh_rate() {
 	uint32_t curRate = ultramodern::get_display_refresh_rate();
 	if (curRate != lastRate) {
 		graphics_model_handle.DirtyVariable("display_refresh_rate");
+		recomp::invalidate_ui();
 	}
 	lastRate = curRate;
 }
@@ -834,7 +859,13 @@ public:
 		
 		constructor.Bind("rumble_strength", &control_options_context.rumble_strength);
 		constructor.Bind("gyro_sensitivity", &control_options_context.gyro_sensitivity);
-		constructor.Bind("mouse_sensitivity", &control_options_context.mouse_sensitivity);
+		constructor.BindFunc("mouse_sensitivity",
+			[](Rml::Variant& out) { out = control_options_context.mouse_sensitivity; },
+			[](const Rml::Variant& in) {
+				store_mouse_sensitivity(in.Get<int>());
+				general_model_handle.DirtyVariable("mouse_sensitivity");
+			}
+		);
 		bind_option(constructor, "targeting_mode", &control_options_context.targeting_mode);
 		bind_option(constructor, "background_input_mode", &control_options_context.background_input_mode);
 		bind_option(constructor, "autosave_mode", &control_options_context.autosave_mode);
@@ -930,6 +961,7 @@ void recomp::set_debug_mode_enabled(bool enabled) {
 	debug_context.debug_enabled = enabled;
 	if (debug_context.model_handle) {
 		debug_context.model_handle.DirtyVariable("debug_enabled");
+		recomp::invalidate_ui();
 	}
 }
 
@@ -942,10 +974,12 @@ void recomp::update_supported_options() {
 	new_options = ultramodern::get_graphics_config();
 
 	graphics_model_handle.DirtyAllVariables();
+	recomp::invalidate_ui();
 }
 
 void recomp::toggle_fullscreen() {
 	new_options.wm_option = (new_options.wm_option == ultramodern::WindowMode::Windowed) ? ultramodern::WindowMode::Fullscreen : ultramodern::WindowMode::Windowed;
 	apply_graphics_config();
 	graphics_model_handle.DirtyVariable("wm_option");
+	recomp::invalidate_ui();
 }
@@ -0,0 +1,162 @@
+#ifndef UI_GEOMETRY_POOL_H
+#define UI_GEOMETRY_POOL_H
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+namespace RecompRml {
+    // First-fit allocator over a fixed number of elements. Free ranges are kept sorted by offset so that
+    // neighbouring ranges can be merged back together when an allocation is released.
+    class RangeAllocator {
+        std::map<uint32_t, uint32_t> free_ranges_{}; // offset -> count
+        uint32_t capacity_ = 0;
+        uint32_t used_ = 0;
+    public:
+        RangeAllocator(uint32_t capacity) : capacity_(capacity) {
+            free_ranges_.emplace(0, capacity);
+        }
+
+        bool allocate(uint32_t count, uint32_t& offset_out) {
+            for (auto it = free_ranges_.begin(); it != free_ranges_.end(); ++it) {
+                if (it->second >= count) {
+                    offset_out = it->first;
+                    uint32_t remaining = it->second - count;
+                    free_ranges_.erase(it);
+                    if (remaining != 0) {
+                        free_ranges_.emplace(offset_out + count, remaining);
+                    }
+                    used_ += count;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void free(uint32_t offset, uint32_t count) {
+            used_ -= count;
+            auto next_it = free_ranges_.lower_bound(offset);
+
+            // Merge with the following free range if it starts where this one ends.
+            if (next_it != free_ranges_.end() && next_it->first == offset + count) {
+                count += next_it->second;
+                next_it = free_ranges_.erase(next_it);
+            }
+
+            // Merge with the preceding free range if it ends where this one starts.
+            if (next_it != free_ranges_.begin()) {
+                auto prev_it = std::prev(next_it);
+                if (prev_it->first + prev_it->second == offset) {
+                    prev_it->second += count;
+                    return;
+                }
+            }
+
+            free_ranges_.emplace(offset, count);
+        }
+
+        uint32_t capacity() const { return capacity_; }
+        uint32_t used() const { return used_; }
+    };
+
+    // Suballocates compiled geometry from pages of vertex and index buffers. The buffers are created through the backend, which
+    // provides a `Buffer` type along with `create_vertex_buffer(count)` and `create_index_buffer(count)` returning
+    // `std::unique_ptr<Buffer>` (null on failure). The renderer implements it with RT64's RHI.
+    //
+    // The GPU may still be reading released geometry for the frame in flight, so released ranges only go back to the pages'
+    // free lists when the next frame starts.
+    template <typename Backend>
+    class GeometryPool {
+    public:
+        using Buffer = typename Backend::Buffer;
+
+        struct Page {
+            std::unique_ptr<Buffer> vertex_buffer;
+            std::unique_ptr<Buffer> index_buffer;
+            RangeAllocator vertices;
+            RangeAllocator indices;
+        };
+
+        struct Allocation {
+            uint32_t page;
+            uint32_t vertex_offset;
+            uint32_t num_vertices;
+            uint32_t index_offset;
+            uint32_t num_indices;
+        };
+
+        GeometryPool(Backend& backend, uint32_t page_vertex_count, uint32_t page_index_count) :
+            backend_(backend), page_vertex_count_(page_vertex_count), page_index_count_(page_index_count) {}
+
+        bool allocate(uint32_t num_vertices, uint32_t num_indices, Allocation& out) {
+            out.num_vertices = num_vertices;
+            out.num_indices = num_indices;
+
+            // Look for room in one of the existing pages first.
+            for (uint32_t page_index = 0; page_index < pages_.size(); page_index++) {
+                Page& page = pages_[page_index];
+                uint32_t vertex_offset, index_offset;
+                if (page.vertices.allocate(num_vertices, vertex_offset)) {
+                    if (page.indices.allocate(num_indices, index_offset)) {
+                        out.page = page_index;
+                        out.vertex_offset = vertex_offset;
+                        out.index_offset = index_offset;
+                        return true;
+                    }
+                    page.vertices.free(vertex_offset, num_vertices);
+                }
+            }
+
+            // None of the pages had room, so create a new one. Geometry larger than the default page size gets a page sized to fit it.
+            uint32_t vertex_count = std::max(page_vertex_count_, num_vertices);
+            uint32_t index_count = std::max(page_index_count_, num_indices);
+            Page page{
+                .vertex_buffer = backend_.create_vertex_buffer(vertex_count),
+                .index_buffer = backend_.create_index_buffer(index_count),
+                .vertices = RangeAllocator{ vertex_count },
+                .indices = RangeAllocator{ index_count },
+            };
+
+            if (page.vertex_buffer == nullptr || page.index_buffer == nullptr) {
+                return false;
+            }
+
+            // Allocations from a fresh page always succeed as the page is at least as large as the request.
+            out.page = uint32_t(pages_.size());
+            page.vertices.allocate(num_vertices, out.vertex_offset);
+            page.indices.allocate(num_indices, out.index_offset);
+            pages_.emplace_back(std::move(page));
+            return true;
+        }
+
+        // Queues an allocation to be freed when the next frame starts.
+        void release(const Allocation& allocation) {
+            released_.push_back(allocation);
+        }
+
+        // Returns the ranges released during the last frame to the pages' free lists.
+        void begin_frame() {
+            for (const Allocation& allocation : released_) {
+                Page& page = pages_[allocation.page];
+                page.vertices.free(allocation.vertex_offset, allocation.num_vertices);
+                page.indices.free(allocation.index_offset, allocation.num_indices);
+            }
+            released_.clear();
+        }
+
+        Page& page(uint32_t index) { return pages_[index]; }
+        const std::vector<Page>& pages() const { return pages_; }
+    private:
+        Backend& backend_;
+        uint32_t page_vertex_count_;
+        uint32_t page_index_count_;
+        std::vector<Page> pages_{};
+        std::vector<Allocation> released_{};
+    };
+}
+
+#endif
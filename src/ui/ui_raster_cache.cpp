@@ -0,0 +1,176 @@
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <system_error>
+
+#include "ui_raster_cache.hpp"
+#include "xxHash/xxh3.h"
+
+namespace {
+    // Bump this whenever the contents of an entry change meaning, which invalidates every existing entry.
+    constexpr uint32_t cache_version = 2;
+    constexpr uint32_t cache_magic = 0x49554352; // "RCUI"
+    constexpr uint64_t cache_size_budget = 64 * 1024 * 1024;
+    constexpr uint32_t bytes_per_pixel = 4;
+
+    struct EntryHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct {
+        std::filesystem::path directory;
+        bool enabled = false;
+        RecompRml::RasterCacheStats stats;
+    } cache_context;
+
+    std::filesystem::path entry_path(uint64_t key) {
+        char filename[32];
+        snprintf(filename, sizeof(filename), "%016llx.bin", static_cast<unsigned long long>(key));
+        return cache_context.directory / filename;
+    }
+}
+
+void RecompRml::raster_cache_init(const std::filesystem::path& directory) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        fprintf(stderr, "[UI] Failed to create raster cache directory: %s\n", ec.message().c_str());
+        cache_context.enabled = false;
+        return;
+    }
+
+    cache_context.directory = directory;
+    cache_context.enabled = true;
+
+    // Entries for assets that have since changed are never looked up again, so trim the least recently written entries
+    // whenever the cache grows past its budget.
+    struct CacheFile {
+        std::filesystem::path path;
+        std::filesystem::file_time_type write_time;
+        uint64_t size;
+    };
+    std::vector<CacheFile> files{};
+    uint64_t total_size = 0;
+
+    for (const auto& dir_entry : std::filesystem::directory_iterator{ directory, ec }) {
+        if (!dir_entry.is_regular_file(ec)) {
+            continue;
+        }
+        uint64_t size = dir_entry.file_size(ec);
+        files.emplace_back(CacheFile{ dir_entry.path(), dir_entry.last_write_time(ec), size });
+        total_size += size;
+    }
+
+    if (total_size > cache_size_budget) {
+        std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) { return a.write_time < b.write_time; });
+        for (const CacheFile& file : files) {
+            if (total_size <= cache_size_budget) {
+                break;
+            }
+            if (std::filesystem::remove(file.path, ec)) {
+                total_size -= file.size;
+            }
+        }
+    }
+}
+
+uint64_t RecompRml::raster_cache_asset_hash(const void* data, size_t size) {
+    uint64_t hash = XXH3_64bits(data, size);
+    return hash != 0 ? hash : 1;
+}
+
+uint64_t RecompRml::raster_cache_key(uint64_t asset_hash, uint32_t width, uint32_t height, float dpi_scale) {
+    struct {
+        uint64_t asset_hash;
+        uint32_t width;
+        uint32_t height;
+        uint32_t dpi_scale_milli;
+        uint32_t version;
+    } key_data{ asset_hash, width, height, uint32_t(dpi_scale * 1000.0f + 0.5f), cache_version };
+
+    return XXH3_64bits(&key_data, sizeof(key_data));
+}
+
+bool RecompRml::raster_cache_load(uint64_t key, RasterCacheEntry& out) {
+    if (!cache_context.enabled) {
+        return false;
+    }
+
+    std::ifstream file{ entry_path(key), std::ios::binary | std::ios::ate };
+    if (!file.good()) {
+        cache_context.stats.misses++;
+        return false;
+    }
+
+    size_t file_size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    out.data.resize(file_size);
+    file.read(reinterpret_cast<char*>(out.data.data()), file_size);
+
+    EntryHeader header;
+    if (!file.good() || file_size < sizeof(header)) {
+        cache_context.stats.misses++;
+        return false;
+    }
+    memcpy(&header, out.data.data(), sizeof(header));
+
+    // Reject entries from other versions, hash collisions in the filename and truncated writes.
+    if (header.magic != cache_magic || header.version != cache_version || header.key != key ||
+        file_size != sizeof(header) + size_t(header.width) * header.height * bytes_per_pixel)
+    {
+        cache_context.stats.misses++;
+        return false;
+    }
+
+    out.width = header.width;
+    out.height = header.height;
+    out.pixel_offset = sizeof(header);
+
+    cache_context.stats.hits++;
+    cache_context.stats.bytes_read += file_size;
+    return true;
+}
+
+void RecompRml::raster_cache_store(uint64_t key, const uint8_t* pixels, uint32_t width, uint32_t height) {
+    if (!cache_context.enabled) {
+        return;
+    }
+
+    EntryHeader header{ cache_magic, cache_version, key, width, height };
+    size_t pixel_bytes = size_t(width) * height * bytes_per_pixel;
+
+    // Write to a temporary file and rename it into place so a partially written entry is never picked up.
+    std::filesystem::path path = entry_path(key);
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file{ temp_path, std::ios::binary };
+        if (!file.good()) {
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(pixels), pixel_bytes);
+        if (!file.good()) {
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        return;
+    }
+
+    cache_context.stats.bytes_written += sizeof(header) + pixel_bytes;
+}
+
+RecompRml::RasterCacheStats RecompRml::raster_cache_get_stats() {
+    return cache_context.stats;
+}
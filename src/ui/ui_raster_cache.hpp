@@ -0,0 +1,43 @@
+#ifndef UI_RASTER_CACHE_H
+#define UI_RASTER_CACHE_H
+
+#include <cstdint>
+#include <vector>
+#include <filesystem>
+#include <string_view>
+
+namespace RecompRml {
+    // Content-addressed on-disk cache of rasterized UI images. Entries are keyed by a hash of the source asset combined with
+    // the raster's size and the DPI scale it was produced at, so a change to any of them simply misses and produces a new entry.
+    struct RasterCacheEntry {
+        std::vector<uint8_t> data;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        size_t pixel_offset = 0;
+
+        const uint8_t* pixels() const { return data.data() + pixel_offset; }
+    };
+
+    struct RasterCacheStats {
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+        uint64_t bytes_read = 0;
+        uint64_t bytes_written = 0;
+    };
+
+    // Opens the cache in the given directory and trims it down to its size budget.
+    void raster_cache_init(const std::filesystem::path& directory);
+
+    // Hashes an asset's contents, so that an entry is reused for identical assets wherever they're loaded from and missed as
+    // soon as an asset changes, even if its size and modification time don't. Never returns 0, which callers use for no asset.
+    uint64_t raster_cache_asset_hash(const void* data, size_t size);
+    uint64_t raster_cache_key(uint64_t asset_hash, uint32_t width, uint32_t height, float dpi_scale);
+
+    // Loads an entry with a single read. The pixels are tightly packed 32-bit RGBA.
+    bool raster_cache_load(uint64_t key, RasterCacheEntry& out);
+    void raster_cache_store(uint64_t key, const uint8_t* pixels, uint32_t width, uint32_t height);
+
+    RasterCacheStats raster_cache_get_stats();
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef UI_REDRAW_TRACKER_H
+#define UI_REDRAW_TRACKER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace RecompRml {
+    // Decides each frame whether the UI has to be updated and rendered, or whether the UI rendered on an earlier frame can be
+    // drawn again. The UI is redrawn when something invalidated it (input, a menu change, a data model change), when the swap
+    // chain was resized, when RmlUi's next update delay has passed (animations, transitions, caret blink) and at least once
+    // every max_retain_period in case a change was made without invalidating it.
+    //
+    // Keeping a frame to draw again means rendering the UI into a texture and then drawing that to the swap chain. That's
+    // required with MSAA, as the multisampled target has to be resolved anyway, but without it the copy is only worth it if
+    // the frame gets reused. So while the UI keeps changing frame after frame, it's drawn straight to the swap chain, and only
+    // the first frame after that goes through the texture so that it can be retained.
+    class RedrawTracker {
+    public:
+        using Clock = std::chrono::steady_clock;
+        static constexpr std::chrono::milliseconds max_retain_period{ 1000 };
+
+        enum class Action {
+            // Draw the retained frame again.
+            Retain,
+            // Update and render the UI into the retained texture, then draw that to the swap chain.
+            RenderRetained,
+            // Update and render the UI straight to the swap chain. Nothing is retained.
+            RenderDirect,
+        };
+
+        // Something changed what the UI displays. Can be called from any thread.
+        void invalidate() {
+            invalidated_.store(true, std::memory_order_relaxed);
+        }
+
+        Action begin_frame(Clock::time_point now, int width, int height, bool multisampled) {
+            bool invalidated = invalidated_.exchange(false, std::memory_order_relaxed);
+            bool resized = width != width_ || height != height_;
+            bool changed = invalidated || resized || now >= next_update_time_;
+            width_ = width;
+            height_ = height;
+
+            Action action;
+            if (!changed && has_retained_) {
+                action = Action::Retain;
+            }
+            else if (changed && !multisampled && rendered_last_frame_) {
+                action = Action::RenderDirect;
+            }
+            else {
+                action = Action::RenderRetained;
+            }
+
+            rendered_last_frame_ = action != Action::Retain;
+            if (action == Action::RenderDirect) {
+                has_retained_ = false;
+            }
+            else if (action == Action::RenderRetained) {
+                has_retained_ = true;
+            }
+            return action;
+        }
+
+        // Reports how long RmlUi can go without an update after rendering a frame, as given by Context::GetNextUpdateDelay.
+        void rendered(Clock::time_point now, double update_delay_seconds) {
+            std::chrono::duration<double> update_delay{ update_delay_seconds };
+            if (update_delay < max_retain_period) {
+                next_update_time_ = now + std::chrono::duration_cast<Clock::duration>(update_delay);
+            }
+            else {
+                next_update_time_ = now + max_retain_period;
+            }
+        }
+    private:
+        std::atomic_bool invalidated_ = true;
+        bool has_retained_ = false;
+        bool rendered_last_frame_ = false;
+        int width_ = 0;
+        int height_ = 0;
+        Clock::time_point next_update_time_{};
+    };
+}
+
+#endif
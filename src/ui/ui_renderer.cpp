@@ -4,11 +4,23 @@
 
 #include <fstream>
 #include <filesystem>
+#include <chrono>
+#include <cinttypes>
 
 #include "recomp_ui.h"
 #include "recomp_input.h"
 #include "recomp_game.h"
+#include "recomp_config.h"
+#include "recomp_training.h"
 #include "ui_rml_hacks.hpp"
+#include "ui_atlas_packer.hpp"
+#include "ui_geometry_pool.hpp"
+#include "ui_redraw_tracker.hpp"
+#include "ui_raster_cache.hpp"
+#include "ui_cached_svg.hpp"
+#include "../../ultramodern/perf_metrics.hpp"
+#include "../../ultramodern/func_counters.hpp"
+#include "../../ultramodern/instance.hpp"
 
 #include "concurrentqueue.h"
 
@@ -61,11 +73,61 @@ void CalculateTextureRowWidthPadding(uint32_t rowPitch, uint32_t &rowWidth, uint
 struct RmlPushConstants {
     Rml::Matrix4f transform;
     Rml::Vector2f translation;
+    Rml::Vector2f uv_offset;
+    Rml::Vector2f uv_scale;
 };
 
+static constexpr uint32_t no_atlas_page = UINT32_MAX;
+
 struct TextureHandle {
     std::unique_ptr<RT64::RenderTexture> texture;
     std::unique_ptr<RT64::RenderDescriptorSet> set;
+    // Textures packed into an atlas page don't own a texture or descriptor set and use the page's instead.
+    // The UV transform maps the texture's own coordinates onto its region of the page.
+    uint32_t atlas_page = no_atlas_page;
+    RecompRml::ShelfPacker::Rect atlas_rect{};
+    Rml::Vector2f uv_offset{ 0.0f, 0.0f };
+    Rml::Vector2f uv_scale{ 1.0f, 1.0f };
+};
+
+// A large texture that small UI textures (glyph pages, icons, the white texture) are packed into so that
+// consecutive draws using different textures can share one descriptor set.
+struct AtlasPage {
+    std::unique_ptr<RT64::RenderTexture> texture;
+    std::unique_ptr<RT64::RenderDescriptorSet> set;
+    RecompRml::ShelfPacker packer;
+};
+
+// Creates the buffers of compiled geometry pages with RT64's RHI.
+struct RhiGeometryBackend {
+    using Buffer = RT64::RenderBuffer;
+    RT64::RenderDevice* device = nullptr;
+
+    std::unique_ptr<RT64::RenderBuffer> create_vertex_buffer(uint32_t count) {
+        return device->createBuffer(RT64::RenderBufferDesc::VertexBuffer(count * sizeof(Rml::Vertex), RT64::RenderHeapType::DEFAULT));
+    }
+
+    std::unique_ptr<RT64::RenderBuffer> create_index_buffer(uint32_t count) {
+        return device->createBuffer(RT64::RenderBufferDesc::IndexBuffer(count * sizeof(int), RT64::RenderHeapType::DEFAULT));
+    }
+};
+
+using GeometryPool = RecompRml::GeometryPool<RhiGeometryBackend>;
+
+struct CompiledGeometry {
+    GeometryPool::Allocation allocation;
+    Rml::TextureHandle texture;
+};
+
+// Per-frame counters for UI rendering, accumulated over a log period.
+struct UIRenderStats {
+    uint64_t frames = 0;
+    uint64_t bytes_uploaded = 0;
+    uint64_t immediate_draws = 0;
+    uint64_t compiled_draws = 0;
+    uint64_t texture_binds = 0;
+    uint64_t skipped_frames = 0;
+    uint64_t direct_frames = 0;
 };
 
 static std::vector<char> read_file(const std::filesystem::path& filepath) {
@@ -102,6 +164,11 @@ class RmlRenderInterface_RT64 : public Rml::RenderInterfaceCompatibility {
     static constexpr uint32_t initial_upload_buffer_size = 1024 * 1024;
     static constexpr uint32_t initial_vertex_buffer_size = 512 * sizeof(Rml::Vertex);
     static constexpr uint32_t initial_index_buffer_size = 1024 * sizeof(int);
+    static constexpr uint32_t geometry_page_vertex_count = 64 * 1024;
+    static constexpr uint32_t geometry_page_index_count = 3 * geometry_page_vertex_count;
+    static constexpr uint32_t atlas_page_size = 2048;
+    static constexpr uint32_t atlas_max_texture_size = 512;
+    static constexpr uint32_t atlas_padding = 1;
     static constexpr RT64::RenderFormat RmlTextureFormat = RT64::RenderFormat::R8G8B8A8_UNORM;
     static constexpr RT64::RenderFormat RmlTextureFormatBgra = RT64::RenderFormat::B8G8R8A8_UNORM;
     static constexpr RT64::RenderFormat SwapChainFormat = RT64::RenderFormat::B8G8R8A8_UNORM;
@@ -132,6 +199,7 @@ class RmlRenderInterface_RT64 : public Rml::RenderInterfaceCompatibility {
     std::unique_ptr<RT64::RenderPipelineLayout> layout_{};
     std::unique_ptr<RT64::RenderPipeline> pipeline_{};
     std::unique_ptr<RT64::RenderPipeline> pipeline_ms_{};
+    std::unique_ptr<RT64::RenderPipeline> screen_pipeline_{};
     std::unique_ptr<RT64::RenderTexture> screen_texture_ms_{};
     std::unique_ptr<RT64::RenderTexture> screen_texture_{};
     std::unique_ptr<RT64::RenderFramebuffer> screen_framebuffer_{};
@@ -146,11 +214,22 @@ class RmlRenderInterface_RT64 : public Rml::RenderInterfaceCompatibility {
     uint32_t gTexture_descriptor_index;
     RT64::RenderInputSlot vertex_slot_{ 0, sizeof(Rml::Vertex) };
     RT64::RenderCommandList* list_ = nullptr;
+    bool drawing_direct_ = false;
     bool scissor_enabled_ = false;
     std::vector<std::unique_ptr<RT64::RenderBuffer>> stale_buffers_{};
+    RhiGeometryBackend geometry_backend_{};
+    GeometryPool geometry_pool_{ geometry_backend_, geometry_page_vertex_count, geometry_page_index_count };
+    std::unordered_map<Rml::CompiledGeometryHandle, CompiledGeometry> compiled_geometry_{};
+    Rml::CompiledGeometryHandle compiled_geometry_count_ = 1; // Start at 1 as 0 tells RmlUi that compilation failed
+    std::vector<AtlasPage> atlas_pages_{};
+    std::vector<std::pair<uint32_t, RecompRml::ShelfPacker::Rect>> released_atlas_rects_{};
+    const RT64::RenderDescriptorSet* bound_texture_set_ = nullptr;
+    UIRenderStats stats_{};
+    std::chrono::steady_clock::time_point stats_period_start_ = std::chrono::steady_clock::now();
 public:
     RmlRenderInterface_RT64(struct UIRenderContext* render_context) {
         render_context_ = render_context;
+        geometry_backend_.device = render_context->device;
 
         // Enable 4X MSAA if supported by the device.
         const RT64::RenderSampleCounts desired_sample_count = RT64::RenderSampleCount::COUNT_8;
@@ -234,21 +313,30 @@ public:
         if (multisampling_.sampleCount > 1) {
             pipeline_desc.multisampling = multisampling_;
             pipeline_ms_ = render_context->device->createGraphicsPipeline(pipeline_desc);
-
-            // Create the descriptor set for the screen drawer.
-            RT64::RenderDescriptorRange screen_descriptor_range(RT64::RenderDescriptorRangeType::TEXTURE, 2, 1);
-            screen_descriptor_set_ = render_context->device->createDescriptorSet(RT64::RenderDescriptorSetDesc(&screen_descriptor_range, 1));
-
-            // Create vertex buffer for the screen drawer (full-screen triangle).
-            screen_vertex_buffer_size_ = sizeof(Rml::Vertex) * 3;
-            screen_vertex_buffer_ = render_context->device->createBuffer(RT64::RenderBufferDesc::VertexBuffer(screen_vertex_buffer_size_, RT64::RenderHeapType::UPLOAD));
-            Rml::Vertex *vertices = (Rml::Vertex *)(screen_vertex_buffer_->map());
-            const Rml::ColourbPremultiplied white(255, 255, 255, 255);
-            vertices[0] = Rml::Vertex{ Rml::Vector2f(-1.0f, 1.0f), white, Rml::Vector2f(0.0f, 0.0f) };
-            vertices[1] = Rml::Vertex{ Rml::Vector2f(-1.0f, -3.0f), white, Rml::Vector2f(0.0f, 2.0f) };
-            vertices[2] = Rml::Vertex{ Rml::Vector2f(3.0f, 1.0f), white, Rml::Vector2f(2.0f, 0.0f) };
-            screen_vertex_buffer_->unmap();
         }
+
+        // The texture the UI is rendered into holds colors that were already blended against its transparent clear color,
+        // so it's drawn to the swap chain with premultiplied alpha. That gives the same result as drawing the UI straight to
+        // the swap chain, which matters as the two alternate depending on whether the frame is retained.
+        pipeline_desc.multisampling = RT64::RenderMultisampling();
+        pipeline_desc.renderTargetBlend[0].srcBlend = RT64::RenderBlend::ONE;
+        screen_pipeline_ = render_context->device->createGraphicsPipeline(pipeline_desc);
+
+        // The UI is rendered into an internal texture that's then drawn to the swap chain when it needs to be resolved
+        // (MSAA) or drawn again on later frames where nothing in it changed, see RecompRml::RedrawTracker.
+        // Create the descriptor set for the screen drawer.
+        RT64::RenderDescriptorRange screen_descriptor_range(RT64::RenderDescriptorRangeType::TEXTURE, 2, 1);
+        screen_descriptor_set_ = render_context->device->createDescriptorSet(RT64::RenderDescriptorSetDesc(&screen_descriptor_range, 1));
+
+        // Create vertex buffer for the screen drawer (full-screen triangle).
+        screen_vertex_buffer_size_ = sizeof(Rml::Vertex) * 3;
+        screen_vertex_buffer_ = render_context->device->createBuffer(RT64::RenderBufferDesc::VertexBuffer(screen_vertex_buffer_size_, RT64::RenderHeapType::UPLOAD));
+        Rml::Vertex *vertices = (Rml::Vertex *)(screen_vertex_buffer_->map());
+        const Rml::ColourbPremultiplied white(255, 255, 255, 255);
+        vertices[0] = Rml::Vertex{ Rml::Vector2f(-1.0f, 1.0f), white, Rml::Vector2f(0.0f, 0.0f) };
+        vertices[1] = Rml::Vertex{ Rml::Vector2f(-1.0f, -3.0f), white, Rml::Vector2f(0.0f, 2.0f) };
+        vertices[2] = Rml::Vertex{ Rml::Vector2f(3.0f, 1.0f), white, Rml::Vector2f(2.0f, 0.0f) };
+        screen_vertex_buffer_->unmap();
     }
 
     void resize_upload_buffer(uint32_t new_size, bool map = true) {
@@ -328,13 +416,7 @@ public:
         index_buffer_size_ = new_size;
     }
 
-    void RenderGeometry(Rml::Vertex* vertices, int num_vertices, int* indices, int num_indices, Rml::TextureHandle texture, const Rml::Vector2f& translation) override {
-        uint32_t vert_size_bytes = num_vertices * sizeof(*vertices);
-        uint32_t index_size_bytes = num_indices * sizeof(*indices);
-        uint32_t total_bytes = vert_size_bytes + index_size_bytes;
-        uint32_t index_bytes_start = vert_size_bytes;
-
-
+    void ensure_texture(Rml::TextureHandle texture) {
         if (!textures_.contains(texture)) {
             if (texture == 0) {
                 // Create a 1x1 pixel white texture as the first handle
@@ -345,6 +427,48 @@ public:
                 assert(false && "Rendered without texture!");
             }
         }
+    }
+
+    void set_draw_state(Rml::TextureHandle texture, const Rml::Vector2f& translation) {
+        list_->setViewports(RT64::RenderViewport{ 0, 0, float(window_width_), float(window_height_) });
+        if (scissor_enabled_) {
+            list_->setScissors(RT64::RenderRect{
+                scissor_x_,
+                scissor_y_,
+                (scissor_width_ + scissor_x_),
+                (scissor_height_ + scissor_y_) });
+        }
+        else {
+            list_->setScissors(RT64::RenderRect{ 0, 0, window_width_, window_height_ });
+        }
+
+        const TextureHandle& texture_handle = textures_.at(texture);
+        RT64::RenderDescriptorSet* texture_set = texture_handle.atlas_page == no_atlas_page ? texture_handle.set.get() : atlas_pages_[texture_handle.atlas_page].set.get();
+
+        // Only rebind the texture's descriptor set when it differs from the last draw's, which is common for atlased textures.
+        if (texture_set != bound_texture_set_) {
+            list_->setGraphicsDescriptorSet(texture_set, 1);
+            bound_texture_set_ = texture_set;
+            stats_.texture_binds++;
+        }
+
+        RmlPushConstants constants{
+            .transform = mvp_,
+            .translation = translation,
+            .uv_offset = texture_handle.uv_offset,
+            .uv_scale = texture_handle.uv_scale
+        };
+
+        list_->setGraphicsPushConstants(0, &constants);
+    }
+
+    void RenderGeometry(Rml::Vertex* vertices, int num_vertices, int* indices, int num_indices, Rml::TextureHandle texture, const Rml::Vector2f& translation) override {
+        uint32_t vert_size_bytes = num_vertices * sizeof(*vertices);
+        uint32_t index_size_bytes = num_indices * sizeof(*indices);
+        uint32_t total_bytes = vert_size_bytes + index_size_bytes;
+        uint32_t index_bytes_start = vert_size_bytes;
+
+        ensure_texture(texture);
 
         uint32_t upload_buffer_offset = allocate_upload_data(total_bytes);
 
@@ -378,32 +502,145 @@ public:
 		};
         list_->barriers(RT64::RenderBarrierStage::GRAPHICS, usage_barriers, uint32_t(std::size(usage_barriers)));
 
-        list_->setViewports(RT64::RenderViewport{ 0, 0, float(window_width_), float(window_height_) });
-        if (scissor_enabled_) {
-            list_->setScissors(RT64::RenderRect{
-                scissor_x_,
-                scissor_y_,
-                (scissor_width_ + scissor_x_),
-                (scissor_height_ + scissor_y_) });
+        RT64::RenderIndexBufferView index_view{index_buffer_->at(0), index_size_bytes, RT64::RenderFormat::R32_UINT};
+        list_->setIndexBuffer(&index_view);
+        RT64::RenderVertexBufferView vertex_view{vertex_buffer_->at(0), vert_size_bytes};
+        list_->setVertexBuffers(0, &vertex_view, 1, &vertex_slot_);
+
+        set_draw_state(texture, translation);
+
+        list_->drawIndexedInstanced(num_indices, 1, 0, 0, 0);
+
+        stats_.bytes_uploaded += total_bytes;
+        stats_.immediate_draws++;
+    }
+
+    Rml::CompiledGeometryHandle CompileGeometry(Rml::Vertex* vertices, int num_vertices, int* indices, int num_indices, Rml::TextureHandle texture) override {
+        // The geometry can only be uploaded while a command list is being recorded. Returning 0 makes RmlUi fall back to RenderGeometry.
+        if (list_ == nullptr || num_vertices <= 0 || num_indices <= 0) {
+            return 0;
         }
-        else {
-            list_->setScissors(RT64::RenderRect{ 0, 0, window_width_, window_height_ });
+
+        ensure_texture(texture);
+
+        CompiledGeometry geometry{ .texture = texture };
+        if (!geometry_pool_.allocate(uint32_t(num_vertices), uint32_t(num_indices), geometry.allocation)) {
+            return 0;
         }
 
-        RT64::RenderIndexBufferView index_view{index_buffer_->at(0), index_size_bytes, RT64::RenderFormat::R32_UINT};
+        const GeometryPool::Allocation& allocation = geometry.allocation;
+        GeometryPool::Page& page = geometry_pool_.page(allocation.page);
+        uint32_t vert_size_bytes = num_vertices * sizeof(*vertices);
+        uint32_t index_size_bytes = num_indices * sizeof(*indices);
+        uint32_t upload_buffer_offset = allocate_upload_data(vert_size_bytes + index_size_bytes);
+
+        // Copy the vertex and index data into the mapped upload buffer.
+        memcpy(upload_buffer_mapped_data_ + upload_buffer_offset, vertices, vert_size_bytes);
+        memcpy(upload_buffer_mapped_data_ + upload_buffer_offset + vert_size_bytes, indices, index_size_bytes);
+
+        // Copy the data into the page's region for this geometry once. It stays resident until the geometry is released.
+        RT64::RenderBufferBarrier copy_barriers[] = {
+			RT64::RenderBufferBarrier(page.vertex_buffer.get(), RT64::RenderBufferAccess::WRITE),
+			RT64::RenderBufferBarrier(page.index_buffer.get(), RT64::RenderBufferAccess::WRITE)
+		};
+        list_->barriers(RT64::RenderBarrierStage::COPY, copy_barriers, uint32_t(std::size(copy_barriers)));
+
+        list_->copyBufferRegion(page.vertex_buffer->at(allocation.vertex_offset * sizeof(Rml::Vertex)), upload_buffer_->at(upload_buffer_offset), vert_size_bytes);
+        list_->copyBufferRegion(page.index_buffer->at(allocation.index_offset * sizeof(int)), upload_buffer_->at(upload_buffer_offset + vert_size_bytes), index_size_bytes);
+
+        RT64::RenderBufferBarrier usage_barriers[] = {
+			RT64::RenderBufferBarrier(page.vertex_buffer.get(), RT64::RenderBufferAccess::READ),
+			RT64::RenderBufferBarrier(page.index_buffer.get(), RT64::RenderBufferAccess::READ)
+		};
+        list_->barriers(RT64::RenderBarrierStage::GRAPHICS, usage_barriers, uint32_t(std::size(usage_barriers)));
+
+        stats_.bytes_uploaded += vert_size_bytes + index_size_bytes;
+
+        Rml::CompiledGeometryHandle handle = compiled_geometry_count_++;
+        compiled_geometry_.emplace(handle, geometry);
+        return handle;
+    }
+
+    void RenderCompiledGeometry(Rml::CompiledGeometryHandle handle, const Rml::Vector2f& translation) override {
+        auto find_it = compiled_geometry_.find(handle);
+        if (find_it == compiled_geometry_.end()) {
+            assert(false && "Rendered released geometry!");
+            return;
+        }
+
+        const CompiledGeometry& geometry = find_it->second;
+        const GeometryPool::Allocation& allocation = geometry.allocation;
+        GeometryPool::Page& page = geometry_pool_.page(allocation.page);
+
+        RT64::RenderIndexBufferView index_view{page.index_buffer->at(0), page.indices.capacity() * uint32_t(sizeof(int)), RT64::RenderFormat::R32_UINT};
         list_->setIndexBuffer(&index_view);
-        RT64::RenderVertexBufferView vertex_view{vertex_buffer_->at(0), vert_size_bytes};
+        RT64::RenderVertexBufferView vertex_view{page.vertex_buffer->at(0), page.vertices.capacity() * uint32_t(sizeof(Rml::Vertex))};
         list_->setVertexBuffers(0, &vertex_view, 1, &vertex_slot_);
-        list_->setGraphicsDescriptorSet(textures_.at(texture).set.get(), 1);
 
-        RmlPushConstants constants{
-            .transform = mvp_,
-            .translation = translation
-        };
+        set_draw_state(geometry.texture, translation);
 
-        list_->setGraphicsPushConstants(0, &constants);
+        list_->drawIndexedInstanced(allocation.num_indices, 1, allocation.index_offset, allocation.vertex_offset, 0);
 
-        list_->drawIndexedInstanced(num_indices, 1, 0, 0, 0);
+        stats_.compiled_draws++;
+    }
+
+    void ReleaseCompiledGeometry(Rml::CompiledGeometryHandle handle) override {
+        auto find_it = compiled_geometry_.find(handle);
+        if (find_it != compiled_geometry_.end()) {
+            // The pool holds on to the ranges until the next frame starts, as the GPU may still be reading them.
+            geometry_pool_.release(find_it->second.allocation);
+            compiled_geometry_.erase(find_it);
+        }
+    }
+
+    // Prints the UI rendering statistics alongside the perf dump, i.e. only when RECOMP_PERF_DUMP is set.
+    void log_stats() {
+        std::chrono::seconds log_period = ultramodern::perf::dump_interval();
+        if (log_period.count() == 0) {
+            return;
+        }
+
+        stats_.frames++;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - stats_period_start_ < log_period) {
+            return;
+        }
+
+        uint64_t resident_bytes = 0;
+        for (const GeometryPool::Page& page : geometry_pool_.pages()) {
+            resident_bytes += uint64_t(page.vertices.used()) * sizeof(Rml::Vertex) + uint64_t(page.indices.used()) * sizeof(int);
+        }
+
+        size_t atlased_textures = 0;
+        for (const auto& [handle, texture] : textures_) {
+            if (texture.atlas_page != no_atlas_page) {
+                atlased_textures++;
+            }
+        }
+
+        uint64_t atlas_used_area = 0;
+        uint64_t atlas_total_area = 0;
+        for (const AtlasPage& page : atlas_pages_) {
+            atlas_used_area += page.packer.used_area();
+            atlas_total_area += page.packer.total_area();
+        }
+
+        printf("[UI] %" PRIu64 " frames: %.1f KB uploaded/frame, %.1f draws/frame (%.1f compiled), %zu compiled geometries in %zu pages (%.1f KB resident)\n",
+            stats_.frames,
+            stats_.bytes_uploaded / 1024.0 / stats_.frames,
+            double(stats_.immediate_draws + stats_.compiled_draws) / stats_.frames,
+            double(stats_.compiled_draws) / stats_.frames,
+            compiled_geometry_.size(), geometry_pool_.pages().size(), resident_bytes / 1024.0);
+        printf("[UI]   %.1f%% of frames reused the previous UI, %.1f%% were drawn straight to the swap chain\n",
+            100.0 * stats_.skipped_frames / stats_.frames, 100.0 * stats_.direct_frames / stats_.frames);
+        printf("[UI]   %.1f texture binds/frame, %zu atlased and %zu dedicated textures, %zu atlas pages (%.1f%% occupied)\n",
+            double(stats_.texture_binds) / stats_.frames,
+            atlased_textures, textures_.size() - atlased_textures,
+            atlas_pages_.size(), atlas_total_area != 0 ? 100.0 * atlas_used_area / atlas_total_area : 0.0);
+
+        stats_ = {};
+        stats_period_start_ = now;
     }
 
     void EnableScissorRegion(bool enable) override {
@@ -477,8 +714,27 @@ public:
             texture_dimensions.x = size_x;
             texture_dimensions.y = size_y;
 
+            if (file_data.size() < 18 + size_t(size_x) * size_y * RmlTextureFormatBytesPerPixel) {
+                printf("  Truncated image data\n");
+                return false;
+            }
+
+            // Convert the bottom-to-top BGRA pixels to top-to-bottom RGBA.
+            std::vector<Rml::byte> pixels(size_t(size_x) * size_y * RmlTextureFormatBytesPerPixel);
+            const Rml::byte* src_data = reinterpret_cast<const Rml::byte*>(file_data.data() + 18);
+            for (uint32_t row = 0; row < size_y; row++) {
+                const Rml::byte* src_row = src_data + size_t(size_y - row - 1) * size_x * RmlTextureFormatBytesPerPixel;
+                Rml::byte* dst_row = pixels.data() + size_t(row) * size_x * RmlTextureFormatBytesPerPixel;
+                for (uint32_t col = 0; col < size_x; col++) {
+                    dst_row[col * 4 + 0] = src_row[col * 4 + 2];
+                    dst_row[col * 4 + 1] = src_row[col * 4 + 1];
+                    dst_row[col * 4 + 2] = src_row[col * 4 + 0];
+                    dst_row[col * 4 + 3] = src_row[col * 4 + 3];
+                }
+            }
+
             texture_handle = texture_count_++;
-            create_texture(texture_handle, reinterpret_cast<const Rml::byte*>(file_data.data() + 18), texture_dimensions, true, true);
+            create_texture(texture_handle, pixels.data(), texture_dimensions);
 
             return true;
         }
@@ -496,7 +752,104 @@ public:
         return create_texture(texture_handle, source, source_dimensions);
     }
 
+    bool allocate_atlas_rect(uint32_t width, uint32_t height, uint32_t& page_out, RecompRml::ShelfPacker::Rect& rect_out) {
+        // Look for room in one of the existing pages first.
+        for (uint32_t page_index = 0; page_index < atlas_pages_.size(); page_index++) {
+            if (atlas_pages_[page_index].packer.pack(width, height, rect_out)) {
+                page_out = page_index;
+                return true;
+            }
+        }
+
+        // None of the pages had room, so create a new one.
+        AtlasPage page{
+            .texture = render_context_->device->createTexture(RT64::RenderTextureDesc::Texture2D(atlas_page_size, atlas_page_size, 1, RmlTextureFormat)),
+            .set = nullptr,
+            .packer = RecompRml::ShelfPacker{ atlas_page_size, atlas_page_size }
+        };
+
+        if (page.texture == nullptr || !page.packer.pack(width, height, rect_out)) {
+            return false;
+        }
+
+        page.set = texture_set_builder_->create(render_context_->device);
+        page.set->setTexture(gTexture_descriptor_index, page.texture.get(), RT64::RenderTextureLayout::SHADER_READ);
+
+        page_out = uint32_t(atlas_pages_.size());
+        atlas_pages_.emplace_back(std::move(page));
+        return true;
+    }
+
+    bool create_atlas_texture(Rml::TextureHandle texture_handle, const Rml::byte* source, const Rml::Vector2i& source_dimensions, bool flip_y) {
+        uint32_t width = source_dimensions.x;
+        uint32_t height = source_dimensions.y;
+        uint32_t padded_width = width + 2 * atlas_padding;
+        uint32_t padded_height = height + 2 * atlas_padding;
+
+        uint32_t page_index;
+        RecompRml::ShelfPacker::Rect rect;
+        if (!allocate_atlas_rect(padded_width, padded_height, page_index, rect)) {
+            return false;
+        }
+
+        AtlasPage& page = atlas_pages_[page_index];
+
+        // Calculate the texture padding for alignment purposes.
+        uint32_t row_pitch = width * RmlTextureFormatBytesPerPixel;
+        uint32_t row_byte_width, row_byte_padding;
+        CalculateTextureRowWidthPadding(padded_width * RmlTextureFormatBytesPerPixel, row_byte_width, row_byte_padding);
+        uint32_t row_width = row_byte_width / RmlTextureFormatBytesPerPixel;
+        uint32_t uploaded_size_bytes = row_byte_width * padded_height;
+
+        uint32_t upload_buffer_offset = allocate_upload_data_aligned(uploaded_size_bytes, 512);
+        stats_.bytes_uploaded += uploaded_size_bytes;
+
+        // Copy the source data into the upload buffer surrounded by a border that repeats its edge texels,
+        // so linear filtering at the edges of the region doesn't pick up the neighbouring textures in the page.
+        uint8_t* dst_data = upload_buffer_mapped_data_ + upload_buffer_offset;
+        for (uint32_t row = 0; row < padded_height; row++) {
+            uint32_t src_row = uint32_t(std::clamp(int(row) - int(atlas_padding), 0, int(height) - 1));
+            if (flip_y) {
+                src_row = height - src_row - 1;
+            }
+
+            const Rml::byte* src_row_data = source + size_t(src_row) * row_pitch;
+            uint8_t* dst_row_data = dst_data + size_t(row) * row_byte_width;
+            for (uint32_t i = 0; i < atlas_padding; i++) {
+                memcpy(dst_row_data + i * RmlTextureFormatBytesPerPixel, src_row_data, RmlTextureFormatBytesPerPixel);
+                memcpy(dst_row_data + (atlas_padding + width + i) * RmlTextureFormatBytesPerPixel, src_row_data + row_pitch - RmlTextureFormatBytesPerPixel, RmlTextureFormatBytesPerPixel);
+            }
+            memcpy(dst_row_data + atlas_padding * RmlTextureFormatBytesPerPixel, src_row_data, row_pitch);
+        }
+
+        // Copy the upload buffer into the texture's region of the page.
+        list_->barriers(RT64::RenderBarrierStage::COPY, RT64::RenderTextureBarrier(page.texture.get(), RT64::RenderTextureLayout::COPY_DEST));
+
+        list_->copyTextureRegion(
+            RT64::RenderTextureCopyLocation::Subresource(page.texture.get()),
+            RT64::RenderTextureCopyLocation::PlacedFootprint(upload_buffer_.get(), RmlTextureFormat, padded_width, padded_height, 1, row_width, upload_buffer_offset),
+            rect.x, rect.y);
+
+        list_->barriers(RT64::RenderBarrierStage::GRAPHICS, RT64::RenderTextureBarrier(page.texture.get(), RT64::RenderTextureLayout::SHADER_READ));
+
+        textures_.emplace(texture_handle, TextureHandle{
+            .atlas_page = page_index,
+            .atlas_rect = rect,
+            .uv_offset = Rml::Vector2f(float(rect.x + atlas_padding) / atlas_page_size, float(rect.y + atlas_padding) / atlas_page_size),
+            .uv_scale = Rml::Vector2f(float(width) / atlas_page_size, float(height) / atlas_page_size)
+        });
+
+        return true;
+    }
+
     bool create_texture(Rml::TextureHandle texture_handle, const Rml::byte* source, const Rml::Vector2i& source_dimensions, bool flip_y = false, bool bgra = false) {
+        // Pack small textures into an atlas page. Large textures and ones in a different format than the atlas get their own texture.
+        if (!bgra && source_dimensions.x <= int(atlas_max_texture_size) && source_dimensions.y <= int(atlas_max_texture_size)) {
+            if (create_atlas_texture(texture_handle, source, source_dimensions, flip_y)) {
+                return true;
+            }
+        }
+
         std::unique_ptr<RT64::RenderTexture> texture =
             render_context_->device->createTexture(RT64::RenderTextureDesc::Texture2D(source_dimensions.x, source_dimensions.y, 1, bgra ? RmlTextureFormatBgra : RmlTextureFormat));
 
@@ -514,6 +867,7 @@ public:
 
             // Allocate room in the upload buffer for the uploaded data.
             uint32_t upload_buffer_offset = allocate_upload_data_aligned(uploaded_size_bytes, 512);
+            stats_.bytes_uploaded += uploaded_size_bytes;
 
             // Copy the source data into the upload buffer.
             uint8_t* dst_data = upload_buffer_mapped_data_ + upload_buffer_offset;
@@ -569,7 +923,17 @@ public:
     }
 
 	void ReleaseTexture(Rml::TextureHandle texture) override {
-        textures_.erase(texture);
+        auto find_it = textures_.find(texture);
+        if (find_it == textures_.end()) {
+            return;
+        }
+
+        // The atlas region may still be read by the frame in flight, so it's only made available again once the next frame starts.
+        if (find_it->second.atlas_page != no_atlas_page) {
+            released_atlas_rects_.emplace_back(find_it->second.atlas_page, find_it->second.atlas_rect);
+        }
+
+        textures_.erase(find_it);
     }
 
     void SetTransform(const Rml::Matrix4f* transform) override {
@@ -581,19 +945,24 @@ public:
         mvp_ = projection_mtx_ * transform_;
     }
 
-    void start(RT64::RenderCommandList* list, int image_width, int image_height) {
+    // Starts rendering the UI, either into the internal texture or straight to the given framebuffer if there is one.
+    void start(RT64::RenderCommandList* list, int image_width, int image_height, RT64::RenderFramebuffer* direct_framebuffer) {
         list_ = list;
+        drawing_direct_ = direct_framebuffer != nullptr;
 
-        if (multisampling_.sampleCount > 1) {
-            if (window_width_ != image_width || window_height_ != image_height) {
-                screen_framebuffer_.reset();
-                screen_texture_ = render_context_->device->createTexture(RT64::RenderTextureDesc::ColorTarget(image_width, image_height, SwapChainFormat));
+        if (!drawing_direct_ && (screen_texture_ == nullptr || window_width_ != image_width || window_height_ != image_height)) {
+            screen_framebuffer_.reset();
+            screen_texture_ = render_context_->device->createTexture(RT64::RenderTextureDesc::ColorTarget(image_width, image_height, SwapChainFormat));
+            const RT64::RenderTexture *color_attachment = screen_texture_.get();
+            if (multisampling_.sampleCount > 1) {
                 screen_texture_ms_ = render_context_->device->createTexture(RT64::RenderTextureDesc::ColorTarget(image_width, image_height, SwapChainFormat, multisampling_));
-                const RT64::RenderTexture *color_attachment = screen_texture_ms_.get();
-                screen_framebuffer_ = render_context_->device->createFramebuffer(RT64::RenderFramebufferDesc(&color_attachment, 1));
-                screen_descriptor_set_->setTexture(0, screen_texture_.get(), RT64::RenderTextureLayout::SHADER_READ);
+                color_attachment = screen_texture_ms_.get();
             }
+            screen_framebuffer_ = render_context_->device->createFramebuffer(RT64::RenderFramebufferDesc(&color_attachment, 1));
+            screen_descriptor_set_->setTexture(0, screen_texture_.get(), RT64::RenderTextureLayout::SHADER_READ);
+        }
 
+        if (multisampling_.sampleCount > 1 && !drawing_direct_) {
             list_->setPipeline(pipeline_ms_.get());
         }
         else {
@@ -603,6 +972,7 @@ public:
         list_->setGraphicsPipelineLayout(layout_.get());
         // Bind the set for descriptors that don't change across draws
         list_->setGraphicsDescriptorSet(sampler_set_.get(), 0);
+        bound_texture_set_ = nullptr;
 
         window_width_ = image_width;
         window_height_ = image_height;
@@ -614,48 +984,88 @@ public:
         // Clear out any stale buffers from the last command list.
         stale_buffers_.clear();
 
+        // Return the ranges of any geometry released during the last command list to the pages' free lists.
+        geometry_pool_.begin_frame();
+
+        // Likewise for the atlas regions of any released textures.
+        for (const auto& [page_index, rect] : released_atlas_rects_) {
+            atlas_pages_[page_index].packer.release(rect);
+        }
+        released_atlas_rects_.clear();
+
         // Reset and map the upload buffer.
         upload_buffer_bytes_used_ = 0;
         upload_buffer_mapped_data_ = reinterpret_cast<uint8_t*>(upload_buffer_->map());
 
-        // Set an internal texture as the render target if MSAA is enabled.
-        if (multisampling_.sampleCount > 1) {
-            list->barriers(RT64::RenderBarrierStage::GRAPHICS, RT64::RenderTextureBarrier(screen_texture_ms_.get(), RT64::RenderTextureLayout::COLOR_WRITE));
+        if (drawing_direct_) {
+            list->setFramebuffer(direct_framebuffer);
+        }
+        else {
+            // Set the internal texture as the render target.
+            list->barriers(RT64::RenderBarrierStage::GRAPHICS, RT64::RenderTextureBarrier(multisampling_.sampleCount > 1 ? screen_texture_ms_.get() : screen_texture_.get(), RT64::RenderTextureLayout::COLOR_WRITE));
             list->setFramebuffer(screen_framebuffer_.get());
             list->clearColor(0, RT64::RenderColor(0.0f, 0.0f, 0.0f, 0.0f));
         }
     }
 
-    void end(RT64::RenderCommandList* list, RT64::RenderFramebuffer* framebuffer) {
-        // Draw the texture were rendered the UI in to the swap chain framebuffer if MSAA is enabled.
-        if (multisampling_.sampleCount > 1) {
-            RT64::RenderTextureBarrier before_resolve_barriers[] = {
-                RT64::RenderTextureBarrier(screen_texture_ms_.get(), RT64::RenderTextureLayout::RESOLVE_SOURCE),
-                RT64::RenderTextureBarrier(screen_texture_.get(), RT64::RenderTextureLayout::RESOLVE_DEST)
-            };
+    void draw_screen(RT64::RenderCommandList* list, RT64::RenderFramebuffer* framebuffer) {
+        list->setFramebuffer(framebuffer);
+        list->setPipeline(screen_pipeline_.get());
+        list->setGraphicsPipelineLayout(layout_.get());
+        list->setGraphicsDescriptorSet(sampler_set_.get(), 0);
+        list->setGraphicsDescriptorSet(screen_descriptor_set_.get(), 1);
+        list->setViewports(RT64::RenderViewport{ 0, 0, float(window_width_), float(window_height_) });
+        list->setScissors(RT64::RenderRect{ 0, 0, window_width_, window_height_ });
+        RT64::RenderVertexBufferView vertex_view(screen_vertex_buffer_.get(), screen_vertex_buffer_size_);
+        list->setVertexBuffers(0, &vertex_view, 1, &vertex_slot_);
 
-            list->barriers(RT64::RenderBarrierStage::COPY, before_resolve_barriers, uint32_t(std::size(before_resolve_barriers)));
-            list->resolveTexture(screen_texture_.get(), screen_texture_ms_.get());
-            list->barriers(RT64::RenderBarrierStage::GRAPHICS, RT64::RenderTextureBarrier(screen_texture_.get(), RT64::RenderTextureLayout::SHADER_READ));
-            list->setFramebuffer(framebuffer);
-            list->setPipeline(pipeline_.get());
-            list->setGraphicsPipelineLayout(layout_.get());
-            list->setGraphicsDescriptorSet(sampler_set_.get(), 0);
-            list->setGraphicsDescriptorSet(screen_descriptor_set_.get(), 1);
-            RT64::RenderVertexBufferView vertex_view(screen_vertex_buffer_.get(), screen_vertex_buffer_size_);
-            list->setVertexBuffers(0, &vertex_view, 1, &vertex_slot_);
+        RmlPushConstants constants{
+            .transform = Rml::Matrix4f::Identity(),
+            .translation = Rml::Vector2f(0.0f, 0.0f),
+            .uv_offset = Rml::Vector2f(0.0f, 0.0f),
+            .uv_scale = Rml::Vector2f(1.0f, 1.0f)
+        };
+
+        list->setGraphicsPushConstants(0, &constants);
+        list->drawInstanced(3, 1, 0, 0);
+    }
 
-            RmlPushConstants constants{
-                .transform = Rml::Matrix4f::Identity(),
-                .translation = Rml::Vector2f(0.0f, 0.0f)
-            };
+    bool is_multisampled() const {
+        return multisampling_.sampleCount > 1;
+    }
+
+    // Draws the UI rendered on a previous frame without updating or rendering the context.
+    void draw_retained(RT64::RenderCommandList* list, RT64::RenderFramebuffer* framebuffer) {
+        draw_screen(list, framebuffer);
+        stats_.skipped_frames++;
+        log_stats();
+    }
+
+    void end(RT64::RenderCommandList* list, RT64::RenderFramebuffer* framebuffer) {
+        if (drawing_direct_) {
+            stats_.direct_frames++;
+        }
+        else {
+            // Resolve the multisampled texture the UI was rendered into if MSAA is enabled.
+            if (multisampling_.sampleCount > 1) {
+                RT64::RenderTextureBarrier before_resolve_barriers[] = {
+                    RT64::RenderTextureBarrier(screen_texture_ms_.get(), RT64::RenderTextureLayout::RESOLVE_SOURCE),
+                    RT64::RenderTextureBarrier(screen_texture_.get(), RT64::RenderTextureLayout::RESOLVE_DEST)
+                };
+
+                list->barriers(RT64::RenderBarrierStage::COPY, before_resolve_barriers, uint32_t(std::size(before_resolve_barriers)));
+                list->resolveTexture(screen_texture_.get(), screen_texture_ms_.get());
+            }
 
-            list_->setGraphicsPushConstants(0, &constants);
-            list->drawInstanced(3, 1, 0, 0);
+            // Draw the texture the UI was rendered into to the swap chain framebuffer.
+            list->barriers(RT64::RenderBarrierStage::GRAPHICS, RT64::RenderTextureBarrier(screen_texture_.get(), RT64::RenderTextureLayout::SHADER_READ));
+            draw_screen(list, framebuffer);
         }
 
         list_ = nullptr;
 
+        log_stats();
+
         // Unmap the upload buffer if it's mapped.
         if (upload_buffer_mapped_data_) {
             upload_buffer_->unmap();
@@ -783,7 +1193,13 @@ struct UIContext {
         Rml::ElementDocument* current_document;
         Rml::Element* prev_focused;
         bool mouse_is_active_changed = false;
+        Rml::ElementDocument* perf_hud_document = nullptr;
+        Rml::Element* perf_hud_text = nullptr;
+        std::vector<Rml::Element*> perf_hud_bars;
     public:
+        static constexpr size_t perf_hud_bar_count = 120;
+        // Toggled with F3, and initially shown if the RECOMP_PERF_HUD environment variable is set.
+        bool perf_hud_visible = getenv("RECOMP_PERF_HUD") != nullptr;
         bool mouse_is_active_initialized = false;
         bool mouse_is_active = false;
         bool cont_is_active = false;
@@ -859,8 +1275,12 @@ struct UIContext {
                 if (current_document != nullptr) {
                     current_document->Close();
                 }
+                if (perf_hud_document != nullptr) {
+                    perf_hud_document->Close();
+                }
 
                 current_document = nullptr;
+                perf_hud_document = nullptr;
 
                 documents.clear();
                 Rml::Factory::RegisterEventListenerInstancer(&event_listener_instancer);
@@ -870,12 +1290,95 @@ struct UIContext {
                 documents.emplace(menu, controller->load_document(context));
             }
 
+            load_perf_hud();
+
             prev_focused = nullptr;
             mouse_is_active = false;
             mouse_is_active_changed = false;
             mouse_is_active_initialized = false;
         }
 
+        void load_perf_hud() {
+            perf_hud_text = nullptr;
+            perf_hud_bars.clear();
+
+            perf_hud_document = context->LoadDocument("assets/perf_hud.rml");
+            if (perf_hud_document == nullptr) {
+                return;
+            }
+
+            perf_hud_text = perf_hud_document->GetElementById("perf_text");
+            Rml::Element* graph_el = perf_hud_document->GetElementById("perf_graph");
+            if (graph_el != nullptr) {
+                for (size_t i = 0; i < perf_hud_bar_count; i++) {
+                    Rml::ElementPtr bar = perf_hud_document->CreateElement("div");
+                    bar->SetClassNames("perf-hud__bar");
+                    perf_hud_bars.push_back(graph_el->AppendChild(std::move(bar)));
+                }
+            }
+
+            if (perf_hud_visible) {
+                perf_hud_document->Show(Rml::ModalFlag::None, Rml::FocusFlag::None);
+            }
+        }
+
+        void set_perf_hud_visible(bool visible) {
+            perf_hud_visible = visible;
+            if (perf_hud_document == nullptr) {
+                return;
+            }
+
+            if (visible) {
+                perf_hud_document->Show(Rml::ModalFlag::None, Rml::FocusFlag::None);
+            }
+            else {
+                perf_hud_document->Hide();
+            }
+        }
+
+        void update_perf_hud() {
+            if (perf_hud_document == nullptr) {
+                return;
+            }
+
+            ultramodern::perf::Snapshot snapshot = ultramodern::perf::snapshot();
+
+            // Bars are scaled so that the graph's full height is three 60 FPS frames, with frames over 1.5x the median highlighted.
+            constexpr float graph_max_ms = 50.0f;
+            constexpr float graph_height_dp = 96.0f;
+            float slow_frame_ms = snapshot.timings[static_cast<size_t>(ultramodern::perf::Timing::FrameTime)].p50_ms * 1.5f;
+            size_t first_frame = snapshot.frame_times_ms.size() > perf_hud_bars.size() ? snapshot.frame_times_ms.size() - perf_hud_bars.size() : 0;
+            size_t first_bar = perf_hud_bars.size() - (snapshot.frame_times_ms.size() - first_frame);
+            for (size_t i = 0; i < perf_hud_bars.size(); i++) {
+                float frame_ms = i >= first_bar ? snapshot.frame_times_ms[first_frame + i - first_bar] : 0.0f;
+                float height_dp = std::min(frame_ms, graph_max_ms) * (graph_height_dp / graph_max_ms);
+                perf_hud_bars[i]->SetProperty("height", std::to_string(height_dp) + "dp");
+                perf_hud_bars[i]->SetClass("perf-hud__bar--slow", frame_ms > slow_frame_ms);
+            }
+
+            if (perf_hud_text == nullptr) {
+                return;
+            }
+
+            std::string text{};
+            char line[256];
+            for (size_t i = 0; i < snapshot.timings.size(); i++) {
+                const ultramodern::perf::TimingSummary& summary = snapshot.timings[i];
+                snprintf(line, sizeof(line), "%s: %.2f ms (avg %.2f, p95 %.2f, p99 %.2f, max %.2f)<br/>",
+                    ultramodern::perf::timing_name(static_cast<ultramodern::perf::Timing>(i)),
+                    summary.last_ms, summary.average_ms, summary.p95_ms, summary.p99_ms, summary.max_ms);
+                text += line;
+            }
+            snprintf(line, sizeof(line), "Gfx tasks in flight: %" PRIu32 ", frames in flight: %" PRIu32 " (%.1f ms), audio latency: %.1f ms<br/>Overlays loaded: %" PRIu64 ", unloaded: %" PRIu64 "<br/>",
+                snapshot.gfx_tasks_in_flight, snapshot.gfx_frames_in_flight, snapshot.gfx_frame_age_us / 1000.0f, snapshot.audio_latency_ms, snapshot.overlay_loads, snapshot.overlay_unloads);
+            text += line;
+            for (const ultramodern::perf::ThreadUsage& thread : snapshot.threads) {
+                snprintf(line, sizeof(line), "%s: %.1f%% CPU<br/>", thread.name.c_str(), thread.cpu_percent);
+                text += line;
+            }
+            perf_hud_text->SetInnerRML(text);
+        }
+
         void make_event_listeners() {
             for (auto& [menu, controller]: menus) {
                 controller->register_events(event_listener_instancer);
@@ -1103,15 +1606,75 @@ void recomp::get_window_size(int& width, int& height) {
     SDL_GetWindowSizeInPixels(window, &width, &height);
 }
 
+// Breakdown of the time spent bringing up the UI, reported once the first menu frame has been rendered.
+// The process start is approximated by static initialization of this file.
+static struct {
+    using clock = std::chrono::steady_clock;
+    clock::time_point process_start = clock::now();
+    clock::time_point init_start{};
+    clock::duration setup{};
+    clock::duration rml_init{};
+    clock::duration fonts{};
+    clock::duration documents{};
+    bool reported = false;
+} ui_startup_times;
+
+static double to_ms(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static void report_ui_startup_times(std::chrono::steady_clock::duration first_frame) {
+    auto& times = ui_startup_times;
+    times.reported = true;
+
+    auto now = std::chrono::steady_clock::now();
+    auto ui_total = now - times.init_start;
+    auto process_total = now - times.process_start;
+    RecompRml::RasterCacheStats cache_stats = RecompRml::raster_cache_get_stats();
+
+    printf("[UI] Startup: %.1f ms to first menu frame, %.1f ms (%.1f%%) in UI init\n",
+        to_ms(process_total), to_ms(ui_total), 100.0 * to_ms(ui_total) / to_ms(process_total));
+    printf("[UI]   setup %.1f ms, RmlUi init %.1f ms, fonts %.1f ms, documents %.1f ms, first frame %.1f ms\n",
+        to_ms(times.setup), to_ms(times.rml_init), to_ms(times.fonts), to_ms(times.documents), to_ms(first_frame));
+    printf("[UI]   raster cache: %u hits, %u misses, %.1f KB read, %.1f KB written\n",
+        cache_stats.hits, cache_stats.misses, cache_stats.bytes_read / 1024.0, cache_stats.bytes_written / 1024.0);
+}
+
+std::atomic<recomp::Menu> open_menu = recomp::Menu::Launcher;
+
+// RT64's render hooks are process-wide, so every instance's RT64 context calls them. The UI's resources are created on the
+// first context's device, so the UI belongs to the instance that set it up and the other instances' calls are ignored.
+static ultramodern::Instance* ui_instance = nullptr;
+
 void init_hook(RT64::RenderInterface* interface, RT64::RenderDevice* device) {
+    if (ui_instance != nullptr) {
+        return;
+    }
+    ui_instance = ultramodern::try_current_instance();
+
 #if defined(__linux__)
     std::locale::global(std::locale::classic());
 #endif
+    ui_startup_times.init_start = std::chrono::steady_clock::now();
+    auto phase_start = ui_startup_times.init_start;
+    auto end_phase = [&phase_start](std::chrono::steady_clock::duration& phase) {
+        auto now = std::chrono::steady_clock::now();
+        phase += now - phase_start;
+        phase_start = now;
+    };
+
+    RecompRml::raster_cache_init(recomp::get_app_folder_path() / "ui_cache");
+
     ui_context = std::make_unique<UIContext>();
 
     ui_context->rml.add_menu(recomp::Menu::Config, recomp::create_config_menu());
     ui_context->rml.add_menu(recomp::Menu::Launcher, recomp::create_launcher_menu());
 
+    // Training runs start the game without going through the launcher.
+    if (recomp::training::active()) {
+        open_menu.store(recomp::Menu::None);
+    }
+
     ui_context->render.interface = interface;
     ui_context->render.device = device;
 
@@ -1124,9 +1687,13 @@ void init_hook(RT64::RenderInterface* interface, RT64::RenderDevice* device) {
     Rml::SetSystemInterface(ui_context->rml.system_interface.get());
     Rml::SetRenderInterface(ui_context->rml.render_interface.get()->GetAdaptedInterface());
     Rml::Factory::RegisterEventListenerInstancer(&ui_context->rml.event_listener_instancer);
+    end_phase(ui_startup_times.setup);
 
     Rml::Initialise();
 
+    // Replace the SVG plugin's element, which was registered by Initialise, with one that reuses cached bitmaps.
+    RecompRml::register_cached_svg_element();
+
     // Apply the hack to replace RmlUi's default color parser with one that conforms to HTML5 alpha parsing for SASS compatibility
     recomp::apply_color_hack();
 
@@ -1137,6 +1704,7 @@ void init_hook(RT64::RenderInterface* interface, RT64::RenderDevice* device) {
     ui_context->rml.make_bindings();
 
     Rml::Debugger::Initialise(ui_context->rml.context);
+    end_phase(ui_startup_times.rml_init);
 
     {
         const Rml::String directory = "assets/";
@@ -1160,8 +1728,10 @@ void init_hook(RT64::RenderInterface* interface, RT64::RenderDevice* device) {
             Rml::LoadFontFace(directory + face.filename, face.fallback_face);
         }
     }
+    end_phase(ui_startup_times.fonts);
 
     ui_context->rml.load_documents();
+    end_phase(ui_startup_times.documents);
 }
 
 moodycamel::ConcurrentQueue<SDL_Event> ui_event_queue{};
@@ -1174,7 +1744,14 @@ bool recomp::try_deque_event(SDL_Event& out) {
     return ui_event_queue.try_dequeue(out);
 }
 
-std::atomic<recomp::Menu> open_menu = recomp::Menu::Launcher;
+
+// Tracks whether the UI needs to be updated and rendered. Invalidated by input handling in draw_hook, and from elsewhere through
+// invalidate_ui when something changes what the UI displays, e.g. a data model variable being dirtied.
+static RecompRml::RedrawTracker ui_redraw_tracker{};
+
+void recomp::invalidate_ui() {
+    ui_redraw_tracker.invalidate();
+}
 std::atomic<recomp::ConfigSubmenu> open_config_submenu = recomp::ConfigSubmenu::Count;
 
 int cont_button_to_key(SDL_ControllerButtonEvent& button) {
@@ -1246,8 +1823,9 @@ void draw_hook(RT64::RenderCommandList* command_list, RT64::RenderFramebuffer* s
 
     apply_background_input_mode();
 
-    // Return early if the ui context has been destroyed already.
-    if (!ui_context) {
+    // Return early if the ui context has been destroyed already. The draw hook can't tell which instance's context is
+    // presenting, so the UI isn't drawn at all while other instances are running.
+    if (!ui_context || ultramodern::Instance::count() > 1) {
         return;
     }
 
@@ -1259,10 +1837,23 @@ void draw_hook(RT64::RenderCommandList* command_list, RT64::RenderFramebuffer* s
     bool reload_sheets = is_reload_held && !was_reload_held;
     was_reload_held = is_reload_held;
 
+    static bool was_perf_hud_held = false;
+    bool is_perf_hud_held = key_state[SDL_SCANCODE_F3] != 0;
+    bool toggle_perf_hud = is_perf_hud_held && !was_perf_hud_held;
+    was_perf_hud_held = is_perf_hud_held;
+
+    static bool was_func_counters_held = false;
+    bool is_func_counters_held = key_state[SDL_SCANCODE_F4] != 0;
+    if (is_func_counters_held && !was_func_counters_held) {
+        ultramodern::func_counters::report(stdout);
+    }
+    was_func_counters_held = is_func_counters_held;
+
     static recomp::Menu prev_menu = recomp::Menu::None;
     recomp::Menu cur_menu = open_menu.load();
 
     if (reload_sheets) {
+        ui_redraw_tracker.invalidate();
         ui_context->rml.load_documents();
         prev_menu = recomp::Menu::None;
     }
@@ -1270,12 +1861,31 @@ void draw_hook(RT64::RenderCommandList* command_list, RT64::RenderFramebuffer* s
     bool menu_changed = cur_menu != prev_menu;
     if (menu_changed) {
         ui_context->rml.swap_document(cur_menu);
+        ui_redraw_tracker.invalidate();
+    }
+
+    if (toggle_perf_hud) {
+        ui_context->rml.set_perf_hud_visible(!ui_context->rml.perf_hud_visible);
+        ui_redraw_tracker.invalidate();
+    }
+
+    // The performance HUD is refreshed a few times a second, which is enough to read it and keeps its cost out of the frame times it shows.
+    if (ui_context->rml.perf_hud_visible) {
+        static constexpr std::chrono::milliseconds perf_hud_period{ 100 };
+        static std::chrono::steady_clock::time_point next_perf_hud_update{};
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_perf_hud_update) {
+            ui_context->rml.update_perf_hud();
+            next_perf_hud_update = now + perf_hud_period;
+            ui_redraw_tracker.invalidate();
+        }
     }
 
     recomp::ConfigSubmenu config_submenu = open_config_submenu.load();
     if (config_submenu != recomp::ConfigSubmenu::Count) {
         ui_context->rml.swap_config_menu(config_submenu);
         open_config_submenu.store(recomp::ConfigSubmenu::Count);
+        ui_redraw_tracker.invalidate();
     }
 
     prev_menu = cur_menu;
@@ -1368,6 +1978,7 @@ void draw_hook(RT64::RenderCommandList* command_list, RT64::RenderFramebuffer* s
 
             if (menu_is_open) {
                 RmlSDL::InputEventHandler(ui_context->rml.context, cur_event);
+                ui_redraw_tracker.invalidate();
             }
         }
 
@@ -1392,6 +2003,7 @@ void draw_hook(RT64::RenderCommandList* command_list, RT64::RenderFramebuffer* s
                 cur_menu = recomp::Menu::Config;
                 open_menu.store(recomp::Menu::Config);
                 ui_context->rml.swap_document(cur_menu);
+                ui_redraw_tracker.invalidate();
             }
         }
     } // end dequeue event loop
@@ -1404,19 +2016,29 @@ void draw_hook(RT64::RenderCommandList* command_list, RT64::RenderFramebuffer* s
     recomp::InputField scanned_field = recomp::get_scanned_input();
     if (scanned_field != recomp::InputField{}) {
         recomp::finish_scanning_input(scanned_field);
+        ui_redraw_tracker.invalidate();
     }
 
     ui_context->rml.update_primary_input(mouse_moved, non_mouse_interacted);
     ui_context->rml.update_focus(mouse_moved, non_mouse_interacted);
 
-    if (cur_menu != recomp::Menu::None) {
+    if (cur_menu != recomp::Menu::None || ui_context->rml.perf_hud_visible) {
         int width = swap_chain_framebuffer->getWidth();
         int height = swap_chain_framebuffer->getHeight();
 
+        auto now = std::chrono::steady_clock::now();
+        bool multisampled = ui_context->rml.render_interface->is_multisampled();
+        RecompRml::RedrawTracker::Action action = ui_redraw_tracker.begin_frame(now, width, height, multisampled);
+        if (action == RecompRml::RedrawTracker::Action::Retain) {
+            ui_context->rml.render_interface->draw_retained(command_list, swap_chain_framebuffer);
+            return;
+        }
+
         // Scale the UI based on the window size with 1080 vertical resolution as the reference point.
         ui_context->rml.context->SetDensityIndependentPixelRatio((height) / 1080.0f);
 
-        ui_context->rml.render_interface->start(command_list, width, height);
+        bool direct = action == RecompRml::RedrawTracker::Action::RenderDirect;
+        ui_context->rml.render_interface->start(command_list, width, height, direct ? swap_chain_framebuffer : nullptr);
 
         static int prev_width = 0;
         static int prev_height = 0;
@@ -1427,13 +2049,26 @@ void draw_hook(RT64::RenderCommandList* command_list, RT64::RenderFramebuffer* s
         prev_width = width;
         prev_height = height;
 
+        auto frame_start = std::chrono::steady_clock::now();
         ui_context->rml.context->Update();
         ui_context->rml.context->Render();
         ui_context->rml.render_interface->end(command_list, swap_chain_framebuffer);
+
+        ui_redraw_tracker.rendered(now, ui_context->rml.context->GetNextUpdateDelay());
+
+        // The first frame is where RmlUi rasterizes the glyphs and images the menu uses, so it's reported as part of startup.
+        if (!ui_startup_times.reported) {
+            report_ui_startup_times(std::chrono::steady_clock::now() - frame_start);
+        }
     }
 }
 
 void deinit_hook() {
+    if (ultramodern::try_current_instance() != ui_instance) {
+        return;
+    }
+    ui_instance = nullptr;
+
     std::lock_guard lock {ui_context_mutex};
     Rml::Debugger::Shutdown();
     Rml::Shutdown();
@@ -1446,7 +2081,10 @@ void set_rt64_hooks() {
 }
 
 void recomp::set_current_menu(Menu menu) {
-    open_menu.store(menu);
+    // Opening or closing a menu changes whether the cursor is locked, which the event loop applies.
+    if (open_menu.exchange(menu) != menu) {
+        recomp::wake_event_loop();
+    }
     if (menu == recomp::Menu::None) {
         ui_context->rml.system_interface->SetMouseCursor("arrow");
     }
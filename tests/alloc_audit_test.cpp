@@ -0,0 +1,108 @@
+#include <cerrno>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+#include "test_common.hpp"
+#include "alloc_audit.hpp"
+
+// Built with ULTRAMODERN_ALLOC_AUDIT and run with RECOMP_ALLOC_AUDIT set (see CMakeLists.txt), so the heap in this process
+// is interposed and counted. Each allocation function is called on its own between reads of the totals, with nothing else
+// in between that could allocate.
+
+using ultramodern::alloc_audit::Totals;
+using ultramodern::alloc_audit::totals;
+
+struct alignas(64) OverAligned {
+    char data[64];
+};
+
+// Keeps the compiler from eliding allocations whose results are never used.
+static void* volatile sink;
+
+template <typename AllocFunc, typename FreeFunc>
+static void check_counted(const char* name, AllocFunc&& alloc, FreeFunc&& release) {
+    Totals before = totals();
+    void* ptr = alloc();
+    Totals allocated = totals();
+    sink = ptr;
+    release(ptr);
+    Totals freed = totals();
+
+    if (allocated.allocations != before.allocations + 1 || freed.frees != allocated.frees + 1) {
+        fprintf(stderr, "  %s: %llu allocations and %llu frees counted, expected 1 of each\n", name,
+            (unsigned long long)(allocated.allocations - before.allocations), (unsigned long long)(freed.frees - allocated.frees));
+    }
+    CHECK(ptr != nullptr);
+    CHECK(allocated.allocations == before.allocations + 1);
+    CHECK(allocated.frame_allocations == before.frame_allocations + 1);
+    CHECK(freed.frees == allocated.frees + 1);
+}
+
+static void test_allocation_functions_are_counted() {
+    check_counted("malloc", []() { return std::malloc(100); }, [](void* ptr) { std::free(ptr); });
+    check_counted("calloc", []() { return std::calloc(10, 10); }, [](void* ptr) { std::free(ptr); });
+    check_counted("memalign", []() { return memalign(64, 100); }, [](void* ptr) { std::free(ptr); });
+    check_counted("aligned_alloc", []() { return std::aligned_alloc(64, 128); }, [](void* ptr) { std::free(ptr); });
+    check_counted("posix_memalign", []() {
+        void* ptr = nullptr;
+        return posix_memalign(&ptr, 64, 100) == 0 ? ptr : nullptr;
+    }, [](void* ptr) { std::free(ptr); });
+    check_counted("operator new", []() { return static_cast<void*>(new int{ 1 }); }, [](void* ptr) { delete static_cast<int*>(ptr); });
+    check_counted("operator new[]", []() { return static_cast<void*>(new int[16]); }, [](void* ptr) { delete[] static_cast<int*>(ptr); });
+    check_counted("aligned operator new", []() { return static_cast<void*>(new OverAligned{}); }, [](void* ptr) { delete static_cast<OverAligned*>(ptr); });
+    check_counted("aligned operator new[]", []() { return static_cast<void*>(new OverAligned[4]); }, [](void* ptr) { delete[] static_cast<OverAligned*>(ptr); });
+}
+
+static void test_realloc_is_counted() {
+    void* ptr = std::malloc(16);
+    Totals before = totals();
+    ptr = std::realloc(ptr, 4096);
+    Totals after = totals();
+    sink = ptr;
+    std::free(ptr);
+    CHECK(after.allocations == before.allocations + 1);
+    CHECK(after.frame_bytes == before.frame_bytes + 4096);
+}
+
+static void test_invalid_posix_memalign_is_rejected() {
+    Totals before = totals();
+    void* ptr = nullptr;
+    int result = posix_memalign(&ptr, 3, 100);
+    Totals after = totals();
+    CHECK(result == EINVAL);
+    CHECK(ptr == nullptr);
+    CHECK(after.allocations == before.allocations);
+}
+
+static void test_frames_are_closed() {
+    ultramodern::alloc_audit::next_frame();
+    Totals start = totals();
+    CHECK(start.frame_allocations == 0);
+    CHECK(start.frame_bytes == 0);
+
+    sink = std::malloc(1000);
+    std::free(sink);
+    sink = std::malloc(24);
+    std::free(sink);
+
+    Totals end = totals();
+    CHECK(end.frame_allocations == 2);
+    CHECK(end.frame_bytes == 1024);
+
+    ultramodern::alloc_audit::next_frame();
+    Totals next = totals();
+    CHECK(next.frames_recorded == end.frames_recorded + 1);
+    CHECK(next.frame_allocations == 0);
+}
+
+int main() {
+    REQUIRE(totals().recording);
+    test_allocation_functions_are_counted();
+    test_realloc_is_counted();
+    test_invalid_posix_memalign_is_rejected();
+    test_frames_are_closed();
+    // No budget is set, so the report passes.
+    CHECK(ultramodern::alloc_audit::report(stdout));
+    return test::finish("alloc_audit_test");
+}
@@ -0,0 +1,219 @@
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "test_common.hpp"
+#include "compressed_stream.hpp"
+
+namespace compressed_stream = ultramodern::compressed_stream;
+
+namespace {
+    constexpr size_t header_size = 8;
+    constexpr size_t frame_header_size = 8;
+
+    std::vector<char> random_bytes(size_t size, uint32_t seed) {
+        std::mt19937 rng{ seed };
+        std::vector<char> ret(size);
+        for (char& c : ret) {
+            c = static_cast<char>(rng());
+        }
+        return ret;
+    }
+
+    uint32_t read_u32(const char* data) {
+        uint32_t ret;
+        memcpy(&ret, data, sizeof(ret));
+        return ret;
+    }
+
+    void append_u32(std::vector<char>& out, uint32_t value) {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(value));
+    }
+
+    // Wraps a single hand-made LZ4 block in the container format.
+    std::vector<char> single_frame(const std::vector<uint8_t>& block, uint32_t uncompressed_size) {
+        std::vector<char> ret{ 'R', 'L', 'Z', '4' };
+        append_u32(ret, uncompressed_size);
+        append_u32(ret, static_cast<uint32_t>(block.size()));
+        append_u32(ret, uncompressed_size);
+        ret.insert(ret.end(), block.begin(), block.end());
+        return ret;
+    }
+
+    // Reads everything through the streaming decompressor.
+    std::vector<char> read_streamed(const std::vector<char>& data, bool& failed) {
+        compressed_stream::InputBuffer buffer{ data };
+        std::istream stream{ &buffer };
+        std::vector<char> ret{ std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{} };
+        failed = buffer.failed();
+        return ret;
+    }
+
+    // Compresses the input and checks that both decompressors give it back.
+    std::vector<char> check_round_trip(const std::vector<char>& input) {
+        std::vector<char> compressed = compressed_stream::compress(input);
+        CHECK(compressed_stream::is_compressed(compressed));
+
+        std::vector<char> decompressed{};
+        CHECK(compressed_stream::decompress(compressed, decompressed));
+        CHECK(decompressed == input);
+
+        bool failed = true;
+        CHECK(read_streamed(compressed, failed) == input);
+        CHECK(!failed);
+        return compressed;
+    }
+}
+
+static void test_small_inputs() {
+    // Blocks this short are too small to hold a match, so they're all literals.
+    for (size_t size = 0; size <= 16; size++) {
+        check_round_trip(std::vector<char>(size, 'a'));
+    }
+    // Literal runs of 15 and more bytes need extra length bytes.
+    for (size_t size : { 14, 15, 16, 269, 270, 271, 525 }) {
+        check_round_trip(random_bytes(size, uint32_t(size)));
+    }
+}
+
+static void test_compressible_frames() {
+    // Several frames of repetitive data, with the last one partial.
+    std::vector<char> input{};
+    const char* text = "the quick brown fox jumps over the lazy dog ";
+    while (input.size() < 3 * compressed_stream::frame_size + 1234) {
+        input.insert(input.end(), text, text + strlen(text));
+    }
+    std::vector<char> compressed = check_round_trip(input);
+    CHECK(compressed.size() < input.size() / 10);
+    CHECK(read_u32(compressed.data() + 4) == input.size());
+}
+
+static void test_incompressible_frames_are_stored() {
+    std::vector<char> input = random_bytes(2 * compressed_stream::frame_size + 100, 1);
+    std::vector<char> compressed = check_round_trip(input);
+
+    // Every frame is stored as-is, which only adds the headers.
+    size_t frame_count = 3;
+    CHECK(compressed.size() == header_size + frame_count * frame_header_size + input.size());
+    const char* frame = compressed.data() + header_size;
+    for (size_t i = 0; i < frame_count; i++) {
+        uint32_t compressed_size = read_u32(frame);
+        uint32_t uncompressed_size = read_u32(frame + 4);
+        CHECK(compressed_size == uncompressed_size);
+        frame += frame_header_size + compressed_size;
+    }
+}
+
+static void test_mixed_frames() {
+    // Alternate frames that compress with ones that don't.
+    std::vector<char> input{};
+    for (uint32_t i = 0; i < 4; i++) {
+        std::vector<char> part = (i % 2 == 0) ? std::vector<char>(compressed_stream::frame_size, char(i)) :
+            random_bytes(compressed_stream::frame_size, i);
+        input.insert(input.end(), part.begin(), part.end());
+    }
+    check_round_trip(input);
+}
+
+static void test_overlapping_matches() {
+    // Runs with a short period make the compressor emit matches whose offset is smaller than their length, which the
+    // decompressor has to copy forward a byte at a time.
+    for (size_t period = 1; period <= 9; period++) {
+        std::vector<char> input = random_bytes(period, uint32_t(period));
+        while (input.size() < 5000) {
+            input.push_back(input[input.size() - period]);
+        }
+        std::vector<char> compressed = check_round_trip(input);
+        CHECK(compressed.size() < 200);
+    }
+
+    // A hand-made block: one literal, then a match at offset 1 that's 4 + 15 + 20 bytes long, then 5 final literals.
+    std::vector<uint8_t> block{ 0x1F, 'x', 0x01, 0x00, 20, 0x50, 'a', 'b', 'c', 'd', 'e' };
+    std::vector<char> expected(40, 'x');
+    expected.insert(expected.end(), { 'a', 'b', 'c', 'd', 'e' });
+    std::vector<char> data = single_frame(block, static_cast<uint32_t>(expected.size()));
+
+    std::vector<char> decompressed{};
+    CHECK(compressed_stream::decompress(data, decompressed));
+    CHECK(decompressed == expected);
+    bool failed = true;
+    CHECK(read_streamed(data, failed) == expected);
+    CHECK(!failed);
+}
+
+static void test_truncated_input() {
+    std::vector<char> input{};
+    for (uint32_t i = 0; i < 3; i++) {
+        std::vector<char> part = (i == 1) ? random_bytes(compressed_stream::frame_size, i) :
+            std::vector<char>(compressed_stream::frame_size / 2, char('a' + i));
+        input.insert(input.end(), part.begin(), part.end());
+    }
+    std::vector<char> compressed = compressed_stream::compress(input);
+
+    // Every truncation point, from inside the header to the last byte of the final frame, has to fail cleanly. The streaming
+    // decompressor gives back a prefix of the input and then stops.
+    size_t step = 1;
+    for (size_t size = 0; size < compressed.size(); size += step) {
+        // Truncating in the middle of the stored frame behaves the same at every byte, so skip through it faster.
+        step = (size > 200 && size + 200 < compressed.size()) ? 97 : 1;
+        std::vector<char> truncated(compressed.begin(), compressed.begin() + size);
+
+        std::vector<char> decompressed{};
+        CHECK(!compressed_stream::decompress(truncated, decompressed));
+
+        bool failed = false;
+        std::vector<char> streamed = read_streamed(truncated, failed);
+        if (compressed_stream::is_compressed(truncated)) {
+            CHECK(streamed.size() < input.size());
+            CHECK(std::equal(streamed.begin(), streamed.end(), input.begin()));
+        }
+    }
+}
+
+static void test_malformed_blocks() {
+    // A match before the start of the output. The block has to be a different size from its output, or it'd be read as stored.
+    std::vector<char> bad_offset = single_frame({ 0x11, 'x', 0x02, 0x00, 0x50, 'a', 'b', 'c', 'd', 'e' }, 11);
+    // A match that runs past the end of the frame.
+    std::vector<char> overrun = single_frame({ 0x1F, 'x', 0x01, 0x00, 200, 0x00 }, 10);
+    // A literal run that's longer than the block.
+    std::vector<char> short_literals = single_frame({ 0xF0, 10, 'a', 'b' }, 25);
+    // A frame that claims to be larger than frames can be.
+    std::vector<char> oversized = single_frame({ 0x00 }, uint32_t(compressed_stream::frame_size + 1));
+
+    for (const std::vector<char>* data : { &bad_offset, &overrun, &short_literals, &oversized }) {
+        std::vector<char> decompressed{};
+        CHECK(!compressed_stream::decompress(*data, decompressed));
+        bool failed = false;
+        read_streamed(*data, failed);
+        CHECK(failed);
+    }
+}
+
+static void test_uncompressed_passthrough() {
+    std::vector<char> input = random_bytes(1000, 7);
+    CHECK(!compressed_stream::is_compressed(input));
+
+    // Uncompressed data is read in place and can be seeked.
+    compressed_stream::InputBuffer buffer{ input };
+    std::istream stream{ &buffer };
+    stream.seekg(500);
+    char c = 0;
+    stream.read(&c, 1);
+    CHECK(c == input[500]);
+    CHECK(stream.tellg() == 501);
+}
+
+int main() {
+    test_small_inputs();
+    test_compressible_frames();
+    test_incompressible_frames_are_stored();
+    test_mixed_frames();
+    test_overlapping_matches();
+    test_truncated_input();
+    test_malformed_blocks();
+    test_uncompressed_passthrough();
+    return test::finish("compressed_stream_test");
+}
@@ -0,0 +1,73 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "test_common.hpp"
+#include "deadline_sleeper.hpp"
+
+using namespace std::chrono_literals;
+using ultramodern::DeadlineSleeper;
+
+static void test_sleep_reaches_deadline() {
+    DeadlineSleeper sleeper{};
+    for (int i = 0; i < 20; i++) {
+        auto deadline = DeadlineSleeper::clock::now() + 2ms;
+        sleeper.sleep_until(deadline);
+        CHECK(DeadlineSleeper::clock::now() >= deadline);
+    }
+}
+
+static void test_spin_runs_to_deadline_without_changes() {
+    DeadlineSleeper sleeper{};
+    std::atomic<uint32_t> generation = 5;
+    auto deadline = DeadlineSleeper::clock::now() + 1ms;
+    CHECK(sleeper.spin_until(deadline, generation, 5));
+    CHECK(DeadlineSleeper::clock::now() >= deadline);
+}
+
+static void test_spin_ends_when_generation_changes() {
+    DeadlineSleeper sleeper{};
+    std::atomic<uint32_t> generation = 0;
+
+    // Stands in for a timer with an earlier deadline being armed while the timer thread spins towards a later one.
+    std::thread armer{ [&generation]() {
+        std::this_thread::sleep_for(2ms);
+        generation.fetch_add(1, std::memory_order_release);
+    } };
+
+    auto start = DeadlineSleeper::clock::now();
+    bool completed = sleeper.spin_until(start + 10s, generation, 0);
+    auto elapsed = DeadlineSleeper::clock::now() - start;
+    armer.join();
+
+    CHECK(!completed);
+    CHECK(elapsed < 1s);
+}
+
+static void test_spin_window_adapts_to_overshoot() {
+    DeadlineSleeper sleeper{};
+    auto target = DeadlineSleeper::clock::now();
+
+    // A late wakeup widens the window right away.
+    sleeper.record_wakeup(target, target + 1ms);
+    CHECK(sleeper.spin_window() >= 1ms);
+
+    // Punctual wakeups let it shrink back down, but never below the minimum.
+    for (int i = 0; i < 1000; i++) {
+        sleeper.record_wakeup(target, target);
+    }
+    CHECK(sleeper.spin_window() < 100us);
+    CHECK(sleeper.spin_window() > 0ns);
+
+    // The window is capped so that a suspended process doesn't leave the thread spinning for long stretches.
+    sleeper.record_wakeup(target, target + 1s);
+    CHECK(sleeper.spin_window() <= 2ms);
+}
+
+int main() {
+    test_sleep_reaches_deadline();
+    test_spin_runs_to_deadline_without_changes();
+    test_spin_ends_when_generation_changes();
+    test_spin_window_adapts_to_overshoot();
+    return test::finish("deadline_sleeper_test");
+}
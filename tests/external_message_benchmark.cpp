@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "blockingconcurrentqueue.h"
+#include "external_message_queue.hpp"
+
+// Measures the cost of the external message check that every osSendMesg, osJamMesg and osRecvMesg does, and the round
+// trip of a message between two threads, with and without background traffic from producers standing in for the VI, timer
+// and RSP threads. The check is compared against try_dequeue on a BlockingConcurrentQueue, which is what it used before.
+// Usage: external_message_benchmark [iterations]
+
+using clock_type = std::chrono::steady_clock;
+
+struct Message {
+    uint32_t mq;
+    uint32_t msg;
+};
+
+using Queue = ultramodern::ExternalMessageQueue<Message>;
+
+// Background producers sending at roughly the rates of the runtime's external threads.
+class BackgroundTraffic {
+public:
+    BackgroundTraffic(Queue& queue, moodycamel::BlockingConcurrentQueue<Message>& baseline_queue) {
+        using namespace std::chrono_literals;
+        for (auto period : { 16667us, 16667us, 1000us, 250us }) {
+            threads_.emplace_back([this, &queue, &baseline_queue, period]() {
+                auto next = clock_type::now();
+                while (!stop_.load(std::memory_order_relaxed)) {
+                    next += period;
+                    std::this_thread::sleep_until(next);
+                    queue.push(Message{ 1, 2 });
+                    baseline_queue.enqueue(Message{ 1, 2 });
+                }
+            });
+        }
+    }
+
+    ~BackgroundTraffic() {
+        stop_ = true;
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+private:
+    std::atomic_bool stop_ = false;
+    std::vector<std::thread> threads_{};
+};
+
+template <typename Func>
+static double ns_per_op(uint64_t iterations, Func&& func) {
+    auto start = clock_type::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+        func();
+    }
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / double(iterations);
+}
+
+static void measure_check(const char* phase, uint64_t iterations, Queue& queue, moodycamel::BlockingConcurrentQueue<Message>& baseline_queue) {
+    volatile uint32_t delivered = 0;
+    double ring_ns = ns_per_op(iterations, [&]() {
+        if (queue.maybe_pending()) {
+            Message message;
+            while (queue.pop(message)) {
+                delivered = delivered + 1;
+            }
+        }
+    });
+    double baseline_ns = ns_per_op(iterations, [&]() {
+        Message message;
+        while (baseline_queue.try_dequeue(message)) {
+            delivered = delivered + 1;
+        }
+    });
+    printf("  %-10s check: rings %6.2f ns/op, BlockingConcurrentQueue %6.2f ns/op\n", phase, ring_ns, baseline_ns);
+}
+
+// Bounces a message between two threads through a pair of queues and reports the round trip percentiles.
+static void measure_round_trip(const char* phase, uint32_t round_trips) {
+    Queue to_responder{};
+    Queue to_sender{};
+    std::atomic_bool stop = false;
+
+    std::thread responder{ [&]() {
+        Message message;
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (to_responder.maybe_pending() && to_responder.pop(message)) {
+                to_sender.push(message);
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    } };
+
+    std::vector<double> round_trip_ns;
+    round_trip_ns.reserve(round_trips);
+    for (uint32_t i = 0; i < round_trips; i++) {
+        auto start = clock_type::now();
+        to_responder.push(Message{ i, 0 });
+        Message reply;
+        while (!(to_sender.maybe_pending() && to_sender.pop(reply))) {
+            std::this_thread::yield();
+        }
+        round_trip_ns.push_back(std::chrono::duration<double, std::nano>(clock_type::now() - start).count());
+    }
+
+    stop = true;
+    responder.join();
+
+    std::sort(round_trip_ns.begin(), round_trip_ns.end());
+    auto at = [&round_trip_ns](double fraction) {
+        return round_trip_ns[std::min(round_trip_ns.size() - 1, size_t(fraction * double(round_trip_ns.size())))];
+    };
+    printf("  %-10s round trip: p50 %8.0f ns, p99 %8.0f ns\n", phase, at(0.5), at(0.99));
+}
+
+int main(int argc, char** argv) {
+    uint64_t iterations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 50'000'000;
+    if (iterations == 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    uint32_t round_trips = uint32_t(std::min<uint64_t>(iterations / 1000, 50'000));
+    if (std::thread::hardware_concurrency() < 2) {
+        printf("Only one hardware thread, so round trips measure context switches rather than the queue.\n");
+    }
+
+    Queue queue{};
+    moodycamel::BlockingConcurrentQueue<Message> baseline_queue{};
+
+    measure_check("Idle", iterations, queue, baseline_queue);
+    measure_round_trip("Idle", round_trips);
+    {
+        BackgroundTraffic traffic{ queue, baseline_queue };
+        measure_check("Traffic", iterations, queue, baseline_queue);
+        measure_round_trip("Traffic", round_trips);
+    }
+
+    return EXIT_SUCCESS;
+}
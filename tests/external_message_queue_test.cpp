@@ -0,0 +1,203 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "test_common.hpp"
+#include "external_message_queue.hpp"
+
+struct Message {
+    uint32_t producer;
+    uint32_t index;
+};
+
+using Queue = ultramodern::ExternalMessageQueue<Message, 16>;
+
+// Pops everything and checks that each producer's messages arrive in the order they were sent.
+static uint32_t drain_in_order(Queue& queue, std::vector<uint32_t>& next_index) {
+    uint32_t popped = 0;
+    Message message;
+    while (queue.pop(message)) {
+        REQUIRE(message.producer < next_index.size());
+        CHECK(message.index == next_index[message.producer]);
+        next_index[message.producer] = message.index + 1;
+        popped++;
+    }
+    return popped;
+}
+
+static void test_single_producer_overflows_in_order() {
+    Queue queue{};
+    CHECK(!queue.maybe_pending());
+
+    // More than a ring holds, so the rest goes through the overflow queue and has to be merged back in order.
+    for (uint32_t i = 0; i < 100; i++) {
+        queue.push(Message{ 0, i });
+    }
+    CHECK(queue.maybe_pending());
+
+    std::vector<uint32_t> next_index(1, 0);
+    CHECK(drain_in_order(queue, next_index) == 100);
+    CHECK(!queue.maybe_pending());
+}
+
+static void test_concurrent_producers_with_consumer() {
+    Queue queue{};
+    constexpr uint32_t producer_count = 6;
+    constexpr uint32_t messages_per_producer = 20000;
+
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < producer_count; producer++) {
+        producers.emplace_back([&queue, producer]() {
+            for (uint32_t i = 0; i < messages_per_producer; i++) {
+                queue.push(Message{ producer, i });
+            }
+        });
+    }
+
+    std::vector<uint32_t> next_index(producer_count, 0);
+    uint32_t popped = 0;
+    while (popped < producer_count * messages_per_producer) {
+        popped += drain_in_order(queue, next_index);
+    }
+
+    for (std::thread& thread : producers) {
+        thread.join();
+    }
+    CHECK(drain_in_order(queue, next_index) == 0);
+    for (uint32_t producer = 0; producer < producer_count; producer++) {
+        CHECK(next_index[producer] == messages_per_producer);
+    }
+}
+
+// Two producers that take turns, each sending only after the other's previous send has finished, so every message was
+// sent strictly after the one before it. Those have to come out in exactly that order across both producers, including
+// when the rings fill up and the rest go through the overflow queue.
+static void test_two_producers_taking_turns() {
+    Queue queue{};
+    constexpr uint32_t message_count = 200;
+    std::atomic<uint32_t> turn = 0;
+
+    auto producer = [&queue, &turn](uint32_t id) {
+        for (uint32_t sent = id; sent < message_count; sent += 2) {
+            while (turn.load(std::memory_order_acquire) != sent) {
+                std::this_thread::yield();
+            }
+            queue.push(Message{ id, sent });
+            turn.store(sent + 1, std::memory_order_release);
+        }
+    };
+    std::thread first{ producer, 0 };
+    std::thread second{ producer, 1 };
+    first.join();
+    second.join();
+
+    uint32_t expected = 0;
+    Message message;
+    while (queue.pop(message)) {
+        CHECK(message.index == expected);
+        CHECK(message.producer == expected % 2);
+        expected++;
+    }
+    CHECK(expected == message_count);
+}
+
+// Two producers sending at the same time while the consumer drains. Each producer's messages still arrive in order.
+static void test_two_concurrent_producers() {
+    Queue queue{};
+    constexpr uint32_t messages_per_producer = 50000;
+    std::thread first{ [&queue]() {
+        for (uint32_t i = 0; i < messages_per_producer; i++) {
+            queue.push(Message{ 0, i });
+        }
+    } };
+    std::thread second{ [&queue]() {
+        for (uint32_t i = 0; i < messages_per_producer; i++) {
+            queue.push(Message{ 1, i });
+        }
+    } };
+
+    std::vector<uint32_t> next_index(2, 0);
+    uint32_t popped = 0;
+    while (popped < 2 * messages_per_producer) {
+        popped += drain_in_order(queue, next_index);
+    }
+    first.join();
+    second.join();
+    CHECK(next_index[0] == messages_per_producer);
+    CHECK(next_index[1] == messages_per_producer);
+}
+
+// Producers that come and go must give their rings back, so that a long-running game that creates threads doesn't end up
+// pushing everything through the overflow queue.
+static void test_rings_released_on_thread_exit() {
+    Queue queue{};
+    constexpr uint32_t thread_count = Queue::max_rings * 4;
+    std::vector<uint32_t> next_index(thread_count, 0);
+
+    for (uint32_t producer = 0; producer < thread_count; producer++) {
+        std::thread thread{ [&queue, producer]() {
+            queue.push(Message{ producer, 0 });
+        } };
+        thread.join();
+        CHECK(queue.claimed_rings() == 0);
+    }
+
+    // Messages left behind in released rings are still delivered.
+    CHECK(drain_in_order(queue, next_index) == thread_count);
+}
+
+static void test_more_producers_than_rings() {
+    Queue queue{};
+    constexpr uint32_t producer_count = Queue::max_rings + 8;
+    std::atomic<uint32_t> ready = 0;
+    std::atomic_bool release = false;
+
+    // Every producer holds on to its ring until all of them have sent a message, so the extra ones have to overflow.
+    std::vector<std::thread> producers;
+    for (uint32_t producer = 0; producer < producer_count; producer++) {
+        producers.emplace_back([&, producer]() {
+            queue.push(Message{ producer, 0 });
+            ready.fetch_add(1);
+            while (!release.load()) {
+                std::this_thread::yield();
+            }
+        });
+    }
+    while (ready.load() != producer_count) {
+        std::this_thread::yield();
+    }
+
+    CHECK(queue.claimed_rings() == Queue::max_rings);
+    std::vector<uint32_t> next_index(producer_count, 0);
+    CHECK(drain_in_order(queue, next_index) == producer_count);
+
+    release = true;
+    for (std::thread& thread : producers) {
+        thread.join();
+    }
+    CHECK(queue.claimed_rings() == 0);
+}
+
+// A producer that outlives a queue, like the main thread sending to an instance that has shut down, must not keep using
+// its ring in the old queue when a new queue is created in the same place.
+static void test_producer_outlives_queue() {
+    for (uint32_t round = 0; round < 3; round++) {
+        Queue queue{};
+        queue.push(Message{ 0, 0 });
+        CHECK(queue.claimed_rings() == 1);
+
+        std::vector<uint32_t> next_index(1, 0);
+        CHECK(drain_in_order(queue, next_index) == 1);
+    }
+}
+
+int main() {
+    test_single_producer_overflows_in_order();
+    test_concurrent_producers_with_consumer();
+    test_two_producers_taking_turns();
+    test_two_concurrent_producers();
+    test_rings_released_on_thread_exit();
+    test_more_producers_than_rings();
+    test_producer_outlives_queue();
+    return test::finish("external_message_queue_test");
+}
@@ -0,0 +1,149 @@
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test_common.hpp"
+#include "ultramodern.hpp"
+#include "guest_faults.hpp"
+
+// The handler asks which game thread faulted. None of these threads are game threads.
+PTR(OSThread) ultramodern::this_thread() {
+    return NULLPTR;
+}
+
+namespace {
+    constexpr size_t reservation_size = 64 * 1024 * 1024;
+    constexpr size_t rdram_offset = 16 * 1024 * 1024;
+    constexpr size_t rdram_size = 8 * 1024 * 1024;
+
+    uint8_t* reservation = nullptr;
+    uint8_t* rdram = nullptr;
+
+    // Stand-ins for recompiled functions, one of them in an overlay.
+    extern "C" __attribute__((noinline)) uint8_t recompiled_read(const volatile uint8_t* address) {
+        return *address;
+    }
+    extern "C" __attribute__((noinline)) uint8_t overlay_read(const volatile uint8_t* address) {
+        return *address;
+    }
+
+    struct ChildResult {
+        bool crashed = false;
+        std::string output{};
+    };
+
+    // Runs the access in a child process with its stderr captured, as the handler lets the process crash afterwards.
+    template <typename Func>
+    ChildResult run_child(Func&& func) {
+        int pipe_fds[2];
+        REQUIRE(pipe(pipe_fds) == 0);
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) {
+            close(pipe_fds[0]);
+            dup2(pipe_fds[1], STDERR_FILENO);
+            func();
+            _exit(0);
+        }
+        close(pipe_fds[1]);
+
+        ChildResult ret{};
+        char buffer[256];
+        ssize_t count;
+        while ((count = read(pipe_fds[0], buffer, sizeof(buffer))) > 0) {
+            ret.output.append(buffer, size_t(count));
+        }
+        close(pipe_fds[0]);
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ret.crashed = WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV;
+        return ret;
+    }
+
+    bool contains(const std::string& text, const char* part) {
+        return text.find(part) != std::string::npos;
+    }
+}
+
+static void test_access_past_rdram() {
+    ChildResult result = run_child([]() { recompiled_read(rdram + rdram_size + 0x40); });
+    CHECK(result.crashed);
+    CHECK(contains(result.output, "Invalid access to guest address 0x80800040"));
+    CHECK(contains(result.output, " in func_80001000 "));
+    CHECK(contains(result.output, "(guest thread -1)"));
+}
+
+static void test_access_before_rdram() {
+    ChildResult result = run_child([]() { overlay_read(rdram - 0x10); });
+    CHECK(result.crashed);
+    CHECK(contains(result.output, "guest address 0x7FFFFFF0"));
+    CHECK(contains(result.output, " in ovl12:func_80A01234 "));
+}
+
+static void test_faults_outside_the_reservation_pass_through() {
+    ChildResult result = run_child([]() { recompiled_read(reservation + reservation_size + 0x1000); });
+    CHECK(result.crashed);
+    CHECK(result.output.empty());
+}
+
+// A second instance's RDRAM is reported relative to itself, and stops being watched once it's removed.
+static void test_second_reservation() {
+    void* mapping = mmap(nullptr, reservation_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    REQUIRE(mapping != MAP_FAILED);
+    uint8_t* second_reservation = static_cast<uint8_t*>(mapping);
+    uint8_t* second_rdram = second_reservation + rdram_offset;
+    CHECK(ultramodern::guest_faults::add_reservation(second_rdram, second_reservation, reservation_size));
+
+    ChildResult result = run_child([second_rdram]() { recompiled_read(second_rdram + rdram_size + 0x80); });
+    CHECK(result.crashed);
+    CHECK(contains(result.output, "Invalid access to guest address 0x80800080"));
+
+    // The first instance's reservation is still watched.
+    result = run_child([]() { recompiled_read(rdram + rdram_size + 0x40); });
+    CHECK(contains(result.output, "guest address 0x80800040"));
+
+    ultramodern::guest_faults::remove_reservation(second_rdram);
+    result = run_child([second_rdram]() { recompiled_read(second_rdram + rdram_size + 0x80); });
+    CHECK(result.crashed);
+    CHECK(result.output.empty());
+
+    // Only so many can be watched at once, and removing one frees its slot.
+    size_t added = 0;
+    while (added < ultramodern::guest_faults::max_reservations && ultramodern::guest_faults::add_reservation(second_rdram + added, second_reservation, reservation_size)) {
+        added++;
+    }
+    CHECK(added == ultramodern::guest_faults::max_reservations - 1);
+    ultramodern::guest_faults::remove_reservation(second_rdram);
+    CHECK(ultramodern::guest_faults::add_reservation(second_rdram + added, second_reservation, reservation_size));
+    for (size_t i = 0; i <= added; i++) {
+        ultramodern::guest_faults::remove_reservation(second_rdram + i);
+    }
+
+    munmap(mapping, reservation_size);
+}
+
+int main() {
+    // Leave a gap after the reservation so that the last test has an unmapped address to fault on.
+    void* mapping = mmap(nullptr, reservation_size + 0x10000, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    REQUIRE(mapping != MAP_FAILED);
+    reservation = static_cast<uint8_t*>(mapping);
+    rdram = reservation + rdram_offset;
+    REQUIRE(mprotect(rdram, rdram_size, PROT_READ | PROT_WRITE) == 0);
+
+    // Passed out of order to check that install sorts them.
+    std::vector<ultramodern::guest_faults::HostFunction> functions{};
+    functions.push_back({ reinterpret_cast<uintptr_t>(&overlay_read), 0x80A01234, 12 });
+    functions.push_back({ reinterpret_cast<uintptr_t>(&recompiled_read), 0x80001000, -1 });
+    ultramodern::guest_faults::install(rdram, reservation, reservation_size, functions);
+
+    test_access_past_rdram();
+    test_access_before_rdram();
+    test_faults_outside_the_reservation_pass_through();
+    test_second_reservation();
+    return test::finish("guest_faults_test");
+}
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "huge_pages.hpp"
+
+// Compares random accesses to RDRAM-sized memory, and calls into code spread over many pages, on normal and huge pages. The
+// accesses are chained so that each one waits for the last, which makes the time per access mostly miss latency.
+// Usage: huge_pages_benchmark [accesses]
+//
+// The huge page side of the data test uses huge_pages::allocate, so setting RECOMP_HUGE_PAGES=0 makes both sides use normal
+// pages. The code test fills memory with tiny x86-64 functions one per 4KB page, which stands in for the recompiled code that a
+// frame runs through, and maps it onto transparent huge pages the same way RECOMP_HUGE_TEXT does.
+
+constexpr size_t rdram_size = 8 * 1024 * 1024;
+constexpr size_t line_size = 64;
+constexpr size_t huge_page_size = 2 * 1024 * 1024;
+constexpr size_t page_size = 4096;
+
+// Maps memory that transparent huge pages are kept off of.
+static uint8_t* map_normal_pages(size_t size) {
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    madvise(data, size, MADV_NOHUGEPAGE);
+    return static_cast<uint8_t*>(data);
+}
+
+// Maps memory aligned to a huge page and asks for transparent huge pages for it.
+static uint8_t* map_transparent_huge_pages(size_t size) {
+    void* raw = mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    uint8_t* data = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(raw) + huge_page_size - 1) & ~(huge_page_size - 1));
+    madvise(data, size, MADV_HUGEPAGE);
+    return data;
+}
+
+// Links every cache line of the memory into a single cycle in a random order, so that following it touches all of the pages
+// in an order the prefetchers can't predict.
+static void build_chain(uint8_t* data, size_t size) {
+    std::vector<uint32_t> order(size / line_size);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin() + 1, order.end(), std::mt19937{ 1234 });
+    for (size_t i = 0; i < order.size(); i++) {
+        uint32_t next = order[(i + 1) % order.size()];
+        memcpy(data + size_t(order[i]) * line_size, &next, sizeof(next));
+    }
+}
+
+static double chase(const uint8_t* data, uint64_t accesses) {
+    uint32_t line = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < accesses; i++) {
+        memcpy(&line, data + size_t(line) * line_size, sizeof(line));
+    }
+    auto end = std::chrono::steady_clock::now();
+    volatile uint32_t sink = line;
+    (void)sink;
+    return std::chrono::duration<double, std::nano>(end - start).count() / double(accesses);
+}
+
+#if defined(__x86_64__)
+using Stub = uint64_t (*)(uint64_t);
+
+// Writes a function returning its argument plus one at the start of every page, then makes the memory executable.
+static std::vector<Stub> write_stubs(uint8_t* code, size_t size) {
+    // lea rax, [rdi + 1]; ret
+    const uint8_t stub[] = { 0x48, 0x8D, 0x47, 0x01, 0xC3 };
+    std::vector<Stub> ret{};
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        memcpy(code + offset, stub, sizeof(stub));
+        ret.push_back(reinterpret_cast<Stub>(code + offset));
+    }
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        return {};
+    }
+    std::shuffle(ret.begin(), ret.end(), std::mt19937{ 5678 });
+    return ret;
+}
+
+static double call_stubs(const std::vector<Stub>& stubs, uint64_t calls) {
+    uint64_t value = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < calls; i++) {
+        value = stubs[i % stubs.size()](value);
+    }
+    auto end = std::chrono::steady_clock::now();
+    volatile uint64_t sink = value;
+    (void)sink;
+    return std::chrono::duration<double, std::nano>(end - start).count() / double(calls);
+}
+#endif
+
+int main(int argc, char** argv) {
+    uint64_t accesses = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20'000'000;
+    if (accesses == 0) {
+        fprintf(stderr, "Usage: %s [accesses]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%llu random accesses to %zu MiB:\n", (unsigned long long)accesses, rdram_size / (1024 * 1024));
+    uint8_t* normal = map_normal_pages(rdram_size);
+    if (normal == nullptr) {
+        fprintf(stderr, "Failed to map %zu bytes\n", rdram_size);
+        return EXIT_FAILURE;
+    }
+    build_chain(normal, rdram_size);
+    printf("  %-28s %6.2f ns/access\n", "normal pages", chase(normal, accesses));
+
+    ultramodern::huge_pages::Allocation huge = ultramodern::huge_pages::allocate(rdram_size);
+    build_chain(huge.get(), rdram_size);
+    printf("  %-28s %6.2f ns/access\n", ultramodern::huge_pages::backing_name(huge.backing()), chase(huge.get(), accesses));
+    huge.report(stdout, "Benchmark data");
+
+#if defined(__x86_64__)
+    constexpr size_t code_size = 32 * 1024 * 1024;
+    printf("%llu calls to functions spread over %zu MiB of code:\n", (unsigned long long)accesses, code_size / (1024 * 1024));
+    uint8_t* normal_code = map_normal_pages(code_size);
+    uint8_t* huge_code = map_transparent_huge_pages(code_size);
+    std::vector<Stub> normal_stubs = normal_code != nullptr ? write_stubs(normal_code, code_size) : std::vector<Stub>{};
+    std::vector<Stub> huge_stubs = huge_code != nullptr ? write_stubs(huge_code, code_size) : std::vector<Stub>{};
+    if (normal_stubs.empty() || huge_stubs.empty()) {
+        printf("  Executable memory isn't available\n");
+    }
+    else {
+        printf("  %-28s %6.2f ns/call\n", "normal pages", call_stubs(normal_stubs, accesses));
+        printf("  %-28s %6.2f ns/call\n", "transparent huge pages", call_stubs(huge_stubs, accesses));
+    }
+#else
+    printf("The code test only runs on x86-64.\n");
+#endif
+
+    return EXIT_SUCCESS;
+}
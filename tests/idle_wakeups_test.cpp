@@ -0,0 +1,154 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "test_common.hpp"
+#include "ultramodern.hpp"
+#include "instance.hpp"
+#include "recomp.h"
+
+// Checks that the service threads sleep while there's nothing for them to do, by counting how many times they give up the CPU
+// (voluntary context switches, as reported in /proc/self/task/<tid>/status) while the game is idle.
+
+void save_write_ptr(const void* in, uint32_t offset, uint32_t count);
+
+namespace {
+    // Stands in for the quit flag kept by the rest of the runtime, which isn't linked in.
+    struct QuitState {
+        std::atomic_bool requested = false;
+    };
+}
+
+bool ultramodern::quit_requested() {
+    return ultramodern::current_instance().state<QuitState>().requested.load();
+}
+
+// The instance in this test has its own save path.
+std::filesystem::path default_save_file_path() {
+    fprintf(stderr, "The instance used the default save path\n");
+    std::exit(EXIT_FAILURE);
+}
+
+using namespace std::chrono_literals;
+
+// How long the threads are left idle for. Polling on the old 10ms timeout wakes up about 50 times in this window.
+constexpr auto idle_window = 500ms;
+
+static std::set<pid_t> list_tasks() {
+    std::set<pid_t> tasks{};
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator{ "/proc/self/task" }) {
+        tasks.insert(pid_t(std::stoi(entry.path().filename().string())));
+    }
+    return tasks;
+}
+
+static uint64_t voluntary_switches(pid_t tid) {
+    std::ifstream status{ "/proc/self/task/" + std::to_string(tid) + "/status" };
+    std::string line;
+    const std::string key = "voluntary_ctxt_switches:";
+    while (std::getline(status, line)) {
+        if (line.starts_with(key)) {
+            return std::stoull(line.substr(key.size()));
+        }
+    }
+    REQUIRE(false);
+    return 0;
+}
+
+// Sleeps on a semaphore with the 10ms timeout the saving thread used to poll with, to show that the measurement sees the
+// wakeups that polling causes.
+struct PollingThread {
+    moodycamel::LightweightSemaphore semaphore{};
+    std::atomic_bool stop = false;
+    std::atomic<pid_t> tid = 0;
+    std::thread thread{ [this]() {
+        tid = pid_t(syscall(SYS_gettid));
+        while (!stop) {
+            semaphore.wait(10000);
+        }
+    } };
+
+    ~PollingThread() {
+        stop = true;
+        semaphore.signal();
+        thread.join();
+    }
+};
+
+static void test_saving_thread_sleeps_while_idle() {
+    std::vector<uint8_t> rdram(0x1000);
+    ultramodern::Instance instance{ rdram.data() };
+    instance.save_file_path = std::filesystem::temp_directory_path() / ("idle_wakeups_test_" + std::to_string(getpid()) + ".bin");
+    ultramodern::InstanceScope scope{ instance };
+
+    std::set<pid_t> tasks_before = list_tasks();
+    ultramodern::init_saving(rdram.data());
+    std::set<pid_t> tasks_after = list_tasks();
+    std::vector<pid_t> new_tasks{};
+    for (pid_t tid : tasks_after) {
+        if (!tasks_before.contains(tid)) {
+            new_tasks.push_back(tid);
+        }
+    }
+    REQUIRE(new_tasks.size() == 1);
+    pid_t saving_tid = new_tasks[0];
+
+    PollingThread polling{};
+    while (polling.tid == 0) {
+        std::this_thread::yield();
+    }
+
+    // Measures both threads over the same window, after giving them time to reach their waits.
+    auto measure_idle = [&](uint64_t& saving, uint64_t& polled) {
+        std::this_thread::sleep_for(50ms);
+        uint64_t saving_start = voluntary_switches(saving_tid);
+        uint64_t polling_start = voluntary_switches(polling.tid);
+        std::this_thread::sleep_for(idle_window);
+        saving = voluntary_switches(saving_tid) - saving_start;
+        polled = voluntary_switches(polling.tid) - polling_start;
+    };
+
+    uint64_t saving_switches = 0;
+    uint64_t polling_switches = 0;
+    measure_idle(saving_switches, polling_switches);
+    printf("Idle for %lld ms: saving thread %llu switches, polling thread %llu switches\n",
+        (long long)(idle_window / 1ms), (unsigned long long)saving_switches, (unsigned long long)polling_switches);
+    CHECK(polling_switches >= 10);
+    CHECK(saving_switches <= 2);
+    CHECK(saving_switches < polling_switches);
+
+    // A write wakes it up to save, after which it goes back to sleeping without a timeout.
+    char value = 0x5A;
+    save_write_ptr(&value, 0, 1);
+    std::this_thread::sleep_for(100ms);
+    {
+        std::ifstream save_file{ instance.save_file_path, std::ios_base::binary };
+        CHECK(save_file.good() && save_file.get() == 0x5A);
+    }
+    measure_idle(saving_switches, polling_switches);
+    printf("Idle after a save: saving thread %llu switches, polling thread %llu switches\n",
+        (unsigned long long)saving_switches, (unsigned long long)polling_switches);
+    CHECK(saving_switches <= 2);
+    CHECK(saving_switches < polling_switches);
+
+    // Quitting has to wake it up, as nothing else will.
+    instance.state<QuitState>().requested = true;
+    ultramodern::wake_saving_thread();
+    ultramodern::join_saving_thread();
+
+    std::filesystem::remove(instance.save_file_path);
+}
+
+int main() {
+    test_saving_thread_sleeps_while_idle();
+    return test::finish("idle_wakeups_test");
+}
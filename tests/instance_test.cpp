@@ -0,0 +1,405 @@
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_common.hpp"
+#include "ultramodern.hpp"
+#include "instance.hpp"
+#include "recomp.h"
+
+void set_audio_callbacks(const ultramodern::audio_callbacks_t& callbacks);
+void save_write(RDRAM_ARG PTR(void) rdram_address, uint32_t offset, uint32_t count);
+void save_read(RDRAM_ARG PTR(void) rdram_address, uint32_t offset, uint32_t count);
+
+namespace {
+    // Stands in for the quit flag kept by the rest of the runtime, which isn't linked in.
+    struct QuitState {
+        std::atomic_bool requested = false;
+    };
+}
+
+bool ultramodern::quit_requested() {
+    return ultramodern::current_instance().state<QuitState>().requested.load();
+}
+
+// Every instance in these tests has its own save path.
+std::filesystem::path default_save_file_path() {
+    fprintf(stderr, "An instance used the default save path\n");
+    std::exit(EXIT_FAILURE);
+}
+
+namespace {
+    struct Counter {
+        int value = 0;
+    };
+
+    // Counts how many of these are destroyed along with their instance.
+    std::atomic<int> tracked_destroyed = 0;
+    struct Tracked {
+        ~Tracked() {
+            tracked_destroyed++;
+        }
+    };
+
+    // Enough RDRAM to hold a few threads, so each instance has its own.
+    constexpr size_t test_rdram_size = 0x1000;
+
+    // Game threads are placed in each instance's RDRAM at these addresses.
+    constexpr PTR(OSThread) thread_address(uint32_t index) {
+        return PTR(OSThread)(0x80000100 + index * 0x80);
+    }
+
+    OSThread* init_thread(uint8_t* rdram, uint32_t index, OSPri priority) {
+        OSThread* t = TO_PTR(OSThread, thread_address(index));
+        *t = OSThread{};
+        t->id = OSId(index);
+        t->priority = priority;
+        return t;
+    }
+
+    // Each instance's audio callbacks record into their own slot.
+    std::atomic<uint32_t> frequencies[2] = {};
+    void set_frequency_0(uint32_t freq) { frequencies[0] = freq; }
+    void set_frequency_1(uint32_t freq) { frequencies[1] = freq; }
+    size_t frames_remaining_0() { return 480; }
+    size_t frames_remaining_1() { return 960; }
+}
+
+static void test_state_is_per_instance() {
+    std::vector<uint8_t> rdram_a(test_rdram_size), rdram_b(test_rdram_size);
+    {
+        ultramodern::Instance a{ rdram_a.data() };
+        ultramodern::Instance b{ rdram_b.data() };
+        CHECK(ultramodern::Instance::count() == 2);
+
+        a.state<Counter>().value = 1;
+        b.state<Counter>().value = 2;
+        CHECK(&a.state<Counter>() != &b.state<Counter>());
+        CHECK(a.state<Counter>().value == 1);
+        CHECK(b.state<Counter>().value == 2);
+
+        a.state<Tracked>();
+        b.state<Tracked>();
+    }
+    CHECK(tracked_destroyed == 2);
+    CHECK(ultramodern::Instance::count() == 0);
+    CHECK(ultramodern::try_current_instance() == nullptr);
+}
+
+static void test_threads_follow_their_instance() {
+    std::vector<uint8_t> rdram_a(test_rdram_size), rdram_b(test_rdram_size);
+    ultramodern::Instance a{ rdram_a.data() };
+    ultramodern::Instance b{ rdram_b.data() };
+
+    // Threads that were never bound fall back to the first instance.
+    ultramodern::Instance* unbound = nullptr;
+    std::thread{ [&unbound]() { unbound = &ultramodern::current_instance(); } }.join();
+    CHECK(unbound == &a);
+
+    // Threads created from a bound thread inherit its instance, including threads they create in turn.
+    ultramodern::Instance* inherited = nullptr;
+    ultramodern::Instance* nested = nullptr;
+    {
+        ultramodern::InstanceScope scope{ b };
+        CHECK(&ultramodern::current_instance() == &b);
+        ultramodern::create_instance_thread([&inherited, &nested]() {
+            inherited = &ultramodern::current_instance();
+            ultramodern::create_instance_thread([&nested]() { nested = &ultramodern::current_instance(); }).join();
+        }).join();
+    }
+    CHECK(inherited == &b);
+    CHECK(nested == &b);
+    CHECK(&ultramodern::current_instance() == &a);
+}
+
+// Destroying the oldest instance moves unbound threads on to the next oldest one, rather than leaving them without one while
+// other instances are still running.
+static void test_fallback_moves_to_remaining_instance() {
+    std::vector<uint8_t> rdram_a(test_rdram_size), rdram_b(test_rdram_size), rdram_c(test_rdram_size);
+    auto a = std::make_unique<ultramodern::Instance>(rdram_a.data());
+    auto b = std::make_unique<ultramodern::Instance>(rdram_b.data());
+    auto c = std::make_unique<ultramodern::Instance>(rdram_c.data());
+    CHECK(ultramodern::try_current_instance() == a.get());
+
+    a.reset();
+    ultramodern::Instance* unbound = nullptr;
+    std::thread{ [&unbound]() { unbound = ultramodern::try_current_instance(); } }.join();
+    CHECK(unbound == b.get());
+
+    // Destroying one that isn't the oldest doesn't change the fallback.
+    c.reset();
+    CHECK(ultramodern::try_current_instance() == b.get());
+
+    b.reset();
+    CHECK(ultramodern::try_current_instance() == nullptr);
+}
+
+// Counts how many times it's called for each instance, to check that thread bind callbacks follow scopes.
+std::atomic<int> bind_calls[2] = {};
+std::vector<uint8_t>* bind_rdrams[2] = {};
+static void count_binds(ultramodern::Instance& instance) {
+    for (int i = 0; i < 2; i++) {
+        if (bind_rdrams[i] != nullptr && instance.rdram() == bind_rdrams[i]->data()) {
+            bind_calls[i]++;
+        }
+    }
+}
+
+static void test_thread_bind_callbacks() {
+    std::vector<uint8_t> rdram_a(test_rdram_size), rdram_b(test_rdram_size);
+    bind_rdrams[0] = &rdram_a;
+    bind_rdrams[1] = &rdram_b;
+    {
+        ultramodern::Instance a{ rdram_a.data() };
+        ultramodern::Instance b{ rdram_b.data() };
+        // Adding the same callback twice only calls it once.
+        ultramodern::Instance::add_thread_bind_callback(count_binds);
+        ultramodern::Instance::add_thread_bind_callback(count_binds);
+
+        {
+            ultramodern::InstanceScope scope{ b };
+            CHECK(bind_calls[1] == 1);
+        }
+        // Leaving the scope rebinds the thread to the instance it falls back to.
+        CHECK(bind_calls[0] == 1);
+    }
+    bind_rdrams[0] = nullptr;
+    bind_rdrams[1] = nullptr;
+}
+
+constexpr uint32_t threads_per_instance = 8;
+
+// Queues one instance's threads on its running queue. Each instance uses its own range of thread indices.
+static void queue_threads(uint8_t* rdram, uint32_t first_index) {
+    for (uint32_t i = first_index; i < first_index + threads_per_instance; i++) {
+        init_thread(rdram, i, OSPri((i * 5) % threads_per_instance));
+        ultramodern::thread_queue_insert(rdram, ultramodern::running_queue, thread_address(i));
+    }
+}
+
+// Pops everything from an instance's running queue, returning false unless it held exactly that instance's threads in
+// priority order.
+static bool drain_threads(uint8_t* rdram, uint32_t first_index) {
+    OSPri last_priority = threads_per_instance;
+    uint32_t popped = 0;
+    while (!ultramodern::thread_queue_empty(rdram, ultramodern::running_queue)) {
+        PTR(OSThread) t = ultramodern::thread_queue_pop(rdram, ultramodern::running_queue);
+        if (t < thread_address(first_index) || t >= thread_address(first_index + threads_per_instance) ||
+            TO_PTR(OSThread, t)->priority > last_priority)
+        {
+            return false;
+        }
+        last_priority = TO_PTR(OSThread, t)->priority;
+        popped++;
+    }
+    return popped == threads_per_instance;
+}
+
+// The running queue's head is the one link that isn't in RDRAM, so it has to be per instance for the instances not to see
+// each other's threads.
+static void test_running_queues_are_per_instance() {
+    std::vector<uint8_t> rdram_a(test_rdram_size), rdram_b(test_rdram_size);
+    ultramodern::Instance a{ rdram_a.data() };
+    ultramodern::Instance b{ rdram_b.data() };
+
+    // Interleave the two instances' queue operations on one thread.
+    {
+        ultramodern::InstanceScope scope{ a };
+        queue_threads(a.rdram(), 0);
+    }
+    {
+        ultramodern::InstanceScope scope{ b };
+        CHECK(ultramodern::thread_queue_empty(b.rdram(), ultramodern::running_queue));
+        queue_threads(b.rdram(), threads_per_instance);
+    }
+    {
+        ultramodern::InstanceScope scope{ a };
+        CHECK(drain_threads(a.rdram(), 0));
+    }
+    {
+        ultramodern::InstanceScope scope{ b };
+        CHECK(drain_threads(b.rdram(), threads_per_instance));
+    }
+
+    // Then run both instances' game threads at once.
+    std::atomic<int> failures = 0;
+    auto run_instance = [&failures](ultramodern::Instance& instance, uint32_t first_index) {
+        ultramodern::InstanceScope scope{ instance };
+        for (int round = 0; round < 2000; round++) {
+            queue_threads(instance.rdram(), first_index);
+            if (!drain_threads(instance.rdram(), first_index)) {
+                failures++;
+                return;
+            }
+        }
+    };
+
+    std::thread thread_a{ run_instance, std::ref(a), 0 };
+    std::thread thread_b{ run_instance, std::ref(b), threads_per_instance };
+    thread_a.join();
+    thread_b.join();
+    CHECK(failures == 0);
+}
+
+static void test_audio_callbacks_are_per_instance() {
+    std::vector<uint8_t> rdram_a(test_rdram_size), rdram_b(test_rdram_size);
+    ultramodern::Instance a{ rdram_a.data() };
+    ultramodern::Instance b{ rdram_b.data() };
+
+    {
+        ultramodern::InstanceScope scope{ a };
+        set_audio_callbacks(ultramodern::audio_callbacks_t{ nullptr, frames_remaining_0, set_frequency_0 });
+    }
+    {
+        ultramodern::InstanceScope scope{ b };
+        set_audio_callbacks(ultramodern::audio_callbacks_t{ nullptr, frames_remaining_1, set_frequency_1 });
+    }
+
+    {
+        ultramodern::InstanceScope scope{ a };
+        ultramodern::set_audio_frequency(32000);
+        CHECK(ultramodern::get_audio_latency_us() == 15000);
+    }
+    {
+        ultramodern::InstanceScope scope{ b };
+        ultramodern::set_audio_frequency(48000);
+        CHECK(ultramodern::get_audio_latency_us() == 20000);
+    }
+    CHECK(frequencies[0] == 32000);
+    CHECK(frequencies[1] == 48000);
+}
+
+namespace {
+    // Enough RDRAM for the data the game writes to its save in run_game.
+    constexpr size_t game_rdram_size = 0x20000;
+    constexpr uint32_t save_block_size = 0x800;
+    constexpr uint32_t save_blocks = 16;
+
+    struct GameResult {
+        std::vector<uint8_t> rdram;
+        std::vector<char> save;
+    };
+
+    uint32_t next_random(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    std::filesystem::path save_path(const char* name) {
+        return std::filesystem::temp_directory_path() / (std::string{ "instance_test_" } + name + ".bin");
+    }
+
+    std::vector<char> read_file(const std::filesystem::path& path) {
+        std::ifstream file{ path, std::ios_base::binary };
+        return std::vector<char>{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+    }
+}
+
+// A stand-in for a game run on one instance: it computes into RDRAM, saves some of it through the save buffer, reads saved
+// data back and schedules its threads, then quits, which writes the save file out. Everything it does depends only on its
+// seed, so it has to give the same results no matter what other instances are doing at the same time.
+static void run_game(ultramodern::Instance& instance, uint32_t seed) {
+    ultramodern::InstanceScope scope{ instance };
+    uint8_t* rdram = instance.rdram();
+    ultramodern::init_saving(rdram);
+
+    uint32_t state = seed;
+    for (uint32_t round = 0; round < 200; round++) {
+        uint32_t block = next_random(state) % save_blocks;
+        gpr block_address = 0x80010000 + block * save_block_size;
+        for (uint32_t offset = 0; offset < save_block_size; offset += 4) {
+            recomp::rdram::write_u32(rdram, block_address + offset, next_random(state) + round);
+        }
+        save_write(rdram, block_address, block * save_block_size, save_block_size);
+
+        // Read a different block back, which has to see this instance's writes only.
+        uint32_t read_block = next_random(state) % save_blocks;
+        save_read(rdram, 0x80018000, read_block * save_block_size, save_block_size);
+
+        queue_threads(rdram, 0);
+        if (!drain_threads(rdram, 0)) {
+            recomp::rdram::write_u32(rdram, 0x80000000, 0xBAD);
+        }
+
+        // Let the saving thread write some of the rounds out while the game is still running.
+        if (round % 50 == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 15 });
+        }
+    }
+
+    instance.state<QuitState>().requested = true;
+    ultramodern::wake_saving_thread();
+    ultramodern::join_saving_thread();
+}
+
+static GameResult collect_result(ultramodern::Instance& instance) {
+    return GameResult{ std::vector<uint8_t>(instance.rdram(), instance.rdram() + game_rdram_size), read_file(instance.save_file_path) };
+}
+
+// Runs two instances with different seeds one after the other and then at the same time, each with its own save file, and
+// checks that running them side by side changes neither their RAM nor what they saved.
+static void test_concurrent_runs_match_sequential() {
+    constexpr uint32_t seeds[2] = { 0x1234567, 0x89ABCDE };
+    const char* names[2] = { "first", "second" };
+
+    GameResult sequential[2];
+    for (int i = 0; i < 2; i++) {
+        std::vector<uint8_t> rdram(game_rdram_size);
+        ultramodern::Instance instance{ rdram.data() };
+        instance.save_file_path = save_path(names[i]);
+        std::filesystem::remove(instance.save_file_path);
+        run_game(instance, seeds[i]);
+        sequential[i] = collect_result(instance);
+    }
+
+    GameResult concurrent[2];
+    {
+        std::vector<uint8_t> rdram_a(game_rdram_size), rdram_b(game_rdram_size);
+        ultramodern::Instance a{ rdram_a.data() };
+        ultramodern::Instance b{ rdram_b.data() };
+        ultramodern::Instance* instances[2] = { &a, &b };
+        for (int i = 0; i < 2; i++) {
+            instances[i]->save_file_path = save_path((std::string{ names[i] } + "_concurrent").c_str());
+            std::filesystem::remove(instances[i]->save_file_path);
+        }
+
+        std::thread thread_a{ run_game, std::ref(a), seeds[0] };
+        std::thread thread_b{ run_game, std::ref(b), seeds[1] };
+        thread_a.join();
+        thread_b.join();
+        for (int i = 0; i < 2; i++) {
+            concurrent[i] = collect_result(*instances[i]);
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        CHECK(recomp::rdram::read_u32(sequential[i].rdram.data(), 0x80000000) != 0xBAD);
+        CHECK(sequential[i].save.size() == 0x20000);
+        CHECK(concurrent[i].rdram == sequential[i].rdram);
+        CHECK(concurrent[i].save == sequential[i].save);
+    }
+    // The two games differ, so matching results can't come from both writing the same thing.
+    CHECK(sequential[0].save != sequential[1].save);
+
+    for (const char* name : { "first", "second", "first_concurrent", "second_concurrent" }) {
+        std::filesystem::remove(save_path(name));
+    }
+}
+
+int main() {
+    test_state_is_per_instance();
+    test_threads_follow_their_instance();
+    test_fallback_moves_to_remaining_instance();
+    test_thread_bind_callbacks();
+    test_running_queues_are_per_instance();
+    test_audio_callbacks_are_per_instance();
+    test_concurrent_runs_match_sequential();
+    return test::finish("instance_test");
+}
@@ -0,0 +1,104 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "overlay_fixture.hpp"
+#include "instance.hpp"
+
+// Compares the overlay code with the function map it replaced on the work a room transition does: the actor overlays of the
+// old room are unloaded, the new room's are loaded, and then the room runs, calling into them through function pointers.
+// Rooms are run once with each overlay in its own slot, and once with two overlays loaded over each other in every slot, which
+// is what hides functions when one of them is unloaded.
+// Usage: overlay_churn_benchmark [transitions]
+
+constexpr uint32_t overlays_per_room = 30;
+// Indirect calls made while each room runs, to functions of its overlays.
+constexpr size_t calls_per_room = 20000;
+
+namespace {
+    struct Result {
+        double transition_ns;
+        double call_ns;
+    };
+
+    // Where each of a room's overlays is loaded. Overlays that share a slot are a few functions apart, so they overlap.
+    int32_t overlay_address(uint32_t overlay, uint32_t overlays_per_slot) {
+        return overlay_fixture::slot_address(overlay / overlays_per_slot) + static_cast<int32_t>((overlay % overlays_per_slot) * 0x40);
+    }
+
+    template <typename Load, typename Unload, typename Lookup>
+    Result run_rooms(uint64_t transitions, uint32_t overlays_per_slot, Load&& load, Unload&& unload, Lookup&& lookup) {
+        std::chrono::steady_clock::duration transition_time{};
+        std::chrono::steady_clock::duration call_time{};
+        uintptr_t sink = 0;
+        std::vector<int32_t> call_targets(calls_per_room);
+        for (uint64_t room = 0; room < transitions; room++) {
+            // Alternate between two sets of overlays, as going back and forth between two rooms does.
+            uint32_t first_id = (room % 2) * overlays_per_room / 3;
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t overlay = 0; overlay < overlays_per_room; overlay++) {
+                load(first_id + overlay, overlay_address(overlay, overlays_per_slot));
+            }
+            auto loaded = std::chrono::steady_clock::now();
+
+            // Most calls go to a few functions, e.g. the update and draw functions of the actors in the room.
+            for (size_t i = 0; i < calls_per_room; i++) {
+                uint32_t overlay = static_cast<uint32_t>((i / 64) * 2654435761u % overlays_per_room);
+                const SectionTableEntry& section = section_table[overlay_sections_by_index[first_id + overlay]];
+                call_targets[i] = overlay_address(overlay, overlays_per_slot) + static_cast<int32_t>(section.funcs[i % 7 % section.num_funcs].offset);
+            }
+            auto calls_start = std::chrono::steady_clock::now();
+            for (int32_t target : call_targets) {
+                sink += reinterpret_cast<uintptr_t>(lookup(target));
+            }
+            auto calls_end = std::chrono::steady_clock::now();
+
+            for (uint32_t slot = 0; slot < overlays_per_room / overlays_per_slot; slot++) {
+                unload(overlay_fixture::slot_address(slot), overlay_fixture::slot_size - 1);
+            }
+            auto unloaded = std::chrono::steady_clock::now();
+
+            transition_time += (loaded - start) + (unloaded - calls_end);
+            call_time += calls_end - calls_start;
+        }
+        volatile uintptr_t result = sink;
+        (void)result;
+        return Result{
+            std::chrono::duration<double, std::nano>(transition_time).count() / double(transitions * overlays_per_room),
+            std::chrono::duration<double, std::nano>(call_time).count() / double(transitions * calls_per_room),
+        };
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t transitions = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000;
+    if (transitions == 0) {
+        fprintf(stderr, "Usage: %s [transitions]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static uint8_t rdram[0x1000];
+    ultramodern::Instance instance{ rdram };
+    overlay_fixture::bind(instance);
+    overlay_fixture::init(1234);
+    init_overlays();
+
+    overlay_fixture::OldFuncMap old_map{};
+    for (uint32_t overlays_per_slot : { 1u, 2u }) {
+        printf("%llu room transitions of %u overlays, %u per slot:\n", (unsigned long long)transitions, overlays_per_room, overlays_per_slot);
+        Result resident = run_rooms(transitions, overlays_per_slot,
+            [](uint32_t id, int32_t ram) { load_overlay_by_id(id, ram); },
+            [](int32_t ram, uint32_t size) { unload_overlays(ram, size); },
+            [](int32_t addr) { return get_function(addr); });
+        Result old = run_rooms(transitions, overlays_per_slot,
+            [&old_map](uint32_t id, int32_t ram) { old_map.load_overlay_by_id(id, ram); },
+            [&old_map](int32_t ram, uint32_t size) { old_map.unload_overlays(ram, size); },
+            [&old_map](int32_t addr) { return old_map.find(addr); });
+
+        printf("  %-28s %8.1f ns/overlay %6.2f ns/call\n", "resident sections", resident.transition_ns, resident.call_ns);
+        printf("  %-28s %8.1f ns/overlay %6.2f ns/call\n", "function map", old.transition_ns, old.call_ns);
+    }
+    return EXIT_SUCCESS;
+}
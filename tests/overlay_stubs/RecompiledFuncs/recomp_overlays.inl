@@ -0,0 +1,10 @@
+// Stand-in for the recompiler's section table, which the overlay tests fill in at runtime (see overlay_fixture.hpp). This
+// directory is on the tests' include path so that src/recomp/overlays.cpp finds this file through its
+// "../RecompiledFuncs/recomp_overlays.inl" include.
+#include "sections.h"
+
+constexpr size_t test_section_count = 40;
+
+extern SectionTableEntry section_table[test_section_count];
+extern int overlay_sections_by_index[test_section_count];
+static const size_t num_sections = test_section_count;
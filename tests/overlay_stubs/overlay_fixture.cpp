@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <random>
+
+#include "overlay_fixture.hpp"
+#include "perf_metrics.hpp"
+#include "instance.hpp"
+
+SectionTableEntry section_table[test_section_count];
+int overlay_sections_by_index[test_section_count];
+
+namespace {
+    FuncEntry section_functions[test_section_count][overlay_fixture::max_section_functions];
+    FuncEntry patch_functions[2];
+    SectionTableEntry patch_section_entry{};
+
+    // The functions are never called, so their addresses only have to be distinct.
+    char function_addresses[test_section_count * overlay_fixture::max_section_functions + 2];
+
+    recomp_func_t* fake_function(size_t index) {
+        return reinterpret_cast<recomp_func_t*>(&function_addresses[index]);
+    }
+}
+
+// The overlay code counts loads for the performance HUD, which isn't linked in.
+void ultramodern::perf::count_overlay_load() {}
+void ultramodern::perf::count_overlay_unload() {}
+
+void load_patch_functions() {
+    load_special_overlay(patch_section_entry, overlay_fixture::patch_address);
+}
+
+void overlay_fixture::bind(ultramodern::Instance& instance) {
+    ultramodern::Instance::add_thread_bind_callback(bind_overlays);
+    // Left bound for the rest of the process.
+    static ultramodern::InstanceScope scope{ instance };
+}
+
+void overlay_fixture::init(uint32_t seed) {
+    std::mt19937 rng{ seed };
+    for (size_t section_index = 0; section_index < test_section_count; section_index++) {
+        uint32_t size = 0x1000 * (1 + rng() % (max_section_size / 0x1000));
+        std::vector<uint32_t> offsets{};
+        for (size_t i = 0; i < max_section_functions; i++) {
+            offsets.push_back((rng() % (size / 4)) * 4);
+        }
+        std::sort(offsets.begin(), offsets.end());
+        offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+        // The recompiler doesn't list functions in order, so the overlay code has to sort them itself.
+        std::shuffle(offsets.begin(), offsets.end(), rng);
+
+        FuncEntry* funcs = section_functions[section_index];
+        for (size_t i = 0; i < offsets.size(); i++) {
+            funcs[i] = FuncEntry{ fake_function(section_index * max_section_functions + i), offsets[i] };
+        }
+        // Linked outside of the slots, at increasing ROM addresses so that init_overlays' sort keeps the order.
+        section_table[section_index] = SectionTableEntry{ static_cast<uint32_t>(0x10000 + section_index * 0x10000),
+            static_cast<uint32_t>(0x80800000 + section_index * 0x10000), size, funcs, offsets.size(), section_index };
+        overlay_sections_by_index[section_index] = static_cast<int>(section_index);
+    }
+
+    size_t patch_index = test_section_count * max_section_functions;
+    patch_functions[0] = FuncEntry{ fake_function(patch_index), 0x00 };
+    patch_functions[1] = FuncEntry{ fake_function(patch_index + 1), 0x40 };
+    patch_section_entry = SectionTableEntry{ 0, static_cast<uint32_t>(patch_address), 0x100, patch_functions, 2, 0 };
+}
+
+const SectionTableEntry& overlay_fixture::patch_section() {
+    return patch_section_entry;
+}
+
+overlay_fixture::OldFuncMap::OldFuncMap() {
+    section_addresses.resize(num_sections);
+    for (size_t section_index = 0; section_index < test_section_count; section_index++) {
+        section_addresses[section_table[section_index].index] = section_table[section_index].ram_addr;
+    }
+    for (size_t function_index = 0; function_index < patch_section_entry.num_funcs; function_index++) {
+        const FuncEntry& func = patch_section_entry.funcs[function_index];
+        func_map[patch_address + func.offset] = func.func;
+    }
+}
+
+void overlay_fixture::OldFuncMap::load_overlay(size_t section_table_index, int32_t ram) {
+    const SectionTableEntry& section = section_table[section_table_index];
+    for (size_t function_index = 0; function_index < section.num_funcs; function_index++) {
+        const FuncEntry& func = section.funcs[function_index];
+        func_map[ram + func.offset] = func.func;
+    }
+    loaded_sections.emplace_back(LoadedSection{ ram, section_table_index });
+    section_addresses[section.index] = ram;
+}
+
+void overlay_fixture::OldFuncMap::load_overlay_by_id(uint32_t id, uint32_t ram_addr) {
+    uint32_t section_table_index = overlay_sections_by_index[id];
+    const SectionTableEntry& section = section_table[section_table_index];
+    int32_t prev_address = section_addresses[section.index];
+    if (prev_address == static_cast<int32_t>(section.ram_addr)) {
+        load_overlay(section_table_index, ram_addr);
+    }
+    else {
+        int32_t new_address = prev_address + ram_addr;
+        unload_overlay_by_id(id);
+        load_overlay(section_table_index, new_address);
+    }
+}
+
+void overlay_fixture::OldFuncMap::erase_functions(const LoadedSection& loaded) {
+    const SectionTableEntry& section = section_table[loaded.section_table_index];
+    for (size_t func_index = 0; func_index < section.num_funcs; func_index++) {
+        func_map.erase(loaded.loaded_ram_addr + section.funcs[func_index].offset);
+    }
+    section_addresses[section.index] = section.ram_addr;
+}
+
+void overlay_fixture::OldFuncMap::unload_overlay_by_id(uint32_t id) {
+    uint32_t section_table_index = overlay_sections_by_index[id];
+    auto find_it = std::find_if(loaded_sections.begin(), loaded_sections.end(),
+        [section_table_index](const LoadedSection& s) { return s.section_table_index == section_table_index; });
+    if (find_it != loaded_sections.end()) {
+        erase_functions(*find_it);
+        loaded_sections.erase(find_it);
+    }
+}
+
+bool overlay_fixture::OldFuncMap::unload_overlays(int32_t ram_addr, uint32_t size) {
+    auto overlaps = [ram_addr, size](const LoadedSection& loaded) {
+        const SectionTableEntry& section = section_table[loaded.section_table_index];
+        return ram_addr < static_cast<int32_t>(loaded.loaded_ram_addr + section.size) && static_cast<int32_t>(ram_addr + size) >= loaded.loaded_ram_addr;
+    };
+    for (const LoadedSection& loaded : loaded_sections) {
+        const SectionTableEntry& section = section_table[loaded.section_table_index];
+        if (overlaps(loaded) && (ram_addr > loaded.loaded_ram_addr || static_cast<int32_t>(ram_addr + size) < static_cast<int32_t>(loaded.loaded_ram_addr + section.size))) {
+            return false;
+        }
+    }
+    for (auto it = loaded_sections.begin(); it != loaded_sections.end();) {
+        if (overlaps(*it)) {
+            erase_functions(*it);
+            it = loaded_sections.erase(it);
+            continue;
+        }
+        ++it;
+    }
+    return true;
+}
+
+recomp_func_t* overlay_fixture::OldFuncMap::find(int32_t addr) const {
+    auto find_it = func_map.find(addr);
+    return find_it == func_map.end() ? nullptr : find_it->second;
+}
@@ -0,0 +1,80 @@
+#ifndef __OVERLAY_FIXTURE_HPP__
+#define __OVERLAY_FIXTURE_HPP__
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "recomp.h"
+#include "RecompiledFuncs/recomp_overlays.inl"
+
+// Shared setup for the tests and benchmarks of src/recomp/overlays.cpp, which link it with a section table of made-up
+// overlays instead of the recompiled game.
+
+namespace ultramodern {
+    class Instance;
+}
+
+void init_overlays();
+void bind_overlays(ultramodern::Instance& instance);
+void load_special_overlay(const SectionTableEntry& section, int32_t ram);
+recomp_func_t* find_function(int32_t addr);
+extern "C" void load_overlays(uint32_t rom, int32_t ram_addr, uint32_t size);
+extern "C" void unload_overlays(int32_t ram_addr, uint32_t size);
+extern "C" void load_overlay_by_id(uint32_t id, uint32_t ram_addr);
+extern "C" void unload_overlay_by_id(uint32_t id);
+
+namespace overlay_fixture {
+    constexpr size_t max_section_functions = 64;
+    // Every section fits in a slot, and slots are where the tests load them.
+    constexpr uint32_t slot_size = 0x4000;
+    constexpr uint32_t max_section_size = 0x3000;
+    constexpr int32_t first_slot = static_cast<int32_t>(0x80100000);
+    // The patches are loaded inside the second slot, so game code loaded there overrides them.
+    constexpr int32_t patch_address = first_slot + slot_size + 0x800;
+
+    constexpr int32_t slot_address(uint32_t slot) {
+        return first_slot + static_cast<int32_t>(slot * slot_size);
+    }
+
+    // Binds the calling thread to the instance the way game threads are, which points the overlay code at its state.
+    void bind(ultramodern::Instance& instance);
+
+    // Fills the section table with sections of 1 to 3 pages, each holding functions at random offsets, and sets up the patch
+    // section. Must be called before init_overlays.
+    void init(uint32_t seed);
+
+    // The patch section that load_patch_functions loads.
+    const SectionTableEntry& patch_section();
+
+    // The overlay lookup as it was implemented before the resident section intervals, with a map from every loaded function's
+    // address to the function. Loads overwrite the map entries at their functions' addresses and unloads erase them, whichever
+    // section put them there.
+    class OldFuncMap {
+    public:
+        OldFuncMap();
+
+        void load_overlay(size_t section_table_index, int32_t ram);
+        void load_overlay_by_id(uint32_t id, uint32_t ram_addr);
+        void unload_overlay_by_id(uint32_t id);
+        // Returns false without changing anything if the region only covers part of a section, where the runtime exits.
+        bool unload_overlays(int32_t ram_addr, uint32_t size);
+
+        recomp_func_t* find(int32_t addr) const;
+        const std::unordered_map<int32_t, recomp_func_t*>& functions() const { return func_map; }
+        int32_t section_address(uint32_t id) const { return section_addresses[section_table[overlay_sections_by_index[id]].index]; }
+    private:
+        struct LoadedSection {
+            int32_t loaded_ram_addr;
+            size_t section_table_index;
+        };
+
+        void erase_functions(const LoadedSection& loaded);
+
+        std::vector<LoadedSection> loaded_sections{};
+        std::unordered_map<int32_t, recomp_func_t*> func_map{};
+        std::vector<int32_t> section_addresses{};
+    };
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include <iterator>
+#include <random>
+
+#include "test_common.hpp"
+#include "overlay_fixture.hpp"
+#include "instance.hpp"
+
+using overlay_fixture::OldFuncMap;
+
+namespace {
+    const SectionTableEntry& section_for_id(uint32_t id) {
+        return section_table[overlay_sections_by_index[id]];
+    }
+
+    // Checks every function address either side knows about, as well as every word of the slots.
+    bool matches(const OldFuncMap& expected) {
+        for (const auto& [addr, func] : expected.functions()) {
+            if (find_function(addr) != func || get_function(addr) != func) {
+                return false;
+            }
+        }
+        for (uint32_t offset = 0; offset < 8 * overlay_fixture::slot_size; offset += 4) {
+            int32_t addr = overlay_fixture::first_slot + static_cast<int32_t>(offset);
+            if (find_function(addr) != expected.find(addr)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+// Two sections loaded so that one function of each lands on the same address.
+static void test_overlapping_sections(OldFuncMap& expected) {
+    uint32_t first_id = 3;
+    uint32_t second_id = 4;
+    const SectionTableEntry& first = section_for_id(first_id);
+    const SectionTableEntry& second = section_for_id(second_id);
+    int32_t first_ram = overlay_fixture::slot_address(4);
+    int32_t shared_addr = first_ram + static_cast<int32_t>(first.funcs[0].offset);
+    int32_t second_ram = shared_addr - static_cast<int32_t>(second.funcs[0].offset);
+
+    load_overlay_by_id(first_id, first_ram);
+    expected.load_overlay_by_id(first_id, first_ram);
+    load_overlay_by_id(second_id, second_ram);
+    expected.load_overlay_by_id(second_id, second_ram);
+    // The section loaded later overwrote the earlier one.
+    CHECK(find_function(shared_addr) == second.funcs[0].func);
+    CHECK(matches(expected));
+
+    // Unloading it leaves nothing at the shared address rather than bringing back the earlier section's function, but the
+    // earlier section's other functions stay.
+    unload_overlay_by_id(second_id);
+    expected.unload_overlay_by_id(second_id);
+    CHECK(find_function(shared_addr) == nullptr);
+    CHECK(matches(expected));
+
+    // Loading the later section again and unloading the earlier one hides the later one's function the same way.
+    load_overlay_by_id(second_id, second_ram);
+    expected.load_overlay_by_id(second_id, second_ram);
+    CHECK(find_function(shared_addr) == second.funcs[0].func);
+    unload_overlay_by_id(first_id);
+    expected.unload_overlay_by_id(first_id);
+    CHECK(find_function(shared_addr) == nullptr);
+    CHECK(matches(expected));
+
+    // Reloading the earlier section restores its functions.
+    load_overlay_by_id(first_id, first_ram);
+    expected.load_overlay_by_id(first_id, first_ram);
+    CHECK(find_function(shared_addr) == first.funcs[0].func);
+    CHECK(matches(expected));
+
+    unload_overlay_by_id(first_id);
+    expected.unload_overlay_by_id(first_id);
+    unload_overlay_by_id(second_id);
+    expected.unload_overlay_by_id(second_id);
+    CHECK(matches(expected));
+}
+
+// Game code loaded over the patches overrides them, and unloading it hides the patches at the same addresses.
+static void test_code_over_patches(OldFuncMap& expected) {
+    const SectionTableEntry& patches = overlay_fixture::patch_section();
+    int32_t patch_addr = overlay_fixture::patch_address + static_cast<int32_t>(patches.funcs[1].offset);
+    CHECK(get_function(patch_addr) == patches.funcs[1].func);
+
+    uint32_t id = 7;
+    const SectionTableEntry& section = section_for_id(id);
+    int32_t ram = patch_addr - static_cast<int32_t>(section.funcs[0].offset);
+    load_overlay_by_id(id, ram);
+    expected.load_overlay_by_id(id, ram);
+    CHECK(get_function(patch_addr) == section.funcs[0].func);
+    CHECK(matches(expected));
+
+    unload_overlays(ram, section.size);
+    expected.unload_overlays(ram, section.size);
+    CHECK(find_function(patch_addr) == nullptr);
+    CHECK(matches(expected));
+}
+
+// Random loads at overlapping addresses and unloads of both kinds, compared against the old implementation after every one.
+// The patches are in one of the slots, so they get overridden and hidden as well.
+static void test_random_operations(OldFuncMap& expected) {
+    std::mt19937 rng{ 5678 };
+    uint32_t mismatched_steps = 0;
+    for (int step = 0; step < 20000; step++) {
+        uint32_t slot = rng() % 8;
+        int32_t slot_address = overlay_fixture::slot_address(slot);
+        switch (rng() % 3) {
+            case 0: {
+                // Only sections that aren't loaded, as loading a loaded section by id moves it by the address instead.
+                uint32_t id = rng() % test_section_count;
+                if (expected.section_address(id) != static_cast<int32_t>(section_for_id(id).ram_addr)) {
+                    break;
+                }
+                // Anywhere in the first page of the slot, so sections in a slot overlap each other but not other slots.
+                int32_t ram = slot_address + static_cast<int32_t>((rng() % (0x1000 / 4)) * 4);
+                load_overlay_by_id(id, ram);
+                expected.load_overlay_by_id(id, ram);
+                break;
+            }
+            case 1:
+                if (expected.unload_overlays(slot_address, overlay_fixture::slot_size - 1)) {
+                    unload_overlays(slot_address, overlay_fixture::slot_size - 1);
+                }
+                break;
+            case 2: {
+                uint32_t id = rng() % test_section_count;
+                unload_overlay_by_id(id);
+                expected.unload_overlay_by_id(id);
+                break;
+            }
+        }
+
+        // Spot check some addresses after every step, and everything every so often.
+        bool step_matches = true;
+        for (int query = 0; query < 16; query++) {
+            int32_t addr;
+            if (!expected.functions().empty() && rng() % 2 == 0) {
+                auto it = expected.functions().begin();
+                std::advance(it, rng() % expected.functions().size());
+                addr = it->first;
+            }
+            else {
+                addr = overlay_fixture::first_slot + static_cast<int32_t>((rng() % (8 * overlay_fixture::slot_size / 4)) * 4);
+            }
+            step_matches = step_matches && find_function(addr) == expected.find(addr);
+        }
+        if (step % 500 == 0) {
+            step_matches = step_matches && matches(expected);
+        }
+        mismatched_steps += step_matches ? 0 : 1;
+    }
+    CHECK(mismatched_steps == 0);
+    CHECK(matches(expected));
+}
+
+int main() {
+    static uint8_t rdram[0x1000];
+    ultramodern::Instance instance{ rdram };
+    overlay_fixture::bind(instance);
+    overlay_fixture::init(1234);
+    init_overlays();
+
+    // Follows the runtime through every test, as the tests leave overlays loaded and patches hidden for the next one.
+    OldFuncMap expected{};
+    test_overlapping_sections(expected);
+    test_code_over_patches(expected);
+    test_random_operations(expected);
+    return test::finish("overlays_property_test");
+}
@@ -0,0 +1,126 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "recomp_rdram.h"
+#include "rdram_mirror.hpp"
+
+// Measures RDRAM accesses in the layout this build was compiled with, along with the cost of keeping RT64's mirror of RDRAM in
+// sync in big-endian builds. It's built twice, as rdram_layout_benchmark (native words) and rdram_layout_benchmark_big_endian,
+// so run both to compare the layouts.
+// Usage: rdram_layout_benchmark[_big_endian] [rounds]
+
+constexpr size_t rdram_size = 16 * 1024 * 1024;
+// Game data the workload touches, e.g. the actors of a scene.
+constexpr size_t object_count = 4096;
+constexpr size_t object_size = 0x150;
+
+template <typename Func>
+static double measure_ns(uint64_t repeats, Func&& func) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < repeats; i++) {
+        func();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / double(repeats);
+}
+
+// Updates every object's fields with the mix of access sizes that game code does.
+static uint64_t update_objects(uint8_t* rdram, const std::vector<uint32_t>& objects) {
+    uint64_t sum = 0;
+    for (uint32_t object : objects) {
+        uint64_t vaddr = 0x80000000 + object;
+        uint32_t flags = recomp::rdram::read_u32(rdram, vaddr + 0x04);
+        uint16_t id = recomp::rdram::read_u16(rdram, vaddr + 0x00);
+        uint8_t category = recomp::rdram::read_u8(rdram, vaddr + 0x02);
+        uint32_t x = recomp::rdram::read_u32(rdram, vaddr + 0x24);
+        uint32_t y = recomp::rdram::read_u32(rdram, vaddr + 0x28);
+        uint32_t z = recomp::rdram::read_u32(rdram, vaddr + 0x2C);
+        recomp::rdram::write_u32(rdram, vaddr + 0x24, x + 3);
+        recomp::rdram::write_u32(rdram, vaddr + 0x28, y ^ flags);
+        recomp::rdram::write_u32(rdram, vaddr + 0x2C, z - 1);
+        recomp::rdram::write_u16(rdram, vaddr + 0x32, uint16_t(id + category));
+        recomp::rdram::write_u8(rdram, vaddr + 0x1E, uint8_t(category + 1));
+        sum += recomp::rdram::read_u64(rdram, vaddr + 0x40) + x + y + z;
+        recomp::rdram::write_u64(rdram, vaddr + 0x48, sum);
+    }
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    uint64_t rounds = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200;
+    if (rounds == 0) {
+        fprintf(stderr, "Usage: %s [rounds]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+    printf("Big-endian RDRAM, %llu rounds:\n", (unsigned long long)rounds);
+#else
+    printf("Native word RDRAM, %llu rounds:\n", (unsigned long long)rounds);
+#endif
+
+    std::unique_ptr<uint8_t[]> rdram = std::make_unique<uint8_t[]>(rdram_size);
+    std::mt19937 rng{ 42 };
+    for (size_t i = 0; i < rdram_size; i += 4) {
+        uint32_t value = rng();
+        memcpy(rdram.get() + i, &value, sizeof(value));
+    }
+
+    // Objects are spread over the first 8MB, where the game's heap is.
+    std::vector<uint32_t> objects(object_count);
+    for (uint32_t& object : objects) {
+        object = (rng() % ((8 * 1024 * 1024 - object_size) / 16)) * 16;
+    }
+
+    volatile uint64_t sink = 0;
+    double update_ns = measure_ns(rounds, [&]() { sink = sink + update_objects(rdram.get(), objects); });
+    printf("  %-36s %8.1f ns/object\n", "Object updates", update_ns / object_count);
+
+    constexpr size_t dma_size = 1024 * 1024;
+    std::vector<uint8_t> rom(dma_size);
+    for (uint8_t& byte : rom) {
+        byte = uint8_t(rng());
+    }
+    double copy_in_ns = measure_ns(rounds, [&]() { recomp::rdram::copy_in(rdram.get(), 0x80100000, rom.data(), rom.size()); });
+    printf("  %-36s %8.2f GB/s\n", "copy_in (ROM DMA)", dma_size / copy_in_ns);
+    double copy_out_ns = measure_ns(rounds, [&]() { recomp::rdram::copy_out(rdram.get(), 0x80100000, rom.data(), rom.size()); });
+    printf("  %-36s %8.2f GB/s\n", "copy_out", dma_size / copy_out_ns);
+
+    // The mirror is only used in big-endian builds, but it doesn't depend on the layout, so it's measured in both.
+    printf("Keeping RT64's mirror of %zu MiB in sync, per display list:\n", rdram_size / (1024 * 1024));
+    std::unique_ptr<uint8_t[]> swapped = std::make_unique<uint8_t[]>(rdram_size);
+    double swap_ns = measure_ns(rounds, [&]() { recomp::rdram::swap_words(swapped.get(), rdram.get(), rdram_size); });
+    printf("  %-36s %8.1f us\n", "Swapping all of RDRAM", swap_ns / 1000.0);
+
+    ultramodern::RdramMirror mirror{ rdram.get(), rdram_size };
+    double idle_ns = measure_ns(rounds, [&]() { mirror.sync(); });
+    printf("  %-36s %8.1f us\n", "Sync, nothing changed", idle_ns / 1000.0);
+
+    // A frame's worth of game writes: the objects plus a display list and matrices.
+    double frame_ns = measure_ns(rounds, [&]() {
+        update_objects(rdram.get(), objects);
+        memset(rdram.get() + 0x200000, int(rng() & 0xFF), 256 * 1024);
+        mirror.sync();
+    }) - update_ns;
+    printf("  %-36s %8.1f us\n", "Sync after a frame of game writes", frame_ns / 1000.0);
+
+    double framebuffer_ns = measure_ns(rounds, [&]() {
+        // RT64 copying a 320x240 16-bit framebuffer back into RDRAM.
+        memset(mirror.data() + 0x400000, int(rng() & 0xFF), 320 * 240 * 2);
+        mirror.sync();
+    });
+    printf("  %-36s %8.1f us\n", "Sync after an RT64 framebuffer copy", framebuffer_ns / 1000.0);
+
+    double all_ns = measure_ns(rounds, [&]() {
+        memset(rdram.get(), int(rng() & 0xFF), rdram_size);
+        mirror.sync();
+    });
+    printf("  %-36s %8.1f us\n", "Sync after rewriting all of RDRAM", all_ns / 1000.0);
+
+    return EXIT_SUCCESS;
+}
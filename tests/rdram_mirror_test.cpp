@@ -0,0 +1,156 @@
+#include <cstring>
+#include <vector>
+
+#include "test_common.hpp"
+#include "rdram_mirror.hpp"
+#include "recomp_rdram.h"
+
+using ultramodern::RdramMirror;
+
+namespace {
+    constexpr size_t test_size = 16 * RdramMirror::page_size;
+
+    uint32_t load_word(const uint8_t* data, size_t offset) {
+        uint32_t ret;
+        memcpy(&ret, data + offset, sizeof(ret));
+        return ret;
+    }
+
+    void store_word(uint8_t* data, size_t offset, uint32_t value) {
+        memcpy(data + offset, &value, sizeof(value));
+    }
+
+    // Whether the mirror holds exactly the word-swapped contents of the game's RDRAM.
+    bool in_sync(const std::vector<uint8_t>& game, RdramMirror& mirror) {
+        for (size_t i = 0; i < game.size(); i += 4) {
+            if (recomp::rdram::byteswap(load_word(mirror.data(), i)) != load_word(game.data(), i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> make_game_rdram() {
+        std::vector<uint8_t> ret(test_size);
+        for (size_t i = 0; i < ret.size(); i += 4) {
+            store_word(ret.data(), i, uint32_t(i * 2654435761u));
+        }
+        return ret;
+    }
+}
+
+static void test_starts_in_sync() {
+    std::vector<uint8_t> game = make_game_rdram();
+    RdramMirror mirror{ game.data(), game.size() };
+    CHECK(in_sync(game, mirror));
+
+    RdramMirror::SyncStats stats = mirror.sync();
+    CHECK(stats.game_pages == 0);
+    CHECK(stats.rt64_pages == 0);
+}
+
+static void test_game_writes_reach_the_mirror() {
+    std::vector<uint8_t> game = make_game_rdram();
+    RdramMirror mirror{ game.data(), game.size() };
+
+    // A word, a halfword and a byte in different pages.
+    recomp::rdram::write_u32(game.data(), 0x80000000 + 0x10, 0x11223344);
+    store_word(game.data(), 3 * RdramMirror::page_size + 8, 0xAABBCCDD);
+    game[7 * RdramMirror::page_size + 1] = 0x5A;
+
+    RdramMirror::SyncStats stats = mirror.sync();
+    CHECK(stats.game_pages == 3);
+    CHECK(stats.rt64_pages == 0);
+    CHECK(in_sync(game, mirror));
+    // The mirror is in the native word layout that RT64 reads.
+    CHECK(load_word(mirror.data(), 0x10) == recomp::rdram::byteswap(uint32_t(0x11223344)));
+
+    stats = mirror.sync();
+    CHECK(stats.game_pages == 0);
+}
+
+static void test_rt64_writes_are_copied_back() {
+    std::vector<uint8_t> game = make_game_rdram();
+    RdramMirror mirror{ game.data(), game.size() };
+
+    // RT64 copies a framebuffer into two pages.
+    for (size_t i = 5 * RdramMirror::page_size; i < 7 * RdramMirror::page_size; i += 4) {
+        store_word(mirror.data(), i, uint32_t(0xF00D0000 + i));
+    }
+
+    RdramMirror::SyncStats stats = mirror.sync();
+    CHECK(stats.game_pages == 0);
+    CHECK(stats.rt64_pages == 2);
+    CHECK(in_sync(game, mirror));
+    CHECK(load_word(game.data(), 5 * RdramMirror::page_size) == recomp::rdram::byteswap(uint32_t(0xF00D0000 + 5 * RdramMirror::page_size)));
+
+    // What was copied back isn't mistaken for a game write on the next sync.
+    stats = mirror.sync();
+    CHECK(stats.game_pages == 0);
+    CHECK(stats.rt64_pages == 0);
+}
+
+static void test_both_sides_in_one_page() {
+    std::vector<uint8_t> game = make_game_rdram();
+    RdramMirror mirror{ game.data(), game.size() };
+
+    size_t page = 9 * RdramMirror::page_size;
+    // Different words of the same page.
+    store_word(game.data(), page + 0x20, 0x01020304);
+    store_word(mirror.data(), page + 0x40, 0x05060708);
+    // The same word, where the game's value wins.
+    store_word(game.data(), page + 0x80, 0x0A0B0C0D);
+    store_word(mirror.data(), page + 0x80, 0x0E0F1011);
+
+    RdramMirror::SyncStats stats = mirror.sync();
+    CHECK(stats.game_pages == 1);
+    CHECK(stats.rt64_pages == 1);
+    CHECK(in_sync(game, mirror));
+    CHECK(load_word(game.data(), page + 0x20) == 0x01020304);
+    CHECK(load_word(game.data(), page + 0x40) == recomp::rdram::byteswap(uint32_t(0x05060708)));
+    CHECK(load_word(game.data(), page + 0x80) == 0x0A0B0C0D);
+}
+
+static void test_repeated_syncs() {
+    // Alternate writes from both sides over many syncs and compare with a model of what each word should hold.
+    std::vector<uint8_t> game = make_game_rdram();
+    RdramMirror mirror{ game.data(), game.size() };
+    std::vector<uint8_t> expected = game;
+
+    uint32_t seed = 1;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed;
+    };
+    for (int round = 0; round < 50; round++) {
+        std::vector<bool> game_wrote(test_size / 4, false);
+        for (int write = 0; write < 20; write++) {
+            size_t offset = (next() % (test_size / 4)) * 4;
+            uint32_t value = next();
+            if (next() % 2 == 0) {
+                store_word(game.data(), offset, value);
+                store_word(expected.data(), offset, value);
+                game_wrote[offset / 4] = true;
+            }
+            else {
+                store_word(mirror.data(), offset, recomp::rdram::byteswap(value));
+                // RT64's write only lands if the game didn't also write the word since the last sync.
+                if (!game_wrote[offset / 4]) {
+                    store_word(expected.data(), offset, value);
+                }
+            }
+        }
+        mirror.sync();
+        CHECK(game == expected);
+        CHECK(in_sync(game, mirror));
+    }
+}
+
+int main() {
+    test_starts_in_sync();
+    test_game_writes_reach_the_mirror();
+    test_rt64_writes_are_copied_back();
+    test_both_sides_in_one_page();
+    test_repeated_syncs();
+    return test::finish("rdram_mirror_test");
+}
@@ -0,0 +1,41 @@
+#ifndef __TEST_COMMON_HPP__
+#define __TEST_COMMON_HPP__
+
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal checking for the tests in this directory, which are plain executables that CTest runs and that fail by exiting with
+// a nonzero status.
+namespace test {
+    inline int failures = 0;
+
+    inline void check(bool condition, const char* expression, const char* file, int line) {
+        if (!condition) {
+            fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+            failures++;
+        }
+    }
+
+    // Returns the exit status for main.
+    inline int finish(const char* name) {
+        if (failures != 0) {
+            fprintf(stderr, "[%s] %d check(s) failed\n", name, failures);
+            return EXIT_FAILURE;
+        }
+        printf("[%s] passed\n", name);
+        return EXIT_SUCCESS;
+    }
+}
+
+#define CHECK(expression) test::check((expression), #expression, __FILE__, __LINE__)
+
+// Stops the test if a check fails, for when later checks depend on it.
+#define REQUIRE(expression) \
+    do { \
+        if (!(expression)) { \
+            test::check(false, #expression, __FILE__, __LINE__); \
+            std::exit(EXIT_FAILURE); \
+        } \
+    } while (0)
+
+#endif
@@ -0,0 +1,106 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "timer_heap.hpp"
+
+// Measures arming, firing and stopping timers with different numbers of timers armed at once. Games keep a handful armed
+// most of the time, with bursts when many threads wait on osSetTimer-based delays.
+// Usage: timer_heap_benchmark [operations]
+
+struct BenchmarkTimer : ultramodern::TimerNode {
+    uint32_t payload;
+};
+
+using TimerSet = ultramodern::TimerSet<uint32_t, BenchmarkTimer>;
+
+template <typename Func>
+static void measure(const char* name, uint64_t operations, Func&& func) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t sink = func();
+    auto end = std::chrono::steady_clock::now();
+    volatile uint64_t result = sink;
+    (void)result;
+    double ns_per_op = std::chrono::duration<double, std::nano>(end - start).count() / double(operations);
+    printf("  %-28s %6.2f ns/op\n", name, ns_per_op);
+}
+
+static void run(uint32_t timer_count, uint64_t operations) {
+    std::mt19937 rng{ timer_count };
+    std::vector<uint64_t> offsets(4096);
+    for (uint64_t& offset : offsets) {
+        offset = 1 + rng() % 100000;
+    }
+    std::vector<uint32_t> ids(4096);
+    for (uint32_t& id : ids) {
+        id = rng() % timer_count;
+    }
+
+    TimerSet timers{};
+    uint64_t now = 0;
+    // Every timer has been armed once, so the set isn't measured while it grows.
+    for (uint32_t id = 0; id < timer_count; id++) {
+        timers.arm(id, now + offsets[id % offsets.size()], 0).payload = id;
+    }
+
+    printf("%u timers armed:\n", timer_count);
+
+    // Rearming timers that are already armed, as a thread that keeps pushing back a timeout does.
+    measure("rearm", operations, [&]() {
+        for (uint64_t i = 0; i < operations; i++) {
+            timers.arm(ids[i % ids.size()], now + offsets[i % offsets.size()], 0);
+        }
+        return uint64_t(timers.size());
+    });
+
+    // Firing the earliest one-shot timer and arming it again, as a game does when it waits on timers back to back.
+    measure("fire and arm", operations, [&]() {
+        uint64_t sink = 0;
+        for (uint64_t i = 0; i < operations; i++) {
+            now = timers.earliest()->deadline;
+            BenchmarkTimer& fired = timers.fire(now);
+            sink += fired.payload;
+            timers.arm(fired.payload, now + offsets[i % offsets.size()], 0);
+        }
+        return sink;
+    });
+
+    // Stopping a timer anywhere in the heap and arming it again.
+    measure("stop and arm", operations, [&]() {
+        uint64_t sink = 0;
+        for (uint64_t i = 0; i < operations; i++) {
+            uint32_t id = ids[i % ids.size()];
+            sink += timers.stop(id) ? 1 : 0;
+            timers.arm(id, now + offsets[i % offsets.size()], 0);
+        }
+        return sink;
+    });
+
+    // Periodic timers, which are rearmed in place when they fire.
+    for (uint32_t id = 0; id < timer_count; id++) {
+        timers.arm(id, now + offsets[id % offsets.size()], 1000 + offsets[id % offsets.size()]);
+    }
+    measure("fire periodic", operations, [&]() {
+        uint64_t sink = 0;
+        for (uint64_t i = 0; i < operations; i++) {
+            now = timers.earliest()->deadline;
+            sink += timers.fire(now).payload;
+        }
+        return sink;
+    });
+}
+
+int main(int argc, char** argv) {
+    uint64_t operations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2'000'000;
+    if (operations == 0) {
+        fprintf(stderr, "Usage: %s [operations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t timer_count : { 4u, 64u, 1024u }) {
+        run(timer_count, operations);
+    }
+    return EXIT_SUCCESS;
+}
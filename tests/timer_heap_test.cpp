@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "test_common.hpp"
+#include "timer_heap.hpp"
+
+struct TestTimer : ultramodern::TimerNode {
+    uint32_t id;
+};
+
+using TimerSet = ultramodern::TimerSet<uint32_t, TestTimer>;
+
+static TestTimer& arm(TimerSet& timers, uint32_t id, uint64_t deadline, uint64_t interval = 0) {
+    TestTimer& timer = timers.arm(id, deadline, interval);
+    timer.id = id;
+    return timer;
+}
+
+// Fires everything, which is only valid for one-shot timers, and returns the order they fired in.
+static std::vector<uint32_t> fire_all(TimerSet& timers) {
+    std::vector<uint32_t> fired{};
+    while (!timers.empty()) {
+        uint64_t now = timers.earliest()->deadline;
+        fired.push_back(timers.fire(now).id);
+    }
+    return fired;
+}
+
+static void test_fires_in_deadline_order() {
+    TimerSet timers{};
+    std::mt19937 rng{ 42 };
+    std::vector<std::pair<uint64_t, uint32_t>> expected{};
+    for (uint32_t id = 0; id < 500; id++) {
+        uint64_t deadline = rng() % 100000;
+        arm(timers, id, deadline);
+        expected.emplace_back(deadline, id);
+    }
+    // Ids were assigned in the order the timers were armed, so sorting by them breaks ties the same way.
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<uint32_t> fired = fire_all(timers);
+    REQUIRE(fired.size() == expected.size());
+    for (size_t i = 0; i < fired.size(); i++) {
+        CHECK(fired[i] == expected[i].second);
+    }
+}
+
+// Timers with the same deadline fire in the order they were armed, and rearming one counts as arming it again.
+static void test_ties_fire_in_arming_order() {
+    TimerSet timers{};
+    for (uint32_t id = 0; id < 10; id++) {
+        arm(timers, id, 1000);
+    }
+    arm(timers, 3, 1000);
+    arm(timers, 0, 1000);
+
+    std::vector<uint32_t> expected{ 1, 2, 4, 5, 6, 7, 8, 9, 3, 0 };
+    CHECK(fire_all(timers) == expected);
+}
+
+// Stopping and rearming timers in the middle of the heap keeps the rest in order.
+static void test_remove_and_update_in_middle() {
+    TimerSet timers{};
+    std::mt19937 rng{ 7 };
+    std::vector<uint64_t> deadlines(200);
+    for (uint32_t id = 0; id < deadlines.size(); id++) {
+        deadlines[id] = 1000 + id * 10;
+        arm(timers, id, deadlines[id]);
+    }
+
+    std::vector<bool> stopped(deadlines.size(), false);
+    for (int i = 0; i < 300; i++) {
+        uint32_t id = rng() % deadlines.size();
+        if (rng() % 2 == 0) {
+            // Moves the timer to anywhere in the heap, including ahead of every other one.
+            deadlines[id] = rng() % 5000;
+            arm(timers, id, deadlines[id]);
+            stopped[id] = false;
+        }
+        else {
+            CHECK(timers.stop(id) == !stopped[id]);
+            stopped[id] = true;
+        }
+    }
+
+    size_t live = std::count(stopped.begin(), stopped.end(), false);
+    CHECK(timers.size() == live);
+
+    std::vector<uint32_t> fired = fire_all(timers);
+    CHECK(fired.size() == live);
+    for (size_t i = 0; i < fired.size(); i++) {
+        CHECK(!stopped[fired[i]]);
+        if (i > 0) {
+            CHECK(deadlines[fired[i - 1]] <= deadlines[fired[i]]);
+        }
+    }
+}
+
+// Stopping a timer that was never armed, has already fired or was already stopped fails, as osStopTimer returns -1 for it.
+static void test_stop_inactive_timer() {
+    TimerSet timers{};
+    CHECK(!timers.stop(1));
+
+    arm(timers, 1, 100);
+    CHECK(timers.stop(1));
+    CHECK(!timers.stop(1));
+
+    arm(timers, 1, 100);
+    timers.fire(100);
+    CHECK(timers.empty());
+    CHECK(!timers.stop(1));
+
+    // A periodic timer stays armed after firing, so it can still be stopped.
+    arm(timers, 2, 100, 50);
+    timers.fire(100);
+    CHECK(timers.stop(2));
+}
+
+// A periodic timer that fires late is reloaded from its previous deadline rather than from when it fired, so the lateness
+// doesn't accumulate.
+static void test_periodic_rearm_without_drift() {
+    TimerSet timers{};
+    constexpr uint64_t start = 1000;
+    constexpr uint64_t interval = 781;
+    arm(timers, 1, start + interval, interval);
+
+    std::mt19937 rng{ 3 };
+    for (uint64_t period = 1; period <= 1000; period++) {
+        CHECK(timers.earliest()->deadline == start + period * interval);
+        // Woken up to most of an interval late.
+        uint64_t now = timers.earliest()->deadline + rng() % (interval - 1);
+        TestTimer& fired = timers.fire(now);
+        CHECK(fired.id == 1);
+        CHECK(fired.queued());
+    }
+}
+
+// A periodic timer that falls more than an interval behind, e.g. because the process was suspended, fires once and is
+// resynchronized to the current time instead of firing once for every period it missed.
+static void test_periodic_resync_after_stall() {
+    TimerSet timers{};
+    constexpr uint64_t interval = 1000;
+    arm(timers, 1, interval, interval);
+
+    uint64_t now = 50 * interval + 123;
+    timers.fire(now);
+    CHECK(timers.earliest()->deadline == now + interval);
+    CHECK(timers.earliest()->deadline > now);
+
+    // It runs without drift again from the new deadline.
+    uint64_t resynced = timers.earliest()->deadline;
+    timers.fire(resynced + 10);
+    CHECK(timers.earliest()->deadline == resynced + interval);
+
+    // Just under an interval late is still caught up rather than resynchronized.
+    uint64_t deadline = timers.earliest()->deadline;
+    timers.fire(deadline + interval - 1);
+    CHECK(timers.earliest()->deadline == deadline + interval);
+}
+
+// Periodic and one-shot timers interleave by deadline.
+static void test_periodic_and_one_shot_interleave() {
+    TimerSet timers{};
+    arm(timers, 1, 100, 100);
+    arm(timers, 2, 250);
+    arm(timers, 3, 250, 0);
+
+    std::vector<uint32_t> fired{};
+    for (int i = 0; i < 5; i++) {
+        uint64_t now = timers.earliest()->deadline;
+        fired.push_back(timers.fire(now).id);
+    }
+    std::vector<uint32_t> expected{ 1, 1, 2, 3, 1 };
+    CHECK(fired == expected);
+    CHECK(timers.size() == 1);
+}
+
+int main() {
+    test_fires_in_deadline_order();
+    test_ties_fire_in_arming_order();
+    test_remove_and_update_in_middle();
+    test_stop_inactive_timer();
+    test_periodic_rearm_without_drift();
+    test_periodic_resync_after_stall();
+    test_periodic_and_one_shot_interleave();
+    return test::finish("timer_heap_test");
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "deadline_sleeper.hpp"
+
+// Measures how late periodic deadlines are woken up for, comparing DeadlineSleeper against a plain sleep_until. The load
+// phase keeps every hardware thread busy to show how the sleeper holds up when the OS has other work to schedule.
+// Usage: timer_jitter_benchmark [iterations] [period_us]
+
+using clock_type = ultramodern::DeadlineSleeper::clock;
+
+struct Percentiles {
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+static Percentiles percentiles(std::vector<double>& errors_us) {
+    std::sort(errors_us.begin(), errors_us.end());
+    auto at = [&errors_us](double fraction) {
+        size_t index = std::min(errors_us.size() - 1, size_t(fraction * double(errors_us.size())));
+        return errors_us[index];
+    };
+    return { at(0.50), at(0.99), at(0.999), errors_us.back() };
+}
+
+template <typename SleepFunc>
+static Percentiles measure(uint32_t iterations, std::chrono::microseconds period, SleepFunc&& sleep) {
+    std::vector<double> errors_us;
+    errors_us.reserve(iterations);
+
+    auto deadline = clock_type::now() + period;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sleep(deadline);
+        auto woke = clock_type::now();
+        errors_us.push_back(std::chrono::duration<double, std::micro>(woke - deadline).count());
+        deadline += period;
+        // Don't try to catch up after a very late wakeup, which would measure the backlog instead of the sleep.
+        if (deadline < woke) {
+            deadline = woke + period;
+        }
+    }
+
+    return percentiles(errors_us);
+}
+
+static void report(const char* name, const Percentiles& result) {
+    printf("  %-22s p50 %8.1fus  p99 %8.1fus  p999 %8.1fus  max %8.1fus\n", name, result.p50, result.p99, result.p999, result.max);
+}
+
+static void run_phase(const char* phase, uint32_t iterations, std::chrono::microseconds period) {
+    printf("%s:\n", phase);
+
+    report("sleep_until", measure(iterations, period, [](const clock_type::time_point& deadline) {
+        std::this_thread::sleep_until(deadline);
+    }));
+
+    ultramodern::DeadlineSleeper sleeper{};
+    report("DeadlineSleeper", measure(iterations, period, [&sleeper](const clock_type::time_point& deadline) {
+        sleeper.sleep_until(deadline);
+    }));
+    printf("  spin window after run: %.1fus\n", std::chrono::duration<double, std::micro>(sleeper.spin_window()).count());
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = argc > 1 ? uint32_t(strtoul(argv[1], nullptr, 10)) : 5000;
+    std::chrono::microseconds period{ argc > 2 ? strtoul(argv[2], nullptr, 10) : 16667 / 8 };
+    if (iterations == 0 || period.count() == 0) {
+        fprintf(stderr, "Usage: %s [iterations] [period_us]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ultramodern::minimize_timer_slack();
+    printf("%u wakeups every %lldus\n", iterations, (long long)period.count());
+
+    run_phase("Idle", iterations, period);
+
+    std::atomic_bool stop_load = false;
+    std::vector<std::thread> load_threads;
+    unsigned int load_thread_count = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < load_thread_count; i++) {
+        load_threads.emplace_back([&stop_load]() {
+            volatile uint64_t sink = 0;
+            while (!stop_load.load(std::memory_order_relaxed)) {
+                sink = sink + 1;
+            }
+        });
+    }
+
+    char loaded_name[64];
+    snprintf(loaded_name, sizeof(loaded_name), "Loaded (%u busy threads)", load_thread_count);
+    run_phase(loaded_name, iterations, period);
+
+    stop_load = true;
+    for (std::thread& thread : load_threads) {
+        thread.join();
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "tsc_clock.hpp"
+
+// Measures the cost of reading the N64 counter through the TSC clock compared to converting std::chrono clocks to ticks.
+// Usage: tsc_clock_benchmark [iterations]
+
+constexpr uint64_t counter_per_ms = 46'875;
+
+static uint64_t chrono_ticks(std::chrono::steady_clock::time_point start) {
+    uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    return micros * counter_per_ms / 1000;
+}
+
+template <typename Func>
+static void measure(const char* name, uint64_t iterations, Func&& func) {
+    volatile uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+        sink = sink + func();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns_per_call = std::chrono::duration<double, std::nano>(end - start).count() / double(iterations);
+    printf("  %-28s %6.2f ns/call\n", name, ns_per_call);
+}
+
+int main(int argc, char** argv) {
+    uint64_t iterations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20'000'000;
+    if (iterations == 0) {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    printf("%llu calls each:\n", (unsigned long long)iterations);
+    measure("steady_clock -> ticks", iterations, [start]() { return chrono_ticks(start); });
+    measure("high_resolution_clock", iterations, []() { return uint64_t(std::chrono::high_resolution_clock::now().time_since_epoch().count()); });
+
+#ifdef ULTRAMODERN_HAS_TSC
+    if (!ultramodern::tsc::is_invariant()) {
+        printf("  The TSC isn't invariant on this machine, so the runtime would use steady_clock.\n");
+    }
+
+    uint64_t tsc_start = ultramodern::tsc::read();
+    uint64_t ticks_start = chrono_ticks(start);
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+    ultramodern::tsc::Calibration calibration{};
+    ultramodern::tsc::Params params{};
+    if (!ultramodern::tsc::calibrate(tsc_start, ticks_start, ultramodern::tsc::read(), chrono_ticks(start), calibration, params)) {
+        fprintf(stderr, "TSC calibration failed\n");
+        return EXIT_FAILURE;
+    }
+    ultramodern::tsc::Clock clock{};
+    clock.publish(params);
+    clock.enable();
+
+    measure("rdtsc", iterations, []() { return ultramodern::tsc::read(); });
+    measure("tsc::Clock::now", iterations, [&clock]() { return clock.now(); });
+#else
+    printf("  No TSC on this architecture.\n");
+#endif
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+#include "test_common.hpp"
+#include "tsc_clock.hpp"
+
+namespace tsc = ultramodern::tsc;
+
+// N64 counter ticks per second.
+constexpr double ticks_per_second = 46'875'000.0;
+
+// A simulated machine: a TSC running at a fixed rate that's unknown to the calibration, and a reference clock that reads
+// the true time with some sampling noise.
+struct SimulatedClocks {
+    double tsc_hz;
+    double noise_ticks;
+    std::mt19937_64 rng{ 1234 };
+
+    uint64_t tsc_at(double seconds) const {
+        return uint64_t(seconds * tsc_hz) + 1'000'000'000ULL;
+    }
+
+    uint64_t reference_at(double seconds) {
+        std::uniform_real_distribution<double> noise{ -noise_ticks, noise_ticks };
+        return uint64_t(std::max(0.0, seconds * ticks_per_second + noise(rng)));
+    }
+};
+
+static void test_negative_delta_clamps_to_base() {
+    tsc::Params params{ .base_tsc = 1000, .base_ticks = 5000, .ticks_per_tsc_fixed = 1ULL << tsc::fixed_shift };
+    CHECK(tsc::ticks_at(params, 1000) == 5000);
+    CHECK(tsc::ticks_at(params, 1100) == 5100);
+    // A TSC read slightly behind the base (e.g. from another core) must not wrap around.
+    CHECK(tsc::ticks_at(params, 990) == 5000);
+    CHECK(tsc::ticks_at(params, 0) == 5000);
+}
+
+// The 32-bit fallback has to give the same results as the 128-bit multiply, including where the partial products carry.
+static void test_portable_multiply() {
+    CHECK(tsc::mul_shift_fixed_portable(1000, 1ULL << tsc::fixed_shift) == 1000);
+    CHECK(tsc::mul_shift_fixed_portable(~0ULL, 1ULL << tsc::fixed_shift) == ~0ULL);
+    CHECK(tsc::mul_shift_fixed_portable(0xFFFFFFFFULL, 0xFFFFFFFFULL) == 0xFFFFFFFEULL);
+#if defined(__SIZEOF_INT128__)
+    std::mt19937_64 rng{ 42 };
+    uint32_t mismatches = 0;
+    for (int i = 0; i < 100000; i++) {
+        // Mix of full-width values and ones in the range the clock actually uses.
+        uint64_t value = (i % 2 == 0) ? rng() : rng() >> 20;
+        uint64_t fixed = (i % 3 == 0) ? rng() : rng() >> 31;
+        uint64_t expected = uint64_t((unsigned __int128)value * fixed >> tsc::fixed_shift);
+        mismatches += tsc::mul_shift_fixed_portable(value, fixed) == expected ? 0 : 1;
+    }
+    CHECK(mismatches == 0);
+#endif
+}
+
+static void test_rejects_bad_calibration() {
+    tsc::Calibration calibration{};
+    tsc::Params params{};
+    CHECK(!tsc::calibrate(100, 100, 100, 200, calibration, params));
+    CHECK(!tsc::calibrate(100, 200, 200, 200, calibration, params));
+    CHECK(tsc::calibrate(100, 100, 200, 200, calibration, params));
+}
+
+// Runs the clock for ten simulated hours with one refinement per second and checks that it tracks the reference clock,
+// never runs backwards and never changes rate by more than the per-refinement limit.
+static void test_long_run_drift() {
+    SimulatedClocks clocks{ .tsc_hz = 2'893'417'211.0, .noise_ticks = 50.0 };
+
+    // The initial calibration spans 20ms like the runtime's, so the noise leaves it tens of ppm off.
+    tsc::Calibration calibration{};
+    tsc::Params params{};
+    REQUIRE(tsc::calibrate(clocks.tsc_at(0.0), clocks.reference_at(0.0), clocks.tsc_at(0.02), clocks.reference_at(0.02), calibration, params));
+
+    constexpr int run_seconds = 10 * 60 * 60;
+    constexpr int settle_seconds = 60;
+    double true_rate = ticks_per_second / clocks.tsc_hz;
+    double max_error_ticks = 0.0;
+    uint64_t last_ticks = 0;
+    bool monotonic = true;
+    bool rate_steps_bounded = true;
+
+    for (int second = 1; second <= run_seconds; second++) {
+        double t = 0.02 + second;
+
+        // Check a few points between refinements as well as at them.
+        for (double fraction : { 0.0, 0.25, 0.5, 0.75 }) {
+            double sample_time = t - 1.0 + fraction;
+            uint64_t ticks = tsc::ticks_at(params, clocks.tsc_at(sample_time));
+            if (ticks < last_ticks) {
+                monotonic = false;
+            }
+            last_ticks = ticks;
+            if (second > settle_seconds) {
+                max_error_ticks = std::max(max_error_ticks, std::fabs(double(ticks) - sample_time * ticks_per_second));
+            }
+        }
+
+        double previous_rate = calibration.ticks_per_tsc;
+        params = tsc::refine(calibration, params, clocks.tsc_at(t), clocks.reference_at(t));
+        if (std::fabs(calibration.ticks_per_tsc / previous_rate - 1.0) > tsc::max_rate_step * 1.0001) {
+            rate_steps_bounded = false;
+        }
+    }
+
+    double rate_error_ppm = std::fabs(calibration.ticks_per_tsc / true_rate - 1.0) * 1e6;
+    double max_error_us = max_error_ticks / ticks_per_second * 1e6;
+    printf("  drift over %d hours: max error %.2fus, final rate error %.4fppm\n", run_seconds / 3600, max_error_us, rate_error_ppm);
+
+    CHECK(monotonic);
+    CHECK(rate_steps_bounded);
+    CHECK(rate_error_ppm < 0.1);
+    CHECK(max_error_us < 50.0);
+}
+
+// A single reference sample that's far off (e.g. right after the process was suspended) may only move the rate by the
+// per-refinement limit, and the clock must stay continuous through it.
+static void test_outlier_sample_is_limited() {
+    SimulatedClocks clocks{ .tsc_hz = 3'000'000'000.0, .noise_ticks = 0.0 };
+    tsc::Calibration calibration{};
+    tsc::Params params{};
+    REQUIRE(tsc::calibrate(clocks.tsc_at(0.0), clocks.reference_at(0.0), clocks.tsc_at(0.02), clocks.reference_at(0.02), calibration, params));
+
+    for (int second = 1; second <= 5; second++) {
+        params = tsc::refine(calibration, params, clocks.tsc_at(second), clocks.reference_at(second));
+    }
+
+    double rate_before = calibration.ticks_per_tsc;
+    uint64_t tsc_sample = clocks.tsc_at(6.0);
+    uint64_t ticks_before = tsc::ticks_at(params, tsc_sample);
+    // The reference jumps a full second ahead of where it should be.
+    params = tsc::refine(calibration, params, tsc_sample, uint64_t(7.0 * ticks_per_second));
+
+    CHECK(std::fabs(calibration.ticks_per_tsc / rate_before - 1.0) <= tsc::max_rate_step * 1.0001);
+    CHECK(tsc::ticks_at(params, tsc_sample) == ticks_before);
+    // The slew is capped, so the clock runs at most 0.1% fast to catch up.
+    double slewed_rate = double(params.ticks_per_tsc_fixed) / double(1ULL << tsc::fixed_shift);
+    CHECK(slewed_rate <= calibration.ticks_per_tsc * (1.0 + tsc::max_slew) * 1.0001);
+}
+
+int main() {
+    test_negative_delta_clamps_to_base();
+    test_portable_multiply();
+    test_rejects_bad_calibration();
+    test_long_run_drift();
+    test_outlier_sample_is_limited();
+    return test::finish("tsc_clock_test");
+}
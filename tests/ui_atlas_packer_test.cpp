@@ -0,0 +1,118 @@
+#include <random>
+#include <vector>
+
+#include "test_common.hpp"
+#include "ui_atlas_packer.hpp"
+
+using RecompRml::ShelfPacker;
+
+static bool overlaps(const ShelfPacker::Rect& a, const ShelfPacker::Rect& b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static void test_rejects_invalid_sizes() {
+    ShelfPacker packer{ 256, 256 };
+    ShelfPacker::Rect rect{};
+    CHECK(!packer.pack(0, 16, rect));
+    CHECK(!packer.pack(16, 0, rect));
+    CHECK(!packer.pack(257, 16, rect));
+    CHECK(!packer.pack(16, 257, rect));
+    CHECK(packer.pack(256, 256, rect));
+    CHECK(rect.x == 0 && rect.y == 0);
+    CHECK(!packer.pack(1, 1, rect));
+}
+
+static void test_shelves_fill_left_to_right() {
+    ShelfPacker packer{ 256, 256 };
+    ShelfPacker::Rect a{}, b{}, c{};
+    REQUIRE(packer.pack(100, 16, a));
+    REQUIRE(packer.pack(100, 16, b));
+    REQUIRE(packer.pack(100, 16, c));
+    CHECK(a.y == b.y);
+    CHECK(b.x == a.x + a.width);
+    // The third doesn't fit in what's left of the first shelf.
+    CHECK(c.y >= a.y + a.height);
+    CHECK(packer.used_area() == 3 * 100 * 16);
+}
+
+static void test_released_space_is_reused() {
+    ShelfPacker packer{ 256, 256 };
+    ShelfPacker::Rect a{}, b{}, c{}, d{};
+    REQUIRE(packer.pack(128, 16, a));
+    REQUIRE(packer.pack(128, 16, b));
+    packer.release(a);
+    REQUIRE(packer.pack(64, 16, c));
+    CHECK(c.y == a.y);
+    CHECK(c.x == a.x);
+    REQUIRE(packer.pack(64, 16, d));
+    CHECK(d.y == a.y);
+    CHECK(d.x == a.x + 64);
+}
+
+static void test_empty_trailing_shelves_are_reclaimed() {
+    ShelfPacker packer{ 64, 64 };
+    ShelfPacker::Rect small{}, tall{};
+    // Fill the whole atlas with short shelves, then release them all.
+    std::vector<ShelfPacker::Rect> rects{};
+    ShelfPacker::Rect rect{};
+    while (packer.pack(64, 4, rect)) {
+        rects.push_back(rect);
+    }
+    CHECK(rects.size() == 16);
+    for (const ShelfPacker::Rect& released : rects) {
+        packer.release(released);
+    }
+    CHECK(packer.empty());
+    // The space can now be used for a rectangle taller than any of the old shelves.
+    CHECK(packer.pack(64, 64, tall));
+    packer.release(tall);
+    CHECK(packer.pack(8, 8, small));
+}
+
+static void test_random_packing_stays_consistent() {
+    std::mt19937 rng{ 27 };
+    ShelfPacker packer{ 512, 512 };
+    std::vector<ShelfPacker::Rect> live{};
+    uint64_t live_area = 0;
+
+    for (int step = 0; step < 20000; step++) {
+        if (live.empty() || rng() % 3 != 0) {
+            uint32_t width = 1 + rng() % 64;
+            uint32_t height = 1 + rng() % 64;
+            ShelfPacker::Rect rect{};
+            if (packer.pack(width, height, rect)) {
+                REQUIRE(rect.width == width && rect.height == height);
+                REQUIRE(rect.x + rect.width <= 512 && rect.y + rect.height <= 512);
+                for (const ShelfPacker::Rect& other : live) {
+                    REQUIRE(!overlaps(rect, other));
+                }
+                live.push_back(rect);
+                live_area += uint64_t(width) * height;
+            }
+        }
+        else {
+            size_t index = rng() % live.size();
+            packer.release(live[index]);
+            live_area -= uint64_t(live[index].width) * live[index].height;
+            live[index] = live.back();
+            live.pop_back();
+        }
+        REQUIRE(packer.used_area() == live_area);
+    }
+
+    for (const ShelfPacker::Rect& rect : live) {
+        packer.release(rect);
+    }
+    CHECK(packer.empty());
+    ShelfPacker::Rect full{};
+    CHECK(packer.pack(512, 512, full));
+}
+
+int main() {
+    test_rejects_invalid_sizes();
+    test_shelves_fill_left_to_right();
+    test_released_space_is_reused();
+    test_empty_trailing_shelves_are_reclaimed();
+    test_random_packing_stays_consistent();
+    return test::finish("ui_atlas_packer_test");
+}
@@ -0,0 +1,153 @@
+#include <memory>
+#include <vector>
+
+#include "test_common.hpp"
+#include "ui_geometry_pool.hpp"
+
+// Stands in for RT64's RHI, recording the buffers the pool creates instead of creating GPU resources.
+struct MockBackend {
+    struct Buffer {
+        bool index;
+        uint32_t count;
+    };
+
+    std::vector<Buffer> created{};
+    bool fail = false;
+
+    std::unique_ptr<Buffer> create_vertex_buffer(uint32_t count) {
+        return create(false, count);
+    }
+
+    std::unique_ptr<Buffer> create_index_buffer(uint32_t count) {
+        return create(true, count);
+    }
+
+    std::unique_ptr<Buffer> create(bool index, uint32_t count) {
+        if (fail) {
+            return nullptr;
+        }
+        created.push_back(Buffer{ index, count });
+        return std::make_unique<Buffer>(Buffer{ index, count });
+    }
+};
+
+using Pool = RecompRml::GeometryPool<MockBackend>;
+
+constexpr uint32_t page_vertices = 1024;
+constexpr uint32_t page_indices = 3 * page_vertices;
+
+static void test_first_allocation_creates_page() {
+    MockBackend backend{};
+    Pool pool{ backend, page_vertices, page_indices };
+    Pool::Allocation allocation{};
+    REQUIRE(pool.allocate(100, 300, allocation));
+    CHECK(allocation.page == 0);
+    CHECK(allocation.vertex_offset == 0);
+    CHECK(allocation.index_offset == 0);
+    CHECK(allocation.num_vertices == 100);
+    CHECK(allocation.num_indices == 300);
+    REQUIRE(backend.created.size() == 2);
+    CHECK(!backend.created[0].index && backend.created[0].count == page_vertices);
+    CHECK(backend.created[1].index && backend.created[1].count == page_indices);
+    CHECK(pool.pages().size() == 1);
+    CHECK(pool.pages()[0].vertices.used() == 100);
+    CHECK(pool.pages()[0].indices.used() == 300);
+}
+
+static void test_full_page_opens_another() {
+    MockBackend backend{};
+    Pool pool{ backend, page_vertices, page_indices };
+    Pool::Allocation first{}, second{}, third{};
+    REQUIRE(pool.allocate(600, 600, first));
+    REQUIRE(pool.allocate(400, 600, second));
+    CHECK(second.page == 0);
+    CHECK(second.vertex_offset == 600);
+    REQUIRE(pool.allocate(100, 100, third));
+    CHECK(third.page == 1);
+    CHECK(pool.pages().size() == 2);
+    CHECK(backend.created.size() == 4);
+}
+
+static void test_oversized_geometry_gets_its_own_page() {
+    MockBackend backend{};
+    Pool pool{ backend, page_vertices, page_indices };
+    Pool::Allocation allocation{};
+    REQUIRE(pool.allocate(4 * page_vertices, 10, allocation));
+    REQUIRE(backend.created.size() == 2);
+    CHECK(backend.created[0].count == 4 * page_vertices);
+    CHECK(backend.created[1].count == page_indices);
+}
+
+static void test_release_is_deferred_to_next_frame() {
+    MockBackend backend{};
+    Pool pool{ backend, page_vertices, page_indices };
+    Pool::Allocation first{}, second{};
+    REQUIRE(pool.allocate(page_vertices, 10, first));
+    pool.release(first);
+
+    // The GPU may still be reading the released ranges, so they can't be handed out again within the same frame.
+    REQUIRE(pool.allocate(page_vertices, 10, second));
+    CHECK(second.page == 1);
+
+    pool.begin_frame();
+    Pool::Allocation third{};
+    REQUIRE(pool.allocate(page_vertices, 10, third));
+    CHECK(third.page == 0);
+    CHECK(third.vertex_offset == 0);
+    CHECK(pool.pages().size() == 2);
+}
+
+static void test_released_ranges_merge() {
+    MockBackend backend{};
+    Pool pool{ backend, page_vertices, page_indices };
+    Pool::Allocation a{}, b{}, c{};
+    REQUIRE(pool.allocate(256, 256, a));
+    REQUIRE(pool.allocate(256, 256, b));
+    REQUIRE(pool.allocate(512, 512, c));
+    pool.release(b);
+    pool.release(a);
+    pool.begin_frame();
+    CHECK(pool.pages()[0].vertices.used() == 512);
+
+    // Only fits if the two released neighbours were merged back into one range.
+    Pool::Allocation merged{};
+    REQUIRE(pool.allocate(512, 512, merged));
+    CHECK(merged.page == 0);
+    CHECK(merged.vertex_offset == 0);
+    CHECK(merged.index_offset == 0);
+}
+
+static void test_index_overflow_rolls_back_vertices() {
+    MockBackend backend{};
+    Pool pool{ backend, page_vertices, page_indices };
+    Pool::Allocation a{}, b{};
+    REQUIRE(pool.allocate(10, page_indices, a));
+    // The vertices fit in page 0 but the indices don't, so page 0 must be left as it was.
+    REQUIRE(pool.allocate(10, 10, b));
+    CHECK(b.page == 1);
+    CHECK(pool.pages()[0].vertices.used() == 10);
+}
+
+static void test_backend_failure() {
+    MockBackend backend{};
+    backend.fail = true;
+    Pool pool{ backend, page_vertices, page_indices };
+    Pool::Allocation allocation{};
+    CHECK(!pool.allocate(10, 10, allocation));
+    CHECK(pool.pages().empty());
+
+    backend.fail = false;
+    CHECK(pool.allocate(10, 10, allocation));
+    CHECK(allocation.page == 0);
+}
+
+int main() {
+    test_first_allocation_creates_page();
+    test_full_page_opens_another();
+    test_oversized_geometry_gets_its_own_page();
+    test_release_is_deferred_to_next_frame();
+    test_released_ranges_merge();
+    test_index_overflow_rolls_back_vertices();
+    test_backend_failure();
+    return test::finish("ui_geometry_pool_test");
+}
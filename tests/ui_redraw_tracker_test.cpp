@@ -0,0 +1,165 @@
+#include <chrono>
+#include <thread>
+
+#include "test_common.hpp"
+#include "ui_redraw_tracker.hpp"
+
+using RecompRml::RedrawTracker;
+using Action = RedrawTracker::Action;
+using namespace std::chrono_literals;
+
+constexpr int width = 1920;
+constexpr int height = 1080;
+// RmlUi's update delay when nothing is animating, which is longer than the retain period.
+constexpr double idle_delay = 1e9;
+
+// Stands in for draw_hook, with the time advancing by a frame each call.
+struct Frames {
+    RedrawTracker tracker{};
+    RedrawTracker::Clock::time_point now{ 1h };
+    bool multisampled = false;
+
+    Action next(double update_delay = idle_delay, int frame_width = width, int frame_height = height) {
+        now += 16ms;
+        Action action = tracker.begin_frame(now, frame_width, frame_height, multisampled);
+        if (action != Action::Retain) {
+            tracker.rendered(now, update_delay);
+        }
+        return action;
+    }
+
+    // Runs idle frames until the UI has been retained, which takes one rendered frame after any change.
+    void settle() {
+        for (int i = 0; i < 3; i++) {
+            next();
+        }
+        REQUIRE(next() == Action::Retain);
+    }
+};
+
+static void test_first_frame_renders_then_retains() {
+    Frames frames{};
+    CHECK(frames.next() == Action::RenderRetained);
+    CHECK(frames.next() == Action::Retain);
+    CHECK(frames.next() == Action::Retain);
+}
+
+// An input event reaching an open menu invalidates the UI from the render thread.
+static void test_input_event() {
+    Frames frames{};
+    frames.settle();
+    frames.tracker.invalidate();
+    CHECK(frames.next() == Action::RenderRetained);
+    CHECK(frames.next() == Action::Retain);
+}
+
+// invalidate_ui is called from whichever thread changed a data model variable.
+static void test_invalidate_from_another_thread() {
+    Frames frames{};
+    frames.settle();
+    std::thread other{ [&frames]() { frames.tracker.invalidate(); } };
+    other.join();
+    CHECK(frames.next() == Action::RenderRetained);
+    CHECK(frames.next() == Action::Retain);
+}
+
+// A menu change invalidates the UI the same way, and a change that's been handled doesn't cause another redraw.
+static void test_menu_change() {
+    Frames frames{};
+    frames.settle();
+    frames.tracker.invalidate();
+    frames.tracker.invalidate();
+    CHECK(frames.next() == Action::RenderRetained);
+    CHECK(frames.next() == Action::Retain);
+}
+
+// The retained frame is the size of the swap chain it was rendered for, so a resize always redraws.
+static void test_window_resize() {
+    Frames frames{};
+    frames.settle();
+    CHECK(frames.next(idle_delay, 1280, 720) == Action::RenderRetained);
+    CHECK(frames.next(idle_delay, 1280, 720) == Action::Retain);
+    CHECK(frames.next(idle_delay, 1920, 1080) == Action::RenderRetained);
+}
+
+// A caret blink or transition asks for an update after a delay, and the UI is redrawn once it has passed.
+static void test_update_delay_expiry() {
+    Frames frames{};
+    frames.settle();
+    frames.tracker.invalidate();
+    CHECK(frames.next(0.1) == Action::RenderRetained);
+
+    int retained = 0;
+    while (frames.next() == Action::Retain) {
+        retained++;
+    }
+    // 100ms is six 16ms frames.
+    CHECK(retained == 6);
+    CHECK(frames.next() == Action::Retain);
+}
+
+// Without anything asking for an update, the UI is still refreshed once per retain period.
+static void test_safety_refresh() {
+    Frames frames{};
+    frames.settle();
+    frames.tracker.invalidate();
+    REQUIRE(frames.next() == Action::RenderRetained);
+    RedrawTracker::Clock::time_point last_render = frames.now;
+    int retained = 0;
+    while (frames.next() == Action::Retain) {
+        retained++;
+    }
+    CHECK(frames.now - last_render >= RedrawTracker::max_retain_period);
+    CHECK(frames.now - last_render < RedrawTracker::max_retain_period + 16ms);
+    CHECK(retained > 0);
+}
+
+// While the UI changes on consecutive frames it's drawn straight to the swap chain, and the first frame once it stops goes
+// through the texture so that it can be retained.
+static void test_direct_while_changing() {
+    Frames frames{};
+    frames.settle();
+
+    // An animation asks for an update on every frame.
+    frames.tracker.invalidate();
+    CHECK(frames.next(0.0) == Action::RenderRetained);
+    CHECK(frames.next(0.0) == Action::RenderDirect);
+    CHECK(frames.next(0.0) == Action::RenderDirect);
+    CHECK(frames.next() == Action::RenderDirect);
+    CHECK(frames.next() == Action::RenderRetained);
+    CHECK(frames.next() == Action::Retain);
+
+    // Likewise for input on every frame.
+    for (int i = 0; i < 3; i++) {
+        frames.tracker.invalidate();
+        CHECK(frames.next() == (i == 0 ? Action::RenderRetained : Action::RenderDirect));
+    }
+    CHECK(frames.next() == Action::RenderRetained);
+    CHECK(frames.next() == Action::Retain);
+}
+
+// With MSAA the UI has to be resolved from the texture anyway, so it's never drawn straight to the swap chain.
+static void test_multisampled_never_direct() {
+    Frames frames{};
+    frames.multisampled = true;
+    frames.settle();
+    frames.tracker.invalidate();
+    for (int i = 0; i < 5; i++) {
+        CHECK(frames.next(0.0) == Action::RenderRetained);
+    }
+    CHECK(frames.next() == Action::RenderRetained);
+    CHECK(frames.next() == Action::Retain);
+}
+
+int main() {
+    test_first_frame_renders_then_retains();
+    test_input_event();
+    test_invalidate_from_another_thread();
+    test_menu_change();
+    test_window_resize();
+    test_update_delay_expiry();
+    test_safety_refresh();
+    test_direct_while_changing();
+    test_multisampled_never_direct();
+    return test::finish("ui_redraw_tracker_test");
+}
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Differential test for RECOMP_RDRAM_BIG_ENDIAN. Replays the same input recording in a build with native word RDRAM and one with
+// big-endian RDRAM, with RECOMP_RDRAM_HASH writing a hash of RDRAM at every controller read (once per frame), and reports the
+// first read where the two builds' RDRAM differed. The hashes are taken in the console's byte order, so they match whenever
+// the game state does. See include/recomp_training.h for recording input and for why long replays can drift apart.
+
+namespace {
+    struct Build {
+        const char* name;
+        std::filesystem::path executable;
+        std::filesystem::path hash_path;
+        std::vector<uint64_t> hashes{};
+    };
+
+    void set_env(const char* name, const std::string& value) {
+#if defined(_WIN32)
+        _putenv_s(name, value.c_str());
+#else
+        setenv(name, value.c_str(), 1);
+#endif
+    }
+
+    // Runs the build in training mode with the script, returning false if it didn't exit cleanly.
+    bool run_build(const Build& build, const std::filesystem::path& script_path) {
+        set_env("RECOMP_RDRAM_HASH", build.hash_path.string());
+        // Progress reports would only interleave with the comparison's output.
+        set_env("RECOMP_TRAINING_REPORT_INTERVAL", "0");
+        std::string command = "\"" + build.executable.string() + "\" --training \"" + script_path.string() + "\"";
+#if defined(_WIN32)
+        // cmd.exe strips the outer quotes of the whole command line.
+        command = "\"" + command + "\"";
+#endif
+        printf("Running the %s build: %s\n", build.name, command.c_str());
+        fflush(stdout);
+        int status = std::system(command.c_str());
+        if (status != 0) {
+            fprintf(stderr, "The %s build exited with status %d\n", build.name, status);
+            return false;
+        }
+        return true;
+    }
+
+    // Reads the "<read index> <hash>" lines written by RECOMP_RDRAM_HASH.
+    bool read_hashes(Build& build) {
+        FILE* file = fopen(build.hash_path.string().c_str(), "r");
+        if (file == nullptr) {
+            fprintf(stderr, "The %s build didn't write %s\n", build.name, build.hash_path.string().c_str());
+            return false;
+        }
+        uint64_t index;
+        uint64_t hash;
+        while (fscanf(file, "%" SCNu64 " %" SCNx64, &index, &hash) == 2) {
+            if (index != build.hashes.size()) {
+                fprintf(stderr, "%s is missing the hash for controller read %zu\n", build.hash_path.string().c_str(), build.hashes.size());
+                fclose(file);
+                return false;
+            }
+            build.hashes.push_back(hash);
+        }
+        fclose(file);
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <native build executable> <big-endian build executable> <input recording> [work directory]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::error_code ec;
+    std::filesystem::path work_dir = argc > 4 ? std::filesystem::path{ argv[4] } : std::filesystem::current_path();
+    std::filesystem::create_directories(work_dir, ec);
+    std::filesystem::path recording = std::filesystem::absolute(argv[3], ec);
+
+    // Both builds replay the recording and then quit.
+    std::filesystem::path script_path = work_dir / "compare_rdram_layouts.txt";
+    {
+        std::ofstream script{ script_path };
+        script << "replay " << recording.string() << "\nquit\n";
+        if (!script.good()) {
+            fprintf(stderr, "Failed to write %s\n", script_path.string().c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    Build builds[2] = {
+        { "native", std::filesystem::absolute(argv[1], ec), work_dir / "rdram_hashes_native.txt" },
+        { "big-endian", std::filesystem::absolute(argv[2], ec), work_dir / "rdram_hashes_big_endian.txt" },
+    };
+    for (Build& build : builds) {
+        std::filesystem::remove(build.hash_path, ec);
+        if (!run_build(build, script_path) || !read_hashes(build)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    const std::vector<uint64_t>& native = builds[0].hashes;
+    const std::vector<uint64_t>& big_endian = builds[1].hashes;
+    size_t common = std::min(native.size(), big_endian.size());
+    for (size_t i = 0; i < common; i++) {
+        if (native[i] != big_endian[i]) {
+            printf("RDRAM differs from controller read %zu of %zu: %016" PRIX64 " (native) vs %016" PRIX64 " (big-endian)\n",
+                i, common, native[i], big_endian[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (native.size() != big_endian.size()) {
+        printf("RDRAM matched for %zu controller reads, but the native build read %zu times and the big-endian build %zu times\n",
+            common, native.size(), big_endian.size());
+        return EXIT_FAILURE;
+    }
+    if (common == 0) {
+        printf("Neither build read the controller, so there was nothing to compare\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("RDRAM matched at all %zu controller reads\n", common);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "../ultramodern/compressed_stream.hpp"
+
+// Build time tool that compresses a file into the format read by ultramodern::compressed_stream, used to shrink data that gets
+// embedded in the executable. The output is decompressed again and compared to the input before it's written.
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <input file> <output file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream input_file{ argv[1], std::ios::binary };
+    if (!input_file.good()) {
+        fprintf(stderr, "Failed to open input file %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    std::vector<char> input{ std::istreambuf_iterator<char>{input_file}, std::istreambuf_iterator<char>{} };
+
+    std::vector<char> compressed = ultramodern::compressed_stream::compress(input);
+
+    auto decompress_start = std::chrono::steady_clock::now();
+    std::vector<char> decompressed{};
+    bool decompressed_ok = ultramodern::compressed_stream::decompress(compressed, decompressed);
+    auto decompress_time = std::chrono::steady_clock::now() - decompress_start;
+
+    if (!decompressed_ok || decompressed != input) {
+        fprintf(stderr, "Round trip check failed for %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream output_file{ argv[2], std::ios::binary };
+    output_file.write(compressed.data(), compressed.size());
+    if (!output_file.good()) {
+        fprintf(stderr, "Failed to write output file %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    printf("Compressed %s: %zu -> %zu bytes (%.1f%%), decompresses in %.2f ms\n",
+        argv[1], input.size(), compressed.size(), 100.0 * compressed.size() / std::max<size_t>(input.size(), 1),
+        std::chrono::duration<double, std::milli>(decompress_time).count());
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../ultramodern/dl_capture.hpp"
+
+namespace dl_capture = ultramodern::dl_capture;
+
+namespace {
+    // Large enough for any capture, as the runtime's RDRAM is never bigger than this.
+    constexpr uint32_t max_rdram_size = 64 * 1024 * 1024;
+
+    struct FrameStats {
+        uint32_t tasks = 0;
+        dl_capture::DisplayListInfo info{};
+    };
+
+    // Replay sink that walks every display list instead of rendering it, so captures can be inspected without a GPU.
+    class CountingSink : public dl_capture::Sink {
+    public:
+        explicit CountingSink(uint32_t rdram_size) : rdram_size_(rdram_size) {}
+
+        void send_dl(uint8_t* rdram, const OSTask* task) override {
+            cur_frame_.tasks++;
+            dl_capture::walk_display_list(rdram, rdram_size_, task->t.data_ptr, cur_frame_.info);
+        }
+
+        void update_screen(uint8_t* rdram, const dl_capture::ViRegisters& vi_regs) override {
+            frames.emplace_back(std::move(cur_frame_));
+            cur_frame_ = {};
+        }
+
+        std::vector<FrameStats> frames{};
+    private:
+        uint32_t rdram_size_;
+        FrameStats cur_frame_{};
+    };
+
+    uint32_t matrix_group_pushes(const dl_capture::DisplayListInfo& info) {
+        uint32_t ret = 0;
+        for (const auto& [id, count] : info.matrix_groups) {
+            ret += count;
+        }
+        return ret;
+    }
+
+    void print_frame(size_t index, const FrameStats& frame) {
+        const dl_capture::DisplayListInfo& info = frame.info;
+        printf("%6zu %5u %9u %9u %9u %12llu %5u %7zu %7u%s\n", index, frame.tasks, info.commands, info.triangles, info.vertices,
+            static_cast<unsigned long long>(info.texture_load_bytes), info.max_depth, info.matrix_groups.size(),
+            matrix_group_pushes(info), info.truncated ? "  (truncated)" : "");
+    }
+
+    void print_frame_header() {
+        printf("%6s %5s %9s %9s %9s %12s %5s %7s %7s\n", "frame", "tasks", "commands", "tris", "verts", "tex bytes", "depth",
+            "groups", "pushes");
+    }
+
+    void analyze(const std::vector<FrameStats>& frames, size_t top_count, bool per_frame) {
+        if (per_frame) {
+            print_frame_header();
+            for (size_t i = 0; i < frames.size(); i++) {
+                print_frame(i, frames[i]);
+            }
+            printf("\n");
+        }
+
+        // Frames with the most commands are the most likely to have pathological display lists.
+        std::vector<size_t> order(frames.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&frames](size_t a, size_t b) {
+            return frames[a].info.commands > frames[b].info.commands;
+        });
+        printf("Heaviest frames by command count:\n");
+        print_frame_header();
+        for (size_t i = 0; i < std::min(top_count, order.size()); i++) {
+            print_frame(order[i], frames[order[i]]);
+        }
+
+        dl_capture::DisplayListInfo totals{};
+        for (const FrameStats& frame : frames) {
+            for (size_t opcode = 0; opcode < totals.command_counts.size(); opcode++) {
+                totals.command_counts[opcode] += frame.info.command_counts[opcode];
+            }
+            for (size_t extended = 0; extended < totals.extended_command_counts.size(); extended++) {
+                totals.extended_command_counts[extended] += frame.info.extended_command_counts[extended];
+            }
+            for (const auto& [id, count] : frame.info.matrix_groups) {
+                totals.matrix_groups[id] += count;
+            }
+            totals.commands += frame.info.commands;
+        }
+
+        printf("\nCommands by opcode (%u total):\n", totals.commands);
+        std::vector<std::pair<uint32_t, uint32_t>> opcodes{};
+        for (size_t opcode = 0; opcode < totals.command_counts.size(); opcode++) {
+            if (totals.command_counts[opcode] != 0) {
+                opcodes.emplace_back(totals.command_counts[opcode], static_cast<uint32_t>(opcode));
+            }
+        }
+        std::sort(opcodes.rbegin(), opcodes.rend());
+        for (const auto& [count, opcode] : opcodes) {
+            printf("  0x%02X %10u\n", opcode, count);
+        }
+
+        printf("\nExtended commands by id:\n");
+        for (size_t extended = 0; extended < totals.extended_command_counts.size(); extended++) {
+            if (totals.extended_command_counts[extended] != 0) {
+                printf("  0x%02zX %10u\n", extended, totals.extended_command_counts[extended]);
+            }
+        }
+
+        std::vector<std::pair<uint32_t, uint32_t>> groups{};
+        for (const auto& [id, count] : totals.matrix_groups) {
+            groups.emplace_back(count, id);
+        }
+        std::sort(groups.rbegin(), groups.rend());
+        printf("\nMatrix group tags (%zu distinct, top %zu):\n", groups.size(), std::min(top_count, groups.size()));
+        for (size_t i = 0; i < std::min(top_count, groups.size()); i++) {
+            printf("  0x%08X %10u\n", groups[i].second, groups[i].first);
+        }
+    }
+}
+
+// Offline tool for display list captures (see ultramodern/dl_capture.hpp).
+//   analyze: per-frame command counts, matrix group tag usage, texture load bytes and display list depth.
+//   replay: replays the capture into a counting sink to measure how fast captures can be fed to a renderer.
+int main(int argc, char** argv) {
+    if (argc < 3 || (strcmp(argv[1], "analyze") != 0 && strcmp(argv[1], "replay") != 0)) {
+        fprintf(stderr, "Usage: %s analyze <capture> [--top N] [--frames]\n", argv[0]);
+        fprintf(stderr, "       %s replay <capture> [--loops N]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bool replay_mode = strcmp(argv[1], "replay") == 0;
+    const char* capture_path = argv[2];
+    size_t top_count = 10;
+    long loops = 1;
+    bool per_frame = false;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+            top_count = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+            loops = std::max(strtol(argv[++i], nullptr, 10), 1L);
+        }
+        else if (strcmp(argv[i], "--frames") == 0) {
+            per_frame = true;
+        }
+    }
+
+    std::unique_ptr<uint8_t[]> rdram = std::make_unique<uint8_t[]>(max_rdram_size);
+    CountingSink sink{ max_rdram_size };
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < loops; i++) {
+        if (!dl_capture::replay(capture_path, rdram.get(), max_rdram_size, sink)) {
+            fprintf(stderr, "Failed to read capture %s\n", capture_path);
+            return EXIT_FAILURE;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (replay_mode) {
+        printf("Replayed %zu frames in %.3f s (%.1f frames/s)\n", sink.frames.size(), seconds, sink.frames.size() / seconds);
+    }
+    else {
+        analyze(sink.frames, top_count, per_frame);
+    }
+
+    return EXIT_SUCCESS;
+}
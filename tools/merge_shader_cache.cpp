@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../ultramodern/compressed_stream.hpp"
+#include "../ultramodern/shader_cache.hpp"
+
+static bool read_file(const char* path, std::vector<char>& out) {
+    std::ifstream input_file{ path, std::ios::binary };
+    if (!input_file.good()) {
+        return false;
+    }
+    out.assign(std::istreambuf_iterator<char>{input_file}, std::istreambuf_iterator<char>{});
+    return true;
+}
+
+// Merges user shader caches collected from several machines into one, e.g. to fold them back into the embedded list or to
+// share them. Shaders that are already in the list passed with --exclude (such as the embedded one) are left out.
+int main(int argc, char** argv) {
+    namespace shader_cache = ultramodern::shader_cache;
+
+    std::vector<const char*> exclude_paths{};
+    std::vector<const char*> positional_args{};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--exclude") == 0 && i + 1 < argc) {
+            exclude_paths.push_back(argv[++i]);
+        }
+        else {
+            positional_args.push_back(argv[i]);
+        }
+    }
+
+    if (positional_args.size() < 2) {
+        fprintf(stderr, "Usage: %s [--exclude <shader list>]... <output file> <input file>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    shader_cache::Merger merger{};
+    std::vector<char> file_data{};
+
+    // Both kinds of input may be compressed, as is the case for the embedded list in the build directory.
+    for (const char* path : exclude_paths) {
+        if (!read_file(path, file_data)) {
+            fprintf(stderr, "Failed to open shader list %s\n", path);
+            return EXIT_FAILURE;
+        }
+        ultramodern::compressed_stream::InputBuffer buffer{file_data};
+        std::istream stream{&buffer};
+        merger.add_reference(stream);
+    }
+
+    for (size_t i = 1; i < positional_args.size(); i++) {
+        if (!read_file(positional_args[i], file_data)) {
+            fprintf(stderr, "Failed to open shader cache %s\n", positional_args[i]);
+            return EXIT_FAILURE;
+        }
+        ultramodern::compressed_stream::InputBuffer buffer{file_data};
+        std::istream stream{&buffer};
+        merger.add(stream);
+    }
+
+    shader_cache::MergeResult result = merger.finish(shader_cache::max_user_cache_size);
+
+    std::ofstream output_file{ positional_args[0], std::ios::binary };
+    output_file.write(result.data.data(), result.data.size());
+    if (!output_file.good()) {
+        fprintf(stderr, "Failed to write output file %s\n", positional_args[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("Wrote %zu shaders (%zu bytes) to %s\n", result.records, result.data.size(), positional_args[0]);
+    printf("Dropped %zu duplicate, %zu incompatible and %zu over the size limit; %zu inputs ended in a truncated record\n",
+        result.duplicates, result.incompatible, result.over_size, result.malformed_inputs);
+
+    return EXIT_SUCCESS;
+}
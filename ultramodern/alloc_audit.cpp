@@ -0,0 +1,406 @@
+#ifdef ULTRAMODERN_ALLOC_AUDIT
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cinttypes>
+#include <cerrno>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+#include "alloc_audit.hpp"
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   include <Windows.h>
+#elif defined(__GLIBC__)
+#   include <execinfo.h>
+#   define ALLOC_AUDIT_INTERPOSE_MALLOC
+#endif
+
+#ifdef _MSC_VER
+#   define ALLOC_AUDIT_NOINLINE __declspec(noinline)
+#else
+#   define ALLOC_AUDIT_NOINLINE __attribute__((noinline))
+#endif
+
+namespace {
+    constexpr size_t max_stack_depth = 12;
+    // Frames skipped at the top of each sampled stack, which belong to the audit itself: capture_stack, record_sample,
+    // record_allocation and the interposed allocation function. These are kept from being inlined so the count is fixed.
+    constexpr size_t skipped_stack_frames = 4;
+    constexpr size_t call_site_table_size = 4096;
+    constexpr size_t frame_history_size = 600;
+    constexpr uint32_t default_sample_period = 64;
+
+    struct CallSite {
+        std::atomic_uint64_t hash;
+        std::atomic_bool ready;
+        std::array<void*, max_stack_depth> stack;
+        uint32_t depth;
+        std::atomic_uint64_t samples;
+        std::atomic_uint64_t bytes;
+    };
+
+    // Everything here is statically allocated, as it's used from inside the allocator.
+    struct {
+        bool recording = false;
+        uint32_t sample_period = default_sample_period;
+        int64_t budget = -1;
+        std::atomic_uint64_t frame_allocations = 0;
+        std::atomic_uint64_t frame_bytes = 0;
+        std::atomic_uint64_t total_allocations = 0;
+        std::atomic_uint64_t total_frees = 0;
+        std::atomic_uint64_t dropped_samples = 0;
+        std::array<uint64_t, frame_history_size> allocations_per_frame{};
+        std::array<uint64_t, frame_history_size> bytes_per_frame{};
+        uint64_t frames_recorded = 0;
+        std::array<CallSite, call_site_table_size> call_sites{};
+    } audit;
+
+    // Set while the calling thread is inside the audit, so that allocations made by the audit itself (e.g. by the unwinder)
+    // aren't recorded and can't recurse.
+    thread_local bool in_audit = false;
+    thread_local uint32_t sample_countdown = 0;
+
+    ALLOC_AUDIT_NOINLINE size_t capture_stack(std::array<void*, max_stack_depth + skipped_stack_frames>& frames) {
+#if defined(_WIN32)
+        return RtlCaptureStackBackTrace(0, static_cast<DWORD>(frames.size()), frames.data(), nullptr);
+#elif defined(__GLIBC__)
+        return backtrace(frames.data(), static_cast<int>(frames.size()));
+#else
+        return 0;
+#endif
+    }
+
+    ALLOC_AUDIT_NOINLINE void record_sample(size_t size) {
+        std::array<void*, max_stack_depth + skipped_stack_frames> frames;
+        size_t frame_count = capture_stack(frames);
+        if (frame_count <= skipped_stack_frames) {
+            return;
+        }
+
+        void** stack = frames.data() + skipped_stack_frames;
+        size_t depth = frame_count - skipped_stack_frames;
+
+        // FNV-1a over the return addresses. 0 marks an empty slot, so it's never used as a hash.
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < depth; i++) {
+            hash = (hash ^ reinterpret_cast<uintptr_t>(stack[i])) * 0x100000001b3ULL;
+        }
+        hash |= 1;
+
+        for (size_t probe = 0; probe < 32; probe++) {
+            CallSite& site = audit.call_sites[(hash + probe) % call_site_table_size];
+            uint64_t expected = 0;
+            if (site.hash.compare_exchange_strong(expected, hash, std::memory_order_acq_rel)) {
+                std::copy_n(stack, depth, site.stack.begin());
+                site.depth = static_cast<uint32_t>(depth);
+                site.ready.store(true, std::memory_order_release);
+            }
+            else if (expected != hash) {
+                continue;
+            }
+            site.samples.fetch_add(1, std::memory_order_relaxed);
+            site.bytes.fetch_add(size, std::memory_order_relaxed);
+            return;
+        }
+
+        audit.dropped_samples.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ALLOC_AUDIT_NOINLINE void record_allocation(size_t size) {
+        if (!audit.recording || in_audit) {
+            return;
+        }
+
+        in_audit = true;
+        audit.frame_allocations.fetch_add(1, std::memory_order_relaxed);
+        audit.frame_bytes.fetch_add(size, std::memory_order_relaxed);
+        audit.total_allocations.fetch_add(1, std::memory_order_relaxed);
+
+        if (sample_countdown == 0) {
+            sample_countdown = audit.sample_period;
+            record_sample(size);
+        }
+        sample_countdown--;
+        in_audit = false;
+    }
+
+    void record_free(void* ptr) {
+        if (ptr != nullptr && audit.recording && !in_audit) {
+            audit.total_frees.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool init_audit() {
+        const char* setting = getenv("RECOMP_ALLOC_AUDIT");
+        if (setting == nullptr) {
+            return false;
+        }
+
+        long sample_period = strtol(setting, nullptr, 10);
+        audit.sample_period = sample_period > 0 ? static_cast<uint32_t>(sample_period) : default_sample_period;
+
+        const char* budget = getenv("RECOMP_ALLOC_AUDIT_BUDGET");
+        if (budget != nullptr) {
+            audit.budget = strtoll(budget, nullptr, 10);
+        }
+
+        // The unwinder allocates the first time it's used, so get that out of the way before recording starts.
+        in_audit = true;
+        std::array<void*, max_stack_depth + skipped_stack_frames> frames;
+        capture_stack(frames);
+        in_audit = false;
+
+        audit.recording = true;
+        return true;
+    }
+
+    [[maybe_unused]] const bool audit_initialized = init_audit();
+}
+
+#ifdef ALLOC_AUDIT_INTERPOSE_MALLOC
+// On glibc the executable's definitions of the allocation functions take precedence over libc's for the whole process,
+// including allocations from operator new and from other libraries.
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* ptr);
+
+    void* malloc(size_t size) {
+        record_allocation(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) {
+        record_allocation(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, size_t size) {
+        record_allocation(size);
+        return __libc_realloc(ptr, size);
+    }
+
+    // The aligned allocation functions are interposed too, as libstdc++ implements the aligned forms of operator new with them.
+    void* memalign(size_t alignment, size_t size) {
+        record_allocation(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) {
+        record_allocation(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** out, size_t alignment, size_t size) {
+        if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+            return EINVAL;
+        }
+        record_allocation(size);
+        void* ret = __libc_memalign(alignment, size);
+        if (ret == nullptr) {
+            return ENOMEM;
+        }
+        *out = ret;
+        return 0;
+    }
+
+    void free(void* ptr) {
+        record_free(ptr);
+        __libc_free(ptr);
+    }
+}
+#else
+// Without a way to interpose malloc, audit C++ allocations through the replaceable global operator new and delete.
+void* operator new(size_t size) {
+    record_allocation(size);
+    void* ret = std::malloc(size == 0 ? 1 : size);
+    if (ret == nullptr) {
+        throw std::bad_alloc{};
+    }
+    return ret;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    record_allocation(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept {
+    record_free(ptr);
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+static void* aligned_heap_alloc(size_t size, size_t alignment) {
+#if defined(_WIN32)
+    return _aligned_malloc(size == 0 ? 1 : size, alignment);
+#else
+    // aligned_alloc requires the size to be a multiple of the alignment.
+    return std::aligned_alloc(alignment, (std::max<size_t>(size, 1) + alignment - 1) & ~(alignment - 1));
+#endif
+}
+
+static void aligned_heap_free(void* ptr) {
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    record_allocation(size);
+    void* ret = aligned_heap_alloc(size, static_cast<size_t>(alignment));
+    if (ret == nullptr) {
+        throw std::bad_alloc{};
+    }
+    return ret;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    record_allocation(size);
+    return aligned_heap_alloc(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept {
+    return operator new(size, alignment, tag);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    record_free(ptr);
+    aligned_heap_free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept {
+    operator delete(ptr, alignment);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept {
+    operator delete(ptr, alignment);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t alignment) noexcept {
+    operator delete(ptr, alignment);
+}
+#endif
+
+ultramodern::alloc_audit::Totals ultramodern::alloc_audit::totals() {
+    return Totals{
+        .recording = audit.recording,
+        .allocations = audit.total_allocations.load(std::memory_order_relaxed),
+        .frees = audit.total_frees.load(std::memory_order_relaxed),
+        .frame_allocations = audit.frame_allocations.load(std::memory_order_relaxed),
+        .frame_bytes = audit.frame_bytes.load(std::memory_order_relaxed),
+        .frames_recorded = audit.frames_recorded,
+    };
+}
+
+void ultramodern::alloc_audit::next_frame() {
+    if (!audit.recording) {
+        return;
+    }
+
+    // Only the VI thread closes frames, so the history itself needs no synchronization beyond the report reading it at exit.
+    size_t slot = audit.frames_recorded % frame_history_size;
+    audit.allocations_per_frame[slot] = audit.frame_allocations.exchange(0, std::memory_order_relaxed);
+    audit.bytes_per_frame[slot] = audit.frame_bytes.exchange(0, std::memory_order_relaxed);
+    audit.frames_recorded++;
+}
+
+static void print_stack(FILE* out, void* const* stack, size_t depth) {
+#if defined(__GLIBC__)
+    char** symbols = backtrace_symbols(stack, static_cast<int>(depth));
+    for (size_t i = 0; i < depth; i++) {
+        fprintf(out, "        %s\n", symbols != nullptr ? symbols[i] : "?");
+    }
+    free(symbols);
+#else
+    for (size_t i = 0; i < depth; i++) {
+        fprintf(out, "        %p\n", stack[i]);
+    }
+#endif
+}
+
+bool ultramodern::alloc_audit::report(FILE* out) {
+    if (!audit.recording) {
+        return true;
+    }
+
+    in_audit = true;
+
+    size_t frame_count = std::min<uint64_t>(audit.frames_recorded, frame_history_size);
+    std::vector<uint64_t> frame_allocations(audit.allocations_per_frame.begin(), audit.allocations_per_frame.begin() + frame_count);
+    uint64_t total_frame_allocations = 0;
+    uint64_t total_frame_bytes = 0;
+    size_t allocation_free_frames = 0;
+    for (size_t i = 0; i < frame_count; i++) {
+        total_frame_allocations += audit.allocations_per_frame[i];
+        total_frame_bytes += audit.bytes_per_frame[i];
+        allocation_free_frames += audit.allocations_per_frame[i] == 0 ? 1 : 0;
+    }
+    std::sort(frame_allocations.begin(), frame_allocations.end());
+
+    double average_allocations = frame_count == 0 ? 0.0 : double(total_frame_allocations) / frame_count;
+    fprintf(out, "[AllocAudit] %" PRIu64 " allocations and %" PRIu64 " frees in %" PRIu64 " frames\n",
+        audit.total_allocations.load(), audit.total_frees.load(), audit.frames_recorded);
+    if (frame_count != 0) {
+        fprintf(out, "[AllocAudit] Last %zu frames: %.1f allocations (%.1f bytes) per frame on average, median %" PRIu64 ", max %" PRIu64 ", %zu frames without allocations\n",
+            frame_count, average_allocations, double(total_frame_bytes) / frame_count, frame_allocations[frame_count / 2], frame_allocations.back(), allocation_free_frames);
+    }
+
+    std::vector<const CallSite*> sites{};
+    for (const CallSite& site : audit.call_sites) {
+        if (site.ready.load(std::memory_order_acquire)) {
+            sites.push_back(&site);
+        }
+    }
+    std::sort(sites.begin(), sites.end(), [](const CallSite* a, const CallSite* b) { return a->samples.load() > b->samples.load(); });
+
+    constexpr size_t max_reported_sites = 20;
+    fprintf(out, "[AllocAudit] Top call sites (1 in %" PRIu32 " allocations sampled, %" PRIu64 " samples dropped):\n", audit.sample_period, audit.dropped_samples.load());
+    for (size_t i = 0; i < std::min(sites.size(), max_reported_sites); i++) {
+        fprintf(out, "  #%zu: %" PRIu64 " samples, %" PRIu64 " bytes\n", i + 1, sites[i]->samples.load(), sites[i]->bytes.load());
+        print_stack(out, sites[i]->stack.data(), sites[i]->depth);
+    }
+
+    bool within_budget = audit.budget < 0 || average_allocations <= double(audit.budget);
+    if (!within_budget) {
+        fprintf(out, "[AllocAudit] FAILED: %.1f allocations per frame exceeds the budget of %" PRId64 "\n", average_allocations, audit.budget);
+    }
+    fflush(out);
+
+    in_audit = false;
+    return within_budget;
+}
+
+#endif
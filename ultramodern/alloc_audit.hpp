@@ -0,0 +1,39 @@
+#ifndef __ALLOC_AUDIT_HPP__
+#define __ALLOC_AUDIT_HPP__
+
+#include <cstdint>
+#include <cstdio>
+
+// Allocation audit mode. Builds with ULTRAMODERN_ALLOC_AUDIT interpose the heap (malloc, the aligned allocation functions and
+// friends on Linux, operator new and delete including their aligned forms elsewhere) and, when the RECOMP_ALLOC_AUDIT environment variable is set, count every allocation against the
+// current frame. One in every RECOMP_ALLOC_AUDIT allocations (64 if the variable is empty or 0) has its call stack sampled
+// so the report can show where steady-state allocations come from. Other builds compile this down to nothing.
+namespace ultramodern {
+    namespace alloc_audit {
+        struct Totals {
+            // Whether RECOMP_ALLOC_AUDIT was set, as nothing is counted otherwise.
+            bool recording;
+            uint64_t allocations;
+            uint64_t frees;
+            // Counts for the frame that hasn't been closed by next_frame yet.
+            uint64_t frame_allocations;
+            uint64_t frame_bytes;
+            uint64_t frames_recorded;
+        };
+
+#ifdef ULTRAMODERN_ALLOC_AUDIT
+        Totals totals();
+        // Closes the current frame's allocation count. Called once per VI.
+        void next_frame();
+        // Prints allocations per frame over the most recent frames and the most frequently sampled call sites. Returns false
+        // if RECOMP_ALLOC_AUDIT_BUDGET is set and the average number of allocations per frame exceeded it.
+        bool report(FILE* out);
+#else
+        inline Totals totals() { return {}; }
+        inline void next_frame() {}
+        inline bool report(FILE*) { return true; }
+#endif
+    }
+}
+
+#endif
@@ -1,13 +1,22 @@
 #include "ultra64.h"
 #include "ultramodern.hpp"
+#include "instance.hpp"
 #include <cassert>
 
-static uint32_t sample_rate = 48000;
+namespace {
+	// Per-instance audio output, as each instance plays its audio through its own callbacks.
+	struct AudioContext {
+		uint32_t sample_rate = 48000;
+		ultramodern::audio_callbacks_t callbacks{};
+	};
+}
 
-static ultramodern::audio_callbacks_t audio_callbacks;
+static AudioContext& audio_context() {
+	return ultramodern::current_instance().state<AudioContext>();
+}
 
 void set_audio_callbacks(const ultramodern::audio_callbacks_t& callbacks) {
-	audio_callbacks = callbacks;
+	audio_context().callbacks = callbacks;
 }
 
 void ultramodern::init_audio() {
@@ -16,10 +25,11 @@ void ultramodern::init_audio() {
 }
 
 void ultramodern::set_audio_frequency(uint32_t freq) {
-	if (audio_callbacks.set_frequency) {
-		audio_callbacks.set_frequency(freq);
+	AudioContext& audio = audio_context();
+	if (audio.callbacks.set_frequency) {
+		audio.callbacks.set_frequency(freq);
 	}
-	sample_rate = freq;
+	audio.sample_rate = freq;
 }
 
 void ultramodern::queue_audio_buffer(RDRAM_ARG PTR(int16_t) audio_data_, uint32_t byte_count) {
@@ -30,9 +40,18 @@ void ultramodern::queue_audio_buffer(RDRAM_ARG PTR(int16_t) audio_data_, uint32_
 	uint32_t sample_count = byte_count / sizeof(int16_t);
 
 	// Queue the swapped audio data.
-	if (audio_callbacks.queue_samples) {
-		audio_callbacks.queue_samples(TO_PTR(int16_t, audio_data_), sample_count);
+	AudioContext& audio = audio_context();
+	if (audio.callbacks.queue_samples) {
+		audio.callbacks.queue_samples(TO_PTR(int16_t, audio_data_), sample_count);
+	}
+}
+
+uint32_t ultramodern::get_audio_latency_us() {
+	AudioContext& audio = audio_context();
+	if (audio.callbacks.get_frames_remaining == nullptr || audio.sample_rate == 0) {
+		return 0;
 	}
+	return static_cast<uint32_t>(uint64_t(audio.callbacks.get_frames_remaining()) * 1000000 / audio.sample_rate);
 }
 
 // For SDL2
@@ -45,9 +64,10 @@ float buffer_offset_frames = 0.5f;
 // Reporting a number that's too low can lead to audio lag in some games.
 uint32_t ultramodern::get_remaining_audio_bytes() {
 	// Get the number of remaining buffered audio bytes.
+	AudioContext& audio = audio_context();
 	uint32_t buffered_byte_count;
-	if (audio_callbacks.get_frames_remaining != nullptr) {
-		buffered_byte_count = audio_callbacks.get_frames_remaining() * 2 * sizeof(int16_t);
+	if (audio.callbacks.get_frames_remaining != nullptr) {
+		buffered_byte_count = audio.callbacks.get_frames_remaining() * 2 * sizeof(int16_t);
 	}
 	else {
 		buffered_byte_count = 100;
@@ -56,7 +76,7 @@ uint32_t ultramodern::get_remaining_audio_bytes() {
 	 // there are enough samples even if the audio thread experiences a small amount of lag. This prevents
 	 // audio popping on games that use the buffered audio byte count to determine how many samples
 	 // to generate.
-	 uint32_t samples_per_vi = (sample_rate / 60);
+	 uint32_t samples_per_vi = (audio.sample_rate / 60);
 	 if (buffered_byte_count > static_cast<uint32_t>(buffer_offset_frames * sizeof(int16_t) * samples_per_vi)) {
 	 	buffered_byte_count -= static_cast<uint32_t>(buffer_offset_frames * sizeof(int16_t) * samples_per_vi);
 	 }
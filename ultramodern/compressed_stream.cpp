@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "compressed_stream.hpp"
+
+namespace compressed_stream = ultramodern::compressed_stream;
+
+namespace {
+    constexpr std::array<char, 4> magic = { 'R', 'L', 'Z', '4' };
+    constexpr size_t header_size = magic.size() + sizeof(uint32_t);
+    constexpr size_t frame_header_size = 2 * sizeof(uint32_t);
+
+    // LZ4 block format limits: matches are at least 4 bytes long, the last 5 bytes of a block are always literals and the last
+    // match has to start at least 12 bytes before the end of the block.
+    constexpr size_t min_match = 4;
+    constexpr size_t last_literals = 5;
+    constexpr size_t match_start_limit = 12;
+    constexpr size_t max_offset = 65535;
+    constexpr uint32_t hash_bits = 14;
+
+    uint32_t read_u32(const char* data) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+    }
+
+    void write_u32(std::vector<char>& out, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    void write_length(std::vector<char>& out, size_t length) {
+        while (length >= 255) {
+            out.push_back(static_cast<char>(255));
+            length -= 255;
+        }
+        out.push_back(static_cast<char>(length));
+    }
+
+    void write_sequence(std::vector<char>& out, const char* literals, size_t literal_length, size_t offset, size_t match_length) {
+        size_t match_code = match_length - min_match;
+        uint8_t token = static_cast<uint8_t>((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15));
+        out.push_back(static_cast<char>(token));
+        if (literal_length >= 15) {
+            write_length(out, literal_length - 15);
+        }
+        out.insert(out.end(), literals, literals + literal_length);
+        out.push_back(static_cast<char>(offset & 0xFF));
+        out.push_back(static_cast<char>(offset >> 8));
+        if (match_code >= 15) {
+            write_length(out, match_code - 15);
+        }
+    }
+
+    void write_last_literals(std::vector<char>& out, const char* literals, size_t literal_length) {
+        out.push_back(static_cast<char>(std::min<size_t>(literal_length, 15) << 4));
+        if (literal_length >= 15) {
+            write_length(out, literal_length - 15);
+        }
+        out.insert(out.end(), literals, literals + literal_length);
+    }
+
+    // Greedy single-pass compressor. It trades some ratio for simplicity, as it only runs at build time and decompression speed
+    // doesn't depend on how the matches were found.
+    void compress_block(std::span<const char> input, std::vector<char>& out) {
+        const char* src = input.data();
+        size_t size = input.size();
+        size_t anchor = 0;
+
+        if (size > match_start_limit) {
+            std::vector<int32_t> table(size_t{1} << hash_bits, -1);
+            auto hash = [](uint32_t sequence) { return (sequence * 2654435761U) >> (32 - hash_bits); };
+
+            size_t pos = 0;
+            size_t match_limit = size - last_literals;
+            while (pos < size - match_start_limit) {
+                uint32_t sequence = read_u32(src + pos);
+                uint32_t hash_index = hash(sequence);
+                int32_t candidate = table[hash_index];
+                table[hash_index] = static_cast<int32_t>(pos);
+
+                if (candidate < 0 || pos - candidate > max_offset || read_u32(src + candidate) != sequence) {
+                    pos++;
+                    continue;
+                }
+
+                size_t match_length = min_match;
+                while (pos + match_length < match_limit && src[candidate + match_length] == src[pos + match_length]) {
+                    match_length++;
+                }
+
+                write_sequence(out, src + anchor, pos - anchor, pos - candidate, match_length);
+                pos += match_length;
+                anchor = pos;
+            }
+        }
+
+        write_last_literals(out, src + anchor, size - anchor);
+    }
+
+    bool read_length(std::span<const char> src, size_t& pos, size_t& length) {
+        uint8_t byte;
+        do {
+            if (pos >= src.size()) {
+                return false;
+            }
+            byte = static_cast<uint8_t>(src[pos++]);
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    bool decompress_block(std::span<const char> src, char* dst, size_t dst_size) {
+        size_t in_pos = 0;
+        size_t out_pos = 0;
+
+        while (in_pos < src.size()) {
+            uint8_t token = static_cast<uint8_t>(src[in_pos++]);
+
+            size_t literal_length = token >> 4;
+            if (literal_length == 15 && !read_length(src, in_pos, literal_length)) {
+                return false;
+            }
+            if (literal_length > src.size() - in_pos || literal_length > dst_size - out_pos) {
+                return false;
+            }
+            memcpy(dst + out_pos, src.data() + in_pos, literal_length);
+            in_pos += literal_length;
+            out_pos += literal_length;
+
+            // The last sequence only has literals.
+            if (in_pos == src.size()) {
+                break;
+            }
+
+            if (src.size() - in_pos < 2) {
+                return false;
+            }
+            size_t offset = static_cast<uint8_t>(src[in_pos]) | (size_t(static_cast<uint8_t>(src[in_pos + 1])) << 8);
+            in_pos += 2;
+            if (offset == 0 || offset > out_pos) {
+                return false;
+            }
+
+            size_t match_length = token & 0xF;
+            if (match_length == 15 && !read_length(src, in_pos, match_length)) {
+                return false;
+            }
+            match_length += min_match;
+            if (match_length > dst_size - out_pos) {
+                return false;
+            }
+
+            // Matches may overlap the bytes they produce, in which case they have to be copied forward one byte at a time.
+            const char* match = dst + out_pos - offset;
+            if (offset >= match_length) {
+                memcpy(dst + out_pos, match, match_length);
+            }
+            else {
+                for (size_t i = 0; i < match_length; i++) {
+                    dst[out_pos + i] = match[i];
+                }
+            }
+            out_pos += match_length;
+        }
+
+        return out_pos == dst_size;
+    }
+
+    // Decompresses the frame at the start of `frames` into `out` and advances `frames` past it.
+    bool decompress_frame(std::span<const char>& frames, std::vector<char>& out) {
+        if (frames.size() < frame_header_size) {
+            return false;
+        }
+        uint32_t compressed_size = read_u32(frames.data());
+        uint32_t uncompressed_size = read_u32(frames.data() + sizeof(uint32_t));
+        if (uncompressed_size > compressed_stream::frame_size || compressed_size > frames.size() - frame_header_size) {
+            return false;
+        }
+
+        std::span<const char> frame_data = frames.subspan(frame_header_size, compressed_size);
+        frames = frames.subspan(frame_header_size + compressed_size);
+        out.resize(uncompressed_size);
+
+        if (compressed_size == uncompressed_size) {
+            memcpy(out.data(), frame_data.data(), uncompressed_size);
+            return true;
+        }
+        return decompress_block(frame_data, out.data(), uncompressed_size);
+    }
+}
+
+std::vector<char> compressed_stream::compress(std::span<const char> data) {
+    std::vector<char> ret{};
+    ret.reserve(data.size() / 2 + header_size);
+    ret.insert(ret.end(), magic.begin(), magic.end());
+    write_u32(ret, static_cast<uint32_t>(data.size()));
+
+    std::vector<char> block{};
+    for (size_t offset = 0; offset < data.size(); offset += frame_size) {
+        std::span<const char> frame = data.subspan(offset, std::min(frame_size, data.size() - offset));
+        block.clear();
+        compress_block(frame, block);
+
+        // Store frames that don't compress as-is.
+        if (block.size() >= frame.size()) {
+            write_u32(ret, static_cast<uint32_t>(frame.size()));
+            write_u32(ret, static_cast<uint32_t>(frame.size()));
+            ret.insert(ret.end(), frame.begin(), frame.end());
+        }
+        else {
+            write_u32(ret, static_cast<uint32_t>(block.size()));
+            write_u32(ret, static_cast<uint32_t>(frame.size()));
+            ret.insert(ret.end(), block.begin(), block.end());
+        }
+    }
+
+    return ret;
+}
+
+bool compressed_stream::is_compressed(std::span<const char> data) {
+    return data.size() >= header_size && std::equal(magic.begin(), magic.end(), data.begin());
+}
+
+bool compressed_stream::decompress(std::span<const char> data, std::vector<char>& out) {
+    if (!is_compressed(data)) {
+        return false;
+    }
+
+    out.clear();
+    out.reserve(read_u32(data.data() + magic.size()));
+    std::span<const char> frames = data.subspan(header_size);
+    std::vector<char> frame{};
+    while (!frames.empty()) {
+        if (!decompress_frame(frames, frame)) {
+            return false;
+        }
+        out.insert(out.end(), frame.begin(), frame.end());
+    }
+    return out.size() == read_u32(data.data() + magic.size());
+}
+
+compressed_stream::InputBuffer::InputBuffer(std::span<const char> data) : compressed_(is_compressed(data)), data_(data) {
+    if (compressed_) {
+        remaining_frames_ = data.subspan(header_size);
+        frame_.reserve(frame_size);
+        setg(nullptr, nullptr, nullptr);
+    }
+    else {
+        // The buffer is only ever read from, so the data can be used in place.
+        char* begin = const_cast<char*>(data.data());
+        setg(begin, begin, begin + data.size());
+    }
+}
+
+compressed_stream::InputBuffer::int_type compressed_stream::InputBuffer::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (!compressed_ || failed_ || remaining_frames_.empty()) {
+        return traits_type::eof();
+    }
+
+    frame_start_ += egptr() - eback();
+    if (!decompress_frame(remaining_frames_, frame_) || frame_.empty()) {
+        failed_ = true;
+        setg(nullptr, nullptr, nullptr);
+        return traits_type::eof();
+    }
+
+    setg(frame_.data(), frame_.data(), frame_.data() + frame_.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+compressed_stream::InputBuffer::pos_type compressed_stream::InputBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    if ((which & std::ios_base::in) == 0) {
+        return pos_type(off_type(-1));
+    }
+
+    off_type cur = static_cast<off_type>(frame_start_ + (gptr() - eback()));
+    if (compressed_) {
+        // Frames can't be revisited once they've been decompressed, so only reporting the position is supported.
+        if (dir == std::ios_base::cur && off == 0) {
+            return pos_type(cur);
+        }
+        return pos_type(off_type(-1));
+    }
+
+    off_type target;
+    switch (dir) {
+        case std::ios_base::beg:
+            target = off;
+            break;
+        case std::ios_base::cur:
+            target = cur + off;
+            break;
+        case std::ios_base::end:
+            target = static_cast<off_type>(data_.size()) + off;
+            break;
+        default:
+            return pos_type(off_type(-1));
+    }
+    if (target < 0 || target > static_cast<off_type>(data_.size())) {
+        return pos_type(off_type(-1));
+    }
+
+    setg(eback(), eback() + target, egptr());
+    return pos_type(target);
+}
+
+compressed_stream::InputBuffer::pos_type compressed_stream::InputBuffer::seekpos(pos_type pos, std::ios_base::openmode which) {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
@@ -0,0 +1,54 @@
+#ifndef __COMPRESSED_STREAM_HPP__
+#define __COMPRESSED_STREAM_HPP__
+
+#include <cstdint>
+#include <span>
+#include <streambuf>
+#include <vector>
+
+// Compression for data embedded in the executable, such as the shader cache. The data is split into independent frames of up
+// to `frame_size` bytes that are each compressed in the LZ4 block format, so it can be decompressed one frame at a time while
+// it's being read instead of all at once.
+//
+// Layout (little endian):
+//   char magic[4] = "RLZ4"
+//   uint32_t uncompressed_size
+//   frames, each being:
+//     uint32_t compressed_size
+//     uint32_t uncompressed_size
+//     uint8_t data[compressed_size] (stored as-is when compressed_size == uncompressed_size)
+namespace ultramodern {
+    namespace compressed_stream {
+        constexpr size_t frame_size = 64 * 1024;
+
+        std::vector<char> compress(std::span<const char> data);
+        bool is_compressed(std::span<const char> data);
+        // Decompresses the whole input at once. Returns false if the input is malformed.
+        bool decompress(std::span<const char> data, std::vector<char>& out);
+
+        // Read-only stream buffer over a span of memory that holds either compressed or uncompressed data. Uncompressed data
+        // is read in place, while compressed data is decompressed a frame at a time as it's read. Neither makes a copy of the
+        // whole input.
+        class InputBuffer : public std::streambuf {
+        public:
+            explicit InputBuffer(std::span<const char> data);
+            // Whether a malformed frame was encountered, in which case reading stops early.
+            bool failed() const { return failed_; }
+        protected:
+            int_type underflow() override;
+            pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+            pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+        private:
+            bool compressed_;
+            bool failed_ = false;
+            std::span<const char> data_;
+            // Compressed mode only: the frames that haven't been decompressed yet, the current frame's contents and the
+            // offset in the uncompressed data at which the current frame starts.
+            std::span<const char> remaining_frames_;
+            std::vector<char> frame_;
+            size_t frame_start_ = 0;
+        };
+    }
+}
+
+#endif
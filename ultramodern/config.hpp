@@ -28,6 +28,17 @@ namespace ultramodern {
 		OptionCount
 	};
 
+	// What to do once the game has swapped to more frames than the gfx thread has presented.
+	enum class FrameQueueMode {
+		// Hold back retrace messages so the game waits for the gfx thread to catch up. The held message is delivered as
+		// soon as a frame has been presented.
+		Block,
+		// Keep the game running and let the frames queue up, counting the ones past the limit as coalesced. Every frame is
+		// still handed to RT64 for presentation, which keeps its screen state and display list captures complete.
+		Coalesce,
+		OptionCount
+	};
+
 	struct GraphicsConfig {
 		Resolution res_option;
 		WindowMode wm_option;
@@ -39,6 +50,10 @@ namespace ultramodern {
 		int rr_manual_value;
 		int ds_option;
 		bool developer_mode;
+		// Maximum number of frames the game may have swapped to without them having been presented yet, see FrameQueueMode.
+		// 0 leaves the queue unbounded.
+		int max_frames_in_flight;
+		FrameQueueMode frame_queue_mode;
 
 		auto operator<=>(const GraphicsConfig& rhs) const = default;
 	};
@@ -68,6 +83,11 @@ namespace ultramodern {
 		{ultramodern::GraphicsApi::D3D12, "D3D12"},
 		{ultramodern::GraphicsApi::Vulkan, "Vulkan"},
 	});
+
+	NLOHMANN_JSON_SERIALIZE_ENUM(ultramodern::FrameQueueMode, {
+		{ultramodern::FrameQueueMode::Block, "Block"},
+		{ultramodern::FrameQueueMode::Coalesce, "Coalesce"},
+	});
 };
 
 #endif
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <thread>
+
+#include "deadline_sleeper.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include "Windows.h"
+#endif
+
+#if defined(__linux__)
+#include <time.h>
+#include <errno.h>
+#include <sys/prctl.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__)
+
+void ultramodern::minimize_timer_slack() {
+    // The default timer slack of 50us lets the kernel delay wakeups to coalesce them with other timers.
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+}
+
+// Sleeps for the given duration on CLOCK_MONOTONIC against an absolute deadline, so interruptions don't extend the sleep.
+static void coarse_sleep_for(std::chrono::nanoseconds duration) {
+    timespec target;
+    clock_gettime(CLOCK_MONOTONIC, &target);
+    int64_t target_ns = int64_t(target.tv_nsec) + duration.count();
+    target.tv_sec += target_ns / 1'000'000'000;
+    target.tv_nsec = target_ns % 1'000'000'000;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr) == EINTR) {}
+}
+
+#elif defined(_WIN32)
+
+void ultramodern::minimize_timer_slack() {}
+
+static void coarse_sleep_for(std::chrono::nanoseconds duration) {
+    // Sleep only has millisecond granularity, so leave anything shorter to the spin.
+    DWORD millis = DWORD(std::chrono::floor<std::chrono::milliseconds>(duration).count());
+    if (millis > 0) {
+        Sleep(millis);
+    }
+}
+
+#else
+
+void ultramodern::minimize_timer_slack() {}
+
+static void coarse_sleep_for(std::chrono::nanoseconds duration) {
+    std::this_thread::sleep_for(duration);
+}
+
+#endif
+
+static inline void spin_pause() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+void ultramodern::DeadlineSleeper::sleep_until(const clock::time_point& deadline) {
+    auto sleep_target = deadline - spin_window_;
+    auto now = clock::now();
+    if (sleep_target > now) {
+        coarse_sleep_for(sleep_target - now);
+        record_wakeup(sleep_target, clock::now());
+    }
+    spin_until(deadline);
+}
+
+void ultramodern::DeadlineSleeper::spin_until(const clock::time_point& deadline) {
+    while (clock::now() < deadline) {
+        spin_pause();
+    }
+}
+
+bool ultramodern::DeadlineSleeper::spin_until(const clock::time_point& deadline, const std::atomic<uint32_t>& generation, uint32_t seen_generation) {
+    while (clock::now() < deadline) {
+        if (generation.load(std::memory_order_acquire) != seen_generation) {
+            return false;
+        }
+        spin_pause();
+    }
+    return true;
+}
+
+void ultramodern::DeadlineSleeper::record_wakeup(const clock::time_point& target, const clock::time_point& woke) {
+    using namespace std::chrono_literals;
+    constexpr std::chrono::nanoseconds min_spin_window = 20us;
+    constexpr std::chrono::nanoseconds max_spin_window = 2ms;
+
+    auto overshoot = std::max(std::chrono::duration_cast<std::chrono::nanoseconds>(woke - target), std::chrono::nanoseconds::zero());
+
+    // Grow the estimate immediately when a sleep wakes up later than expected and let it decay slowly otherwise,
+    // so that a single late wakeup widens the window for a while instead of causing a run of missed deadlines.
+    if (overshoot > overshoot_estimate_) {
+        overshoot_estimate_ = overshoot;
+    }
+    else {
+        overshoot_estimate_ -= (overshoot_estimate_ - overshoot) / 16;
+    }
+
+    spin_window_ = std::clamp(overshoot_estimate_ + overshoot_estimate_ / 4 + min_spin_window, min_spin_window, max_spin_window);
+}
@@ -0,0 +1,34 @@
+#ifndef __DEADLINE_SLEEPER_HPP__
+#define __DEADLINE_SLEEPER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace ultramodern {
+    // Asks the OS to wake the calling thread as close to its requested wakeup times as possible.
+    void minimize_timer_slack();
+
+    // Sleeps until deadlines with a precision the OS sleep functions alone can't provide. Most of the wait is spent sleeping,
+    // and the last part of it is spun. The spin window follows how late the sleeps have been waking up, so it stays as short
+    // as the system allows. Each thread that needs precise deadlines should own its own sleeper.
+    class DeadlineSleeper {
+    public:
+        using clock = std::chrono::high_resolution_clock;
+
+        void sleep_until(const clock::time_point& deadline);
+        // Spins until the deadline without sleeping.
+        void spin_until(const clock::time_point& deadline);
+        // Spins until the deadline or until `generation` no longer holds `seen_generation`, whichever comes first. Used by
+        // waiters whose deadline can be moved earlier while they spin. Returns false if the spin was cut short.
+        bool spin_until(const clock::time_point& deadline, const std::atomic<uint32_t>& generation, uint32_t seen_generation);
+        // Records a sleep done by the caller (e.g. a timed wait on a condition variable) to adapt the spin window.
+        void record_wakeup(const clock::time_point& target, const clock::time_point& woke);
+        std::chrono::nanoseconds spin_window() const { return spin_window_; }
+    private:
+        std::chrono::nanoseconds overshoot_estimate_{ std::chrono::microseconds{ 200 } };
+        std::chrono::nanoseconds spin_window_{ std::chrono::microseconds{ 300 } };
+    };
+}
+
+#endif
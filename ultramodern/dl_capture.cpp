@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "dl_capture.hpp"
+#include "compressed_stream.hpp"
+
+namespace dl_capture = ultramodern::dl_capture;
+
+namespace {
+    constexpr std::array<char, 4> magic = { 'R', 'D', 'L', 'C' };
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+    // Task records hold the OSTask as the host stores it, which differs between RDRAM layouts, so captures from big-endian
+    // RDRAM builds are kept apart from the others.
+    constexpr uint32_t capture_version = 0x80000001;
+#else
+    constexpr uint32_t capture_version = 1;
+#endif
+    constexpr size_t record_header_size = 2 * sizeof(uint32_t);
+
+    // Limits for walking display lists, which guard against following garbage pointers forever.
+    constexpr uint32_t max_walk_commands = 1 << 20;
+    constexpr uint32_t max_walk_depth = 32;
+
+    // F3DEX2 opcodes the walker needs to understand.
+    constexpr uint8_t G_VTX = 0x01;
+    constexpr uint8_t G_BRANCH_Z = 0x04;
+    constexpr uint8_t G_TRI1 = 0x05;
+    constexpr uint8_t G_TRI2 = 0x06;
+    constexpr uint8_t G_QUAD = 0x07;
+    constexpr uint8_t G_MTX = 0xDA;
+    constexpr uint8_t G_MOVEWORD = 0xDB;
+    constexpr uint8_t G_MOVEMEM = 0xDC;
+    constexpr uint8_t G_DL = 0xDE;
+    constexpr uint8_t G_ENDDL = 0xDF;
+    constexpr uint8_t G_RDPHALF_1 = 0xE1;
+    constexpr uint8_t G_LOADTLUT = 0xF0;
+    constexpr uint8_t G_LOADBLOCK = 0xF3;
+    constexpr uint8_t G_LOADTILE = 0xF4;
+    constexpr uint8_t G_SETTIMG = 0xFD;
+
+    constexpr uint32_t G_MW_SEGMENT = 0x06;
+    constexpr uint32_t G_DL_NOPUSH = 0x01;
+
+    // Extended GBI commands that take up two command slots.
+    constexpr uint32_t G_EX_FILLRECT_V1 = 0x000003;
+    constexpr uint32_t G_EX_MATRIXGROUP_V1 = 0x00000C;
+
+    uint32_t segmented_to_physical(const std::array<uint32_t, 16>& segments, uint32_t addr) {
+        return (segments[(addr >> 24) & 0xF] + (addr & 0x00FFFFFF)) & 0x3FFFFFF;
+    }
+
+    void mark_range(std::vector<uint8_t>* touched_pages, uint32_t rdram_size, uint32_t addr, uint32_t size) {
+        if (touched_pages == nullptr || size == 0 || addr >= rdram_size) {
+            return;
+        }
+        uint32_t end = std::min<uint64_t>(uint64_t{addr} + size, rdram_size);
+        for (uint32_t page = addr / dl_capture::page_size; page <= (end - 1) / dl_capture::page_size; page++) {
+            (*touched_pages)[page] = 1;
+        }
+    }
+
+    void write_u32(std::ostream& stream, uint32_t value) {
+        char bytes[4];
+        for (int i = 0; i < 4; i++) {
+            bytes[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+        stream.write(bytes, sizeof(bytes));
+    }
+
+    bool read_u32(std::istream& stream, uint32_t& value) {
+        uint8_t bytes[4];
+        stream.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+        if (stream.gcount() != sizeof(bytes)) {
+            return false;
+        }
+        value = uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+        return true;
+    }
+}
+
+void dl_capture::walk_display_list(const uint8_t* rdram, uint32_t rdram_size, uint32_t dl_addr, DisplayListInfo& info,
+    std::vector<uint8_t>* touched_pages)
+{
+    std::array<uint32_t, 16> segments{};
+    std::array<uint32_t, max_walk_depth> return_stack;
+    uint32_t depth = 0;
+    uint32_t pc = dl_addr & 0x3FFFFFF;
+    uint32_t rdphalf_1 = 0;
+    uint32_t texture_addr = 0;
+    uint32_t texture_size = 0;
+    uint32_t texture_width = 0;
+    uint32_t commands = 0;
+
+    info.max_depth = std::max(info.max_depth, 1U);
+
+    while (true) {
+        if (commands++ >= max_walk_commands || pc + 8 > rdram_size) {
+            info.truncated = true;
+            return;
+        }
+
+        // RDRAM is stored in native 32-bit words, so each half of a command can be read directly.
+        uint32_t w0, w1;
+        memcpy(&w0, rdram + pc, sizeof(w0));
+        memcpy(&w1, rdram + pc + 4, sizeof(w1));
+        mark_range(touched_pages, rdram_size, pc, 8);
+        pc += 8;
+
+        uint8_t opcode = w0 >> 24;
+        info.commands++;
+        info.command_counts[opcode]++;
+
+        switch (opcode) {
+            case G_VTX:
+                {
+                    uint32_t count = (w0 >> 12) & 0xFF;
+                    info.vertices += count;
+                    mark_range(touched_pages, rdram_size, segmented_to_physical(segments, w1), count * 16);
+                }
+                break;
+            case G_TRI1:
+                info.triangles += 1;
+                break;
+            case G_TRI2:
+            case G_QUAD:
+                info.triangles += 2;
+                break;
+            case G_MTX:
+                mark_range(touched_pages, rdram_size, segmented_to_physical(segments, w1), 64);
+                break;
+            case G_MOVEMEM:
+                mark_range(touched_pages, rdram_size, segmented_to_physical(segments, w1), (((w0 >> 19) & 0x1F) + 1) * 8);
+                break;
+            case G_MOVEWORD:
+                if (((w0 >> 16) & 0xFF) == G_MW_SEGMENT) {
+                    segments[((w0 & 0xFFFF) / 4) & 0xF] = w1 & 0x3FFFFFF;
+                }
+                break;
+            case G_RDPHALF_1:
+                rdphalf_1 = w1;
+                break;
+            case G_SETTIMG:
+                texture_addr = segmented_to_physical(segments, w1);
+                texture_size = (w0 >> 19) & 0x3;
+                texture_width = (w0 & 0xFFF) + 1;
+                break;
+            case G_LOADBLOCK:
+                {
+                    // The sizes are in texels, which are 4 << siz bits each.
+                    uint32_t texels = ((w1 >> 12) & 0xFFF) + 1;
+                    uint32_t bytes = (texels << texture_size) / 2;
+                    info.texture_load_bytes += bytes;
+                    mark_range(touched_pages, rdram_size, texture_addr, bytes);
+                }
+                break;
+            case G_LOADTILE:
+                {
+                    uint32_t uls = ((w0 >> 12) & 0xFFF) >> 2;
+                    uint32_t ult = (w0 & 0xFFF) >> 2;
+                    uint32_t lrs = ((w1 >> 12) & 0xFFF) >> 2;
+                    uint32_t lrt = (w1 & 0xFFF) >> 2;
+                    if (lrs >= uls && lrt >= ult) {
+                        uint32_t line_bytes = (texture_width << texture_size) / 2;
+                        uint32_t row_bytes = ((lrs - uls + 1) << texture_size) / 2;
+                        uint32_t rows = lrt - ult + 1;
+                        info.texture_load_bytes += uint64_t{row_bytes} * rows;
+                        mark_range(touched_pages, rdram_size, texture_addr + ult * line_bytes + ((uls << texture_size) / 2),
+                            (rows - 1) * line_bytes + row_bytes);
+                    }
+                }
+                break;
+            case G_LOADTLUT:
+                {
+                    uint32_t bytes = (((w1 >> 14) & 0x3FF) + 1) * sizeof(uint16_t);
+                    info.texture_load_bytes += bytes;
+                    mark_range(touched_pages, rdram_size, texture_addr, bytes);
+                }
+                break;
+            case G_DL:
+            case G_BRANCH_Z:
+                {
+                    // Conditional branches are walked like calls, since either path may be taken.
+                    bool push = opcode == G_BRANCH_Z || ((w0 >> 16) & 0xFF) != G_DL_NOPUSH;
+                    uint32_t target = segmented_to_physical(segments, opcode == G_BRANCH_Z ? rdphalf_1 : w1);
+                    if (push) {
+                        if (depth >= max_walk_depth) {
+                            info.truncated = true;
+                            return;
+                        }
+                        return_stack[depth++] = pc;
+                        info.max_depth = std::max(info.max_depth, depth + 1);
+                    }
+                    pc = target;
+                }
+                break;
+            case G_ENDDL:
+                if (depth == 0) {
+                    return;
+                }
+                pc = return_stack[--depth];
+                break;
+            case extended_opcode:
+                {
+                    uint32_t extended = w0 & 0xFFFFFF;
+                    info.extended_command_counts[std::min<size_t>(extended, info.extended_command_counts.size() - 1)]++;
+                    if (extended == G_EX_MATRIXGROUP_V1) {
+                        info.matrix_groups[w1]++;
+                    }
+                    if (extended == G_EX_MATRIXGROUP_V1 || extended == G_EX_FILLRECT_V1) {
+                        mark_range(touched_pages, rdram_size, pc, 8);
+                        pc += 8;
+                    }
+                }
+                break;
+        }
+    }
+}
+
+bool dl_capture::Writer::open(const std::filesystem::path& path, uint32_t rdram_size) {
+    stream_.open(path, std::ios::binary | std::ios::trunc);
+    if (!stream_.good()) {
+        return false;
+    }
+
+    rdram_size_ = rdram_size;
+    shadow_rdram_.assign(rdram_size, 0);
+    touched_pages_.assign(rdram_size / page_size, 0);
+    wrote_keyframe_ = false;
+    frames_ = 0;
+
+    stream_.write(magic.data(), magic.size());
+    write_u32(stream_, capture_version);
+    write_u32(stream_, rdram_size);
+    write_u32(stream_, page_size);
+    bytes_written_ = magic.size() + 3 * sizeof(uint32_t);
+    return stream_.good();
+}
+
+void dl_capture::Writer::close() {
+    stream_.close();
+    shadow_rdram_ = {};
+    touched_pages_ = {};
+    page_data_ = {};
+}
+
+void dl_capture::Writer::write_record(RecordType type, const void* data, uint32_t size) {
+    write_u32(stream_, static_cast<uint32_t>(type));
+    write_u32(stream_, size);
+    stream_.write(static_cast<const char*>(data), size);
+    bytes_written_ += record_header_size + size;
+}
+
+void dl_capture::Writer::write_task(const uint8_t* rdram, const OSTask* task) {
+    // The first task stores all of RDRAM so that replays start from the same state, even for memory the walker can't see
+    // being read (such as framebuffers).
+    if (!wrote_keyframe_) {
+        std::fill(touched_pages_.begin(), touched_pages_.end(), 1);
+        wrote_keyframe_ = true;
+    }
+    else {
+        std::fill(touched_pages_.begin(), touched_pages_.end(), 0);
+        DisplayListInfo info{};
+        walk_display_list(rdram, rdram_size_, task->t.data_ptr, info, &touched_pages_);
+        // RT64 also reads the microcode to detect which GBI it implements.
+        mark_range(&touched_pages_, rdram_size_, task->t.ucode & 0x3FFFFFF, task->t.ucode_size);
+        mark_range(&touched_pages_, rdram_size_, task->t.ucode_data & 0x3FFFFFF, task->t.ucode_data_size);
+    }
+
+    page_data_.clear();
+    for (uint32_t page = 0; page < touched_pages_.size(); page++) {
+        size_t offset = size_t{page} * page_size;
+        if (touched_pages_[page] == 0 || memcmp(shadow_rdram_.data() + offset, rdram + offset, page_size) == 0) {
+            continue;
+        }
+        memcpy(shadow_rdram_.data() + offset, rdram + offset, page_size);
+        const char* page_index = reinterpret_cast<const char*>(&page);
+        page_data_.insert(page_data_.end(), page_index, page_index + sizeof(page));
+        page_data_.insert(page_data_.end(), shadow_rdram_.begin() + offset, shadow_rdram_.begin() + offset + page_size);
+    }
+
+    if (!page_data_.empty()) {
+        std::vector<char> compressed = compressed_stream::compress(page_data_);
+        write_record(RecordType::Pages, compressed.data(), static_cast<uint32_t>(compressed.size()));
+    }
+    write_record(RecordType::Task, task, sizeof(OSTask));
+}
+
+void dl_capture::Writer::write_screen(const ViRegisters& vi_regs) {
+    write_record(RecordType::Screen, &vi_regs, sizeof(vi_regs));
+    frames_++;
+}
+
+bool dl_capture::replay(const std::filesystem::path& path, uint8_t* rdram, uint32_t rdram_size, Sink& sink) {
+    std::ifstream stream{ path, std::ios::binary };
+    std::array<char, 4> file_magic{};
+    uint32_t version, capture_rdram_size, capture_page_size;
+    stream.read(file_magic.data(), file_magic.size());
+    if (!stream.good() || file_magic != magic || !read_u32(stream, version) || !read_u32(stream, capture_rdram_size) ||
+        !read_u32(stream, capture_page_size))
+    {
+        fprintf(stderr, "%s is not a display list capture\n", path.string().c_str());
+        return false;
+    }
+    if (version != capture_version || capture_page_size != page_size || capture_rdram_size > rdram_size) {
+        fprintf(stderr, "Unsupported display list capture (version %u, page size %u, RDRAM size 0x%X)\n",
+            version, capture_page_size, capture_rdram_size);
+        return false;
+    }
+
+    memset(rdram, 0, capture_rdram_size);
+
+    std::vector<char> record{};
+    std::vector<char> pages{};
+    uint32_t type, size;
+    while (read_u32(stream, type)) {
+        if (!read_u32(stream, size)) {
+            return false;
+        }
+        record.resize(size);
+        stream.read(record.data(), size);
+        if (static_cast<uint32_t>(stream.gcount()) != size) {
+            return false;
+        }
+
+        switch (static_cast<RecordType>(type)) {
+            case RecordType::Pages:
+                {
+                    constexpr size_t entry_size = sizeof(uint32_t) + page_size;
+                    if (!compressed_stream::decompress(record, pages) || pages.size() % entry_size != 0) {
+                        return false;
+                    }
+                    for (size_t offset = 0; offset < pages.size(); offset += entry_size) {
+                        uint32_t page;
+                        memcpy(&page, pages.data() + offset, sizeof(page));
+                        if (page >= capture_rdram_size / page_size) {
+                            return false;
+                        }
+                        memcpy(rdram + size_t{page} * page_size, pages.data() + offset + sizeof(page), page_size);
+                    }
+                }
+                break;
+            case RecordType::Task:
+                {
+                    if (size != sizeof(OSTask)) {
+                        return false;
+                    }
+                    OSTask task;
+                    memcpy(&task, record.data(), sizeof(task));
+                    sink.send_dl(rdram, &task);
+                }
+                break;
+            case RecordType::Screen:
+                {
+                    if (size != sizeof(ViRegisters)) {
+                        return false;
+                    }
+                    ViRegisters vi_regs;
+                    memcpy(&vi_regs, record.data(), sizeof(vi_regs));
+                    sink.update_screen(rdram, vi_regs);
+                }
+                break;
+            default:
+                // Skip records from newer versions of the format.
+                break;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,117 @@
+#ifndef __DL_CAPTURE_HPP__
+#define __DL_CAPTURE_HPP__
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include "ultra64.h"
+
+// Capture of the graphics work sent to RT64, so that it can be analyzed and replayed without running the game. Setting
+// RECOMP_DL_CAPTURE to a file path records the first RECOMP_DL_CAPTURE_FRAMES frames (300 by default) to it, and setting
+// RECOMP_DL_REPLAY to a capture replays it through RT64 at startup as a rendering benchmark.
+//
+// Layout (little endian):
+//   char magic[4] = "RDLC"
+//   uint32_t version
+//   uint32_t rdram_size
+//   uint32_t page_size
+//   records, each being:
+//     uint32_t type (RecordType)
+//     uint32_t size
+//     uint8_t data[size]
+// Pages records hold RDRAM pages compressed with compressed_stream, each being a uint32_t page index followed by the page's
+// contents. The first one holds all of RDRAM, after which only the pages read by a display list that changed since they were
+// last written are stored. Task records hold an OSTask, and Screen records hold the VI registers and end a frame.
+namespace ultramodern {
+    namespace dl_capture {
+        constexpr uint32_t page_size = 4096;
+
+        enum class RecordType : uint32_t {
+            Pages = 1,
+            Task = 2,
+            Screen = 3,
+        };
+
+        struct ViRegisters {
+            uint32_t status;
+            uint32_t origin;
+            uint32_t width;
+            uint32_t intr;
+            uint32_t v_current_line;
+            uint32_t timing;
+            uint32_t v_sync;
+            uint32_t h_sync;
+            uint32_t leap;
+            uint32_t h_start;
+            uint32_t v_start;
+            uint32_t v_burst;
+            uint32_t x_scale;
+            uint32_t y_scale;
+        };
+
+        // Summary of a display list, found by walking it along with the display lists it calls. Extended (RT64) commands are
+        // counted under their own opcode, as their layout depends on the extended GBI version.
+        struct DisplayListInfo {
+            std::array<uint32_t, 256> command_counts{};
+            std::array<uint32_t, 64> extended_command_counts{};
+            // Number of times each matrix group id was pushed by gEXMatrixGroup.
+            std::map<uint32_t, uint32_t> matrix_groups;
+            uint32_t commands = 0;
+            uint32_t vertices = 0;
+            uint32_t triangles = 0;
+            uint32_t max_depth = 0;
+            uint64_t texture_load_bytes = 0;
+            // Set if the walk stopped early because of a command limit, a bad address or too deep a call stack.
+            bool truncated = false;
+        };
+
+        // Opcode that RT64's extended GBI commands use, which matches the value the patches are built with.
+        constexpr uint8_t extended_opcode = 0x64;
+
+        // Walks an F3DEX2 display list starting at the physical address `dl_addr`. If `touched_pages` is given, every RDRAM page
+        // the display list reads from (commands, vertices, matrices and texture data) is marked in it.
+        void walk_display_list(const uint8_t* rdram, uint32_t rdram_size, uint32_t dl_addr, DisplayListInfo& info,
+            std::vector<uint8_t>* touched_pages = nullptr);
+
+        class Writer {
+        public:
+            bool open(const std::filesystem::path& path, uint32_t rdram_size);
+            void close();
+            bool is_open() const { return stream_.is_open(); }
+            void write_task(const uint8_t* rdram, const OSTask* task);
+            void write_screen(const ViRegisters& vi_regs);
+            uint32_t frames() const { return frames_; }
+            uint64_t bytes_written() const { return bytes_written_; }
+        private:
+            void write_record(RecordType type, const void* data, uint32_t size);
+
+            std::ofstream stream_;
+            uint32_t rdram_size_ = 0;
+            // RDRAM contents as of the last time each page was written, which later writes are compared against.
+            std::vector<uint8_t> shadow_rdram_;
+            std::vector<uint8_t> touched_pages_;
+            std::vector<char> page_data_;
+            bool wrote_keyframe_ = false;
+            uint32_t frames_ = 0;
+            uint64_t bytes_written_ = 0;
+        };
+
+        // Receives the graphics work from a capture as it's replayed.
+        class Sink {
+        public:
+            virtual ~Sink() = default;
+            virtual void send_dl(uint8_t* rdram, const OSTask* task) = 0;
+            virtual void update_screen(uint8_t* rdram, const ViRegisters& vi_regs) = 0;
+        };
+
+        // Replays a capture into a sink using `rdram` as the RDRAM, which has to be at least as large as the capture's RDRAM.
+        // Returns false if the capture couldn't be read or is malformed.
+        bool replay(const std::filesystem::path& path, uint8_t* rdram, uint32_t rdram_size, Sink& sink);
+    }
+}
+
+#endif
@@ -8,11 +8,18 @@
 #include <mutex>
 #include <queue>
 #include <cstring>
+#include <algorithm>
+#include <vector>
 
 #include "blockingconcurrentqueue.h"
 
 #include "ultra64.h"
 #include "ultramodern.hpp"
+#include "sync_stats.hpp"
+#include "alloc_audit.hpp"
+#include "func_counters.hpp"
+#include "perf_metrics.hpp"
+#include "instance.hpp"
 #include "config.hpp"
 #include "rt64_layer.h"
 #include "recomp.h"
@@ -22,10 +29,12 @@
 
 struct SpTaskAction {
     OSTask task;
+    std::chrono::high_resolution_clock::time_point enqueue_time;
 };
 
 struct SwapBuffersAction {
     uint32_t origin;
+    std::chrono::high_resolution_clock::time_point enqueue_time;
 };
 
 struct UpdateConfigAction {
@@ -33,99 +42,189 @@ struct UpdateConfigAction {
 
 struct LoadShaderCacheAction {
     std::span<const char> data;
+    std::filesystem::path user_cache_path;
 };
 
-using Action = std::variant<SpTaskAction, SwapBuffersAction, UpdateConfigAction, LoadShaderCacheAction>;
-
-static struct {
-    struct {
-        std::thread thread;
-        PTR(OSMesgQueue) mq = NULLPTR;
-        PTR(void) current_buffer = NULLPTR;
-        PTR(void) next_buffer = NULLPTR;
-        OSMesg msg = (OSMesg)0;
-        int retrace_count = 1;
-    } vi;
-    struct {
-        std::thread gfx_thread;
-        std::thread task_thread;
-        PTR(OSMesgQueue) mq = NULLPTR;
-        OSMesg msg = (OSMesg)0;
-    } sp;
-    struct {
-        PTR(OSMesgQueue) mq = NULLPTR;
-        OSMesg msg = (OSMesg)0;
-    } dp;
-    struct {
-        PTR(OSMesgQueue) mq = NULLPTR;
-        OSMesg msg = (OSMesg)0;
-    } ai;
-    struct {
-        PTR(OSMesgQueue) mq = NULLPTR;
-        OSMesg msg = (OSMesg)0;
-    } si;
-    // The same message queue may be used for multiple events, so share a mutex for all of them
-    std::mutex message_mutex;
-    uint8_t* rdram;
-    moodycamel::BlockingConcurrentQueue<Action> action_queue{};
-    moodycamel::BlockingConcurrentQueue<OSTask*> sp_task_queue{};
-    moodycamel::ConcurrentQueue<OSThread*> deleted_threads{};
-} events_context{};
+// Sent on quit to wake the gfx thread, which otherwise blocks until there's an action for it.
+struct ShutdownAction {
+};
+
+using Action = std::variant<SpTaskAction, SwapBuffersAction, UpdateConfigAction, LoadShaderCacheAction, ShutdownAction>;
+
+namespace {
+    // Per-instance state for the event threads and the queues that feed them.
+    struct EventsContext {
+        struct {
+            std::thread thread;
+            PTR(OSMesgQueue) mq = NULLPTR;
+            PTR(void) current_buffer = NULLPTR;
+            PTR(void) next_buffer = NULLPTR;
+            OSMesg msg = (OSMesg)0;
+            int retrace_count = 1;
+            uint32_t hstart = 0;
+            uint32_t origin_offset = 320 * sizeof(uint16_t);
+            bool black = false;
+            // Alternates the framebuffer shown before the game has started, see vi_thread_func.
+            bool dummy_swap = false;
+            // Set while a retrace message is being held back for the gfx thread to catch up, see send_vi_retrace.
+            std::atomic_bool retrace_held = false;
+        } vi;
+        struct {
+            std::thread gfx_thread;
+            std::thread task_thread;
+            PTR(OSMesgQueue) mq = NULLPTR;
+            OSMesg msg = (OSMesg)0;
+        } sp;
+        struct {
+            PTR(OSMesgQueue) mq = NULLPTR;
+            OSMesg msg = (OSMesg)0;
+        } dp;
+        struct {
+            PTR(OSMesgQueue) mq = NULLPTR;
+            OSMesg msg = (OSMesg)0;
+        } ai;
+        struct {
+            PTR(OSMesgQueue) mq = NULLPTR;
+            OSMesg msg = (OSMesg)0;
+        } si;
+        // The same message queue may be used for multiple events, so share a mutex for all of them
+        ultramodern::InstrumentedMutex message_mutex{ "message_mutex" };
+        uint8_t* rdram;
+        moodycamel::BlockingConcurrentQueue<Action> action_queue{};
+        moodycamel::BlockingConcurrentQueue<OSTask*> sp_task_queue{};
+        ultramodern::sync_stats::Point action_queue_stats{ "action_queue", ultramodern::sync_stats::Point::Kind::Queue };
+        ultramodern::sync_stats::Point sp_task_queue_stats{ "sp_task_queue", ultramodern::sync_stats::Point::Kind::Queue };
+        moodycamel::ConcurrentQueue<OSThread*> deleted_threads{};
+        struct {
+            // Graphics tasks that have been submitted but whose display list hasn't finished processing yet.
+            std::atomic_uint32_t tasks_in_flight = 0;
+            std::atomic_uint32_t peak_tasks_in_flight = 0;
+            std::atomic_uint64_t last_task_age_us = 0;
+            std::atomic_uint64_t peak_task_age_us = 0;
+            // Frames the game has swapped to that the gfx thread hasn't presented yet. This is where the queue grows when
+            // rendering falls behind, as the game can't submit a graphics task before the previous one's DP completion.
+            std::atomic_uint32_t frames_in_flight = 0;
+            std::atomic_uint32_t peak_frames_in_flight = 0;
+            std::atomic_uint64_t last_frame_age_us = 0;
+            std::atomic_uint64_t peak_frame_age_us = 0;
+            std::atomic_uint64_t held_retraces = 0;
+            std::atomic_uint64_t coalesced_frames = 0;
+        } gfx_queue;
+    };
+}
+
+static EventsContext& events_context() {
+    return ultramodern::current_instance().state<EventsContext>();
+}
+
+static void enqueue_action(Action&& action) {
+    EventsContext& events = events_context();
+    ultramodern::sync_stats::on_push(events.action_queue_stats);
+    events.action_queue.enqueue(std::move(action));
+}
+
+static void enqueue_sp_task(OSTask* task) {
+    EventsContext& events = events_context();
+    ultramodern::sync_stats::on_push(events.sp_task_queue_stats);
+    events.sp_task_queue.enqueue(task);
+}
+
+template <typename T>
+static void update_peak(std::atomic<T>& peak, T value) {
+    T cur_peak = peak.load(std::memory_order_relaxed);
+    while (value > cur_peak && !peak.compare_exchange_weak(cur_peak, value, std::memory_order_relaxed)) {}
+}
 
 extern "C" void osSetEventMesg(RDRAM_ARG OSEvent event_id, PTR(OSMesgQueue) mq_, OSMesg msg) {
+    EventsContext& events = events_context();
     OSMesgQueue* mq = TO_PTR(OSMesgQueue, mq_);
-    std::lock_guard lock{ events_context.message_mutex };
+    std::lock_guard lock{ events.message_mutex };
 
     switch (event_id) {
         case OS_EVENT_SP:
-            events_context.sp.msg = msg;
-            events_context.sp.mq = mq_;
+            events.sp.msg = msg;
+            events.sp.mq = mq_;
             break;
         case OS_EVENT_DP:
-            events_context.dp.msg = msg;
-            events_context.dp.mq = mq_;
+            events.dp.msg = msg;
+            events.dp.mq = mq_;
             break;
         case OS_EVENT_AI:
-            events_context.ai.msg = msg;
-            events_context.ai.mq = mq_;
+            events.ai.msg = msg;
+            events.ai.mq = mq_;
             break;
         case OS_EVENT_SI:
-            events_context.si.msg = msg;
-            events_context.si.mq = mq_;
+            events.si.msg = msg;
+            events.si.mq = mq_;
     }
 }
 
 extern "C" void osViSetEvent(RDRAM_ARG PTR(OSMesgQueue) mq_, OSMesg msg, u32 retrace_count) {
-    std::lock_guard lock{ events_context.message_mutex };
-    events_context.vi.mq = mq_;
-    events_context.vi.msg = msg;
-    events_context.vi.retrace_count = retrace_count;
+    EventsContext& events = events_context();
+    std::lock_guard lock{ events.message_mutex };
+    events.vi.mq = mq_;
+    events.vi.msg = msg;
+    events.vi.retrace_count = retrace_count;
 }
 
-uint64_t total_vis = 0;
+void set_dummy_vi();
 
+// Whether the game may be sent another retrace message, as opposed to it being held back until the gfx thread has caught up.
+// Must be called with the message mutex held.
+static bool retrace_has_room(EventsContext& events, const ultramodern::GraphicsConfig& graphics_config) {
+    uint32_t max_in_flight = static_cast<uint32_t>(std::max(graphics_config.max_frames_in_flight, 0));
+    return graphics_config.frame_queue_mode != ultramodern::FrameQueueMode::Block || max_in_flight == 0 ||
+        events.gfx_queue.frames_in_flight.load(std::memory_order_seq_cst) < max_in_flight;
+}
 
-extern std::atomic_bool exited;
+// Must be called with the message mutex held.
+static void send_vi_retrace(EventsContext& events) {
+    uint8_t* rdram = events.rdram;
+    events.vi.retrace_held.store(false, std::memory_order_relaxed);
+    if (events.vi.mq != NULLPTR) {
+        if (osSendMesg(PASS_RDRAM events.vi.mq, events.vi.msg, OS_MESG_NOBLOCK) == -1) {
+            //printf("Game skipped a VI frame!\n");
+        }
+    }
+}
 
-void set_dummy_vi();
+// Delivers the retrace message the VI thread held back, once the gfx thread has presented enough frames to make room for it.
+// Without this the game would wait for the retrace after that, which adds up to a whole frame of latency every time
+// rendering falls behind.
+static void release_held_retrace(EventsContext& events, const ultramodern::GraphicsConfig& graphics_config) {
+    if (!events.vi.retrace_held.load(std::memory_order_seq_cst)) {
+        return;
+    }
+    std::lock_guard lock{ events.message_mutex };
+    // The VI thread may have sent a retrace since the check above.
+    if (events.vi.retrace_held.load(std::memory_order_relaxed) && retrace_has_room(events, graphics_config)) {
+        send_vi_retrace(events);
+    }
+}
 
 void vi_thread_func() {
+    EventsContext& events = events_context();
     ultramodern::set_native_thread_name("VI Thread");
     // This thread should be prioritized over every other thread in the application, as it's what allows
     // the game to generate new audio and gfx lists.
     ultramodern::set_native_thread_priority(ultramodern::ThreadPriority::Critical);
+    ultramodern::minimize_timer_slack();
     using namespace std::chrono_literals;
+
+    // Retraces are paced with a deadline sleeper, as plain sleeps can wake up late enough to cause visible frame pacing jitter.
+    ultramodern::DeadlineSleeper vi_sleeper{};
     
-    int remaining_retraces = events_context.vi.retrace_count;
+    int remaining_retraces = events.vi.retrace_count;
+    uint64_t total_vis = 0;
 
-    while (!exited) {
+    while (!ultramodern::quit_requested()) {
         // Determine the next VI time (more accurate than adding 16ms each VI interrupt)
         auto next = ultramodern::get_start() + (total_vis * 1000000us) / (60 * ultramodern::get_speed_multiplier());
         //if (next > std::chrono::high_resolution_clock::now()) {
         //    printf("Sleeping for %" PRIu64 " us to get from %" PRIu64 " us to %" PRIu64 " us \n",
         //        (next - std::chrono::high_resolution_clock::now()) / 1us,
-        //        (std::chrono::high_resolution_clock::now() - events_context.start) / 1us,
-        //        (next - events_context.start) / 1us);
+        //        (std::chrono::high_resolution_clock::now() - events.start) / 1us,
+        //        (next - events.start) / 1us);
         //} else {
         //    printf("No need to sleep\n");
         //}
@@ -134,7 +233,13 @@ void vi_thread_func() {
             // printf("Skipping the next VI wait\n");
             next = std::chrono::high_resolution_clock::now();
         }
-        ultramodern::sleep_until(next);
+        vi_sleeper.sleep_until(next);
+        ultramodern::perf::record(ultramodern::perf::Timing::ViLateness, std::chrono::high_resolution_clock::now() - next);
+        ultramodern::refine_clock_calibration();
+        ultramodern::sync_stats::dump_if_due();
+        ultramodern::alloc_audit::next_frame();
+        ultramodern::func_counters::next_frame();
+        ultramodern::perf::tick();
         // Calculate how many VIs have passed
         uint64_t new_total_vis = (ultramodern::time_since_start() * (60 * ultramodern::get_speed_multiplier()) / 1000ms) + 1;
         if (new_total_vis > total_vis + 1) {
@@ -145,32 +250,47 @@ void vi_thread_func() {
         remaining_retraces--;
 
         {
-            std::lock_guard lock{ events_context.message_mutex };
-            uint8_t* rdram = events_context.rdram;
+            std::lock_guard lock{ events.message_mutex };
+            uint8_t* rdram = events.rdram;
             if (remaining_retraces == 0) {
-                remaining_retraces = events_context.vi.retrace_count;
+                remaining_retraces = events.vi.retrace_count;
+
+                // Once the game has swapped to more frames than the gfx thread has presented, the retrace message is held
+                // back. The game paces itself on these messages, so it waits for rendering to catch up the same way it would
+                // for a slow display, and the latency between it producing a frame and the frame being shown stays bounded.
+                // The gfx thread delivers the held message as soon as it has made room. Retraces that pass while one is
+                // already held are folded into it, as the game only wants to know that at least one has happened.
+                ultramodern::GraphicsConfig graphics_config = ultramodern::get_graphics_config();
 
                 if (ultramodern::is_game_started()) {
-                    if (events_context.vi.mq != NULLPTR) {
-                        if (osSendMesg(PASS_RDRAM events_context.vi.mq, events_context.vi.msg, OS_MESG_NOBLOCK) == -1) {
-                            //printf("Game skipped a VI frame!\n");
+                    if (retrace_has_room(events, graphics_config)) {
+                        send_vi_retrace(events);
+                    }
+                    else {
+                        // The gfx thread doesn't take the mutex to make room, so the flag is set before checking again. Either
+                        // this sees the room or the gfx thread sees the flag.
+                        events.vi.retrace_held.store(true, std::memory_order_seq_cst);
+                        if (retrace_has_room(events, graphics_config)) {
+                            send_vi_retrace(events);
+                        }
+                        else {
+                            events.gfx_queue.held_retraces.fetch_add(1, std::memory_order_relaxed);
                         }
                     }
                 }
                 else {
                     set_dummy_vi();
-                    static bool swap = false;
                     uint32_t vi_origin = 0x400 + 0x280; // Skip initial RDRAM contents and add the usual origin offset
                     // Offset by one FB every other frame so RT64 continues drawing
-                    if (swap) {
+                    if (events.vi.dummy_swap) {
                         vi_origin += 0x25800;
                     }
                     osViSwapBuffer(rdram, vi_origin);
-                    swap = !swap;
+                    events.vi.dummy_swap = !events.vi.dummy_swap;
                 }
             }
-            if (events_context.ai.mq != NULLPTR) {
-                if (osSendMesg(PASS_RDRAM events_context.ai.mq, events_context.ai.msg, OS_MESG_NOBLOCK) == -1) {
+            if (events.ai.mq != NULLPTR) {
+                if (osSendMesg(PASS_RDRAM events.ai.mq, events.ai.msg, OS_MESG_NOBLOCK) == -1) {
                     //printf("Game skipped a AI frame!\n");
                 }
             }
@@ -182,18 +302,20 @@ void vi_thread_func() {
 }
 
 void sp_complete() {
-    uint8_t* rdram = events_context.rdram;
-    std::lock_guard lock{ events_context.message_mutex };
-    osSendMesg(PASS_RDRAM events_context.sp.mq, events_context.sp.msg, OS_MESG_NOBLOCK);
+    EventsContext& events = events_context();
+    uint8_t* rdram = events.rdram;
+    std::lock_guard lock{ events.message_mutex };
+    osSendMesg(PASS_RDRAM events.sp.mq, events.sp.msg, OS_MESG_NOBLOCK);
 }
 
 void dp_complete() {
-    uint8_t* rdram = events_context.rdram;
-    std::lock_guard lock{ events_context.message_mutex };
-    osSendMesg(PASS_RDRAM events_context.dp.mq, events_context.dp.msg, OS_MESG_NOBLOCK);
+    EventsContext& events = events_context();
+    uint8_t* rdram = events.rdram;
+    std::lock_guard lock{ events.message_mutex };
+    osSendMesg(PASS_RDRAM events.dp.mq, events.dp.msg, OS_MESG_NOBLOCK);
 }
 
-uint8_t dmem[0x1000];
+RECOMP_THREAD_LOCAL uint8_t dmem[0x1000];
 uint16_t rspReciprocals[512];
 uint16_t rspInverseSquareRoots[512];
 
@@ -221,8 +343,12 @@ void rsp_constants_init() {
 
 // Runs a recompiled RSP microcode
 void run_rsp_microcode(uint8_t* rdram, const OSTask* task, RspUcodeFunc* ucode_func) {
-    // Load the OSTask into DMEM
+    // Load the OSTask into DMEM, which is always stored as native words
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+    recomp::rdram::swap_words(&dmem[0xFC0], reinterpret_cast<const uint8_t*>(task), sizeof(OSTask));
+#else
     memcpy(&dmem[0xFC0], task, sizeof(OSTask));
+#endif
     // Load the ucode data into DMEM
     dma_rdram_to_dmem(rdram, 0x0000, task->t.ucode_data, 0xF80 - 1);
     // Run the ucode
@@ -233,6 +359,7 @@ void run_rsp_microcode(uint8_t* rdram, const OSTask* task, RspUcodeFunc* ucode_f
 
 
 void task_thread_func(uint8_t* rdram, moodycamel::LightweightSemaphore* thread_ready) {
+    EventsContext& events = events_context();
     ultramodern::set_native_thread_name("SP Task Thread");
     ultramodern::set_native_thread_priority(ultramodern::ThreadPriority::Normal);
 
@@ -242,13 +369,15 @@ void task_thread_func(uint8_t* rdram, moodycamel::LightweightSemaphore* thread_r
     while (true) {
         // Wait until an RSP task has been sent
         OSTask* task;
-        events_context.sp_task_queue.wait_dequeue(task);
+        events.sp_task_queue.wait_dequeue(task);
+        ultramodern::sync_stats::on_pop(events.sp_task_queue_stats);
 
         if (task == nullptr) {
             return;
         }
 
         // Run the correct function based on the task type
+        auto ucode_start = std::chrono::high_resolution_clock::now();
         if (task->t.type == M_AUDTASK) {
             run_rsp_microcode(rdram, task, aspMain);
         }
@@ -256,21 +385,30 @@ void task_thread_func(uint8_t* rdram, moodycamel::LightweightSemaphore* thread_r
             run_rsp_microcode(rdram, task, njpgdspMain);
         }
         else {
-            fprintf(stderr, "Unknown task type: %" PRIu32 "\n", task->t.type);
+            fprintf(stderr, "Unknown task type: %" PRIu32 "\n", uint32_t{ task->t.type });
             assert(false);
             std::quick_exit(EXIT_FAILURE);
         }
+        ultramodern::perf::record(ultramodern::perf::Timing::RspMicrocode, std::chrono::high_resolution_clock::now() - ucode_start);
 
         // Tell the game that the RSP has completed
         sp_complete();
     }
 }
 
+// The graphics config is the user's setting and there's only one window, so it's shared by every instance rather than kept
+// per instance.
 static std::atomic<ultramodern::GraphicsConfig> cur_config{};
 
 void ultramodern::set_graphics_config(const ultramodern::GraphicsConfig& config) {
     cur_config = config;
-    events_context.action_queue.enqueue(UpdateConfigAction{});
+    // Every instance's gfx thread picks up the change. The config can be set before any instance exists, in which case the
+    // gfx threads read it when they start up.
+    ultramodern::Instance::for_each([](ultramodern::Instance& instance) {
+        EventsContext& events = instance.state<EventsContext>();
+        ultramodern::sync_stats::on_push(events.action_queue_stats);
+        events.action_queue.enqueue(UpdateConfigAction{});
+    });
 }
 
 ultramodern::GraphicsConfig ultramodern::get_graphics_config() {
@@ -297,12 +435,68 @@ uint32_t ultramodern::get_display_refresh_rate() {
     return display_refresh_rate.load();
 }
 
-void ultramodern::load_shader_cache(std::span<const char> cache_data) {
-    events_context.action_queue.enqueue(LoadShaderCacheAction{cache_data});
+void ultramodern::load_shader_cache(std::span<const char> cache_data, const std::filesystem::path& user_cache_path) {
+    enqueue_action(LoadShaderCacheAction{cache_data, user_cache_path});
+}
+
+// Replays a display list capture through RT64 and reports how long it took to render, which gives a rendering benchmark that
+// doesn't depend on reaching the same point in the game.
+static void replay_dl_capture(ultramodern::RT64Context& rt64, uint8_t* rdram, const char* capture_path) {
+    using clock = std::chrono::high_resolution_clock;
+
+    struct ReplaySink : public ultramodern::dl_capture::Sink {
+        ultramodern::RT64Context& rt64;
+        std::vector<double> frame_times_ms{};
+        clock::duration cur_frame_time{};
+
+        ReplaySink(ultramodern::RT64Context& rt64) : rt64(rt64) {}
+
+        void send_dl(uint8_t* rdram, const OSTask* task) override {
+            auto start = clock::now();
+            rt64.send_dl(task);
+            cur_frame_time += clock::now() - start;
+        }
+
+        void update_screen(uint8_t* rdram, const ultramodern::dl_capture::ViRegisters& vi_regs) override {
+            auto start = clock::now();
+            rt64.set_vi_registers(vi_regs);
+            rt64.update_screen(vi_regs.origin);
+            cur_frame_time += clock::now() - start;
+            frame_times_ms.push_back(std::chrono::duration<double, std::milli>(cur_frame_time).count());
+            cur_frame_time = {};
+        }
+    };
+
+    const char* loops_setting = getenv("RECOMP_DL_REPLAY_LOOPS");
+    long loops = loops_setting != nullptr ? std::max(strtol(loops_setting, nullptr, 10), 1L) : 1;
+
+    ReplaySink sink{ rt64 };
+    for (long i = 0; i < loops; i++) {
+        if (!ultramodern::dl_capture::replay(capture_path, rdram, ultramodern::rdram_size, sink)) {
+            fprintf(stderr, "Failed to replay display list capture %s\n", capture_path);
+            break;
+        }
+    }
+
+    if (!sink.frame_times_ms.empty()) {
+        std::vector<double> sorted = sink.frame_times_ms;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double time : sorted) {
+            total += time;
+        }
+        printf("[DL Replay] %zu frames: avg %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", sorted.size(),
+            total / sorted.size(), sorted[sorted.size() / 2], sorted[sorted.size() * 99 / 100], sorted.back());
+    }
+
+    // Leave RDRAM the way the game expects to find it.
+    memset(rdram, 0, ultramodern::rdram_size);
 }
 
 void gfx_thread_func(uint8_t* rdram, moodycamel::LightweightSemaphore* thread_ready, ultramodern::WindowHandle window_handle) {
+    EventsContext& events = events_context();
     bool enabled_instant_present = false;
+    std::chrono::high_resolution_clock::time_point last_swap_time{};
     using namespace std::chrono_literals;
 
     ultramodern::set_native_thread_name("Gfx Thread");
@@ -321,118 +515,142 @@ void gfx_thread_func(uint8_t* rdram, moodycamel::LightweightSemaphore* thread_re
     
     rsp_constants_init();
 
+    // RECOMP_DL_REPLAY replays a display list capture before the game gets a chance to run, see dl_capture.hpp.
+    if (const char* replay_path = getenv("RECOMP_DL_REPLAY"); replay_path != nullptr) {
+        replay_dl_capture(rt64, rt64.rdram(), replay_path);
+    }
+
     // Notify the caller thread that this thread is ready.
     thread_ready->signal();
 
-    while (!exited) {
-        // Try to pull an action from the queue
+    while (!ultramodern::quit_requested()) {
+        // Wait for an action to be sent. Quitting sends a ShutdownAction, so there's no need to wake up periodically to check for it.
         Action action;
-        if (events_context.action_queue.wait_dequeue_timed(action, 1ms)) {
-            // Determine the action type and act on it
-            if (const auto* task_action = std::get_if<SpTaskAction>(&action)) {
-                // Turn on instant present if the game has been started and it hasn't been turned on yet.
-                if (ultramodern::is_game_started() && !enabled_instant_present) {
-                    rt64.enable_instant_present();
-                    enabled_instant_present = true;
-                }
-                // Tell the game that the RSP completed instantly. This will allow it to queue other task types, but it won't
-                // start another graphics task until the RDP is also complete. Games usually preserve the RSP inputs until the RDP
-                // is finished as well, so sending this early shouldn't be an issue in most cases.
-                // If this causes issues then the logic can be replaced with responding to yield requests.
-                sp_complete();
-                ultramodern::measure_input_latency();
-
-                auto rt64_start = std::chrono::high_resolution_clock::now();
-                rt64.send_dl(&task_action->task);
-                auto rt64_end = std::chrono::high_resolution_clock::now();
-                dp_complete();
-                // printf("RT64 ProcessDList time: %d us\n", static_cast<u32>(std::chrono::duration_cast<std::chrono::microseconds>(rt64_end - rt64_start).count()));
+        events.action_queue.wait_dequeue(action);
+        ultramodern::sync_stats::on_pop(events.action_queue_stats);
+
+        // Determine the action type and act on it
+        if (const auto* task_action = std::get_if<SpTaskAction>(&action)) {
+            // Turn on instant present if the game has been started and it hasn't been turned on yet.
+            if (ultramodern::is_game_started() && !enabled_instant_present) {
+                rt64.enable_instant_present();
+                enabled_instant_present = true;
             }
-            else if (const auto* swap_action = std::get_if<SwapBuffersAction>(&action)) {
-                events_context.vi.current_buffer = events_context.vi.next_buffer;
-                rt64.update_screen(swap_action->origin);
-                display_refresh_rate = rt64.get_display_framerate();
+
+            uint64_t task_age_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - task_action->enqueue_time).count();
+            events.gfx_queue.last_task_age_us.store(task_age_us, std::memory_order_relaxed);
+            update_peak(events.gfx_queue.peak_task_age_us, task_age_us);
+
+            // Tell the game that the RSP completed instantly. This will allow it to queue other task types, but it won't
+            // start another graphics task until the RDP is also complete. Games usually preserve the RSP inputs until the RDP
+            // is finished as well, so sending this early shouldn't be an issue in most cases.
+            // If this causes issues then the logic can be replaced with responding to yield requests.
+            sp_complete();
+            ultramodern::measure_input_latency();
+
+            auto rt64_start = std::chrono::high_resolution_clock::now();
+            rt64.sync_rdram();
+            rt64.send_dl(&task_action->task);
+            auto rt64_end = std::chrono::high_resolution_clock::now();
+            ultramodern::perf::record(ultramodern::perf::Timing::SendDl, rt64_end - rt64_start);
+            dp_complete();
+            events.gfx_queue.tasks_in_flight.fetch_sub(1);
+            // printf("RT64 ProcessDList time: %d us\n", static_cast<u32>(std::chrono::duration_cast<std::chrono::microseconds>(rt64_end - rt64_start).count()));
+        }
+        else if (const auto* swap_action = std::get_if<SwapBuffersAction>(&action)) {
+            events.vi.current_buffer = events.vi.next_buffer;
+
+            uint64_t frame_age_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - swap_action->enqueue_time).count();
+            events.gfx_queue.last_frame_age_us.store(frame_age_us, std::memory_order_relaxed);
+            update_peak(events.gfx_queue.peak_frame_age_us, frame_age_us);
+
+            // In coalescing mode the game isn't held back, so frames that already have more frames queued behind them than
+            // allowed are only counted. Every frame still goes through update_screen, as RT64 tracks the VI origin and its
+            // framebuffers per screen update and display list captures record one screen per frame.
+            uint32_t max_in_flight = static_cast<uint32_t>(std::max(old_config.max_frames_in_flight, 0));
+            uint32_t frames_in_flight = events.gfx_queue.frames_in_flight.load(std::memory_order_relaxed);
+            if (old_config.frame_queue_mode == ultramodern::FrameQueueMode::Coalesce && max_in_flight != 0 && frames_in_flight > max_in_flight) {
+                events.gfx_queue.coalesced_frames.fetch_add(1, std::memory_order_relaxed);
             }
-            else if (const auto* config_action = std::get_if<UpdateConfigAction>(&action)) {
-                ultramodern::GraphicsConfig new_config = cur_config;
-                if (old_config != new_config) {
-                    rt64.update_config(old_config, new_config);
-                    old_config = new_config;
-                }
+            rt64.update_screen(swap_action->origin);
+            events.gfx_queue.frames_in_flight.fetch_sub(1, std::memory_order_seq_cst);
+            release_held_retrace(events, old_config);
+            display_refresh_rate = rt64.get_display_framerate();
+
+            auto swap_time = std::chrono::high_resolution_clock::now();
+            if (last_swap_time != std::chrono::high_resolution_clock::time_point{}) {
+                ultramodern::perf::record(ultramodern::perf::Timing::FrameTime, swap_time - last_swap_time);
             }
-            else if (const auto* load_shader_cache_action = std::get_if<LoadShaderCacheAction>(&action)) {
-                rt64.load_shader_cache(load_shader_cache_action->data);
+            last_swap_time = swap_time;
+        }
+        else if (const auto* config_action = std::get_if<UpdateConfigAction>(&action)) {
+            ultramodern::GraphicsConfig new_config = cur_config;
+            if (old_config != new_config) {
+                rt64.update_config(old_config, new_config);
+                old_config = new_config;
             }
         }
+        else if (const auto* load_shader_cache_action = std::get_if<LoadShaderCacheAction>(&action)) {
+            rt64.load_shader_cache(load_shader_cache_action->data, load_shader_cache_action->user_cache_path);
+        }
     }
     // TODO move recomp code out of ultramodern.
     recomp::destroy_ui();
     rt64.shutdown();
 }
 
-extern unsigned int VI_STATUS_REG;
-extern unsigned int VI_ORIGIN_REG;
-extern unsigned int VI_WIDTH_REG;
-extern unsigned int VI_INTR_REG;
-extern unsigned int VI_V_CURRENT_LINE_REG;
-extern unsigned int VI_TIMING_REG;
-extern unsigned int VI_V_SYNC_REG;
-extern unsigned int VI_H_SYNC_REG;
-extern unsigned int VI_LEAP_REG;
-extern unsigned int VI_H_START_REG;
-extern unsigned int VI_V_START_REG;
-extern unsigned int VI_V_BURST_REG;
-extern unsigned int VI_X_SCALE_REG;
-extern unsigned int VI_Y_SCALE_REG;
-
-uint32_t hstart = 0;
-uint32_t vi_origin_offset = 320 * sizeof(uint16_t);
-bool vi_black = false;
-
 void set_dummy_vi() {
-    VI_STATUS_REG = 0x311E;
-    VI_WIDTH_REG = 0x140;
-    VI_V_SYNC_REG = 0x20D;
-    VI_H_SYNC_REG = 0xC15;
-    VI_LEAP_REG = 0x0C150C15;
-    hstart = 0x006C02EC;
-    VI_X_SCALE_REG = 0x200;
-    VI_V_CURRENT_LINE_REG = 0x0;
-    vi_origin_offset = 0x280;
-    VI_Y_SCALE_REG = 0x400;
-    VI_V_START_REG = 0x2501FF;
-    VI_V_BURST_REG = 0xE0204;
-    VI_INTR_REG = 0x2;
+    EventsContext& events = events_context();
+    ultramodern::HardwareRegisters& regs = ultramodern::hardware_registers();
+    regs.VI_STATUS_REG = 0x311E;
+    regs.VI_WIDTH_REG = 0x140;
+    regs.VI_V_SYNC_REG = 0x20D;
+    regs.VI_H_SYNC_REG = 0xC15;
+    regs.VI_LEAP_REG = 0x0C150C15;
+    events.vi.hstart = 0x006C02EC;
+    regs.VI_X_SCALE_REG = 0x200;
+    regs.VI_V_CURRENT_LINE_REG = 0x0;
+    events.vi.origin_offset = 0x280;
+    regs.VI_Y_SCALE_REG = 0x400;
+    regs.VI_V_START_REG = 0x2501FF;
+    regs.VI_V_BURST_REG = 0xE0204;
+    regs.VI_INTR_REG = 0x2;
 }
 
 extern "C" void osViSwapBuffer(RDRAM_ARG PTR(void) frameBufPtr) {
-    if (vi_black) {
-        VI_H_START_REG = 0;
+    EventsContext& events = events_context();
+    ultramodern::HardwareRegisters& regs = ultramodern::hardware_registers();
+    if (events.vi.black) {
+        regs.VI_H_START_REG = 0;
     } else {
-        VI_H_START_REG = hstart;
+        regs.VI_H_START_REG = events.vi.hstart;
     }
-    events_context.vi.next_buffer = frameBufPtr;
-    events_context.action_queue.enqueue(SwapBuffersAction{ osVirtualToPhysical(frameBufPtr) + vi_origin_offset });
+    events.vi.next_buffer = frameBufPtr;
+    uint32_t frames_in_flight = events.gfx_queue.frames_in_flight.fetch_add(1, std::memory_order_relaxed) + 1;
+    update_peak(events.gfx_queue.peak_frames_in_flight, frames_in_flight);
+    enqueue_action(SwapBuffersAction{ osVirtualToPhysical(frameBufPtr) + events.vi.origin_offset, std::chrono::high_resolution_clock::now() });
 }
 
 extern "C" void osViSetMode(RDRAM_ARG PTR(OSViMode) mode_) {
     OSViMode* mode = TO_PTR(OSViMode, mode_);
-    VI_STATUS_REG = mode->comRegs.ctrl;
-    VI_WIDTH_REG = mode->comRegs.width;
+    EventsContext& events = events_context();
+    ultramodern::HardwareRegisters& regs = ultramodern::hardware_registers();
+    regs.VI_STATUS_REG = mode->comRegs.ctrl;
+    regs.VI_WIDTH_REG = mode->comRegs.width;
     // burst
-    VI_V_SYNC_REG = mode->comRegs.vSync;
-    VI_H_SYNC_REG = mode->comRegs.hSync;
-    VI_LEAP_REG = mode->comRegs.leap;
-    hstart = mode->comRegs.hStart;
-    VI_X_SCALE_REG = mode->comRegs.xScale;
-    VI_V_CURRENT_LINE_REG = mode->comRegs.vCurrent;
+    regs.VI_V_SYNC_REG = mode->comRegs.vSync;
+    regs.VI_H_SYNC_REG = mode->comRegs.hSync;
+    regs.VI_LEAP_REG = mode->comRegs.leap;
+    events.vi.hstart = mode->comRegs.hStart;
+    regs.VI_X_SCALE_REG = mode->comRegs.xScale;
+    regs.VI_V_CURRENT_LINE_REG = mode->comRegs.vCurrent;
 
     // TODO swap these every VI to account for fields changing
-    vi_origin_offset = mode->fldRegs[0].origin;
-    VI_Y_SCALE_REG = mode->fldRegs[0].yScale;
-    VI_V_START_REG = mode->fldRegs[0].vStart;
-    VI_V_BURST_REG = mode->fldRegs[0].vBurst;
-    VI_INTR_REG = mode->fldRegs[0].vIntr;
+    events.vi.origin_offset = mode->fldRegs[0].origin;
+    regs.VI_Y_SCALE_REG = mode->fldRegs[0].yScale;
+    regs.VI_V_START_REG = mode->fldRegs[0].vStart;
+    regs.VI_V_BURST_REG = mode->fldRegs[0].vBurst;
+    regs.VI_INTR_REG = mode->fldRegs[0].vIntr;
 }
 
 #define VI_CTRL_TYPE_16             0x00002
@@ -461,43 +679,45 @@ extern "C" void osViSetMode(RDRAM_ARG PTR(OSViMode) mode_) {
 #define	OS_VI_DITHER_FILTER_OFF 0x0080
 
 extern "C" void osViSetSpecialFeatures(uint32_t func) {
+    ultramodern::HardwareRegisters& regs = ultramodern::hardware_registers();
     if ((func & OS_VI_GAMMA_ON) != 0) {
-        VI_STATUS_REG |= VI_CTRL_GAMMA_ON;
+        regs.VI_STATUS_REG |= VI_CTRL_GAMMA_ON;
     }
 
     if ((func & OS_VI_GAMMA_OFF) != 0) {
-        VI_STATUS_REG &= ~VI_CTRL_GAMMA_ON;
+        regs.VI_STATUS_REG &= ~VI_CTRL_GAMMA_ON;
     }
 
     if ((func & OS_VI_GAMMA_DITHER_ON) != 0) {
-        VI_STATUS_REG |= VI_CTRL_GAMMA_DITHER_ON;
+        regs.VI_STATUS_REG |= VI_CTRL_GAMMA_DITHER_ON;
     }
 
     if ((func & OS_VI_GAMMA_DITHER_OFF) != 0) {
-        VI_STATUS_REG &= ~VI_CTRL_GAMMA_DITHER_ON;
+        regs.VI_STATUS_REG &= ~VI_CTRL_GAMMA_DITHER_ON;
     }
 
     if ((func & OS_VI_DIVOT_ON) != 0) {
-        VI_STATUS_REG |= VI_CTRL_DIVOT_ON;
+        regs.VI_STATUS_REG |= VI_CTRL_DIVOT_ON;
     }
 
     if ((func & OS_VI_DIVOT_OFF) != 0) {
-        VI_STATUS_REG &= ~VI_CTRL_DIVOT_ON;
+        regs.VI_STATUS_REG &= ~VI_CTRL_DIVOT_ON;
     }
 
     if ((func & OS_VI_DITHER_FILTER_ON) != 0) {
-        VI_STATUS_REG |= VI_CTRL_DITHER_FILTER_ON;
-        VI_STATUS_REG &= ~VI_CTRL_ANTIALIAS_MASK;
+        regs.VI_STATUS_REG |= VI_CTRL_DITHER_FILTER_ON;
+        regs.VI_STATUS_REG &= ~VI_CTRL_ANTIALIAS_MASK;
     }
 
     if ((func & OS_VI_DITHER_FILTER_OFF) != 0) {
-        VI_STATUS_REG &= ~VI_CTRL_DITHER_FILTER_ON;
+        regs.VI_STATUS_REG &= ~VI_CTRL_DITHER_FILTER_ON;
         //VI_STATUS_REG |= __osViNext->modep->comRegs.ctrl & VI_CTRL_ANTIALIAS_MASK;
     }
 }
 
 extern "C" void osViBlack(uint8_t active) {
-    vi_black = active;
+    EventsContext& events = events_context();
+    events.vi.black = active;
 }
 
 extern "C" void osViSetXScale(float scale) {
@@ -513,50 +733,76 @@ extern "C" void osViSetYScale(float scale) {
 }
 
 extern "C" PTR(void) osViGetNextFramebuffer() {
-    return events_context.vi.next_buffer;
+    return events_context().vi.next_buffer;
 }
 
 extern "C" PTR(void) osViGetCurrentFramebuffer() {
-    return events_context.vi.current_buffer;
+    return events_context().vi.current_buffer;
 }
 
 void ultramodern::submit_rsp_task(RDRAM_ARG PTR(OSTask) task_) {
+    EventsContext& events = events_context();
     OSTask* task = TO_PTR(OSTask, task_);
 
     // Send gfx tasks to the graphics action queue
     if (task->t.type == M_GFXTASK) {
-        events_context.action_queue.enqueue(SpTaskAction{ *task });
+        uint32_t in_flight = events.gfx_queue.tasks_in_flight.fetch_add(1) + 1;
+        update_peak(events.gfx_queue.peak_tasks_in_flight, in_flight);
+        enqueue_action(SpTaskAction{ *task, std::chrono::high_resolution_clock::now() });
     }
     // Set all other tasks as the RSP task
     else {
-        events_context.sp_task_queue.enqueue(task);
+        enqueue_sp_task(task);
     }
 }
 
+ultramodern::GfxQueueStats ultramodern::get_gfx_queue_stats() {
+    EventsContext& events = events_context();
+    return GfxQueueStats{
+        .tasks_in_flight = events.gfx_queue.tasks_in_flight.load(std::memory_order_relaxed),
+        .peak_tasks_in_flight = events.gfx_queue.peak_tasks_in_flight.load(std::memory_order_relaxed),
+        .last_task_age_us = events.gfx_queue.last_task_age_us.load(std::memory_order_relaxed),
+        .peak_task_age_us = events.gfx_queue.peak_task_age_us.load(std::memory_order_relaxed),
+        .frames_in_flight = events.gfx_queue.frames_in_flight.load(std::memory_order_relaxed),
+        .peak_frames_in_flight = events.gfx_queue.peak_frames_in_flight.load(std::memory_order_relaxed),
+        .last_frame_age_us = events.gfx_queue.last_frame_age_us.load(std::memory_order_relaxed),
+        .peak_frame_age_us = events.gfx_queue.peak_frame_age_us.load(std::memory_order_relaxed),
+        .held_retraces = events.gfx_queue.held_retraces.load(std::memory_order_relaxed),
+        .coalesced_frames = events.gfx_queue.coalesced_frames.load(std::memory_order_relaxed),
+    };
+}
+
 void ultramodern::send_si_message(RDRAM_ARG1) {
-    osSendMesg(PASS_RDRAM events_context.si.mq, events_context.si.msg, OS_MESG_NOBLOCK);
+    EventsContext& events = events_context();
+    osSendMesg(PASS_RDRAM events.si.mq, events.si.msg, OS_MESG_NOBLOCK);
 }
 
 void ultramodern::init_events(RDRAM_ARG ultramodern::WindowHandle window_handle) {
+    EventsContext& events = events_context();
     moodycamel::LightweightSemaphore gfx_thread_ready;
     moodycamel::LightweightSemaphore task_thread_ready;
-    events_context.rdram = rdram;
-    events_context.sp.gfx_thread = std::thread{ gfx_thread_func, rdram, &gfx_thread_ready, window_handle };
-    events_context.sp.task_thread = std::thread{ task_thread_func, rdram, &task_thread_ready };
+    events.rdram = rdram;
+    events.sp.gfx_thread = ultramodern::create_instance_thread(gfx_thread_func, rdram, &gfx_thread_ready, window_handle);
+    events.sp.task_thread = ultramodern::create_instance_thread(task_thread_func, rdram, &task_thread_ready);
     
     // Wait for the two sp threads to be ready before continuing to prevent the game from
     // running before we're able to handle RSP tasks.
     gfx_thread_ready.wait();
     task_thread_ready.wait();
 
-    events_context.vi.thread = std::thread{ vi_thread_func };
+    events.vi.thread = ultramodern::create_instance_thread(vi_thread_func);
+}
+
+void ultramodern::wake_event_threads() {
+    enqueue_action(ShutdownAction{});
 }
 
 void ultramodern::join_event_threads() {
-    events_context.sp.gfx_thread.join();
-    events_context.vi.thread.join();
+    EventsContext& events = events_context();
+    events.sp.gfx_thread.join();
+    events.vi.thread.join();
 
     // Send a null RSP task to indicate that the RSP task thread should exit.
-    events_context.sp_task_queue.enqueue(nullptr);
-    events_context.sp.task_thread.join();
+    enqueue_sp_task(nullptr);
+    events.sp.task_thread.join();
 }
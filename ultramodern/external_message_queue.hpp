@@ -0,0 +1,220 @@
+#ifndef __EXTERNAL_MESSAGE_QUEUE_HPP__
+#define __EXTERNAL_MESSAGE_QUEUE_HPP__
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace ultramodern {
+    // Queue of messages sent from external (non-game) threads, such as the VI, timer and RSP task threads, to be delivered by
+    // whichever game thread runs next. Only one game thread runs at a time, so there's a single consumer.
+    //
+    // Each producer thread claims its own single-producer ring the first time it sends a message and releases it when the
+    // thread exits, so rings are only limited by the number of producers running at once rather than by how many have ever
+    // run. Messages sent while every ring is claimed, or while the producer's ring is full, go through a locked overflow queue
+    // instead.
+    //
+    // Messages are stamped with a sequence number when they're sent, which pop uses to merge the rings and the overflow queue.
+    // That guarantees each producer's messages are delivered in the order it sent them, and that messages from different
+    // producers are delivered in the order they were sent as long as both sends finished before the pop that delivers them.
+    // Sends that are still in progress on different threads aren't ordered: a producer can be preempted between stamping a
+    // message and publishing it, so a later-stamped message from another thread can be delivered first. Messages from
+    // separate threads that race like that have no meaningful order anyway, as with the console's interrupts.
+    template <typename T, uint32_t ring_capacity = 64>
+    class ExternalMessageQueue {
+    public:
+        static constexpr uint32_t max_rings = 32;
+
+        ExternalMessageQueue() = default;
+        ExternalMessageQueue(const ExternalMessageQueue&) = delete;
+        ExternalMessageQueue& operator=(const ExternalMessageQueue&) = delete;
+
+        void push(const T& value) {
+            // Stamped before the message is published, see the ordering notes above.
+            Entry entry{ value, next_sequence_.fetch_add(1, std::memory_order_relaxed) };
+            Ring* ring = producer_ring();
+
+            if (ring == nullptr || !ring->try_push(entry)) {
+                std::lock_guard lock{ overflow_mutex_ };
+                overflow_.push_back(entry);
+                overflow_count_.fetch_add(1, std::memory_order_release);
+            }
+
+            pending_.fetch_add(1, std::memory_order_release);
+        }
+
+        // Removes the earliest sent message that has been published by any producer, returning false if there aren't any.
+        // Must only be called by one thread at a time.
+        bool pop(T& out) {
+            // The overflow queue is looked at before the rings. A producer only overflows once its ring is full, so any earlier
+            // message it sent is already in its ring by the time its overflowed one can be seen, and the scan below finds it.
+            // Checking the rings first would let a producer fill its ring and overflow in between, and the overflowed message
+            // would then be delivered ahead of the ones in the ring.
+            uint64_t overflow_sequence = 0;
+            bool has_overflow = peek_overflow(overflow_sequence);
+
+            Ring* earliest_ring = nullptr;
+            const Entry* earliest = nullptr;
+
+            // Rings are claimed lowest index first, so this only scans as many rings as there have been producers at once.
+            // Released rings are still scanned, as they can hold messages their producer sent before exiting.
+            RingSet& ring_set = *ring_set_;
+            uint32_t ring_count = ring_set.high_water.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < ring_count; i++) {
+                const Entry* entry = ring_set.rings[i].peek();
+                if (entry != nullptr && (earliest == nullptr || entry->sequence < earliest->sequence)) {
+                    earliest = entry;
+                    earliest_ring = &ring_set.rings[i];
+                }
+            }
+
+            // A producer that overflowed while the rings were being scanned may have gone back to its ring for its next
+            // message, which the scan can have found ahead of the overflowed one. That's rare enough to just start over.
+            if (!has_overflow && peek_overflow(overflow_sequence)) {
+                return pop(out);
+            }
+
+            // Only this thread pops, so the front of the overflow queue is still the message seen above.
+            if (has_overflow && (earliest == nullptr || overflow_sequence < earliest->sequence)) {
+                std::lock_guard lock{ overflow_mutex_ };
+                out = overflow_.front().value;
+                overflow_.pop_front();
+                overflow_count_.fetch_sub(1, std::memory_order_relaxed);
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+
+            if (earliest == nullptr) {
+                return false;
+            }
+
+            out = earliest->value;
+            earliest_ring->pop();
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // Whether there may be messages to pop, which lets the consumer skip checking for them with a single load. Producers
+        // count a message after pushing it, so the count can briefly go negative when a message is popped before that happens.
+        bool maybe_pending() const {
+            return pending_.load(std::memory_order_relaxed) > 0;
+        }
+
+        uint32_t claimed_rings() const {
+            return uint32_t(std::popcount(ring_set_->claimed_mask.load(std::memory_order_relaxed)));
+        }
+    private:
+        struct Entry {
+            T value;
+            uint64_t sequence;
+        };
+
+        // Single-producer single-consumer ring.
+        class Ring {
+            std::array<Entry, ring_capacity> slots_{};
+            alignas(64) std::atomic<uint32_t> head_ = 0;
+            alignas(64) std::atomic<uint32_t> tail_ = 0;
+        public:
+            bool try_push(const Entry& entry) {
+                uint32_t tail = tail_.load(std::memory_order_relaxed);
+                if (tail - head_.load(std::memory_order_acquire) == ring_capacity) {
+                    return false;
+                }
+                slots_[tail % ring_capacity] = entry;
+                tail_.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            const Entry* peek() const {
+                uint32_t head = head_.load(std::memory_order_relaxed);
+                if (head == tail_.load(std::memory_order_acquire)) {
+                    return nullptr;
+                }
+                return &slots_[head % ring_capacity];
+            }
+
+            void pop() {
+                head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+        };
+
+        struct RingSet {
+            std::array<Ring, max_rings> rings{};
+            std::atomic<uint32_t> claimed_mask = 0;
+            // One past the highest ring index that has ever been claimed.
+            std::atomic<uint32_t> high_water = 0;
+        };
+
+        // The ring a thread has claimed. Releasing it on thread exit publishes everything the thread pushed to the next
+        // thread that claims the same ring, so the ring never has two producers at once. The claim shares ownership of the
+        // rings, so a producer that outlives the queue (e.g. the main thread sending to an instance that has shut down)
+        // neither releases into freed memory nor mistakes a new queue at the same address for the old one.
+        struct ProducerClaim {
+            std::shared_ptr<RingSet> ring_set{};
+            uint32_t index = 0;
+
+            ~ProducerClaim() {
+                release();
+            }
+
+            void release() {
+                if (ring_set != nullptr) {
+                    ring_set->claimed_mask.fetch_and(~(1u << index), std::memory_order_release);
+                    ring_set.reset();
+                }
+            }
+        };
+
+        // Gets the sequence number of the earliest overflowed message, returning false if there aren't any.
+        bool peek_overflow(uint64_t& sequence) {
+            if (overflow_count_.load(std::memory_order_acquire) == 0) {
+                return false;
+            }
+            std::lock_guard lock{ overflow_mutex_ };
+            if (overflow_.empty()) {
+                return false;
+            }
+            sequence = overflow_.front().sequence;
+            return true;
+        }
+
+        Ring* producer_ring() {
+            static thread_local ProducerClaim claim{};
+            if (claim.ring_set == ring_set_) {
+                return &ring_set_->rings[claim.index];
+            }
+
+            // A thread only holds a ring in one queue at a time.
+            claim.release();
+
+            RingSet& ring_set = *ring_set_;
+            uint32_t mask = ring_set.claimed_mask.load(std::memory_order_relaxed);
+            while (mask != UINT32_MAX) {
+                uint32_t index = uint32_t(std::countr_one(mask));
+                if (ring_set.claimed_mask.compare_exchange_weak(mask, mask | (1u << index), std::memory_order_acquire, std::memory_order_relaxed)) {
+                    uint32_t high_water = ring_set.high_water.load(std::memory_order_relaxed);
+                    while (high_water <= index && !ring_set.high_water.compare_exchange_weak(high_water, index + 1, std::memory_order_release, std::memory_order_relaxed)) {}
+                    claim.ring_set = ring_set_;
+                    claim.index = index;
+                    return &ring_set.rings[index];
+                }
+            }
+
+            // Every ring is claimed, so this message goes through the overflow queue. Claiming is retried on the next message.
+            return nullptr;
+        }
+
+        std::shared_ptr<RingSet> ring_set_ = std::make_shared<RingSet>();
+        std::atomic<int32_t> pending_ = 0;
+        std::atomic<uint64_t> next_sequence_ = 0;
+        std::mutex overflow_mutex_;
+        std::deque<Entry> overflow_;
+        std::atomic<uint32_t> overflow_count_ = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,355 @@
+#ifdef ULTRAMODERN_FUNC_COUNTERS
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "func_counters.hpp"
+#include "profiler.hpp"
+#include "ultramodern.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#endif
+
+#if defined(__linux__)
+#   include <dlfcn.h>
+#endif
+
+// The hooks are called by the compiler-generated code in every instrumented function, so they must never be instrumented
+// themselves even if this file ends up built with -finstrument-functions.
+#define FUNC_COUNTERS_HOOK extern "C" __attribute__((no_instrument_function))
+
+namespace func_counters = ultramodern::func_counters;
+
+namespace {
+    // Function ids are slots in an open addressing table keyed by the function's address, which has room for several times the
+    // number of recompiled functions so that lookups rarely have to probe.
+    constexpr uint32_t function_table_bits = 17;
+    constexpr uint32_t function_table_size = 1u << function_table_bits;
+    constexpr uint32_t max_probes = 64;
+    // Id that calls are counted under if their function couldn't be given a slot.
+    constexpr uint32_t overflow_id = function_table_size;
+    constexpr uint32_t max_call_depth = 1024;
+    constexpr size_t default_top_count = 30;
+
+    std::atomic<uintptr_t> function_addresses[function_table_size]{};
+    // Function ids in the order their functions were first called, which is the order they're given slots in.
+    std::atomic<uint32_t> first_touch_ids[function_table_size]{};
+    std::atomic<uint32_t> first_touch_count = 0;
+
+    struct FunctionCounters {
+        uint64_t calls;
+        uint64_t inclusive_cycles;
+        uint64_t exclusive_cycles;
+        // Activations of the function currently on the thread's stack, so that recursive calls only count towards the inclusive
+        // time once.
+        uint64_t active;
+    };
+
+    struct Frame {
+        uintptr_t address;
+        uint32_t id;
+        uint64_t start;
+        uint64_t child_cycles;
+    };
+
+    // Only written by the thread it belongs to. Counters are written through relaxed atomics so that the report can read them
+    // while the game is running, which compiles down to plain loads and stores.
+    struct ThreadCounters {
+        // Indexed by function id, with one extra entry for overflow_id. Allocated zeroed and untouched, so only the pages for
+        // functions the thread actually calls are committed.
+        FunctionCounters* functions;
+        std::array<Frame, max_call_depth> stack;
+        uint32_t depth;
+        // Calls past max_call_depth, which aren't counted but still have to be matched with their exits.
+        uint32_t untracked_depth;
+    };
+
+    struct CounterRegistry {
+        std::mutex mutex{};
+        std::vector<ThreadCounters*> threads{};
+        // Reference point for converting cycles into time.
+        std::chrono::steady_clock::time_point start_time;
+        uint64_t start_cycles;
+        std::string output_path{};
+        std::string function_order_path{};
+        size_t top_count = default_top_count;
+        uint64_t frame_limit = 0;
+    };
+
+    thread_local ThreadCounters* thread_counters = nullptr;
+
+    __attribute__((no_instrument_function)) inline uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t ret;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(ret));
+        return ret;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    CounterRegistry& registry() {
+        // Never destroyed, as threads can still be running instrumented code while the process exits.
+        static CounterRegistry* ret = []() {
+            CounterRegistry* ret = new CounterRegistry{};
+            ret->start_time = std::chrono::steady_clock::now();
+            ret->start_cycles = read_cycles();
+
+            const char* output_path = getenv("RECOMP_FUNC_COUNTERS");
+            if (output_path != nullptr) {
+                ret->output_path = output_path;
+            }
+
+            const char* function_order_path = getenv("RECOMP_FUNC_ORDER");
+            if (function_order_path != nullptr) {
+                ret->function_order_path = function_order_path;
+            }
+
+            const char* top_setting = getenv("RECOMP_FUNC_COUNTERS_TOP");
+            long top_count = top_setting != nullptr ? strtol(top_setting, nullptr, 10) : 0;
+            ret->top_count = top_count > 0 ? static_cast<size_t>(top_count) : default_top_count;
+
+            const char* frames_setting = getenv("RECOMP_FUNC_COUNTERS_FRAMES");
+            long long frame_limit = frames_setting != nullptr ? strtoll(frames_setting, nullptr, 10) : 0;
+            ret->frame_limit = frame_limit > 0 ? static_cast<uint64_t>(frame_limit) : 0;
+            return ret;
+        }();
+        return *ret;
+    }
+
+    __attribute__((no_instrument_function)) inline uint64_t load_counter(uint64_t& counter) {
+        return std::atomic_ref<uint64_t>{ counter }.load(std::memory_order_relaxed);
+    }
+
+    __attribute__((no_instrument_function)) inline void add_to_counter(uint64_t& counter, uint64_t value) {
+        std::atomic_ref<uint64_t> ref{ counter };
+        ref.store(ref.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    __attribute__((no_instrument_function)) ThreadCounters* register_current_thread() {
+        ThreadCounters* counters = new ThreadCounters{};
+        counters->functions = static_cast<FunctionCounters*>(calloc(function_table_size + 1, sizeof(FunctionCounters)));
+
+        CounterRegistry& counter_registry = registry();
+        std::lock_guard lock{ counter_registry.mutex };
+        counter_registry.threads.push_back(counters);
+        thread_counters = counters;
+        return counters;
+    }
+
+    __attribute__((no_instrument_function)) uint32_t function_id(uintptr_t address) {
+        uint32_t slot = static_cast<uint32_t>((static_cast<uint64_t>(address) * 0x9E3779B97F4A7C15ull) >> (64 - function_table_bits));
+        for (uint32_t probe = 0; probe < max_probes; probe++) {
+            std::atomic<uintptr_t>& entry = function_addresses[slot];
+            uintptr_t cur = entry.load(std::memory_order_relaxed);
+            if (cur == address) {
+                return slot;
+            }
+            if (cur == 0) {
+                if (entry.compare_exchange_strong(cur, address, std::memory_order_relaxed)) {
+                    first_touch_ids[first_touch_count.fetch_add(1, std::memory_order_relaxed)].store(slot, std::memory_order_relaxed);
+                    return slot;
+                }
+                if (cur == address) {
+                    return slot;
+                }
+            }
+            slot = (slot + 1) & (function_table_size - 1);
+        }
+        return overflow_id;
+    }
+
+    __attribute__((no_instrument_function)) void pop_frame(ThreadCounters& counters, uint64_t now) {
+        const Frame& frame = counters.stack[--counters.depth];
+        uint64_t elapsed = now - frame.start;
+        FunctionCounters& function = counters.functions[frame.id];
+        add_to_counter(function.exclusive_cycles, elapsed - std::min(frame.child_cycles, elapsed));
+        if (--function.active == 0) {
+            add_to_counter(function.inclusive_cycles, elapsed);
+        }
+        if (counters.depth != 0) {
+            counters.stack[counters.depth - 1].child_cycles += elapsed;
+        }
+    }
+}
+
+FUNC_COUNTERS_HOOK void __cyg_profile_func_enter(void* this_fn, void* call_site) {
+    ThreadCounters* counters = thread_counters;
+    if (counters == nullptr) {
+        counters = register_current_thread();
+    }
+    if (counters->depth == max_call_depth) {
+        counters->untracked_depth++;
+        return;
+    }
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(this_fn);
+    uint32_t id = function_id(address);
+    FunctionCounters& function = counters->functions[id];
+    add_to_counter(function.calls, 1);
+    function.active++;
+    counters->stack[counters->depth++] = { address, id, read_cycles(), 0 };
+}
+
+FUNC_COUNTERS_HOOK void __cyg_profile_func_exit(void* this_fn, void* call_site) {
+    uint64_t now = read_cycles();
+    ThreadCounters* counters = thread_counters;
+    if (counters == nullptr) {
+        return;
+    }
+    if (counters->untracked_depth != 0) {
+        counters->untracked_depth--;
+        return;
+    }
+
+    // Frames above the function's own entry never had their exit hooks called, which happens when a game thread is terminated
+    // by unwinding through the recompiled code. Close them as though they returned now. Exits without a matching entry are
+    // ignored.
+    uintptr_t address = reinterpret_cast<uintptr_t>(this_fn);
+    uint32_t depth = counters->depth;
+    while (depth != 0 && counters->stack[depth - 1].address != address) {
+        depth--;
+    }
+    if (depth == 0) {
+        return;
+    }
+    while (counters->depth >= depth) {
+        pop_frame(*counters, now);
+    }
+}
+
+void func_counters::next_frame() {
+    CounterRegistry& counter_registry = registry();
+    // Only the VI thread closes frames.
+    static uint64_t frames = 0;
+    if (counter_registry.frame_limit != 0 && ++frames == counter_registry.frame_limit) {
+        printf("[FuncCounters] Quitting after %" PRIu64 " frames\n", frames);
+        ultramodern::quit();
+    }
+}
+
+void func_counters::report(FILE* out) {
+    struct FunctionTotals {
+        uint32_t id;
+        uint64_t calls;
+        uint64_t inclusive_cycles;
+        uint64_t exclusive_cycles;
+    };
+
+    CounterRegistry& counter_registry = registry();
+    std::vector<ThreadCounters*> threads{};
+    {
+        std::lock_guard lock{ counter_registry.mutex };
+        threads = counter_registry.threads;
+    }
+
+    std::vector<FunctionTotals> totals{};
+    uint64_t total_calls = 0;
+    uint64_t total_cycles = 0;
+    for (uint32_t id = 0; id <= overflow_id; id++) {
+        FunctionTotals function_totals{ id, 0, 0, 0 };
+        for (ThreadCounters* counters : threads) {
+            FunctionCounters& function = counters->functions[id];
+            function_totals.calls += load_counter(function.calls);
+            function_totals.inclusive_cycles += load_counter(function.inclusive_cycles);
+            function_totals.exclusive_cycles += load_counter(function.exclusive_cycles);
+        }
+        if (function_totals.calls != 0) {
+            total_calls += function_totals.calls;
+            total_cycles += function_totals.exclusive_cycles;
+            totals.push_back(function_totals);
+        }
+    }
+    std::sort(totals.begin(), totals.end(), [](const FunctionTotals& a, const FunctionTotals& b) {
+        return a.exclusive_cycles > b.exclusive_cycles;
+    });
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - counter_registry.start_time).count();
+    double cycles_per_ms = elapsed_ms > 0.0 ? (read_cycles() - counter_registry.start_cycles) / elapsed_ms : 0.0;
+    auto to_ms = [cycles_per_ms](uint64_t cycles) {
+        return cycles_per_ms > 0.0 ? cycles / cycles_per_ms : 0.0;
+    };
+    auto get_name = [](uint32_t id) {
+        if (id == overflow_id) {
+            return std::string{ "[function table full]" };
+        }
+        return ultramodern::profiler::symbolize(function_addresses[id].load(std::memory_order_relaxed));
+    };
+
+    // Exclusive times include the cost of the hooks for the calls the function makes, which inflates the numbers for
+    // functions that call many small ones.
+    fprintf(out, "[FuncCounters] %zu functions called %" PRIu64 " times on %zu threads, %.1f ms in instrumented code\n",
+        totals.size(), total_calls, threads.size(), to_ms(total_cycles));
+    fprintf(out, "[FuncCounters] %12s %10s %7s %10s %9s  %s\n", "calls", "excl ms", "excl %", "incl ms", "cyc/call", "function");
+    for (size_t i = 0; i < std::min(counter_registry.top_count, totals.size()); i++) {
+        const FunctionTotals& function = totals[i];
+        fprintf(out, "[FuncCounters] %12" PRIu64 " %10.2f %6.2f%% %10.2f %9" PRIu64 "  %s\n", function.calls,
+            to_ms(function.exclusive_cycles), total_cycles != 0 ? 100.0 * function.exclusive_cycles / total_cycles : 0.0,
+            to_ms(function.inclusive_cycles), function.exclusive_cycles / function.calls, get_name(function.id).c_str());
+    }
+
+    if (!counter_registry.output_path.empty()) {
+        std::ofstream output_file{ counter_registry.output_path };
+        output_file << "function\tcalls\tinclusive_cycles\texclusive_cycles\n";
+        for (const FunctionTotals& function : totals) {
+            output_file << get_name(function.id) << '\t' << function.calls << '\t' << function.inclusive_cycles << '\t'
+                << function.exclusive_cycles << '\n';
+        }
+        if (output_file.good()) {
+            fprintf(out, "[FuncCounters] Wrote %zu functions to %s\n", totals.size(), counter_registry.output_path.c_str());
+        }
+        else {
+            fprintf(stderr, "[FuncCounters] Failed to write %s\n", counter_registry.output_path.c_str());
+        }
+    }
+    fflush(out);
+}
+
+void func_counters::write_function_order() {
+    CounterRegistry& counter_registry = registry();
+    if (counter_registry.function_order_path.empty()) {
+        return;
+    }
+
+#if defined(__linux__)
+    // The linker matches the ordering file against symbol names, so functions are named by their exported symbols rather than
+    // by the profiler's symbolizer. Addresses without an exported symbol that starts exactly there (e.g. static functions)
+    // can't be ordered and are skipped.
+    std::ofstream order_file{ counter_registry.function_order_path };
+    uint32_t touched = std::min(first_touch_count.load(), function_table_size);
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < touched; i++) {
+        uintptr_t address = function_addresses[first_touch_ids[i].load(std::memory_order_relaxed)].load(std::memory_order_relaxed);
+        Dl_info info{};
+        if (address != 0 && dladdr(reinterpret_cast<void*>(address), &info) != 0 && info.dli_sname != nullptr &&
+            reinterpret_cast<uintptr_t>(info.dli_saddr) == address)
+        {
+            order_file << info.dli_sname << '\n';
+            written++;
+        }
+    }
+    if (order_file.good()) {
+        printf("[FuncCounters] Wrote the first-touch order of %u of %u called functions to %s\n", written, touched,
+            counter_registry.function_order_path.c_str());
+    }
+    else {
+        fprintf(stderr, "[FuncCounters] Failed to write %s\n", counter_registry.function_order_path.c_str());
+    }
+#else
+    fprintf(stderr, "[FuncCounters] RECOMP_FUNC_ORDER is only supported on Linux\n");
+#endif
+}
+
+#endif
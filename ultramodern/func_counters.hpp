@@ -0,0 +1,35 @@
+#ifndef __FUNC_COUNTERS_HPP__
+#define __FUNC_COUNTERS_HPP__
+
+#include <cstdio>
+
+// Exact per-function counters for the recompiled code. Builds with ULTRAMODERN_FUNC_COUNTERS compile RecompiledFuncs and
+// PatchesLib with -finstrument-functions (see the RECOMP_FUNC_COUNTERS CMake option), so every call into them goes through
+// entry and exit hooks that count calls along with inclusive and exclusive cycles in per-thread tables. Unlike the sampling
+// profiler this sees every call to the small helpers that are called millions of times per second.
+//
+// The report is printed at exit and whenever F4 is pressed, listing the top RECOMP_FUNC_COUNTERS_TOP functions (30 by
+// default) by exclusive time. If RECOMP_FUNC_COUNTERS is set to a path, every function that was called is also written to it
+// as tab separated values. Setting RECOMP_FUNC_COUNTERS_FRAMES makes the game quit after that many VIs, so that a fixed run
+// can be profiled unattended.
+//
+// If RECOMP_FUNC_ORDER is set to a path, the symbols of the functions that were called are written to it at exit in the order
+// they were first called. Linking with that file as RECOMP_FUNC_ORDER_FILE groups the code a run actually uses together,
+// in the order it's reached, instead of leaving it scattered in source order. Other builds compile this down to nothing.
+namespace ultramodern {
+    namespace func_counters {
+#ifdef ULTRAMODERN_FUNC_COUNTERS
+        // Counts a VI and quits once RECOMP_FUNC_COUNTERS_FRAMES have passed. Called once per VI.
+        void next_frame();
+        void report(FILE* out);
+        // Writes the first-touch function order if RECOMP_FUNC_ORDER is set.
+        void write_function_order();
+#else
+        inline void next_frame() {}
+        inline void report(FILE*) {}
+        inline void write_function_order() {}
+#endif
+    }
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <utility>
+
+#include "guest_faults.hpp"
+#include "ultramodern.hpp"
+
+#if defined(__linux__)
+#   include <csignal>
+#   include <sys/prctl.h>
+#   include <ucontext.h>
+#   include <unistd.h>
+#endif
+
+namespace guest_faults = ultramodern::guest_faults;
+
+namespace {
+#if defined(__linux__)
+    // Upper bound on the size of the last recompiled function in host code, as function sizes aren't recorded anywhere.
+    constexpr uintptr_t max_last_function_size = 64 * 1024;
+
+    // One instance's RDRAM reservation. A slot is claimed by setting its RDRAM address and published by setting its start,
+    // so the handler only uses slots whose start it sees as set. Lock-free atomics are safe to read from the handler.
+    struct Reservation {
+        std::atomic<uintptr_t> rdram = 0;
+        std::atomic<uintptr_t> start = 0;
+        std::atomic<uintptr_t> end = 0;
+    };
+    static_assert(std::atomic<uintptr_t>::is_always_lock_free);
+
+    // Read by the signal handler. The functions are set up before the handler is installed and never changed afterwards.
+    struct FaultState {
+        std::array<Reservation, guest_faults::max_reservations> reservations;
+        // Sorted by host address.
+        std::vector<guest_faults::HostFunction> functions;
+        struct sigaction previous_action;
+    };
+    FaultState fault_state{};
+
+    // Returns the RDRAM of the reservation containing the address, or 0 if it isn't in one.
+    uintptr_t find_reservation_rdram(uintptr_t address) {
+        for (const Reservation& reservation : fault_state.reservations) {
+            uintptr_t start = reservation.start.load(std::memory_order_acquire);
+            if (start != 0 && address >= start && address < reservation.end.load(std::memory_order_relaxed)) {
+                return reservation.rdram.load(std::memory_order_relaxed);
+            }
+        }
+        return 0;
+    }
+
+    // Builds a message in a fixed buffer without allocating or calling into stdio, so that it can be used from the signal
+    // handler. Anything past the end of the buffer is dropped.
+    class MessageWriter {
+    public:
+        void append(const char* text) {
+            while (*text != '\0' && length_ < sizeof(buffer_)) {
+                buffer_[length_++] = *text++;
+            }
+        }
+
+        void append_hex(uint64_t value, int digits) {
+            for (int digit = digits - 1; digit >= 0; digit--) {
+                append_char("0123456789ABCDEF"[(value >> (4 * digit)) & 0xF]);
+            }
+        }
+
+        void append_decimal(int64_t value) {
+            if (value < 0) {
+                append_char('-');
+            }
+            uint64_t magnitude = value < 0 ? uint64_t(0) - uint64_t(value) : uint64_t(value);
+            char digits[20];
+            int count = 0;
+            do {
+                digits[count++] = char('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude != 0);
+            while (count > 0) {
+                append_char(digits[--count]);
+            }
+        }
+
+        void write_to(int fd) const {
+            ssize_t written = write(fd, buffer_, length_);
+            (void)written;
+        }
+    private:
+        void append_char(char c) {
+            if (length_ < sizeof(buffer_)) {
+                buffer_[length_++] = c;
+            }
+        }
+
+        char buffer_[512];
+        size_t length_ = 0;
+    };
+
+    void append_function_name(MessageWriter& message, uintptr_t pc) {
+        const std::vector<guest_faults::HostFunction>& functions = fault_state.functions;
+        auto find_it = std::upper_bound(functions.begin(), functions.end(), pc,
+            [](uintptr_t pc, const guest_faults::HostFunction& func) { return pc < func.host_address; });
+        if (find_it == functions.begin() || (find_it == functions.end() && pc - std::prev(find_it)->host_address > max_last_function_size)) {
+            // Not recompiled code. Naming it from the executable's symbols would take locks, so only the address is given.
+            message.append("host code at 0x");
+            message.append_hex(pc, 2 * sizeof(uintptr_t));
+            return;
+        }
+        --find_it;
+        if (find_it->overlay_index >= 0) {
+            message.append("ovl");
+            message.append_decimal(find_it->overlay_index);
+            message.append(":");
+        }
+        message.append("func_");
+        message.append_hex(find_it->guest_address, 8);
+    }
+
+    void handle_sigsegv(int, siginfo_t* info, void* ucontext_ptr) {
+        // Putting the previous handler back means that returning runs the faulting access again, which then crashes the same
+        // way it would have without this handler (including leaving a core dump where that's enabled).
+        sigaction(SIGSEGV, &fault_state.previous_action, nullptr);
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(info->si_addr);
+        uintptr_t rdram_address = find_reservation_rdram(address);
+        if (rdram_address == 0) {
+            return;
+        }
+
+        const ucontext_t* context = static_cast<const ucontext_t*>(ucontext_ptr);
+#if defined(__x86_64__)
+        uintptr_t pc = context->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+        uintptr_t pc = context->uc_mcontext.pc;
+#else
+        uintptr_t pc = 0;
+#endif
+
+        // Recompiled code addresses RDRAM relative to 0x80000000, so this is the address the game used with the upper 32 bits
+        // dropped.
+        uint32_t guest_address = static_cast<uint32_t>(0x80000000 + (address - rdram_address));
+
+        // Read straight from the kernel rather than through pthread_getname_np, which may open a file.
+        char thread_name[17] = "unnamed";
+        prctl(PR_GET_NAME, thread_name, 0, 0, 0);
+        thread_name[sizeof(thread_name) - 1] = '\0';
+        int guest_thread_id = -1;
+        PTR(OSThread) guest_thread = ultramodern::this_thread();
+        if (guest_thread != NULLPTR) {
+            // The thread belongs to the instance whose RDRAM it faulted in.
+            const uint8_t* rdram = reinterpret_cast<const uint8_t*>(rdram_address);
+            guest_thread_id = TO_PTR(const OSThread, guest_thread)->id;
+        }
+
+        MessageWriter message{};
+        message.append("[GuestFaults] Invalid access to guest address 0x");
+        message.append_hex(guest_address, 8);
+        message.append(" (host 0x");
+        message.append_hex(address, 2 * sizeof(uintptr_t));
+        message.append(") in ");
+        append_function_name(message, pc);
+        message.append(" on thread \"");
+        message.append(thread_name);
+        message.append("\" (guest thread ");
+        message.append_decimal(guest_thread_id);
+        message.append(")\n");
+        message.write_to(STDERR_FILENO);
+    }
+#endif
+}
+
+void guest_faults::install(const uint8_t* rdram, const uint8_t* reservation, size_t reservation_size, std::vector<HostFunction> functions) {
+#if defined(__linux__)
+    add_reservation(rdram, reservation, reservation_size);
+    std::sort(functions.begin(), functions.end(), [](const HostFunction& a, const HostFunction& b) { return a.host_address < b.host_address; });
+    fault_state.functions = std::move(functions);
+
+    struct sigaction action{};
+    action.sa_sigaction = handle_sigsegv;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGSEGV, &action, &fault_state.previous_action) != 0) {
+        fprintf(stderr, "[GuestFaults] Failed to install the SIGSEGV handler\n");
+    }
+#else
+    (void)rdram;
+    (void)reservation;
+    (void)reservation_size;
+    (void)functions;
+#endif
+}
+
+bool guest_faults::add_reservation(const uint8_t* rdram, const uint8_t* reservation, size_t reservation_size) {
+#if defined(__linux__)
+    for (Reservation& slot : fault_state.reservations) {
+        uintptr_t expected = 0;
+        if (slot.rdram.compare_exchange_strong(expected, reinterpret_cast<uintptr_t>(rdram), std::memory_order_relaxed)) {
+            slot.end.store(reinterpret_cast<uintptr_t>(reservation) + reservation_size, std::memory_order_relaxed);
+            slot.start.store(reinterpret_cast<uintptr_t>(reservation), std::memory_order_release);
+            return true;
+        }
+    }
+    fprintf(stderr, "[GuestFaults] Too many RDRAM reservations to watch (max %zu)\n", max_reservations);
+    return false;
+#else
+    (void)rdram;
+    (void)reservation;
+    (void)reservation_size;
+    return false;
+#endif
+}
+
+void guest_faults::remove_reservation(const uint8_t* rdram) {
+#if defined(__linux__)
+    for (Reservation& slot : fault_state.reservations) {
+        if (slot.rdram.load(std::memory_order_relaxed) == reinterpret_cast<uintptr_t>(rdram)) {
+            slot.start.store(0, std::memory_order_release);
+            slot.end.store(0, std::memory_order_relaxed);
+            slot.rdram.store(0, std::memory_order_release);
+            return;
+        }
+    }
+#else
+    (void)rdram;
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef __GUEST_FAULTS_HPP__
+#define __GUEST_FAULTS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reports guest memory accesses that land outside of RDRAM. RDRAM is allocated inside a reservation of inaccessible address
+// space that covers every offset a recompiled load or store can reach, so an invalid game pointer faults instead of reading
+// or corrupting host memory. The fault handler prints the guest address that was accessed, the recompiled function that
+// accessed it and the thread it happened on, and then lets the process crash as it would have without the handler. The
+// handler only looks things up in tables built by install and add_reservation and writes the report with write(), so it
+// doesn't allocate, lock or use stdio.
+//
+// Each instance's RDRAM has its own reservation, and faults in any of them are reported against that instance's RDRAM. Faults
+// outside of the reservations are passed on untouched. Only supported on Linux.
+namespace ultramodern {
+    namespace guest_faults {
+        // A recompiled function, for naming the function that faulted.
+        struct HostFunction {
+            uintptr_t host_address;
+            // The function's address at the section's link address, which is how it appears in the game's symbols.
+            uint32_t guest_address;
+            // The overlay the function is in, or -1 if it isn't in one.
+            int32_t overlay_index;
+        };
+
+        // How many reservations can be watched at once.
+        constexpr size_t max_reservations = 8;
+
+        // Installs the fault handler and watches the first instance's RDRAM and its reservation. The functions are sorted by
+        // host address here, in any order. Called once at startup, before the game's threads are started.
+        void install(const uint8_t* rdram, const uint8_t* reservation, size_t reservation_size, std::vector<HostFunction> functions);
+
+        // Watches another instance's RDRAM, returning false if there are already max_reservations being watched. Can be called
+        // while the game's threads are running.
+        bool add_reservation(const uint8_t* rdram, const uint8_t* reservation, size_t reservation_size);
+        // Stops watching an instance's RDRAM, which has to be done before its reservation is unmapped.
+        void remove_reservation(const uint8_t* rdram);
+    }
+}
+
+#endif
@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <utility>
+
+#include "huge_pages.hpp"
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   include <Windows.h>
+#else
+#   include <sys/mman.h>
+#   if defined(__linux__)
+#       include <link.h>
+#   endif
+#endif
+
+namespace huge_pages = ultramodern::huge_pages;
+
+namespace {
+    constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+    size_t align_up(size_t value, size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    bool huge_pages_enabled() {
+        static const bool enabled = []() {
+            const char* setting = getenv("RECOMP_HUGE_PAGES");
+            return setting == nullptr || strtol(setting, nullptr, 10) != 0;
+        }();
+        return enabled;
+    }
+
+#if defined(__linux__)
+    // Maps memory aligned to a huge page boundary, so that transparent huge pages can back all of it.
+    uint8_t* map_huge_page_aligned(size_t size) {
+        size_t span = size + huge_page_size;
+        void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            return nullptr;
+        }
+        uint8_t* raw_start = static_cast<uint8_t*>(raw);
+        uint8_t* aligned = reinterpret_cast<uint8_t*>(align_up(reinterpret_cast<uintptr_t>(raw_start), huge_page_size));
+        if (aligned != raw_start) {
+            munmap(raw_start, aligned - raw_start);
+        }
+        uint8_t* aligned_end = aligned + size;
+        if (aligned_end != raw_start + span) {
+            munmap(aligned_end, raw_start + span - aligned_end);
+        }
+        return aligned;
+    }
+
+    // Sums the sizes the kernel reports as huge pages for the mappings overlapping a range.
+    size_t resident_huge_page_bytes(const void* start, size_t size) {
+        uintptr_t range_start = reinterpret_cast<uintptr_t>(start);
+        uintptr_t range_end = range_start + size;
+        std::ifstream smaps{ "/proc/self/smaps" };
+        std::string line;
+        bool in_range = false;
+        size_t ret = 0;
+        while (std::getline(smaps, line)) {
+            uintptr_t mapping_start = 0;
+            uintptr_t mapping_end = 0;
+            size_t kilobytes = 0;
+            if (sscanf(line.c_str(), "%zx-%zx ", &mapping_start, &mapping_end) == 2) {
+                in_range = mapping_start < range_end && mapping_end > range_start;
+            }
+            else if (in_range && (sscanf(line.c_str(), "AnonHugePages: %zu kB", &kilobytes) == 1 ||
+                sscanf(line.c_str(), "Private_Hugetlb: %zu kB", &kilobytes) == 1))
+            {
+                ret += kilobytes * 1024;
+            }
+        }
+        return ret;
+    }
+#endif
+
+#if defined(_WIN32)
+    // Large pages can only be allocated by accounts that have been granted the "Lock pages in memory" right, which also has to
+    // be enabled in the process token.
+    bool enable_lock_memory_privilege() {
+        HANDLE token;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+            return false;
+        }
+        TOKEN_PRIVILEGES privileges{};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        bool ret = LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+            AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+        CloseHandle(token);
+        return ret;
+    }
+#endif
+}
+
+const char* huge_pages::backing_name(Backing backing) {
+    switch (backing) {
+        case Backing::ExplicitHugePages:
+            return "explicit huge pages";
+        case Backing::TransparentHugePages:
+            return "transparent huge pages";
+        case Backing::NormalPages:
+            return "normal pages";
+    }
+    return "unknown";
+}
+
+huge_pages::Allocation::Allocation(Allocation&& rhs) noexcept {
+    *this = std::move(rhs);
+}
+
+huge_pages::Allocation& huge_pages::Allocation::operator=(Allocation&& rhs) noexcept {
+    std::swap(data_, rhs.data_);
+    std::swap(size_, rhs.size_);
+    std::swap(backing_, rhs.backing_);
+    std::swap(reservation_, rhs.reservation_);
+    std::swap(reservation_size_, rhs.reservation_size_);
+    return *this;
+}
+
+huge_pages::Allocation::~Allocation() {
+    if (reservation_ == nullptr) {
+        return;
+    }
+#if defined(_WIN32)
+    VirtualFree(reservation_, 0, MEM_RELEASE);
+#else
+    munmap(reservation_, reservation_size_);
+#endif
+}
+
+void huge_pages::Allocation::report(FILE* out, const char* name) const {
+#if defined(__linux__)
+    fprintf(out, "[HugePages] %s: %zu KiB backed by %s in a %zu MiB reservation, %zu KiB reported as huge pages\n", name,
+        size_ / 1024, backing_name(backing_), reservation_size_ / (1024 * 1024), resident_huge_page_bytes(data_, size_) / 1024);
+#else
+    fprintf(out, "[HugePages] %s: %zu KiB backed by %s in a %zu MiB reservation\n", name, size_ / 1024, backing_name(backing_),
+        reservation_size_ / (1024 * 1024));
+#endif
+}
+
+huge_pages::Allocation huge_pages::allocate(size_t size, size_t reserve_before, size_t reserve_after) {
+    Allocation ret{};
+    size_t rounded_size = align_up(size, huge_page_size);
+
+#if defined(_WIN32)
+    if (huge_pages_enabled() && reserve_before == 0 && reserve_after == 0) {
+        static const bool can_use_large_pages = enable_lock_memory_privilege();
+        size_t large_page_size = GetLargePageMinimum();
+        if (can_use_large_pages && large_page_size != 0) {
+            size_t large_size = align_up(size, large_page_size);
+            void* data = VirtualAlloc(nullptr, large_size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (data != nullptr) {
+                ret.data_ = static_cast<uint8_t*>(data);
+                ret.size_ = large_size;
+                ret.reservation_ = ret.data_;
+                ret.reservation_size_ = large_size;
+                ret.backing_ = Backing::ExplicitHugePages;
+                return ret;
+            }
+        }
+    }
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    reserve_before = align_up(reserve_before, system_info.dwAllocationGranularity);
+    reserve_after = align_up(reserve_after, system_info.dwAllocationGranularity);
+    size_t reservation_size = reserve_before + rounded_size + reserve_after;
+    void* reservation = VirtualAlloc(nullptr, reservation_size, MEM_RESERVE, PAGE_NOACCESS);
+    if (reservation == nullptr) {
+        throw std::bad_alloc{};
+    }
+    // Committed pages are zero-filled on demand when they're first touched.
+    uint8_t* data = static_cast<uint8_t*>(reservation) + reserve_before;
+    if (VirtualAlloc(data, rounded_size, MEM_COMMIT, PAGE_READWRITE) == nullptr) {
+        VirtualFree(reservation, 0, MEM_RELEASE);
+        throw std::bad_alloc{};
+    }
+    ret.reservation_ = static_cast<uint8_t*>(reservation);
+    ret.reservation_size_ = reservation_size;
+#else
+    // Reserve inaccessible address space for the allocation and the space around it, with room to align the allocation to a
+    // huge page boundary so that huge pages can back all of it. The allocation is then mapped over its part of the reservation.
+    // None of it is touched here, so every page is zero-filled on demand when it's first used.
+    size_t reservation_size = align_up(reserve_before, huge_page_size) + rounded_size + align_up(reserve_after, huge_page_size) +
+        huge_page_size;
+    void* reservation = mmap(nullptr, reservation_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED) {
+        throw std::bad_alloc{};
+    }
+    ret.reservation_ = static_cast<uint8_t*>(reservation);
+    ret.reservation_size_ = reservation_size;
+    uint8_t* data = reinterpret_cast<uint8_t*>(align_up(reinterpret_cast<uintptr_t>(ret.reservation_) + reserve_before,
+        huge_page_size));
+    ret.data_ = data;
+    ret.size_ = rounded_size;
+
+#   if defined(__linux__)
+    if (huge_pages_enabled()) {
+        // Explicit huge pages are taken out of the pool when they're mapped, so this fails right away if the pool doesn't
+        // have enough of them instead of when they're first touched.
+        if (mmap(data, rounded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) != MAP_FAILED) {
+            ret.backing_ = Backing::ExplicitHugePages;
+            return ret;
+        }
+
+        // Transparent huge pages are allocated as each aligned 2MB block is first touched, as long as the kernel has any free.
+        if (mmap(data, rounded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED &&
+            madvise(data, rounded_size, MADV_HUGEPAGE) == 0)
+        {
+            ret.backing_ = Backing::TransparentHugePages;
+            return ret;
+        }
+    }
+#   endif
+    if (mmap(data, rounded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        // The reservation is released by ret's destructor.
+        throw std::bad_alloc{};
+    }
+#endif
+    ret.data_ = data;
+    ret.size_ = rounded_size;
+    ret.backing_ = Backing::NormalPages;
+    return ret;
+}
+
+void huge_pages::remap_hot_code(FILE* out, const void* begin, const void* end) {
+    const char* setting = getenv("RECOMP_HUGE_TEXT");
+    if (setting == nullptr || setting[0] == '\0') {
+        return;
+    }
+    size_t max_size = static_cast<size_t>(std::max(strtol(setting, nullptr, 10), 0L)) * 1024 * 1024;
+
+#if defined(__linux__)
+    if (begin == nullptr || end <= begin) {
+        fprintf(out, "[HugePages] Not remapping code: RECOMP_HUGE_TEXT needs a build linked with RECOMP_FUNC_ORDER_FILE\n");
+        return;
+    }
+
+    // Find the code segment that holds the hot code, so that the range can be widened to whole huge pages without reaching
+    // into the data around the segment.
+    struct CodeSegment {
+        uintptr_t address = 0;
+        uintptr_t start = 0;
+        uintptr_t end = 0;
+    } segment{ reinterpret_cast<uintptr_t>(begin) };
+    dl_iterate_phdr([](dl_phdr_info* info, size_t, void* data) {
+        CodeSegment* segment = static_cast<CodeSegment*>(data);
+        for (size_t i = 0; i < info->dlpi_phnum; i++) {
+            const auto& header = info->dlpi_phdr[i];
+            uintptr_t start = info->dlpi_addr + header.p_vaddr;
+            if (header.p_type == PT_LOAD && (header.p_flags & PF_X) != 0 && segment->address >= start &&
+                segment->address < start + header.p_memsz)
+            {
+                segment->start = start;
+                segment->end = start + header.p_memsz;
+                return 1;
+            }
+        }
+        return 0;
+    }, &segment);
+    if (segment.start == 0) {
+        fprintf(out, "[HugePages] Not remapping code: the hot code isn't in a loaded code segment\n");
+        return;
+    }
+
+    // Only whole huge pages can be remapped. The hot code is widened out to them, which pulls in some of the code on either
+    // side, except at the ends of the segment where the partial huge pages stay on normal pages.
+    uintptr_t hot_start = reinterpret_cast<uintptr_t>(begin);
+    uintptr_t hot_end = reinterpret_cast<uintptr_t>(end);
+    uintptr_t start = std::max(hot_start & ~(huge_page_size - 1), align_up(segment.start, huge_page_size));
+    uintptr_t end_address = std::min({ align_up(hot_end, huge_page_size), segment.end & ~(huge_page_size - 1),
+        start + (max_size & ~(huge_page_size - 1)) });
+    if (end_address <= start) {
+        fprintf(out, "[HugePages] Not remapping code: the hot code doesn't cover a whole huge page of its segment\n");
+        return;
+    }
+    size_t size = end_address - start;
+
+    // The code is copied into huge pages and the copy is then moved over the original with a single mremap, which swaps the
+    // page tables atomically. That means this function keeps working even if it's inside the range being remapped.
+    uint8_t* copy = map_huge_page_aligned(size);
+    if (copy == nullptr) {
+        fprintf(out, "[HugePages] Not remapping code: failed to allocate %zu KiB\n", size / 1024);
+        return;
+    }
+    madvise(copy, size, MADV_HUGEPAGE);
+    memcpy(copy, reinterpret_cast<const void*>(start), size);
+    void* remapped = MAP_FAILED;
+    if (mprotect(copy, size, PROT_READ | PROT_EXEC) == 0) {
+        remapped = mremap(copy, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, reinterpret_cast<void*>(start));
+    }
+    if (remapped == MAP_FAILED) {
+        munmap(copy, size);
+        fprintf(out, "[HugePages] Failed to remap code: %s\n", strerror(errno));
+        return;
+    }
+    fprintf(out, "[HugePages] Remapped %zu KiB of code for %zu KiB of hot functions, %zu KiB reported as huge pages\n",
+        size / 1024, (hot_end - hot_start) / 1024, resident_huge_page_bytes(reinterpret_cast<const void*>(start), size) / 1024);
+#else
+    fprintf(out, "[HugePages] RECOMP_HUGE_TEXT is only supported on Linux\n");
+#endif
+}
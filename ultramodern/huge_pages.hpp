@@ -0,0 +1,73 @@
+#ifndef __HUGE_PAGES_HPP__
+#define __HUGE_PAGES_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Huge page backed memory for RDRAM and the recompiled code. Guest memory accesses are spread over all of RDRAM and the
+// recompiled code is many megabytes of functions, so with normal 4KB pages both keep missing the TLBs.
+//
+// RDRAM is allocated from explicit huge pages (hugetlbfs on Linux, large pages on Windows) when the system has some reserved,
+// otherwise from transparent huge pages on Linux, and otherwise from normal pages. Setting RECOMP_HUGE_PAGES=0 always uses
+// normal pages, for comparing the two.
+//
+// Allocations can be placed inside a larger reservation of inaccessible address space, so that stray accesses past either
+// end fault instead of reaching whatever else is mapped there. Only the allocation itself is committed, and it's filled with
+// zero pages on demand as it's first touched rather than all at once, so parts that are never used don't count towards the
+// process's memory usage. On Windows, large pages can't be committed inside a reservation, so reserved allocations always
+// use normal pages there.
+//
+// Setting RECOMP_HUGE_TEXT to a number of megabytes remaps up to that much of the hot recompiled code onto transparent huge
+// pages at startup. The hot code is the functions listed in RECOMP_FUNC_ORDER_FILE, which the linker places together between
+// two marker functions, so this needs a build linked with an ordering file. Only supported on Linux. Tools that symbolize
+// through the memory map (e.g. perf) can't name functions in the remapped range.
+namespace ultramodern {
+    namespace huge_pages {
+        enum class Backing {
+            ExplicitHugePages,
+            TransparentHugePages,
+            NormalPages,
+        };
+        const char* backing_name(Backing backing);
+
+        // Zero-initialized memory that's unmapped, along with its reservation, when destroyed.
+        class Allocation {
+        public:
+            Allocation() = default;
+            Allocation(const Allocation&) = delete;
+            Allocation& operator=(const Allocation&) = delete;
+            Allocation(Allocation&& rhs) noexcept;
+            Allocation& operator=(Allocation&& rhs) noexcept;
+            ~Allocation();
+
+            uint8_t* get() const { return data_; }
+            size_t size() const { return size_; }
+            Backing backing() const { return backing_; }
+            // The inaccessible address space around the allocation, which includes the allocation itself.
+            const uint8_t* reservation() const { return reservation_; }
+            size_t reservation_size() const { return reservation_size_; }
+            // Prints the backing that was used and how much of the allocation the kernel reports as huge pages.
+            void report(FILE* out, const char* name) const;
+        private:
+            friend Allocation allocate(size_t size, size_t reserve_before, size_t reserve_after);
+            uint8_t* data_ = nullptr;
+            size_t size_ = 0;
+            uint8_t* reservation_ = nullptr;
+            size_t reservation_size_ = 0;
+            Backing backing_ = Backing::NormalPages;
+        };
+
+        // Never fails, as normal pages are always available as a fallback. Throws std::bad_alloc if even those aren't. At least
+        // reserve_before and reserve_after bytes of inaccessible address space are reserved directly before and after the
+        // allocation.
+        Allocation allocate(size_t size, size_t reserve_before = 0, size_t reserve_after = 0);
+
+        // Remaps the code between begin and end, widened to whole huge pages, if RECOMP_HUGE_TEXT is set, and prints the result.
+        // Null bounds mean the build has no hot code range, which is reported if remapping was requested. Called once at
+        // startup, before the game's threads are started.
+        void remap_hot_code(FILE* out, const void* begin, const void* end);
+    }
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "instance.hpp"
+
+static thread_local ultramodern::Instance* bound_instance = nullptr;
+// The oldest live instance, which unbound threads fall back to. Kept separately from the list so that the fallback is a
+// single load.
+static std::atomic<ultramodern::Instance*> first_instance = nullptr;
+static std::atomic<size_t> instance_count = 0;
+// Every live instance in the order they were created.
+static std::mutex live_instances_mutex;
+static std::vector<ultramodern::Instance*> live_instances;
+
+static std::array<std::atomic<ultramodern::Instance::thread_bind_callback_t*>, ultramodern::Instance::max_thread_bind_callbacks> thread_bind_callbacks{};
+static std::mutex thread_bind_callbacks_mutex;
+
+static void call_thread_bind_callbacks(ultramodern::Instance& instance) {
+    for (auto& callback : thread_bind_callbacks) {
+        ultramodern::Instance::thread_bind_callback_t* func = callback.load(std::memory_order_acquire);
+        if (func == nullptr) {
+            break;
+        }
+        func(instance);
+    }
+}
+
+ultramodern::Instance::Instance(uint8_t* rdram) : rdram_(rdram) {
+    std::lock_guard lock{ live_instances_mutex };
+    live_instances.push_back(this);
+    first_instance.store(live_instances.front(), std::memory_order_release);
+    instance_count.fetch_add(1);
+}
+
+ultramodern::Instance::~Instance() {
+    // Destroy module state in the reverse order it was first used in, as later modules may depend on earlier ones.
+    for (auto it = slots_.rbegin(); it != slots_.rend(); ++it) {
+        if (it->data != nullptr) {
+            it->destroy(it->data);
+        }
+    }
+
+    // Threads that fell back to this instance move on to the next oldest one rather than finding no instance at all.
+    std::lock_guard lock{ live_instances_mutex };
+    live_instances.erase(std::find(live_instances.begin(), live_instances.end(), this));
+    first_instance.store(live_instances.empty() ? nullptr : live_instances.front(), std::memory_order_release);
+    instance_count.fetch_sub(1);
+}
+
+size_t ultramodern::Instance::allocate_state_index() {
+    static std::atomic<size_t> next_index = 0;
+    size_t index = next_index.fetch_add(1);
+    if (index >= max_state_slots) {
+        fprintf(stderr, "Too many modules with per-instance state (max %zu)\n", max_state_slots);
+        assert(false);
+        std::exit(EXIT_FAILURE);
+    }
+    return index;
+}
+
+void ultramodern::Instance::add_thread_bind_callback(thread_bind_callback_t* callback) {
+    std::lock_guard lock{ thread_bind_callbacks_mutex };
+    for (auto& slot : thread_bind_callbacks) {
+        thread_bind_callback_t* cur = slot.load(std::memory_order_relaxed);
+        if (cur == callback) {
+            return;
+        }
+        if (cur == nullptr) {
+            slot.store(callback, std::memory_order_release);
+            return;
+        }
+    }
+    fprintf(stderr, "Too many thread bind callbacks (max %zu)\n", max_thread_bind_callbacks);
+    assert(false);
+    std::exit(EXIT_FAILURE);
+}
+
+size_t ultramodern::Instance::count() {
+    return instance_count.load();
+}
+
+void ultramodern::Instance::for_each(void (*func)(Instance& instance)) {
+    std::lock_guard lock{ live_instances_mutex };
+    for (Instance* instance : live_instances) {
+        func(*instance);
+    }
+}
+
+ultramodern::Instance* ultramodern::try_current_instance() {
+    Instance* ret = bound_instance;
+    if (ret == nullptr) {
+        ret = first_instance.load(std::memory_order_acquire);
+    }
+    return ret;
+}
+
+ultramodern::Instance& ultramodern::current_instance() {
+    Instance* ret = try_current_instance();
+    if (ret == nullptr) {
+        fprintf(stderr, "No runtime instance exists for thread state to be stored in\n");
+        assert(false);
+        std::exit(EXIT_FAILURE);
+    }
+    return *ret;
+}
+
+ultramodern::InstanceScope::InstanceScope(Instance& instance) : prev_instance(bound_instance) {
+    bound_instance = &instance;
+    call_thread_bind_callbacks(instance);
+}
+
+ultramodern::InstanceScope::~InstanceScope() {
+    bound_instance = prev_instance;
+    // Threads that go back to being unbound fall back to the oldest instance, so their thread-locals follow it.
+    Instance* instance = try_current_instance();
+    if (instance != nullptr) {
+        call_thread_bind_callbacks(*instance);
+    }
+}
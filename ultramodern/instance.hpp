@@ -0,0 +1,100 @@
+#ifndef __INSTANCE_HPP__
+#define __INSTANCE_HPP__
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Runtime state for one running copy of the game. Each module that keeps per-game state (event threads and queues, timers,
+// saving, loaded overlays, etc.) stores it in the instance instead of in a process global, so several instances can run side
+// by side in one process while sharing the ROM, shader cache and recompiled code. Each thread is bound to the instance it
+// works for, and code reaches its instance through `current_instance()` rather than having it passed through every call.
+namespace ultramodern {
+    class Instance {
+    public:
+        // The instance doesn't own its RDRAM so that callers can place it wherever they like.
+        Instance(uint8_t* rdram);
+        ~Instance();
+        Instance(const Instance&) = delete;
+        Instance& operator=(const Instance&) = delete;
+
+        uint8_t* rdram() const { return rdram_; }
+
+        // Overrides where this instance's save file is written. Empty uses the default save location.
+        std::filesystem::path save_file_path{};
+
+        // Returns this instance's copy of a module's state, creating it the first time it's used.
+        template <typename T>
+        T& state() {
+            static const size_t index = allocate_state_index();
+            StateSlot& slot = slots_[index];
+            std::call_once(slot.created, [&slot]() {
+                slot.data = new T{};
+                slot.destroy = [](void* data) { delete static_cast<T*>(data); };
+            });
+            return *static_cast<T*>(slot.data);
+        }
+
+        // Called on every thread that gets bound to an instance, and again when a scope ends with the instance the thread goes
+        // back to, so that state kept in thread-locals for speed (such as the section address table read by recompiled code)
+        // can point at the instance's copy. Adding the same callback again does nothing.
+        using thread_bind_callback_t = void(Instance& instance);
+        static constexpr size_t max_thread_bind_callbacks = 8;
+        static void add_thread_bind_callback(thread_bind_callback_t* callback);
+
+        // The number of instances that currently exist.
+        static size_t count();
+        // Calls `func` on every instance that currently exists, oldest first. Instances can't be destroyed meanwhile.
+        static void for_each(void (*func)(Instance& instance));
+
+    private:
+        friend class InstanceScope;
+
+        static constexpr size_t max_state_slots = 32;
+        static size_t allocate_state_index();
+
+        struct StateSlot {
+            std::once_flag created;
+            void* data = nullptr;
+            void (*destroy)(void*) = nullptr;
+        };
+
+        uint8_t* rdram_;
+        std::array<StateSlot, max_state_slots> slots_{};
+    };
+
+    // Returns the instance the calling thread is bound to. Threads that were never bound (e.g. ones created by libraries)
+    // get the oldest instance that still exists, which keeps single instance setups working without binding every thread.
+    Instance& current_instance();
+    // Same as current_instance, but returns null if no instance exists yet instead of exiting.
+    Instance* try_current_instance();
+
+    // Binds the calling thread to an instance for the lifetime of the scope.
+    class InstanceScope {
+    public:
+        InstanceScope(Instance& instance);
+        ~InstanceScope();
+        InstanceScope(const InstanceScope&) = delete;
+        InstanceScope& operator=(const InstanceScope&) = delete;
+    private:
+        Instance* prev_instance;
+    };
+
+    // Creates a thread that's bound to the calling thread's instance.
+    template <typename F, typename... Args>
+    std::thread create_instance_thread(F&& func, Args&&... args) {
+        return std::thread{
+            [instance = &current_instance(), func = std::forward<F>(func)](auto&&... thread_args) mutable {
+                InstanceScope scope{ *instance };
+                func(std::forward<decltype(thread_args)>(thread_args)...);
+            },
+            std::forward<Args>(args)...
+        };
+    }
+}
+
+#endif
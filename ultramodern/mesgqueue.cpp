@@ -1,9 +1,10 @@
 #include <thread>
 
-#include "blockingconcurrentqueue.h"
-
 #include "ultra64.h"
 #include "ultramodern.hpp"
+#include "external_message_queue.hpp"
+#include "sync_stats.hpp"
+#include "instance.hpp"
 #include "recomp.h"
 
 struct QueuedMessage {
@@ -12,25 +13,74 @@ struct QueuedMessage {
     bool jam;
 };
 
-static moodycamel::BlockingConcurrentQueue<QueuedMessage> external_messages {};
+namespace {
+    // Per-instance queue of messages sent from external threads, see ExternalMessageQueue.
+    struct ExternalMessages {
+        ultramodern::ExternalMessageQueue<QueuedMessage> queue;
+        moodycamel::LightweightSemaphore available;
+        ultramodern::sync_stats::Point stats{ "external_messages", ultramodern::sync_stats::Point::Kind::Queue };
+    };
+}
+
+// The calling thread's instance's external messages, set by bind_external_messages so that game threads can check for messages
+// with a single load instead of looking up their instance every time.
+static RECOMP_THREAD_LOCAL ExternalMessages* bound_external_messages = nullptr;
+
+static ExternalMessages& external_messages_context() {
+    if (bound_external_messages != nullptr) {
+        return *bound_external_messages;
+    }
+    return ultramodern::current_instance().state<ExternalMessages>();
+}
+
+static void bind_external_messages(ultramodern::Instance& instance) {
+    bound_external_messages = &instance.state<ExternalMessages>();
+}
+
+void ultramodern::init_external_messages() {
+    // Game threads are created after this, so they're bound as they start. The calling thread was bound before.
+    ultramodern::Instance::add_thread_bind_callback(bind_external_messages);
+    bind_external_messages(ultramodern::current_instance());
+}
 
 void enqueue_external_message(PTR(OSMesgQueue) mq, OSMesg msg, bool jam) {
-    external_messages.enqueue({mq, msg, jam});
+    ExternalMessages& external_messages = external_messages_context();
+    external_messages.queue.push(QueuedMessage{ mq, msg, jam });
+    ultramodern::sync_stats::on_push(external_messages.stats);
+    external_messages.available.signal();
 }
 
 bool do_send(RDRAM_ARG PTR(OSMesgQueue) mq_, OSMesg msg, bool jam, bool block);
 
+static void deliver_external_message(RDRAM_ARG ExternalMessages& external_messages, const QueuedMessage& to_send) {
+    ultramodern::sync_stats::on_pop(external_messages.stats);
+    // Keep the semaphore's count in step with the number of queued messages.
+    external_messages.available.tryWait();
+    do_send(PASS_RDRAM to_send.mq, to_send.mesg, to_send.jam, false);
+}
+
 void dequeue_external_messages(RDRAM_ARG1) {
+    ExternalMessages& external_messages = external_messages_context();
+    // Fast path for the common case of there being no external messages. Game threads are bound, so this is a thread-local
+    // load and a relaxed load.
+    if (!external_messages.queue.maybe_pending()) {
+        return;
+    }
+
     QueuedMessage to_send;
-    while (external_messages.try_dequeue(to_send)) {
-        do_send(PASS_RDRAM to_send.mq, to_send.mesg, to_send.jam, false);
+    while (external_messages.queue.pop(to_send)) {
+        deliver_external_message(PASS_RDRAM external_messages, to_send);
     }
 }
 
 void ultramodern::wait_for_external_message(RDRAM_ARG1) {
+    ExternalMessages& external_messages = external_messages_context();
     QueuedMessage to_send;
-    external_messages.wait_dequeue(to_send);
-    do_send(PASS_RDRAM to_send.mq, to_send.mesg, to_send.jam, false);
+    // The semaphore can be signalled for messages that were already delivered, so check for a message again after each wakeup.
+    while (!external_messages.queue.pop(to_send)) {
+        external_messages.available.wait();
+    }
+    deliver_external_message(PASS_RDRAM external_messages, to_send);
 }
 
 extern "C" void osCreateMesgQueue(RDRAM_ARG PTR(OSMesgQueue) mq_, PTR(OSMesg) msg, s32 count) {
@@ -75,13 +125,13 @@ bool do_send(RDRAM_ARG PTR(OSMesgQueue) mq_, OSMesg msg, bool jam, bool block) {
     if (jam) {
         // Jams insert at the head of the message queue's buffer.
         mq->first = (mq->first + mq->msgCount - 1) % mq->msgCount;
-        TO_PTR(OSMesg, mq->msg)[mq->first] = msg;
+        MEM_W(4 * mq->first, mq->msg) = msg;
         mq->validCount++;
     }
     else {
         // Sends insert at the tail of the message queue's buffer.
         s32 last = (mq->first + mq->validCount) % mq->msgCount;
-        TO_PTR(OSMesg, mq->msg)[last] = msg;
+        MEM_W(4 * last, mq->msg) = msg;
         mq->validCount++;
     }
 
@@ -111,7 +161,7 @@ bool do_recv(RDRAM_ARG PTR(OSMesgQueue) mq_, PTR(OSMesg) msg_, bool block) {
     }
 
     if (msg_ != NULLPTR) {
-        *TO_PTR(OSMesg, msg_) = TO_PTR(OSMesg, mq->msg)[mq->first];
+        MEM_W(0, msg_) = MEM_W(4 * mq->first, mq->msg);
     }
     
     mq->first = (mq->first + 1) % mq->msgCount;
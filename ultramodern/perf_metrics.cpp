@@ -0,0 +1,280 @@
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
+#include <cinttypes>
+
+#include "ultramodern.hpp"
+#include "perf_metrics.hpp"
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   include <Windows.h>
+#else
+#   include <pthread.h>
+#   include <time.h>
+#endif
+
+namespace perf = ultramodern::perf;
+
+namespace {
+    struct TimingRing {
+        std::array<std::atomic_uint32_t, perf::history_size> values_us{};
+        std::atomic_uint64_t count = 0;
+    };
+
+    // Threads are looked up rarely (a couple of times a second), so the registry is simply guarded by a mutex.
+    struct ThreadEntry {
+        std::string name;
+#if defined(_WIN32)
+        HANDLE handle;
+#else
+        clockid_t clock;
+#endif
+        uint64_t prev_cpu_ns;
+        float cpu_percent;
+        bool active;
+    };
+
+    constexpr auto cpu_sample_period = std::chrono::milliseconds{ 500 };
+
+    struct {
+        std::array<TimingRing, static_cast<size_t>(perf::Timing::Count)> timings;
+        std::atomic_uint64_t overlay_loads = 0;
+        std::atomic_uint64_t overlay_unloads = 0;
+
+        std::mutex threads_mutex;
+        std::vector<ThreadEntry> threads;
+        std::chrono::steady_clock::time_point last_cpu_sample{};
+        std::chrono::steady_clock::time_point last_dump{};
+    } metrics;
+
+    // Marks the thread's registry entry as inactive when the thread exits.
+    struct ThreadRegistration {
+        int32_t index = -1;
+
+        ~ThreadRegistration() {
+            if (index < 0) {
+                return;
+            }
+            std::lock_guard lock{ metrics.threads_mutex };
+            ThreadEntry& entry = metrics.threads[index];
+#if defined(_WIN32)
+            CloseHandle(entry.handle);
+#endif
+            entry.active = false;
+        }
+    };
+
+    thread_local ThreadRegistration thread_registration{};
+
+    bool read_thread_cpu_ns(const ThreadEntry& entry, uint64_t& out) {
+#if defined(_WIN32)
+        FILETIME creation_time, exit_time, kernel_time, user_time;
+        if (!GetThreadTimes(entry.handle, &creation_time, &exit_time, &kernel_time, &user_time)) {
+            return false;
+        }
+        auto to_u64 = [](FILETIME time) { return (uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime; };
+        // FILETIMEs are in units of 100ns.
+        out = (to_u64(kernel_time) + to_u64(user_time)) * 100;
+        return true;
+#else
+        timespec time;
+        if (clock_gettime(entry.clock, &time) != 0) {
+            return false;
+        }
+        out = uint64_t(time.tv_sec) * 1'000'000'000 + time.tv_nsec;
+        return true;
+#endif
+    }
+
+    perf::TimingSummary summarize(const TimingRing& ring, std::vector<float>* ordered_out) {
+        uint64_t count = ring.count.load(std::memory_order_relaxed);
+        size_t num_values = static_cast<size_t>(std::min<uint64_t>(count, perf::history_size));
+        perf::TimingSummary summary{};
+        if (num_values == 0) {
+            return summary;
+        }
+
+        // Read the values oldest first.
+        std::vector<float> values_ms(num_values);
+        uint64_t first = count - num_values;
+        for (size_t i = 0; i < num_values; i++) {
+            values_ms[i] = ring.values_us[(first + i) % perf::history_size].load(std::memory_order_relaxed) / 1000.0f;
+        }
+        if (ordered_out != nullptr) {
+            *ordered_out = values_ms;
+        }
+
+        summary.last_ms = values_ms.back();
+        float total_ms = 0.0f;
+        for (float value : values_ms) {
+            total_ms += value;
+        }
+        summary.average_ms = total_ms / num_values;
+
+        std::sort(values_ms.begin(), values_ms.end());
+        auto percentile = [&values_ms](float fraction) {
+            return values_ms[std::min(values_ms.size() - 1, static_cast<size_t>(fraction * values_ms.size()))];
+        };
+        summary.p50_ms = percentile(0.50f);
+        summary.p95_ms = percentile(0.95f);
+        summary.p99_ms = percentile(0.99f);
+        summary.max_ms = values_ms.back();
+        return summary;
+    }
+
+    void sample_thread_cpu() {
+        auto now = std::chrono::steady_clock::now();
+        float elapsed_ns = std::chrono::duration<float, std::nano>(now - metrics.last_cpu_sample).count();
+        bool have_previous = metrics.last_cpu_sample != std::chrono::steady_clock::time_point{};
+        metrics.last_cpu_sample = now;
+
+        std::lock_guard lock{ metrics.threads_mutex };
+        for (ThreadEntry& entry : metrics.threads) {
+            uint64_t cpu_ns;
+            if (!entry.active || !read_thread_cpu_ns(entry, cpu_ns)) {
+                continue;
+            }
+            if (have_previous && cpu_ns >= entry.prev_cpu_ns) {
+                entry.cpu_percent = 100.0f * (cpu_ns - entry.prev_cpu_ns) / elapsed_ns;
+            }
+            entry.prev_cpu_ns = cpu_ns;
+        }
+    }
+}
+
+const char* perf::timing_name(Timing timing) {
+    switch (timing) {
+        case Timing::FrameTime:
+            return "Frame time";
+        case Timing::ViLateness:
+            return "VI lateness";
+        case Timing::SendDl:
+            return "send_dl";
+        case Timing::RspMicrocode:
+            return "RSP microcode";
+        default:
+            return "?";
+    }
+}
+
+void perf::record(Timing timing, std::chrono::high_resolution_clock::duration duration) {
+    TimingRing& ring = metrics.timings[static_cast<size_t>(timing)];
+    int64_t duration_us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    uint32_t value = static_cast<uint32_t>(std::clamp<int64_t>(duration_us, 0, UINT32_MAX));
+
+    // A reader may see a slot just before it's overwritten, which only makes it report one stale value.
+    uint64_t index = ring.count.fetch_add(1, std::memory_order_relaxed);
+    ring.values_us[index % history_size].store(value, std::memory_order_relaxed);
+}
+
+void perf::count_overlay_load() {
+    metrics.overlay_loads.fetch_add(1, std::memory_order_relaxed);
+}
+
+void perf::count_overlay_unload() {
+    metrics.overlay_unloads.fetch_add(1, std::memory_order_relaxed);
+}
+
+void perf::register_current_thread(const std::string& name) {
+    std::lock_guard lock{ metrics.threads_mutex };
+
+    // Renaming a registered thread just updates its name.
+    if (thread_registration.index >= 0) {
+        metrics.threads[thread_registration.index].name = name;
+        return;
+    }
+
+    ThreadEntry entry{ .name = name, .prev_cpu_ns = 0, .cpu_percent = 0.0f, .active = true };
+#if defined(_WIN32)
+    DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &entry.handle, 0, FALSE, DUPLICATE_SAME_ACCESS);
+#else
+    if (pthread_getcpuclockid(pthread_self(), &entry.clock) != 0) {
+        return;
+    }
+#endif
+    read_thread_cpu_ns(entry, entry.prev_cpu_ns);
+
+    // Reuse the entries of threads that have exited, as game threads can be created and destroyed repeatedly.
+    auto free_it = std::find_if(metrics.threads.begin(), metrics.threads.end(), [](const ThreadEntry& e) { return !e.active; });
+    if (free_it != metrics.threads.end()) {
+        *free_it = std::move(entry);
+        thread_registration.index = static_cast<int32_t>(std::distance(metrics.threads.begin(), free_it));
+    }
+    else {
+        metrics.threads.emplace_back(std::move(entry));
+        thread_registration.index = static_cast<int32_t>(metrics.threads.size() - 1);
+    }
+}
+
+perf::Snapshot perf::snapshot() {
+    Snapshot ret{};
+    for (size_t i = 0; i < static_cast<size_t>(Timing::Count); i++) {
+        ret.timings[i] = summarize(metrics.timings[i], i == static_cast<size_t>(Timing::FrameTime) ? &ret.frame_times_ms : nullptr);
+    }
+
+    ultramodern::GfxQueueStats queue_stats = ultramodern::get_gfx_queue_stats();
+    ret.gfx_tasks_in_flight = queue_stats.tasks_in_flight;
+    ret.gfx_task_age_us = queue_stats.last_task_age_us;
+    ret.gfx_frames_in_flight = queue_stats.frames_in_flight;
+    ret.gfx_frame_age_us = queue_stats.last_frame_age_us;
+    ret.gfx_held_retraces = queue_stats.held_retraces;
+    ret.gfx_coalesced_frames = queue_stats.coalesced_frames;
+    ret.audio_latency_ms = ultramodern::get_audio_latency_us() / 1000.0f;
+    ret.overlay_loads = metrics.overlay_loads.load(std::memory_order_relaxed);
+    ret.overlay_unloads = metrics.overlay_unloads.load(std::memory_order_relaxed);
+
+    std::lock_guard lock{ metrics.threads_mutex };
+    for (const ThreadEntry& entry : metrics.threads) {
+        if (entry.active) {
+            ret.threads.emplace_back(ThreadUsage{ entry.name, entry.cpu_percent });
+        }
+    }
+    std::sort(ret.threads.begin(), ret.threads.end(), [](const ThreadUsage& a, const ThreadUsage& b) { return a.cpu_percent > b.cpu_percent; });
+
+    return ret;
+}
+
+void perf::dump(FILE* out, const Snapshot& snapshot) {
+    fprintf(out, "[Perf] %-14s %8s %8s %8s %8s %8s %8s\n", "", "last", "avg", "p50", "p95", "p99", "max");
+    for (size_t i = 0; i < static_cast<size_t>(Timing::Count); i++) {
+        const TimingSummary& summary = snapshot.timings[i];
+        fprintf(out, "[Perf] %-14s %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f ms\n", timing_name(static_cast<Timing>(i)),
+            summary.last_ms, summary.average_ms, summary.p50_ms, summary.p95_ms, summary.p99_ms, summary.max_ms);
+    }
+    fprintf(out, "[Perf] gfx tasks in flight %" PRIu32 " (last task waited %.2f ms), audio latency %.1f ms, overlays loaded %" PRIu64 " / unloaded %" PRIu64 "\n",
+        snapshot.gfx_tasks_in_flight, snapshot.gfx_task_age_us / 1000.0f, snapshot.audio_latency_ms, snapshot.overlay_loads, snapshot.overlay_unloads);
+    fprintf(out, "[Perf] frames in flight %" PRIu32 " (last frame waited %.2f ms), retraces held %" PRIu64 ", frames coalesced %" PRIu64 "\n",
+        snapshot.gfx_frames_in_flight, snapshot.gfx_frame_age_us / 1000.0f, snapshot.gfx_held_retraces, snapshot.gfx_coalesced_frames);
+    for (const ThreadUsage& thread : snapshot.threads) {
+        fprintf(out, "[Perf]   %-24s %6.1f%% CPU\n", thread.name.c_str(), thread.cpu_percent);
+    }
+    fflush(out);
+}
+
+std::chrono::seconds perf::dump_interval() {
+    // RECOMP_PERF_DUMP enables a periodic text dump of the metrics, with its value being the interval in seconds.
+    static const std::chrono::seconds interval = []() {
+        const char* setting = getenv("RECOMP_PERF_DUMP");
+        if (setting == nullptr) {
+            return std::chrono::seconds{ 0 };
+        }
+        int64_t seconds = strtoll(setting, nullptr, 10);
+        return std::chrono::seconds{ seconds > 0 ? seconds : 5 };
+    }();
+    return interval;
+}
+
+void perf::tick() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - metrics.last_cpu_sample >= cpu_sample_period) {
+        sample_thread_cpu();
+    }
+
+    std::chrono::seconds interval = dump_interval();
+    if (interval.count() > 0 && now - metrics.last_dump >= interval) {
+        metrics.last_dump = now;
+        dump(stdout, snapshot());
+    }
+}
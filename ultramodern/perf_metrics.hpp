@@ -0,0 +1,79 @@
+#ifndef __PERF_METRICS_HPP__
+#define __PERF_METRICS_HPP__
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <string>
+
+// Frame pipeline metrics for the performance HUD and its text dump. Producers record into fixed-size rings of atomics, so
+// recording never blocks or allocates and is safe from any thread.
+namespace ultramodern {
+    namespace perf {
+        enum class Timing : uint32_t {
+            // Time between consecutive framebuffer swaps processed by the gfx thread.
+            FrameTime,
+            // How late the VI thread woke up for each retrace.
+            ViLateness,
+            // Time spent processing each display list (RT64Context::send_dl).
+            SendDl,
+            // Time spent running each recompiled RSP microcode task (run_rsp_microcode).
+            RspMicrocode,
+            Count
+        };
+
+        constexpr size_t history_size = 240;
+
+        void record(Timing timing, std::chrono::high_resolution_clock::duration duration);
+        void count_overlay_load();
+        void count_overlay_unload();
+
+        // Registers the calling thread for CPU time accounting under the given name. Called by set_native_thread_name.
+        void register_current_thread(const std::string& name);
+
+        // Called once per VI. Samples per-thread CPU usage a couple of times a second and writes the text dump if one is due.
+        void tick();
+        // Interval of the periodic text dump enabled by RECOMP_PERF_DUMP, or zero if it's disabled. Other modules' periodic
+        // statistics are printed at the same interval, and only when it's enabled.
+        std::chrono::seconds dump_interval();
+
+        struct TimingSummary {
+            float last_ms;
+            float average_ms;
+            float p50_ms;
+            float p95_ms;
+            float p99_ms;
+            float max_ms;
+        };
+
+        struct ThreadUsage {
+            std::string name;
+            // Percentage of one core used by the thread over the last sampling period.
+            float cpu_percent;
+        };
+
+        struct Snapshot {
+            std::array<TimingSummary, static_cast<size_t>(Timing::Count)> timings;
+            // Frame times in milliseconds, oldest first.
+            std::vector<float> frame_times_ms;
+            uint32_t gfx_tasks_in_flight;
+            uint64_t gfx_task_age_us;
+            uint32_t gfx_frames_in_flight;
+            uint64_t gfx_frame_age_us;
+            uint64_t gfx_held_retraces;
+            uint64_t gfx_coalesced_frames;
+            float audio_latency_ms;
+            uint64_t overlay_loads;
+            uint64_t overlay_unloads;
+            std::vector<ThreadUsage> threads;
+        };
+
+        Snapshot snapshot();
+        void dump(FILE* out, const Snapshot& snapshot);
+        const char* timing_name(Timing timing);
+    }
+}
+
+#endif
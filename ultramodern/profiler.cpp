@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "profiler.hpp"
+
+#if defined(__linux__)
+#   include <cerrno>
+#   include <csignal>
+#   include <ctime>
+#   include <cxxabi.h>
+#   include <dlfcn.h>
+#   include <pthread.h>
+#   include <sys/syscall.h>
+#   include <ucontext.h>
+#   include <unistd.h>
+#   ifndef sigev_notify_thread_id
+#       define sigev_notify_thread_id _sigev_un._tid
+#   endif
+#endif
+
+namespace profiler = ultramodern::profiler;
+
+namespace {
+    constexpr size_t max_stack_depth = 48;
+    constexpr size_t default_sample_capacity = 1 << 16;
+    constexpr long default_sample_rate = 997;
+    constexpr size_t default_top_count = 20;
+
+    struct Sample {
+        uint32_t thread_index;
+        uint32_t depth;
+        // Innermost frame first.
+        std::array<uintptr_t, max_stack_depth> pcs;
+    };
+
+    struct ProfilerState {
+        bool enabled = false;
+        std::string output_path{};
+        long sample_rate = default_sample_rate;
+        size_t top_count = default_top_count;
+        // Samples are written by the signal handler into preallocated slots, so recording never allocates or locks. Samples
+        // that don't fit are counted and dropped.
+        std::unique_ptr<Sample[]> samples{};
+        size_t capacity = 0;
+        std::atomic<size_t> next_sample = 0;
+        std::atomic<size_t> completed_samples = 0;
+        std::atomic<size_t> dropped_samples = 0;
+        std::atomic<bool> stopped = false;
+        std::atomic<profiler::symbolizer_t*> symbolizer = nullptr;
+
+        std::mutex threads_mutex{};
+        std::vector<std::string> thread_names{};
+#if defined(__linux__)
+        std::vector<timer_t> timers{};
+#endif
+    };
+
+    // Read by the signal handler, so it has to be reachable without running any initialization.
+    std::atomic<ProfilerState*> active_profiler = nullptr;
+
+    // Per-thread sampling state. Kept trivially destructible so that the signal handler can use it at any point.
+    struct ThreadSamplingInfo {
+        bool active;
+        uint32_t index;
+        uintptr_t stack_low;
+        uintptr_t stack_high;
+    };
+    thread_local ThreadSamplingInfo thread_sampling_info{};
+
+#if defined(__linux__)
+    void handle_sigprof(int, siginfo_t*, void* ucontext_ptr) {
+        int saved_errno = errno;
+        ProfilerState* profiler = active_profiler.load(std::memory_order_relaxed);
+        const ThreadSamplingInfo& info = thread_sampling_info;
+        if (profiler == nullptr || !info.active || profiler->stopped.load(std::memory_order_relaxed)) {
+            errno = saved_errno;
+            return;
+        }
+
+        size_t slot = profiler->next_sample.fetch_add(1, std::memory_order_relaxed);
+        if (slot >= profiler->capacity) {
+            profiler->dropped_samples.fetch_add(1, std::memory_order_relaxed);
+            errno = saved_errno;
+            return;
+        }
+
+        const ucontext_t* context = static_cast<const ucontext_t*>(ucontext_ptr);
+#if defined(__x86_64__)
+        uintptr_t pc = context->uc_mcontext.gregs[REG_RIP];
+        uintptr_t fp = context->uc_mcontext.gregs[REG_RBP];
+#elif defined(__aarch64__)
+        uintptr_t pc = context->uc_mcontext.pc;
+        uintptr_t fp = context->uc_mcontext.regs[29];
+#else
+        uintptr_t pc = 0;
+        uintptr_t fp = 0;
+#endif
+
+        Sample& sample = profiler->samples[slot];
+        sample.thread_index = info.index;
+        sample.pcs[0] = pc;
+        uint32_t depth = 1;
+
+        // Follow the saved frame pointers, only reading from the thread's own stack. Code built without frame pointers may
+        // use the register for something else, which at worst ends the walk early or adds a bogus frame.
+        while (depth < max_stack_depth && fp % sizeof(uintptr_t) == 0 && fp >= info.stack_low &&
+            fp + 2 * sizeof(uintptr_t) <= info.stack_high)
+        {
+            const uintptr_t* frame = reinterpret_cast<const uintptr_t*>(fp);
+            uintptr_t next_fp = frame[0];
+            uintptr_t return_address = frame[1];
+            if (return_address == 0) {
+                break;
+            }
+            // Point into the call instruction rather than after it, so the frame is attributed to the calling function.
+            sample.pcs[depth++] = return_address - 1;
+            if (next_fp <= fp) {
+                break;
+            }
+            fp = next_fp;
+        }
+
+        sample.depth = depth;
+        profiler->completed_samples.fetch_add(1, std::memory_order_release);
+        errno = saved_errno;
+    }
+
+    // Stops the thread's timer when it exits.
+    struct ThreadTimer {
+        timer_t timer{};
+        bool created = false;
+
+        ~ThreadTimer() {
+            thread_sampling_info.active = false;
+            ProfilerState* profiler = active_profiler.load();
+            if (!created || profiler == nullptr) {
+                return;
+            }
+            // The timer may have already been deleted by stop_and_report.
+            std::lock_guard lock{ profiler->threads_mutex };
+            auto find_it = std::find(profiler->timers.begin(), profiler->timers.end(), timer);
+            if (find_it != profiler->timers.end()) {
+                timer_delete(timer);
+                profiler->timers.erase(find_it);
+            }
+        }
+    };
+    thread_local ThreadTimer thread_timer{};
+#endif
+
+    ProfilerState& profiler_state() {
+        // Never destroyed, as samples may still be delivered while the process exits.
+        static ProfilerState* state = []() {
+            ProfilerState* ret = new ProfilerState{};
+            const char* output_path = getenv("RECOMP_PROFILE");
+            if (output_path == nullptr || output_path[0] == '\0') {
+                return ret;
+            }
+#if defined(__linux__)
+            ret->output_path = output_path;
+
+            const char* rate_setting = getenv("RECOMP_PROFILE_HZ");
+            long rate = rate_setting != nullptr ? strtol(rate_setting, nullptr, 10) : 0;
+            ret->sample_rate = rate > 0 ? rate : default_sample_rate;
+
+            const char* top_setting = getenv("RECOMP_PROFILE_TOP");
+            long top_count = top_setting != nullptr ? strtol(top_setting, nullptr, 10) : 0;
+            ret->top_count = top_count > 0 ? static_cast<size_t>(top_count) : default_top_count;
+
+            ret->capacity = default_sample_capacity;
+            ret->samples = std::make_unique<Sample[]>(ret->capacity);
+
+            struct sigaction action{};
+            action.sa_sigaction = handle_sigprof;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            if (sigaction(SIGPROF, &action, nullptr) != 0) {
+                fprintf(stderr, "[Profiler] Failed to install the SIGPROF handler\n");
+                return ret;
+            }
+
+            ret->enabled = true;
+            active_profiler.store(ret);
+#else
+            fprintf(stderr, "[Profiler] RECOMP_PROFILE is only supported on Linux\n");
+#endif
+            return ret;
+        }();
+        return *state;
+    }
+
+    std::string symbolize(ProfilerState& profiler, uintptr_t pc) {
+        std::string name{};
+        profiler::symbolizer_t* symbolizer = profiler.symbolizer.load();
+        if (symbolizer != nullptr && symbolizer(pc, name)) {
+            return name;
+        }
+
+        char buffer[64];
+#if defined(__linux__)
+        Dl_info info{};
+        if (dladdr(reinterpret_cast<void*>(pc), &info) != 0) {
+            if (info.dli_sname != nullptr) {
+                int status = 0;
+                char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+                if (status == 0 && demangled != nullptr) {
+                    name = demangled;
+                    free(demangled);
+                }
+                else {
+                    name = info.dli_sname;
+                }
+                return name;
+            }
+            if (info.dli_fname != nullptr) {
+                // Unexported functions can't be named without debug info, so identify them by their module offset instead.
+                std::string module = info.dli_fname;
+                module = module.substr(module.find_last_of('/') + 1);
+                snprintf(buffer, sizeof(buffer), "+0x%zx", static_cast<size_t>(pc - reinterpret_cast<uintptr_t>(info.dli_fbase)));
+                return "[" + module + buffer + "]";
+            }
+        }
+#endif
+        snprintf(buffer, sizeof(buffer), "[0x%zx]", static_cast<size_t>(pc));
+        return buffer;
+    }
+}
+
+void profiler::set_symbolizer(symbolizer_t* symbolizer) {
+    profiler_state().symbolizer.store(symbolizer);
+}
+
+std::string profiler::symbolize(uintptr_t pc) {
+    return ::symbolize(profiler_state(), pc);
+}
+
+bool profiler::enabled() {
+    return profiler_state().enabled;
+}
+
+void profiler::register_current_thread(const std::string& name) {
+    ProfilerState& profiler = profiler_state();
+    if (!profiler.enabled || profiler.stopped.load()) {
+        return;
+    }
+
+#if defined(__linux__)
+    uintptr_t stack_low = 0;
+    uintptr_t stack_high = 0;
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void* stack_addr;
+        size_t stack_size;
+        if (pthread_attr_getstack(&attr, &stack_addr, &stack_size) == 0) {
+            stack_low = reinterpret_cast<uintptr_t>(stack_addr);
+            stack_high = stack_low + stack_size;
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    std::lock_guard lock{ profiler.threads_mutex };
+    uint32_t index = static_cast<uint32_t>(profiler.thread_names.size());
+    profiler.thread_names.emplace_back(name);
+
+    // Time the thread's own CPU usage so that samples are only taken while it's running.
+    sigevent event{};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+    timer_t timer;
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) != 0) {
+        fprintf(stderr, "[Profiler] Failed to create a sampling timer for %s\n", name.c_str());
+        return;
+    }
+
+    thread_sampling_info = ThreadSamplingInfo{ .active = true, .index = index, .stack_low = stack_low, .stack_high = stack_high };
+    thread_timer.timer = timer;
+    thread_timer.created = true;
+    profiler.timers.push_back(timer);
+
+    long period_ns = 1'000'000'000 / profiler.sample_rate;
+    itimerspec spec{};
+    spec.it_interval.tv_sec = period_ns / 1'000'000'000;
+    spec.it_interval.tv_nsec = period_ns % 1'000'000'000;
+    spec.it_value = spec.it_interval;
+    timer_settime(timer, 0, &spec, nullptr);
+#endif
+}
+
+void profiler::stop_and_report(FILE* out) {
+    ProfilerState& profiler = profiler_state();
+    if (!profiler.enabled || profiler.stopped.exchange(true)) {
+        return;
+    }
+
+#if defined(__linux__)
+    {
+        std::lock_guard lock{ profiler.threads_mutex };
+        for (timer_t timer : profiler.timers) {
+            timer_delete(timer);
+        }
+        profiler.timers.clear();
+    }
+#endif
+
+    // Give handlers that were already running a moment to finish writing their samples.
+    size_t sample_count = std::min(profiler.next_sample.load(), profiler.capacity);
+    for (int i = 0; i < 100 && profiler.completed_samples.load(std::memory_order_acquire) < sample_count; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+    }
+    sample_count = std::min(sample_count, profiler.completed_samples.load(std::memory_order_acquire));
+
+    std::unordered_map<uintptr_t, std::string> names{};
+    auto get_name = [&](uintptr_t pc) -> const std::string& {
+        auto find_it = names.find(pc);
+        if (find_it == names.end()) {
+            find_it = names.emplace(pc, symbolize(profiler, pc)).first;
+        }
+        return find_it->second;
+    };
+
+    std::map<std::string, uint64_t> folded_stacks{};
+    std::unordered_map<std::string, uint64_t> self_counts{};
+    std::unordered_map<std::string, uint64_t> total_counts{};
+    std::unordered_set<std::string> sample_functions{};
+    std::string stack{};
+
+    for (size_t i = 0; i < sample_count; i++) {
+        const Sample& sample = profiler.samples[i];
+        // Folded stacks start with the outermost frame, and are grouped under the thread that was sampled.
+        stack = profiler.thread_names[sample.thread_index];
+        sample_functions.clear();
+        for (uint32_t depth = sample.depth; depth > 0; depth--) {
+            const std::string& name = get_name(sample.pcs[depth - 1]);
+            stack += ';';
+            stack += name;
+            if (sample_functions.insert(name).second) {
+                total_counts[name]++;
+            }
+        }
+        folded_stacks[stack]++;
+        self_counts[get_name(sample.pcs[0])]++;
+    }
+
+    std::string folded_path = profiler.output_path + ".folded";
+    std::ofstream folded_file{ folded_path };
+    for (const auto& [folded_stack, count] : folded_stacks) {
+        folded_file << folded_stack << ' ' << count << '\n';
+    }
+    if (!folded_file.good()) {
+        fprintf(stderr, "[Profiler] Failed to write %s\n", folded_path.c_str());
+    }
+
+    std::vector<std::pair<uint64_t, std::string>> top_functions{};
+    for (const auto& [name, count] : self_counts) {
+        top_functions.emplace_back(count, name);
+    }
+    std::sort(top_functions.rbegin(), top_functions.rend());
+
+    fprintf(out, "[Profiler] %zu samples from %zu threads (%zu dropped), folded stacks written to %s\n", sample_count,
+        profiler.thread_names.size(), profiler.dropped_samples.load(), folded_path.c_str());
+    fprintf(out, "[Profiler] %8s %8s  %s\n", "self", "total", "function");
+    for (size_t i = 0; i < std::min(profiler.top_count, top_functions.size()); i++) {
+        const auto& [count, name] = top_functions[i];
+        fprintf(out, "[Profiler] %7.2f%% %7.2f%%  %s\n", 100.0 * count / sample_count, 100.0 * total_counts[name] / sample_count,
+            name.c_str());
+    }
+    fflush(out);
+}
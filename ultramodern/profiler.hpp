@@ -0,0 +1,34 @@
+#ifndef __PROFILER_HPP__
+#define __PROFILER_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Sampling profiler for game threads, enabled by setting RECOMP_PROFILE to an output path. Each registered thread gets a CPU
+// time timer that interrupts it RECOMP_PROFILE_HZ times a second (997 by default) to record its call stack by walking the
+// frame pointer chain. Stacks are written to "<path>.folded" in the folded format used by flamegraph tools, and a report of
+// the top RECOMP_PROFILE_TOP functions (20 by default) is printed, when the profiler is stopped.
+//
+// Stacks are only complete for code built with frame pointers (see the RECOMP_PROFILER CMake option); otherwise only the
+// sampled function is reliable. Only supported on Linux.
+namespace ultramodern {
+    namespace profiler {
+        // Turns a host code address into a name. Returns false if the address doesn't belong to the symbolizer, in which case
+        // the name is looked up in the executable's symbols instead.
+        using symbolizer_t = bool(uintptr_t pc, std::string& name);
+        void set_symbolizer(symbolizer_t* symbolizer);
+        // Names a host code address with the symbolizer, falling back to the executable's symbols. Works whether or not the
+        // profiler is enabled.
+        std::string symbolize(uintptr_t pc);
+
+        // Starts sampling the calling thread if the profiler is enabled. Sampling stops when the thread exits.
+        void register_current_thread(const std::string& name);
+
+        bool enabled();
+        // Stops sampling and writes the results. Does nothing if the profiler isn't enabled or was already stopped.
+        void stop_and_report(FILE* out);
+    }
+}
+
+#endif
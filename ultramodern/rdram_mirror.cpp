@@ -0,0 +1,78 @@
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#include "rdram_mirror.hpp"
+#include "recomp_rdram.h"
+
+namespace {
+    uint32_t load_word(const uint8_t* data) {
+        uint32_t ret;
+        memcpy(&ret, data, sizeof(ret));
+        return ret;
+    }
+
+    void store_word(uint8_t* data, uint32_t value) {
+        memcpy(data, &value, sizeof(value));
+    }
+
+    std::atomic_ref<uint32_t> game_word(uint8_t* data) {
+        return std::atomic_ref<uint32_t>{ *reinterpret_cast<uint32_t*>(data) };
+    }
+
+    // Whether a page of the mirror holds the word-swapped contents of a page of the snapshot. Written without an early exit so
+    // that it vectorizes.
+    bool matches_swapped(const uint8_t* mirror, const uint8_t* snapshot, size_t size) {
+        uint32_t difference = 0;
+        for (size_t i = 0; i < size; i += 4) {
+            difference |= recomp::rdram::byteswap(load_word(mirror + i)) ^ load_word(snapshot + i);
+        }
+        return difference == 0;
+    }
+}
+
+ultramodern::RdramMirror::RdramMirror(uint8_t* game_rdram, size_t size) :
+    game_(game_rdram), size_(size), mirror_(std::make_unique<uint8_t[]>(size)), snapshot_(std::make_unique<uint8_t[]>(size))
+{
+    assert(size % page_size == 0);
+    memcpy(snapshot_.get(), game_, size_);
+    recomp::rdram::swap_words(mirror_.get(), snapshot_.get(), size_);
+}
+
+ultramodern::RdramMirror::SyncStats ultramodern::RdramMirror::sync() {
+    SyncStats stats{};
+    for (size_t page_offset = 0; page_offset < size_; page_offset += page_size) {
+        uint8_t* game = game_ + page_offset;
+        uint8_t* mirror = mirror_.get() + page_offset;
+        uint8_t* snapshot = snapshot_.get() + page_offset;
+
+        bool game_changed = memcmp(game, snapshot, page_size) != 0;
+        bool rt64_changed = !matches_swapped(mirror, snapshot, page_size);
+        if (!game_changed && !rt64_changed) {
+            continue;
+        }
+        stats.game_pages += game_changed ? 1 : 0;
+        stats.rt64_pages += rt64_changed ? 1 : 0;
+
+        for (size_t i = 0; i < page_size; i += 4) {
+            uint32_t snapshot_value = load_word(snapshot + i);
+            uint32_t game_value = game_word(game + i).load(std::memory_order_relaxed);
+            if (game_value == snapshot_value) {
+                uint32_t rt64_value = recomp::rdram::byteswap(load_word(mirror + i));
+                if (rt64_value == snapshot_value) {
+                    continue;
+                }
+                // Only RT64 changed this word, unless the game writes it before the exchange, in which case the game's value
+                // is used after all.
+                game_value = snapshot_value;
+                if (game_word(game + i).compare_exchange_strong(game_value, rt64_value, std::memory_order_relaxed)) {
+                    store_word(snapshot + i, rt64_value);
+                    continue;
+                }
+            }
+            store_word(mirror + i, recomp::rdram::byteswap(game_value));
+            store_word(snapshot + i, game_value);
+        }
+    }
+    return stats;
+}
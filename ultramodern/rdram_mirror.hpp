@@ -0,0 +1,47 @@
+#ifndef __RDRAM_MIRROR_HPP__
+#define __RDRAM_MIRROR_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace ultramodern {
+    // Word-swapped copy of the game's RDRAM for RT64 in big-endian RDRAM builds (see recomp_rdram.h), which is experimental.
+    // RT64 reads display lists and textures from the mirror and writes framebuffer copies back into it, so the two copies have
+    // to be brought back in line before each display list.
+    //
+    // Both copies are compared against a snapshot of the game's RDRAM taken at the last sync, which tells which side changed a
+    // word since then. Words the game changed are copied into the mirror, and words only RT64 changed are copied back into the
+    // game's RDRAM. When both changed the same word, the game's value wins. Pages that neither side changed are only read, so
+    // a sync costs a read of both copies and the snapshot plus a write of what actually changed. That's about as much memory
+    // traffic as swapping all of RDRAM into the mirror (see tests/rdram_layout_benchmark.cpp), but RT64's writes survive it.
+    class RdramMirror {
+    public:
+        static constexpr size_t page_size = 4096;
+
+        struct SyncStats {
+            // Pages with words that the game changed since the last sync.
+            uint32_t game_pages = 0;
+            // Pages with words that RT64 changed since the last sync.
+            uint32_t rt64_pages = 0;
+        };
+
+        // size must be a multiple of page_size.
+        RdramMirror(uint8_t* game_rdram, size_t size);
+
+        uint8_t* data() { return mirror_.get(); }
+        size_t size() const { return size_; }
+
+        // Must not run while RT64 is using the mirror. The game's threads can keep running, as RT64's writes are copied back
+        // with atomic compare-exchanges that leave any word the game writes in the meantime alone.
+        SyncStats sync();
+    private:
+        uint8_t* game_;
+        size_t size_;
+        std::unique_ptr<uint8_t[]> mirror_;
+        // The game's RDRAM as of the last sync, when both copies matched it.
+        std::unique_ptr<uint8_t[]> snapshot_;
+    };
+}
+
+#endif
@@ -6,40 +6,38 @@
 #include "hle/rt64_application.h"
 #include "rt64_layer.h"
 #include "rt64_render_hooks.h"
+#include "recomp_rdram.h"
+#include "compressed_stream.hpp"
+#include "shader_cache.hpp"
+#include "instance.hpp"
 
 ultramodern::RT64Context::~RT64Context() = default;
 
 static RT64::UserConfiguration::Antialiasing device_max_msaa = RT64::UserConfiguration::Antialiasing::None;
 static bool sample_positions_supported = false;
 
-static uint8_t DMEM[0x1000];
-static uint8_t IMEM[0x1000];
-
-unsigned int MI_INTR_REG = 0;
-
-unsigned int DPC_START_REG = 0;
-unsigned int DPC_END_REG = 0;
-unsigned int DPC_CURRENT_REG = 0;
-unsigned int DPC_STATUS_REG = 0;
-unsigned int DPC_CLOCK_REG = 0;
-unsigned int DPC_BUFBUSY_REG = 0;
-unsigned int DPC_PIPEBUSY_REG = 0;
-unsigned int DPC_TMEM_REG = 0;
-
-unsigned int VI_STATUS_REG = 0;
-unsigned int VI_ORIGIN_REG = 0;
-unsigned int VI_WIDTH_REG = 0;
-unsigned int VI_INTR_REG = 0;
-unsigned int VI_V_CURRENT_LINE_REG = 0;
-unsigned int VI_TIMING_REG = 0;
-unsigned int VI_V_SYNC_REG = 0;
-unsigned int VI_H_SYNC_REG = 0;
-unsigned int VI_LEAP_REG = 0;
-unsigned int VI_H_START_REG = 0;
-unsigned int VI_V_START_REG = 0;
-unsigned int VI_V_BURST_REG = 0;
-unsigned int VI_X_SCALE_REG = 0;
-unsigned int VI_Y_SCALE_REG = 0;
+ultramodern::HardwareRegisters& ultramodern::hardware_registers() {
+    return ultramodern::current_instance().state<HardwareRegisters>();
+}
+
+static ultramodern::dl_capture::ViRegisters current_vi_registers(const ultramodern::HardwareRegisters& regs) {
+    return ultramodern::dl_capture::ViRegisters{
+        .status = regs.VI_STATUS_REG,
+        .origin = regs.VI_ORIGIN_REG,
+        .width = regs.VI_WIDTH_REG,
+        .intr = regs.VI_INTR_REG,
+        .v_current_line = regs.VI_V_CURRENT_LINE_REG,
+        .timing = regs.VI_TIMING_REG,
+        .v_sync = regs.VI_V_SYNC_REG,
+        .h_sync = regs.VI_H_SYNC_REG,
+        .leap = regs.VI_LEAP_REG,
+        .h_start = regs.VI_H_START_REG,
+        .v_start = regs.VI_V_START_REG,
+        .v_burst = regs.VI_V_BURST_REG,
+        .x_scale = regs.VI_X_SCALE_REG,
+        .y_scale = regs.VI_Y_SCALE_REG,
+    };
+}
 
 void dummy_check_interrupts() {
 
@@ -115,35 +113,41 @@ ultramodern::RT64Context::RT64Context(uint8_t* rdram, ultramodern::WindowHandle
     appCore.checkInterrupts = dummy_check_interrupts;
 
     appCore.HEADER = dummy_rom_header;
+    registers = &ultramodern::hardware_registers();
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+    rdram_mirror = std::make_unique<RdramMirror>(rdram, ultramodern::rdram_size);
+    appCore.RDRAM = rdram_mirror->data();
+#else
     appCore.RDRAM = rdram;
-    appCore.DMEM = DMEM;
-    appCore.IMEM = IMEM;
-
-    appCore.MI_INTR_REG = &MI_INTR_REG;
-
-    appCore.DPC_START_REG = &DPC_START_REG;
-    appCore.DPC_END_REG = &DPC_END_REG;
-    appCore.DPC_CURRENT_REG = &DPC_CURRENT_REG;
-    appCore.DPC_STATUS_REG = &DPC_STATUS_REG;
-    appCore.DPC_CLOCK_REG = &DPC_CLOCK_REG;
-    appCore.DPC_BUFBUSY_REG = &DPC_BUFBUSY_REG;
-    appCore.DPC_PIPEBUSY_REG = &DPC_PIPEBUSY_REG;
-    appCore.DPC_TMEM_REG = &DPC_TMEM_REG;
-
-    appCore.VI_STATUS_REG = &VI_STATUS_REG;
-    appCore.VI_ORIGIN_REG = &VI_ORIGIN_REG;
-    appCore.VI_WIDTH_REG = &VI_WIDTH_REG;
-    appCore.VI_INTR_REG = &VI_INTR_REG;
-    appCore.VI_V_CURRENT_LINE_REG = &VI_V_CURRENT_LINE_REG;
-    appCore.VI_TIMING_REG = &VI_TIMING_REG;
-    appCore.VI_V_SYNC_REG = &VI_V_SYNC_REG;
-    appCore.VI_H_SYNC_REG = &VI_H_SYNC_REG;
-    appCore.VI_LEAP_REG = &VI_LEAP_REG;
-    appCore.VI_H_START_REG = &VI_H_START_REG;
-    appCore.VI_V_START_REG = &VI_V_START_REG;
-    appCore.VI_V_BURST_REG = &VI_V_BURST_REG;
-    appCore.VI_X_SCALE_REG = &VI_X_SCALE_REG;
-    appCore.VI_Y_SCALE_REG = &VI_Y_SCALE_REG;
+#endif
+    appCore.DMEM = registers->DMEM;
+    appCore.IMEM = registers->IMEM;
+
+    appCore.MI_INTR_REG = &registers->MI_INTR_REG;
+
+    appCore.DPC_START_REG = &registers->DPC_START_REG;
+    appCore.DPC_END_REG = &registers->DPC_END_REG;
+    appCore.DPC_CURRENT_REG = &registers->DPC_CURRENT_REG;
+    appCore.DPC_STATUS_REG = &registers->DPC_STATUS_REG;
+    appCore.DPC_CLOCK_REG = &registers->DPC_CLOCK_REG;
+    appCore.DPC_BUFBUSY_REG = &registers->DPC_BUFBUSY_REG;
+    appCore.DPC_PIPEBUSY_REG = &registers->DPC_PIPEBUSY_REG;
+    appCore.DPC_TMEM_REG = &registers->DPC_TMEM_REG;
+
+    appCore.VI_STATUS_REG = &registers->VI_STATUS_REG;
+    appCore.VI_ORIGIN_REG = &registers->VI_ORIGIN_REG;
+    appCore.VI_WIDTH_REG = &registers->VI_WIDTH_REG;
+    appCore.VI_INTR_REG = &registers->VI_INTR_REG;
+    appCore.VI_V_CURRENT_LINE_REG = &registers->VI_V_CURRENT_LINE_REG;
+    appCore.VI_TIMING_REG = &registers->VI_TIMING_REG;
+    appCore.VI_V_SYNC_REG = &registers->VI_V_SYNC_REG;
+    appCore.VI_H_SYNC_REG = &registers->VI_H_SYNC_REG;
+    appCore.VI_LEAP_REG = &registers->VI_LEAP_REG;
+    appCore.VI_H_START_REG = &registers->VI_H_START_REG;
+    appCore.VI_V_START_REG = &registers->VI_V_START_REG;
+    appCore.VI_V_BURST_REG = &registers->VI_V_BURST_REG;
+    appCore.VI_X_SCALE_REG = &registers->VI_X_SCALE_REG;
+    appCore.VI_Y_SCALE_REG = &registers->VI_Y_SCALE_REG;
 
     // Set up the RT64 application configuration fields.
     RT64::ApplicationConfiguration appConfig;
@@ -200,22 +204,86 @@ ultramodern::RT64Context::RT64Context(uint8_t* rdram, ultramodern::WindowHandle
         device_max_msaa = RT64::UserConfiguration::Antialiasing::None;
         sample_positions_supported = false;
     }
+
+    // RECOMP_DL_CAPTURE records the graphics work sent to RT64 to the given file, with RECOMP_DL_CAPTURE_FRAMES frames in it.
+    if (const char* capture_path = getenv("RECOMP_DL_CAPTURE"); capture_path != nullptr) {
+        const char* frames_setting = getenv("RECOMP_DL_CAPTURE_FRAMES");
+        long frames = frames_setting != nullptr ? strtol(frames_setting, nullptr, 10) : 0;
+        dl_capture_frame_limit = frames > 0 ? static_cast<uint32_t>(frames) : 300;
+        dl_capture_path = capture_path;
+        dl_capture_writer = std::make_unique<dl_capture::Writer>();
+        if (!dl_capture_writer->open(dl_capture_path, ultramodern::rdram_size)) {
+            fprintf(stderr, "Failed to open display list capture file %s\n", capture_path);
+            dl_capture_writer.reset();
+        }
+    }
 }
 
 void ultramodern::RT64Context::send_dl(const OSTask* task) {
+    if (dl_capture_writer != nullptr) {
+        dl_capture_writer->write_task(app->core.RDRAM, task);
+    }
+
     app->state->rsp->reset();
     app->interpreter->loadUCodeGBI(task->t.ucode & 0x3FFFFFF, task->t.ucode_data & 0x3FFFFFF, true);
     app->processDisplayLists(app->core.RDRAM, task->t.data_ptr & 0x3FFFFFF, 0, true);
 }
 
+uint8_t* ultramodern::RT64Context::rdram() {
+    return app->core.RDRAM;
+}
+
+void ultramodern::RT64Context::sync_rdram() {
+    if (rdram_mirror != nullptr) {
+        rdram_mirror->sync();
+    }
+}
+
 void ultramodern::RT64Context::update_screen(uint32_t vi_origin) {
-    VI_ORIGIN_REG = vi_origin;
+    registers->VI_ORIGIN_REG = vi_origin;
 
     app->updateScreen();
+
+    if (dl_capture_writer != nullptr) {
+        dl_capture_writer->write_screen(current_vi_registers(*registers));
+        if (dl_capture_writer->frames() >= dl_capture_frame_limit) {
+            finish_dl_capture();
+        }
+    }
+}
+
+void ultramodern::RT64Context::finish_dl_capture() {
+    printf("Captured %u frames of display lists (%.1f MB) to %s\n", dl_capture_writer->frames(),
+        dl_capture_writer->bytes_written() / (1024.0 * 1024.0), dl_capture_path.string().c_str());
+    dl_capture_writer.reset();
+}
+
+void ultramodern::RT64Context::set_vi_registers(const dl_capture::ViRegisters& vi_regs) {
+    registers->VI_STATUS_REG = vi_regs.status;
+    registers->VI_ORIGIN_REG = vi_regs.origin;
+    registers->VI_WIDTH_REG = vi_regs.width;
+    registers->VI_INTR_REG = vi_regs.intr;
+    registers->VI_V_CURRENT_LINE_REG = vi_regs.v_current_line;
+    registers->VI_TIMING_REG = vi_regs.timing;
+    registers->VI_V_SYNC_REG = vi_regs.v_sync;
+    registers->VI_H_SYNC_REG = vi_regs.h_sync;
+    registers->VI_LEAP_REG = vi_regs.leap;
+    registers->VI_H_START_REG = vi_regs.h_start;
+    registers->VI_V_START_REG = vi_regs.v_start;
+    registers->VI_V_BURST_REG = vi_regs.v_burst;
+    registers->VI_X_SCALE_REG = vi_regs.x_scale;
+    registers->VI_Y_SCALE_REG = vi_regs.y_scale;
 }
 
 void ultramodern::RT64Context::shutdown() {
+    if (dl_capture_writer != nullptr) {
+        finish_dl_capture();
+    }
     if (app != nullptr) {
+        if (user_shader_cache_stream != nullptr) {
+            app->rasterShaderCache->stopOfflineDumper();
+            user_shader_cache_stream.reset();
+        }
         app->end();
     }
 }
@@ -245,14 +313,78 @@ uint32_t ultramodern::RT64Context::get_display_framerate() {
     return app->presentQueue->ext.sharedResources->swapChainRate;
 }
 
-void ultramodern::RT64Context::load_shader_cache(std::span<const char> cache_binary) {
-    // TODO figure out how to avoid a copy here.
-    std::istringstream cache_stream{std::string{cache_binary.data(), cache_binary.size()}};
+// Reads the shaders recorded on previous runs, dropping ones that are already in the embedded list, came from a different RT64
+// build or don't fit in the size limit. The file is rewritten if anything was dropped so that it doesn't keep growing.
+static std::vector<char> load_user_shader_cache(std::span<const char> cache_binary, const std::filesystem::path& user_cache_path) {
+    namespace shader_cache = ultramodern::shader_cache;
+    shader_cache::Merger merger{};
+
+    {
+        ultramodern::compressed_stream::InputBuffer cache_buffer{cache_binary};
+        std::istream cache_stream{&cache_buffer};
+        merger.add_reference(cache_stream);
+    }
 
-    if (!app->rasterShaderCache->loadOfflineList(cache_stream)) {
+    {
+        std::ifstream user_cache_stream{user_cache_path, std::ios::binary};
+        if (!user_cache_stream.good()) {
+            return {};
+        }
+        merger.add(user_cache_stream);
+    }
+
+    shader_cache::MergeResult result = merger.finish(shader_cache::max_user_cache_size);
+    printf("Loaded %zu shaders from the user shader cache (dropped %zu duplicate, %zu incompatible, %zu over the size limit)\n",
+        result.records, result.duplicates, result.incompatible, result.over_size);
+
+    if (result.dropped_any()) {
+        std::filesystem::path temp_path = user_cache_path;
+        temp_path += ".tmp";
+        std::error_code ec;
+        {
+            std::ofstream temp_stream{temp_path, std::ios::binary};
+            temp_stream.write(result.data.data(), result.data.size());
+            if (!temp_stream.good()) {
+                ec = std::make_error_code(std::errc::io_error);
+            }
+        }
+        if (!ec) {
+            std::filesystem::rename(temp_path, user_cache_path, ec);
+        }
+        if (ec) {
+            fprintf(stderr, "Failed to compact the user shader cache: %s\n", ec.message().c_str());
+        }
+    }
+
+    return std::move(result.data);
+}
+
+void ultramodern::RT64Context::load_shader_cache(std::span<const char> cache_binary, const std::filesystem::path& user_cache_path) {
+    std::vector<char> user_cache{};
+    if (!user_cache_path.empty()) {
+        user_cache = load_user_shader_cache(cache_binary, user_cache_path);
+    }
+
+    // Read the cache straight out of the embedded binary, decompressing it a frame at a time if it was compressed at build time.
+    // The user's shaders come after it, as both are sequences of self-contained records.
+    ultramodern::compressed_stream::InputBuffer cache_buffer{cache_binary};
+    ultramodern::compressed_stream::InputBuffer user_cache_buffer{user_cache};
+    ultramodern::shader_cache::ConcatInputBuffer combined_buffer{{ &cache_buffer, &user_cache_buffer }};
+    std::istream cache_stream{&combined_buffer};
+
+    if (!app->rasterShaderCache->loadOfflineList(cache_stream) || cache_buffer.failed()) {
        printf("Failed to preload shader cache!\n");
        assert(false);
     }
+
+    // Record every shader that wasn't in either list once it's compiled.
+    if (!user_cache_path.empty()) {
+        user_shader_cache_stream = std::make_unique<std::ofstream>(user_cache_path, std::ios::binary | std::ios::app);
+        if (!user_shader_cache_stream->good() || !app->rasterShaderCache->startOfflineDumper(*user_shader_cache_stream)) {
+            fprintf(stderr, "Failed to open the user shader cache for recording\n");
+            user_shader_cache_stream.reset();
+        }
+    }
 }
 
 RT64::UserConfiguration::Antialiasing ultramodern::RT64MaxMSAA() {
@@ -0,0 +1,144 @@
+#include <cstring>
+
+#include "shader_cache.hpp"
+
+namespace shader_cache = ultramodern::shader_cache;
+
+namespace {
+    constexpr std::array<char, 4> magic = { 'R', 'T', 'S', 'C' };
+    constexpr size_t description_size = 36;
+    constexpr size_t header_size = magic.size() + sizeof(uint32_t) + description_size;
+    // How much of the record header has to match between records from the same RT64 build (magic, version and the first eight
+    // bytes of the description).
+    constexpr size_t version_key_size = magic.size() + sizeof(uint32_t) + 8;
+    // Shaders are a few KB each, so anything much larger means the data isn't a valid record.
+    constexpr uint32_t max_shader_size = 16 * 1024 * 1024;
+
+    uint32_t read_u32(const char* data) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        return uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+    }
+
+    bool read_exact(std::istream& stream, char* out, size_t count) {
+        stream.read(out, count);
+        return static_cast<size_t>(stream.gcount()) == count;
+    }
+
+    bool read_shader(std::istream& stream, std::vector<char>& record) {
+        size_t size_offset = record.size();
+        record.resize(size_offset + sizeof(uint32_t));
+        if (!read_exact(stream, record.data() + size_offset, sizeof(uint32_t))) {
+            return false;
+        }
+        uint32_t shader_size = read_u32(record.data() + size_offset);
+        if (shader_size > max_shader_size) {
+            return false;
+        }
+        record.resize(size_offset + sizeof(uint32_t) + shader_size);
+        return read_exact(stream, record.data() + size_offset + sizeof(uint32_t), shader_size);
+    }
+}
+
+bool shader_cache::read_record(std::istream& stream, std::vector<char>& record, bool& malformed) {
+    malformed = false;
+    record.resize(header_size);
+
+    stream.read(record.data(), header_size);
+    size_t header_read = static_cast<size_t>(stream.gcount());
+    if (header_read == 0) {
+        return false;
+    }
+
+    if (header_read != header_size || memcmp(record.data(), magic.data(), magic.size()) != 0 ||
+        !read_shader(stream, record) || !read_shader(stream, record))
+    {
+        malformed = true;
+        return false;
+    }
+
+    return true;
+}
+
+void shader_cache::Merger::read_records(std::istream& stream, bool reference) {
+    std::vector<char> record{};
+    bool malformed = false;
+
+    while (read_record(stream, record, malformed)) {
+        std::string version_key{ record.data(), version_key_size };
+        if (version_key_.empty()) {
+            version_key_ = version_key;
+        }
+        else if (version_key != version_key_) {
+            if (!reference) {
+                result_.incompatible++;
+            }
+            continue;
+        }
+
+        // Records are keyed by their whole header, as the description is what RT64 looks shaders up by.
+        if (!seen_keys_.emplace(record.data(), header_size).second) {
+            if (!reference) {
+                result_.duplicates++;
+            }
+            continue;
+        }
+
+        if (!reference) {
+            records_.emplace_back(std::move(record));
+            record = {};
+        }
+    }
+
+    if (malformed) {
+        result_.malformed_inputs++;
+    }
+}
+
+void shader_cache::Merger::add_reference(std::istream& stream) {
+    read_records(stream, true);
+}
+
+void shader_cache::Merger::add(std::istream& stream) {
+    read_records(stream, false);
+}
+
+shader_cache::MergeResult shader_cache::Merger::finish(size_t max_size) {
+    size_t total_size = 0;
+    size_t first_kept = records_.size();
+    // Keep the newest records, which are the ones added last.
+    while (first_kept > 0 && total_size + records_[first_kept - 1].size() <= max_size) {
+        first_kept--;
+        total_size += records_[first_kept].size();
+    }
+
+    MergeResult ret = std::move(result_);
+    ret.over_size = first_kept;
+    ret.records = records_.size() - first_kept;
+    ret.data.reserve(total_size);
+    for (size_t i = first_kept; i < records_.size(); i++) {
+        ret.data.insert(ret.data.end(), records_[i].begin(), records_[i].end());
+    }
+
+    result_ = {};
+    records_.clear();
+    seen_keys_.clear();
+    version_key_.clear();
+    return ret;
+}
+
+shader_cache::ConcatInputBuffer::int_type shader_cache::ConcatInputBuffer::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    while (cur_part_ < parts_.size()) {
+        std::streamsize count = parts_[cur_part_]->sgetn(buffer_.data(), buffer_.size());
+        if (count > 0) {
+            setg(buffer_.data(), buffer_.data(), buffer_.data() + count);
+            return traits_type::to_int_type(*gptr());
+        }
+        cur_part_++;
+    }
+
+    return traits_type::eof();
+}
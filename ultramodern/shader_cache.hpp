@@ -0,0 +1,76 @@
+#ifndef __SHADER_CACHE_HPP__
+#define __SHADER_CACHE_HPP__
+
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Handling for RT64 offline shader lists, used to merge the list embedded in the executable with the shaders a user's machine
+// has compiled at runtime. A list is a sequence of self-contained records, each being:
+//   char magic[4] = "RTSC"
+//   uint32_t version
+//   uint8_t description[36]
+//   uint32_t vertex_shader_size, uint8_t vertex_shader[vertex_shader_size]
+//   uint32_t pixel_shader_size, uint8_t pixel_shader[pixel_shader_size]
+// Since every record carries its own header, lists can be appended to and concatenated freely.
+namespace ultramodern {
+    namespace shader_cache {
+        // Limit for the runtime cache on disk. The oldest shaders are dropped first once it's exceeded.
+        constexpr size_t max_user_cache_size = 64 * 1024 * 1024;
+
+        // Reads the next record from the stream into `record`. Returns false at the end of the stream, and also sets `malformed`
+        // if the stream ended partway through a record or the data isn't a record at all (e.g. a write was interrupted).
+        bool read_record(std::istream& stream, std::vector<char>& record, bool& malformed);
+
+        struct MergeResult {
+            std::vector<char> data;
+            size_t records = 0;
+            size_t duplicates = 0;
+            size_t incompatible = 0;
+            size_t over_size = 0;
+            size_t malformed_inputs = 0;
+
+            // Whether anything from the inputs didn't make it into the result.
+            bool dropped_any() const { return duplicates + incompatible + over_size + malformed_inputs != 0; }
+        };
+
+        // Merges shader lists, dropping records that are duplicates of an earlier one or that were written by a different RT64
+        // build than the first record seen.
+        class Merger {
+        public:
+            // Records read from a reference list are used for deduplication and version checks, but aren't part of the result.
+            void add_reference(std::istream& stream);
+            void add(std::istream& stream);
+            // Returns the merged records in the order they were added, dropping the oldest ones to stay within `max_size`.
+            MergeResult finish(size_t max_size);
+        private:
+            void read_records(std::istream& stream, bool reference);
+
+            // The version and the leading description bytes of the first record seen. RT64 writes the same values into every
+            // record it produces, so records that don't match them came from a build with different shaders.
+            std::string version_key_;
+            std::unordered_set<std::string> seen_keys_;
+            std::vector<std::vector<char>> records_;
+            MergeResult result_;
+        };
+
+        // Read-only stream buffer that reads several stream buffers back to back, used to load more than one list at a time.
+        class ConcatInputBuffer : public std::streambuf {
+        public:
+            explicit ConcatInputBuffer(std::vector<std::streambuf*> parts) : parts_(std::move(parts)) {}
+        protected:
+            int_type underflow() override;
+        private:
+            std::vector<std::streambuf*> parts_;
+            size_t cur_part_ = 0;
+            std::array<char, 4096> buffer_;
+        };
+    }
+}
+
+#endif
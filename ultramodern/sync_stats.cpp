@@ -0,0 +1,194 @@
+#include <cstdlib>
+#include <cinttypes>
+#include <bit>
+#include <algorithm>
+
+#include "sync_stats.hpp"
+
+namespace sync_stats = ultramodern::sync_stats;
+
+static bool read_enabled_setting(int64_t& interval_seconds) {
+    const char* setting = getenv("RECOMP_SYNC_STATS");
+    if (setting == nullptr) {
+#ifdef ULTRAMODERN_SYNC_STATS
+        interval_seconds = 10;
+        return true;
+#else
+        interval_seconds = 0;
+        return false;
+#endif
+    }
+
+    interval_seconds = strtoll(setting, nullptr, 10);
+    return true;
+}
+
+static int64_t dump_interval_seconds = 0;
+bool sync_stats::enabled = read_enabled_setting(dump_interval_seconds);
+
+namespace {
+    struct Registry {
+        // Points are only added and removed when the runtime state that owns them is created or destroyed, so the list is
+        // simply guarded by a mutex. Recording into a point never touches the list.
+        std::mutex mutex;
+        sync_stats::Point* head = nullptr;
+        std::atomic<int64_t> last_dump_ns = 0;
+        std::atomic_flag dumping = ATOMIC_FLAG_INIT;
+    };
+}
+
+// Points with static storage duration in other files may be constructed or destroyed before or after this file's globals,
+// so the registry is created on first use and never destroyed.
+static Registry& get_registry() {
+    static Registry* registry = new Registry{};
+    return *registry;
+}
+
+sync_stats::Point::Point(const char* name, Kind kind) : name(name), kind(kind) {
+    Registry& registry = get_registry();
+    std::lock_guard lock{ registry.mutex };
+    next = registry.head;
+    registry.head = this;
+}
+
+sync_stats::Point::~Point() {
+    Registry& registry = get_registry();
+    std::lock_guard lock{ registry.mutex };
+    for (Point** link = &registry.head; *link != nullptr; link = &(*link)->next) {
+        if (*link == this) {
+            *link = next;
+            break;
+        }
+    }
+}
+
+void sync_stats::Histogram::record(uint64_t duration_ns) {
+    size_t bucket = std::min<size_t>(std::bit_width(duration_ns), histogram_buckets - 1);
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+
+    uint64_t cur_max = max_ns.load(std::memory_order_relaxed);
+    while (duration_ns > cur_max && !max_ns.compare_exchange_weak(cur_max, duration_ns, std::memory_order_relaxed)) {}
+}
+
+uint64_t sync_stats::Histogram::count() const {
+    uint64_t ret = 0;
+    for (const auto& bucket : buckets) {
+        ret += bucket.load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+uint64_t sync_stats::Histogram::percentile_ns(double percentile) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(percentile * total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram_buckets; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > target) {
+            return i == 0 ? 0 : (uint64_t{1} << i);
+        }
+    }
+    return max_ns.load(std::memory_order_relaxed);
+}
+
+static void update_peak_depth(sync_stats::Point& point, int64_t depth) {
+    int64_t cur_peak = point.peak_depth.load(std::memory_order_relaxed);
+    while (depth > cur_peak && !point.peak_depth.compare_exchange_weak(cur_peak, depth, std::memory_order_relaxed)) {}
+}
+
+void sync_stats::on_push(Point& point) {
+    if (!enabled) {
+        return;
+    }
+
+    point.operations.fetch_add(1, std::memory_order_relaxed);
+    int64_t depth = point.depth.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (depth > 1) {
+        point.contended.fetch_add(1, std::memory_order_relaxed);
+    }
+    update_peak_depth(point, depth);
+}
+
+void sync_stats::on_pop(Point& point) {
+    if (!enabled) {
+        return;
+    }
+
+    point.depth.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void sync_stats::on_depth(Point& point, int64_t depth) {
+    if (!enabled) {
+        return;
+    }
+
+    int64_t prev_depth = point.depth.exchange(depth, std::memory_order_relaxed);
+    if (depth > prev_depth) {
+        point.operations.fetch_add(1, std::memory_order_relaxed);
+        if (prev_depth > 0) {
+            point.contended.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    update_peak_depth(point, depth);
+}
+
+static void dump_histogram(FILE* out, const char* label, const sync_stats::Histogram& histogram) {
+    uint64_t count = histogram.count();
+    uint64_t average_ns = count == 0 ? 0 : histogram.total_ns.load(std::memory_order_relaxed) / count;
+    fprintf(out, "    %s: avg %" PRIu64 " ns, p50 <= %" PRIu64 " ns, p99 <= %" PRIu64 " ns, max %" PRIu64 " ns, total %.3f ms\n",
+        label, average_ns, histogram.percentile_ns(0.5), histogram.percentile_ns(0.99), histogram.max_ns.load(std::memory_order_relaxed),
+        histogram.total_ns.load(std::memory_order_relaxed) / 1e6);
+}
+
+void sync_stats::dump(FILE* out) {
+    if (!enabled) {
+        return;
+    }
+
+    Registry& registry = get_registry();
+    std::lock_guard lock{ registry.mutex };
+    fprintf(out, "[SyncStats] Lock and queue statistics:\n");
+    for (Point* point = registry.head; point != nullptr; point = point->next) {
+        uint64_t operations = point->operations.load(std::memory_order_relaxed);
+        uint64_t contended = point->contended.load(std::memory_order_relaxed);
+        double contended_percent = operations == 0 ? 0.0 : 100.0 * contended / operations;
+
+        if (point->kind == Point::Kind::Lock) {
+            fprintf(out, "  lock %s: %" PRIu64 " acquisitions, %" PRIu64 " contended (%.2f%%)\n", point->name, operations, contended, contended_percent);
+            dump_histogram(out, "wait", point->wait_time);
+            dump_histogram(out, "hold", point->hold_time);
+        }
+        else {
+            fprintf(out, "  queue %s: %" PRIu64 " pushes, %" PRIu64 " onto a non-empty queue (%.2f%%), depth %" PRId64 ", peak depth %" PRId64 "\n",
+                point->name, operations, contended, contended_percent, point->depth.load(std::memory_order_relaxed), point->peak_depth.load(std::memory_order_relaxed));
+        }
+    }
+    fflush(out);
+}
+
+void sync_stats::dump_if_due() {
+    if (!enabled || dump_interval_seconds <= 0) {
+        return;
+    }
+
+    Registry& registry = get_registry();
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+    int64_t last_dump_ns = registry.last_dump_ns.load(std::memory_order_relaxed);
+    if (last_dump_ns == 0) {
+        registry.last_dump_ns.store(now_ns, std::memory_order_relaxed);
+        return;
+    }
+
+    if (now_ns - last_dump_ns < dump_interval_seconds * 1'000'000'000 || registry.dumping.test_and_set()) {
+        return;
+    }
+
+    registry.last_dump_ns.store(now_ns, std::memory_order_relaxed);
+    dump(stdout);
+    registry.dumping.clear();
+}
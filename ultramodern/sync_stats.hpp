@@ -0,0 +1,128 @@
+#ifndef __SYNC_STATS_HPP__
+#define __SYNC_STATS_HPP__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+
+// Contention telemetry for the runtime's shared locks and queues. Recording is off unless the RECOMP_SYNC_STATS environment
+// variable is set (its value is the dump interval in seconds, 0 for a dump on exit only), or the build enables it by default
+// with ULTRAMODERN_SYNC_STATS. While it's off, each instrumented operation only costs a check of a flag.
+namespace ultramodern {
+    namespace sync_stats {
+        using clock = std::chrono::steady_clock;
+
+        // Durations are bucketed by powers of two of nanoseconds, so bucket n holds durations in [2^(n-1), 2^n) ns.
+        constexpr size_t histogram_buckets = 40;
+
+        struct Histogram {
+            std::array<std::atomic_uint64_t, histogram_buckets> buckets{};
+            std::atomic_uint64_t total_ns = 0;
+            std::atomic_uint64_t max_ns = 0;
+
+            void record(uint64_t duration_ns);
+            uint64_t count() const;
+            // Returns the upper bound of the bucket that contains the given percentile.
+            uint64_t percentile_ns(double percentile) const;
+        };
+
+        extern bool enabled;
+
+        // A named synchronization point. Points register themselves on construction and unregister on destruction, so they
+        // can be part of per-instance state.
+        struct Point {
+            enum class Kind {
+                Lock,
+                Queue
+            };
+
+            explicit Point(const char* name, Kind kind);
+            ~Point();
+            Point(const Point&) = delete;
+            Point& operator=(const Point&) = delete;
+
+            const char* name;
+            Kind kind;
+            // Locks: acquisitions, and how many of them had to wait for another holder.
+            // Queues: enqueues, and how many of them found the queue non-empty.
+            std::atomic_uint64_t operations = 0;
+            std::atomic_uint64_t contended = 0;
+            // Locks only.
+            Histogram wait_time{};
+            Histogram hold_time{};
+            // Queues only.
+            std::atomic_int64_t depth = 0;
+            std::atomic_int64_t peak_depth = 0;
+            Point* next = nullptr;
+        };
+
+        inline uint64_t elapsed_ns(clock::time_point start, clock::time_point end) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        }
+
+        // Call on every push to and pop from an instrumented queue. Pass the queue's real depth to on_depth if it's
+        // cheaply known instead of tracking it with on_push/on_pop.
+        void on_push(Point& point);
+        void on_pop(Point& point);
+        void on_depth(Point& point, int64_t depth);
+
+        // Writes every point's statistics to the given file.
+        void dump(FILE* out);
+        // Dumps to stdout if the configured interval has elapsed since the last dump. Cheap enough to call every frame.
+        void dump_if_due();
+    }
+
+    // Drop-in replacement for std::mutex that records wait and hold times when sync stats are enabled.
+    class InstrumentedMutex {
+    public:
+        explicit InstrumentedMutex(const char* name) : point_(name, sync_stats::Point::Kind::Lock) {}
+
+        void lock() {
+            if (!sync_stats::enabled) {
+                mutex_.lock();
+                return;
+            }
+
+            point_.operations.fetch_add(1, std::memory_order_relaxed);
+            if (mutex_.try_lock()) {
+                point_.wait_time.record(0);
+            }
+            else {
+                sync_stats::clock::time_point wait_start = sync_stats::clock::now();
+                mutex_.lock();
+                point_.contended.fetch_add(1, std::memory_order_relaxed);
+                point_.wait_time.record(sync_stats::elapsed_ns(wait_start, sync_stats::clock::now()));
+            }
+            hold_start_ = sync_stats::clock::now();
+        }
+
+        bool try_lock() {
+            if (!mutex_.try_lock()) {
+                return false;
+            }
+            if (sync_stats::enabled) {
+                point_.operations.fetch_add(1, std::memory_order_relaxed);
+                point_.wait_time.record(0);
+                hold_start_ = sync_stats::clock::now();
+            }
+            return true;
+        }
+
+        void unlock() {
+            if (sync_stats::enabled) {
+                point_.hold_time.record(sync_stats::elapsed_ns(hold_start_, sync_stats::clock::now()));
+            }
+            mutex_.unlock();
+        }
+    private:
+        std::mutex mutex_;
+        sync_stats::Point point_;
+        // Only written and read by the thread that holds the mutex.
+        sync_stats::clock::time_point hold_start_{};
+    };
+}
+
+#endif
@@ -1,40 +1,67 @@
 #include <cassert>
 
 #include "ultramodern.hpp"
+#include "instance.hpp"
+#include "recomp.h"
 
-static PTR(OSThread) running_queue_impl = NULLPTR;
+namespace {
+    // Per-instance head of the running queue.
+    struct RunningQueue {
+        PTR(OSThread) head = NULLPTR;
+    };
+}
+
+static PTR(OSThread)& running_queue_head() {
+    return ultramodern::current_instance().state<RunningQueue>().head;
+}
+
+// Queue heads and the links between queued threads are read and written by their address in RDRAM, rather than through host
+// pointers, so that they're kept in RDRAM's byte order. The running queue's head is the one link that lives on the host.
+static PTR(OSThread) read_link(RDRAM_ARG PTR(PTR(OSThread)) link) {
+    if (link == ultramodern::running_queue) {
+        return running_queue_head();
+    }
+    return MEM_W(0, link);
+}
 
-static PTR(OSThread)* queue_to_ptr(RDRAM_ARG PTR(PTR(OSThread)) queue) {
-    if (queue == ultramodern::running_queue) {
-        return &running_queue_impl;
+static void write_link(RDRAM_ARG PTR(PTR(OSThread)) link, PTR(OSThread) value) {
+    if (link == ultramodern::running_queue) {
+        running_queue_head() = value;
+    }
+    else {
+        MEM_W(0, link) = value;
     }
-    return TO_PTR(PTR(OSThread), queue);
+}
+
+static PTR(PTR(OSThread)) next_link(PTR(OSThread) t) {
+    return GET_MEMBER(OSThread, t, next);
 }
 
 void ultramodern::thread_queue_insert(RDRAM_ARG PTR(PTR(OSThread)) queue_, PTR(OSThread) toadd_) {
-    PTR(OSThread)* cur = queue_to_ptr(PASS_RDRAM queue_);
+    PTR(PTR(OSThread)) cur = queue_;
+    PTR(OSThread) cur_thread = read_link(PASS_RDRAM cur);
     OSThread* toadd = TO_PTR(OSThread, toadd_); 
     debug_printf("[Thread Queue] Inserting thread %d into queue 0x%08X\n", toadd->id, (uintptr_t)queue_);
-    while (*cur && TO_PTR(OSThread, *cur)->priority > toadd->priority) {
-        cur = &TO_PTR(OSThread, *cur)->next;
+    while (cur_thread != NULLPTR && TO_PTR(OSThread, cur_thread)->priority > toadd->priority) {
+        cur = next_link(cur_thread);
+        cur_thread = read_link(PASS_RDRAM cur);
     }
-    toadd->next = (*cur);
+    toadd->next = cur_thread;
     toadd->queue = queue_;
-    *cur = toadd_;
+    write_link(PASS_RDRAM cur, toadd_);
 
     debug_printf("  Contains:");
-    cur = queue_to_ptr(PASS_RDRAM queue_);
-    while (*cur) {
-        debug_printf("%d (%d) ", TO_PTR(OSThread, *cur)->id, TO_PTR(OSThread, *cur)->priority);
-        cur = &TO_PTR(OSThread, *cur)->next;
+    cur_thread = read_link(PASS_RDRAM queue_);
+    while (cur_thread != NULLPTR) {
+        debug_printf("%d (%d) ", TO_PTR(OSThread, cur_thread)->id, TO_PTR(OSThread, cur_thread)->priority);
+        cur_thread = TO_PTR(OSThread, cur_thread)->next;
     }
     debug_printf("\n");
 }
 
 PTR(OSThread) ultramodern::thread_queue_pop(RDRAM_ARG PTR(PTR(OSThread)) queue_) {
-    PTR(OSThread)* queue = queue_to_ptr(PASS_RDRAM queue_);
-    PTR(OSThread) ret = *queue;
-    *queue = TO_PTR(OSThread, ret)->next;
+    PTR(OSThread) ret = read_link(PASS_RDRAM queue_);
+    write_link(PASS_RDRAM queue_, TO_PTR(OSThread, ret)->next);
     TO_PTR(OSThread, ret)->queue = NULLPTR;
     debug_printf("[Thread Queue] Popped thread %d from queue 0x%08X\n", TO_PTR(OSThread, ret)->id, (uintptr_t)queue_);
     return ret;
@@ -45,22 +72,20 @@ bool ultramodern::thread_queue_remove(RDRAM_ARG PTR(PTR(OSThread)) queue_, PTR(O
 
     PTR(PTR(OSThread)) cur = queue_;
     while (cur != NULLPTR) {
-        PTR(OSThread)* cur_ptr = queue_to_ptr(PASS_RDRAM queue_);
-        if (*cur_ptr == t_) {
+        PTR(OSThread) head = read_link(PASS_RDRAM queue_);
+        if (head == t_) {
             return true;
         }
-        cur = TO_PTR(OSThread, *cur_ptr)->next;
+        cur = TO_PTR(OSThread, head)->next;
     }
 
     return false;
 }
 
 bool ultramodern::thread_queue_empty(RDRAM_ARG PTR(PTR(OSThread)) queue_) {
-    PTR(OSThread)* queue = queue_to_ptr(PASS_RDRAM queue_);
-    return *queue == NULLPTR;
+    return read_link(PASS_RDRAM queue_) == NULLPTR;
 }
 
 PTR(OSThread) ultramodern::thread_queue_peek(RDRAM_ARG PTR(PTR(OSThread)) queue_) {
-    PTR(OSThread)* queue = queue_to_ptr(PASS_RDRAM queue_);
-    return *queue;
+    return read_link(PASS_RDRAM queue_);
 }
@@ -5,6 +5,9 @@
 
 #include "ultra64.h"
 #include "ultramodern.hpp"
+#include "perf_metrics.hpp"
+#include "instance.hpp"
+#include "profiler.hpp"
 #include "blockingconcurrentqueue.h"
 
 // Native APIs only used to set thread names for easier debugging
@@ -44,6 +47,8 @@ void run_thread_function(uint8_t* rdram, uint64_t addr, uint64_t sp, uint64_t ar
 
 #if defined(_WIN32)
 void ultramodern::set_native_thread_name(const std::string& name) {
+    ultramodern::perf::register_current_thread(name);
+
     std::wstring wname{name.begin(), name.end()};
 
     HRESULT r;
@@ -81,6 +86,8 @@ void ultramodern::set_native_thread_priority(ThreadPriority pri) {
 }
 #elif defined(__linux__)
 void ultramodern::set_native_thread_name(const std::string& name) {
+    ultramodern::perf::register_current_thread(name);
+
     pthread_setname_np(pthread_self(), name.c_str());
 }
 
@@ -113,8 +120,17 @@ void ultramodern::set_native_thread_priority(ThreadPriority pri) {
 }
 #endif
 
-std::atomic_int temporary_threads = 0;
-std::atomic_int permanent_threads = 0;
+namespace {
+    // Per-instance counts of running game threads, which quicksaving uses to tell when every thread has paused.
+    struct ThreadCounts {
+        std::atomic_int temporary_threads = 0;
+        std::atomic_int permanent_threads = 0;
+    };
+}
+
+static ThreadCounts& thread_counts() {
+    return ultramodern::current_instance().state<ThreadCounts>();
+}
 
 void wait_for_resumed(RDRAM_ARG UltraThreadContext* thread_context) {
     TO_PTR(OSThread, ultramodern::this_thread())->context->running.wait();
@@ -161,13 +177,14 @@ static void _thread_func(RDRAM_ARG PTR(OSThread) self_, PTR(thread_func_t) entry
     // Set the thread name
     ultramodern::set_native_thread_name("Game Thread " + std::to_string(self->id));
     ultramodern::set_native_thread_priority(ultramodern::ThreadPriority::High);
+    ultramodern::profiler::register_current_thread("Game Thread " + std::to_string(self->id));
 
     // TODO fix these being hardcoded (this is only used for quicksaving)
     if ((self->id == 2 && self->priority == 5) || self->id == 13) { // slowly, flashrom
-        temporary_threads.fetch_add(1);
+        thread_counts().temporary_threads.fetch_add(1);
     }
     else if (self->id != 1 && self->id != 2) { // ignore idle and fault
-        permanent_threads.fetch_add(1);
+        thread_counts().permanent_threads.fetch_add(1);
     }
 
     // Signal the initialized semaphore to indicate that this thread can be started.
@@ -203,16 +220,16 @@ static void _thread_func(RDRAM_ARG PTR(OSThread) self_, PTR(thread_func_t) entry
     
     // TODO fix these being hardcoded (this is only used for quicksaving)
     if ((self->id == 2 && self->priority == 5) || self->id == 13) { // slowly, flashrom
-        temporary_threads.fetch_sub(1);
+        thread_counts().temporary_threads.fetch_sub(1);
     }
 }
 
 uint32_t ultramodern::permanent_thread_count() {
-    return permanent_threads.load();
+    return thread_counts().permanent_threads.load();
 }
 
 uint32_t ultramodern::temporary_thread_count() {
-    return temporary_threads.load();
+    return thread_counts().temporary_threads.load();
 }
 
 extern "C" void osStartThread(RDRAM_ARG PTR(OSThread) t_) {
@@ -251,7 +268,7 @@ extern "C" void osCreateThread(RDRAM_ARG PTR(OSThread) t_, OSId id, PTR(thread_f
     // Spawn a new thread, which will immediately pause itself and wait until it's been started.
     // Pass the context as an argument to the thread function to ensure that it can't get cleared before the thread captures its value.
     t->context = new UltraThreadContext{};
-    t->context->host_thread = std::thread{_thread_func, PASS_RDRAM t_, entrypoint, arg, t->context};
+    t->context->host_thread = ultramodern::create_instance_thread(_thread_func, PASS_RDRAM t_, entrypoint, arg, t->context);
 }
 
 extern "C" void osStopThread(RDRAM_ARG PTR(OSThread) t_) {
@@ -316,15 +333,26 @@ PTR(OSThread) ultramodern::this_thread() {
     return thread_self;
 }
 
-static std::thread thread_cleaner_thread;
-static moodycamel::BlockingConcurrentQueue<UltraThreadContext*> deleted_threads{};
-extern std::atomic_bool exited;
+namespace {
+    // Per-instance queue of exited game threads waiting to be joined.
+    struct ThreadCleanerContext {
+        std::thread thread;
+        moodycamel::BlockingConcurrentQueue<UltraThreadContext*> deleted_threads{};
+    };
+}
+
+static ThreadCleanerContext& thread_cleaner_context() {
+    return ultramodern::current_instance().state<ThreadCleanerContext>();
+}
 
 void thread_cleaner_func() {
-    using namespace std::chrono_literals;
-    while (!exited) {
+    ThreadCleanerContext& cleaner = thread_cleaner_context();
+    while (!ultramodern::quit_requested()) {
         UltraThreadContext* to_delete;
-        if (deleted_threads.wait_dequeue_timed(to_delete, 10ms)) {
+        cleaner.deleted_threads.wait_dequeue(to_delete);
+
+        // A null context is sent on quit to wake this thread up.
+        if (to_delete != nullptr) {
             debug_printf("[Cleanup] Deleting thread context %p\n", to_delete);
 
             to_delete->host_thread.join();
@@ -334,13 +362,17 @@ void thread_cleaner_func() {
 }
 
 void ultramodern::init_thread_cleanup() {
-    thread_cleaner_thread = std::thread{thread_cleaner_func};
+    thread_cleaner_context().thread = ultramodern::create_instance_thread(thread_cleaner_func);
 }
 
 void ultramodern::cleanup_thread(UltraThreadContext *cur_context) {
-    deleted_threads.enqueue(cur_context);
+    thread_cleaner_context().deleted_threads.enqueue(cur_context);
+}
+
+void ultramodern::wake_thread_cleaner_thread() {
+    thread_cleaner_context().deleted_threads.enqueue(nullptr);
 }
 
 void ultramodern::join_thread_cleaner_thread() {
-    thread_cleaner_thread.join();
+    thread_cleaner_context().thread.join();
 }
@@ -1,10 +1,14 @@
 #include <thread>
-#include <variant>
-#include <set>
-#include "blockingconcurrentqueue.h"
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include "ultra64.h"
 #include "ultramodern.hpp"
+#include "sync_stats.hpp"
+#include "instance.hpp"
+#include "tsc_clock.hpp"
+#include "timer_heap.hpp"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -13,34 +17,48 @@
 
 // Start time for the program
 static std::chrono::high_resolution_clock::time_point start_time = std::chrono::high_resolution_clock::now();
+// Start time on the monotonic clock, which the counter is measured against as high_resolution_clock may follow the system clock.
+static std::chrono::steady_clock::time_point counter_start_time = std::chrono::steady_clock::now();
 // Game speed multiplier (1 means no speedup)
 constexpr uint32_t speed_multiplier = 1;
 // N64 CPU counter ticks per millisecond
 constexpr uint32_t counter_per_ms = 46'875 * speed_multiplier;
 
 struct OSTimer {
-    PTR(OSTimer) unused1;
-    PTR(OSTimer) unused2;
-    OSTime interval;
-    OSTime timestamp;
-    PTR(OSMesgQueue) mq;
-    OSMesg msg;
-};
-
-struct AddTimerAction {
-    PTR(OSTimer) timer;
+    RDRAM_FIELD(PTR(OSTimer)) unused1;
+    RDRAM_FIELD(PTR(OSTimer)) unused2;
+    RDRAM_FIELD(OSTime) interval;
+    RDRAM_FIELD(OSTime) timestamp;
+    RDRAM_FIELD(PTR(OSMesgQueue)) mq;
+    RDRAM_FIELD(OSMesg) msg;
 };
 
-struct RemoveTimerAction {
+// The guest timer's message, cached alongside its deadline so firing it doesn't read RDRAM.
+struct GuestTimer : ultramodern::TimerNode {
     PTR(OSTimer) timer;
+    PTR(OSMesgQueue) mq;
+    OSMesg msg;
 };
 
-using Action = std::variant<AddTimerAction, RemoveTimerAction>;
+namespace {
+    // Per-instance timer state.
+    struct TimerContext {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cond;
+        ultramodern::TimerSet<PTR(OSTimer), GuestTimer> armed;
+        // Bumped whenever a timer is armed or stopped, which lets the timer thread notice a change to the earliest deadline
+        // while it's spinning without the lock.
+        std::atomic<uint32_t> generation = 0;
+        // Set when the instance shuts down to make the timer thread exit.
+        bool stopping = false;
+        ultramodern::sync_stats::Point heap_stats{ "timer_queue", ultramodern::sync_stats::Point::Kind::Queue };
+    };
+}
 
-struct {
-    std::thread thread;
-    moodycamel::BlockingConcurrentQueue<Action> action_queue{};
-} timer_context;
+static TimerContext& timer_context() {
+    return ultramodern::current_instance().state<TimerContext>();
+}
 
 uint64_t duration_to_ticks(std::chrono::high_resolution_clock::duration duration) {
     uint64_t delta_micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
@@ -60,87 +78,150 @@ std::chrono::high_resolution_clock::time_point ticks_to_timepoint(uint64_t ticks
     return start_time + ticks_to_duration(ticks);
 }
 
-uint64_t time_now() {
-    return duration_to_ticks(std::chrono::high_resolution_clock::now() - start_time);
+// Reads the monotonic clock in counter ticks. Unlike duration_to_ticks this keeps sub-microsecond precision, which the TSC
+// calibration needs to get a usable rate out of a short measurement.
+static uint64_t reference_ticks_now() {
+    uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - counter_start_time).count();
+    return (nanos / 1'000'000) * counter_per_ms + (nanos % 1'000'000) * counter_per_ms / 1'000'000;
 }
 
-void timer_thread(RDRAM_ARG1) {
-    ultramodern::set_native_thread_name("Timer Thread");
-    ultramodern::set_native_thread_priority(ultramodern::ThreadPriority::VeryHigh);
+#ifdef ULTRAMODERN_HAS_TSC
 
-    // Lambda comparator function to keep the set ordered
-    auto timer_sort = [PASS_RDRAM1](PTR(OSTimer) a_, PTR(OSTimer) b_) {
-        OSTimer* a = TO_PTR(OSTimer, a_);
-        OSTimer* b = TO_PTR(OSTimer, b_);
+static ultramodern::tsc::Clock tsc_clock{};
+// Only accessed by the thread refining the calibration.
+static ultramodern::tsc::Calibration tsc_calibration{};
+static uint64_t tsc_per_second = 0;
 
-        // Order by timestamp if the timers have different timestamps
-        if (a->timestamp != b->timestamp) {
-            return a->timestamp < b->timestamp;
-        }
+// Reads the TSC and the reference clock as close together as possible, using the TSC value halfway between two reads.
+static void sample_tsc_and_reference(uint64_t& tsc_out, uint64_t& ticks_out) {
+    uint64_t before = ultramodern::tsc::read();
+    ticks_out = reference_ticks_now();
+    uint64_t after = ultramodern::tsc::read();
+    tsc_out = before + (after - before) / 2;
+}
 
-        // If they have the exact same timestamp then order by address instead
-        return a < b;
-    };
+static void calibrate_tsc_clock() {
+    if (!ultramodern::tsc::is_invariant()) {
+        return;
+    }
 
-    // Ordered set of timers that are currently active
-    std::set<PTR(OSTimer), decltype(timer_sort)> active_timers{timer_sort};
-    
-    // Lambda to process a timer action to handle adding and removing timers
-    auto process_timer_action = [&](const Action& action) {
-        // Determine the action type and act on it
-        if (const auto* add_action = std::get_if<AddTimerAction>(&action)) {
-            active_timers.insert(add_action->timer);
-        } else if (const auto* remove_action = std::get_if<RemoveTimerAction>(&action)) {
-            active_timers.erase(remove_action->timer);
-        }
-    };
+    uint64_t tsc_start, tsc_end, ticks_start, ticks_end;
+    sample_tsc_and_reference(tsc_start, ticks_start);
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+    sample_tsc_and_reference(tsc_end, ticks_end);
 
-    while (true) {
-        // Empty the action queue
-        Action cur_action;
-        while (timer_context.action_queue.try_dequeue(cur_action)) {
-            process_timer_action(cur_action);
-        }
+    ultramodern::tsc::Params params;
+    if (!ultramodern::tsc::calibrate(tsc_start, ticks_start, tsc_end, ticks_end, tsc_calibration, params)) {
+        return;
+    }
 
-        // If there's no timer to act on, wait for one to come in from the action queue
-        while (active_timers.empty()) {
-            timer_context.action_queue.wait_dequeue(cur_action);
-            process_timer_action(cur_action);
-        }
+    tsc_per_second = uint64_t(double(tsc_end - tsc_start) * (1000.0 * counter_per_ms) / double(ticks_end - ticks_start));
+    tsc_clock.publish(params);
+    tsc_clock.enable();
+}
 
-        // Get the timer that's closest to running out
-        PTR(OSTimer) cur_timer_ = *active_timers.begin();
-        OSTimer* cur_timer = TO_PTR(OSTimer, cur_timer_);
+void ultramodern::refine_clock_calibration() {
+    if (!tsc_clock.enabled()) {
+        return;
+    }
+
+    if (int64_t(ultramodern::tsc::read() - tsc_calibration.last_tsc) < int64_t(tsc_per_second)) {
+        return;
+    }
 
-        // Remove the timer from the queue (it may get readded if waiting is interrupted)
-        active_timers.erase(cur_timer_);
+    uint64_t tsc_sample, ticks_sample;
+    sample_tsc_and_reference(tsc_sample, ticks_sample);
+    tsc_clock.publish(ultramodern::tsc::refine(tsc_calibration, tsc_clock.load(), tsc_sample, ticks_sample));
+}
 
-        // Determine how long to wait to reach the timer's timestamp
-        auto wait_duration = ticks_to_timepoint(cur_timer->timestamp) - std::chrono::high_resolution_clock::now();
+uint64_t time_now() {
+    if (tsc_clock.enabled()) {
+        return tsc_clock.now();
+    }
+    return reference_ticks_now();
+}
 
-        // Wait for either the duration to complete or a new action to come through
-        if (wait_duration.count() >= 0 && timer_context.action_queue.wait_dequeue_timed(cur_action, wait_duration)) {
-            // Timer was interrupted by a new action 
-            // Add the current timer back to the queue (done first in case the action is to remove this timer)
-            active_timers.insert(cur_timer_);
-            // Process the new action
-            process_timer_action(cur_action);
+#else
+
+static void calibrate_tsc_clock() {}
+
+void ultramodern::refine_clock_calibration() {}
+
+uint64_t time_now() {
+    return reference_ticks_now();
+}
+
+#endif
+
+void timer_thread(RDRAM_ARG1) {
+    ultramodern::set_native_thread_name("Timer Thread");
+    ultramodern::set_native_thread_priority(ultramodern::ThreadPriority::VeryHigh);
+    ultramodern::minimize_timer_slack();
+
+    ultramodern::DeadlineSleeper sleeper{};
+    TimerContext& timers = timer_context();
+    std::unique_lock lock{ timers.mutex };
+
+    while (!timers.stopping) {
+        // If there's no timer to act on, wait for one to be armed.
+        if (timers.armed.empty()) {
+            timers.cond.wait(lock);
+            continue;
         }
-        else {
-            // Waiting for the timer completed, so send the timer's message to its message queue
-            osSendMesg(PASS_RDRAM cur_timer->mq, cur_timer->msg, OS_MESG_NOBLOCK);
-            // If the timer has a specified interval then reload it with that value
-            if (cur_timer->interval != 0) {
-                cur_timer->timestamp = cur_timer->interval + time_now();
-                active_timers.insert(cur_timer_);
+
+        // Wait until the earliest timer's deadline. Arming or stopping a timer wakes this thread so that it can recheck the earliest timer.
+        GuestTimer* cur_timer = timers.armed.earliest();
+        uint64_t now = time_now();
+        if (cur_timer->deadline > now) {
+            // The deadline is converted relative to the current time, as the counter may come from a different clock than high_resolution_clock.
+            auto deadline = std::chrono::high_resolution_clock::now() + ticks_to_duration(cur_timer->deadline - now);
+            auto wait_target = deadline - sleeper.spin_window();
+            if (wait_target > std::chrono::high_resolution_clock::now()) {
+                if (timers.cond.wait_until(lock, wait_target) == std::cv_status::timeout) {
+                    sleeper.record_wakeup(wait_target, std::chrono::high_resolution_clock::now());
+                }
+            }
+            else {
+                // Close enough to the deadline to spin the rest of the way. The lock is released so timers can still be armed and stopped meanwhile,
+                // and the spin ends early if that happens so that a timer armed with an earlier deadline isn't fired late.
+                uint32_t generation = timers.generation.load(std::memory_order_relaxed);
+                lock.unlock();
+                sleeper.spin_until(deadline, timers.generation, generation);
+                lock.lock();
             }
+            continue;
+        }
+
+        GuestTimer& fired = timers.armed.fire(now);
+        PTR(OSMesgQueue) mq = fired.mq;
+        OSMesg msg = fired.msg;
+        if (fired.queued()) {
+            TO_PTR(OSTimer, fired.timer)->timestamp = fired.deadline;
         }
+        else {
+            ultramodern::sync_stats::on_depth(timers.heap_stats, timers.armed.size());
+        }
+
+        // Send the timer's message to its message queue without holding the lock, as that may wake and run other threads.
+        lock.unlock();
+        osSendMesg(PASS_RDRAM mq, msg, OS_MESG_NOBLOCK);
+        lock.lock();
     }
 }
 
 void ultramodern::init_timers(RDRAM_ARG1) {
-    timer_context.thread = std::thread{ timer_thread, PASS_RDRAM1 };
-    timer_context.thread.detach();
+    calibrate_tsc_clock();
+    timer_context().thread = ultramodern::create_instance_thread(timer_thread, PASS_RDRAM1);
+}
+
+void ultramodern::join_timer_thread() {
+    TimerContext& timers = timer_context();
+    {
+        std::lock_guard lock{ timers.mutex };
+        timers.stopping = true;
+    }
+    timers.cond.notify_one();
+    timers.thread.join();
 }
 
 uint32_t ultramodern::get_speed_multiplier() {
@@ -172,25 +253,51 @@ extern "C" int osSetTimer(RDRAM_ARG PTR(OSTimer) t_, OSTime countdown, OSTime in
     OSTimer* t = TO_PTR(OSTimer, t_);
 
     // Determine the time when this timer will trigger off
+    uint64_t deadline;
     if (countdown == 0) {
         // Set the timestamp based on the interval
-        t->timestamp = interval + time_now();
+        deadline = interval + time_now();
     } else {
-        t->timestamp = countdown + time_now();
+        deadline = countdown + time_now();
     }
+    t->timestamp = deadline;
     t->interval = interval;
     t->mq = mq;
     t->msg = msg;
 
-    timer_context.action_queue.enqueue(AddTimerAction{ t_ });
+    TimerContext& timers = timer_context();
+    {
+        std::lock_guard lock{ timers.mutex };
+        // Setting a timer that's already armed rearms it with the new values.
+        size_t armed_count = timers.armed.size();
+        GuestTimer& node = timers.armed.arm(t_, deadline, interval);
+        node.timer = t_;
+        node.mq = mq;
+        node.msg = msg;
+        if (timers.armed.size() != armed_count) {
+            ultramodern::sync_stats::on_depth(timers.heap_stats, timers.armed.size());
+        }
+        timers.generation.fetch_add(1, std::memory_order_release);
+    }
+    timers.cond.notify_one();
 
     return 0;
 }
 
 extern "C" int osStopTimer(RDRAM_ARG PTR(OSTimer) t_) {
-    timer_context.action_queue.enqueue(RemoveTimerAction{ t_ });
+    TimerContext& timers = timer_context();
+    {
+        std::lock_guard lock{ timers.mutex };
+        // Stopping a timer that isn't armed fails, matching libultra.
+        if (!timers.armed.stop(t_)) {
+            return -1;
+        }
+
+        ultramodern::sync_stats::on_depth(timers.heap_stats, timers.armed.size());
+        timers.generation.fetch_add(1, std::memory_order_release);
+    }
+    timers.cond.notify_one();
 
-    // TODO don't blindly return 0 here; requires some response from the timer thread to know what the returned value was
     return 0;
 }
 
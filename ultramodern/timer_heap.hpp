@@ -0,0 +1,171 @@
+#ifndef __TIMER_HEAP_HPP__
+#define __TIMER_HEAP_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace ultramodern {
+    // Host-side state for a timer. The deadline is cached here so ordering timers never touches RDRAM.
+    struct TimerNode {
+        static constexpr uint32_t not_queued = UINT32_MAX;
+
+        uint64_t deadline = 0;
+        uint64_t interval = 0;
+        uint64_t sequence = 0;
+        uint32_t heap_index = not_queued;
+
+        bool queued() const { return heap_index != not_queued; }
+    };
+
+    // 4-ary min-heap of armed timers ordered by deadline, with ties broken by the order the timers were armed in.
+    // Each node tracks its own position in the heap so that a timer can be removed or rearmed in O(log n).
+    class TimerHeap {
+        static constexpr uint32_t arity = 4;
+        std::vector<TimerNode*> nodes_{};
+
+        static bool before(const TimerNode* a, const TimerNode* b) {
+            if (a->deadline != b->deadline) {
+                return a->deadline < b->deadline;
+            }
+            return a->sequence < b->sequence;
+        }
+
+        void place(uint32_t index, TimerNode* node) {
+            nodes_[index] = node;
+            node->heap_index = index;
+        }
+
+        void sift_up(uint32_t index) {
+            TimerNode* node = nodes_[index];
+            while (index > 0) {
+                uint32_t parent = (index - 1) / arity;
+                if (!before(node, nodes_[parent])) {
+                    break;
+                }
+                place(index, nodes_[parent]);
+                index = parent;
+            }
+            place(index, node);
+        }
+
+        void sift_down(uint32_t index) {
+            TimerNode* node = nodes_[index];
+            uint32_t count = uint32_t(nodes_.size());
+            while (true) {
+                uint32_t first_child = index * arity + 1;
+                if (first_child >= count) {
+                    break;
+                }
+                uint32_t last_child = std::min(first_child + arity, count);
+                uint32_t best_child = first_child;
+                for (uint32_t child = first_child + 1; child < last_child; child++) {
+                    if (before(nodes_[child], nodes_[best_child])) {
+                        best_child = child;
+                    }
+                }
+                if (!before(nodes_[best_child], node)) {
+                    break;
+                }
+                place(index, nodes_[best_child]);
+                index = best_child;
+            }
+            place(index, node);
+        }
+    public:
+        TimerHeap() {
+            nodes_.reserve(64);
+        }
+
+        bool empty() const { return nodes_.empty(); }
+        size_t size() const { return nodes_.size(); }
+        TimerNode* top() const { return nodes_.front(); }
+
+        void push(TimerNode* node) {
+            nodes_.push_back(node);
+            sift_up(uint32_t(nodes_.size() - 1));
+        }
+
+        void remove(TimerNode* node) {
+            uint32_t index = node->heap_index;
+            TimerNode* last = nodes_.back();
+            nodes_.pop_back();
+            node->heap_index = TimerNode::not_queued;
+
+            if (last != node) {
+                place(index, last);
+                // The moved node may belong either above or below its new position.
+                sift_up(index);
+                sift_down(last->heap_index);
+            }
+        }
+
+        // Restores heap order after the given node's deadline was changed.
+        void update(TimerNode* node) {
+            sift_up(node->heap_index);
+            sift_down(node->heap_index);
+        }
+    };
+
+    // The timers of an instance, keyed by the address of the guest timer. `Node` derives from TimerNode and holds whatever
+    // the caller needs when a timer fires. Nodes are created the first time a timer is armed and reused from then on, so
+    // arming, firing and stopping timers doesn't allocate once every timer the game uses has been seen, and a node stays
+    // valid for as long as the set does.
+    template <typename Key, typename Node>
+    class TimerSet {
+        TimerHeap heap_{};
+        std::unordered_map<Key, Node> nodes_{};
+        uint64_t next_sequence_ = 0;
+    public:
+        bool empty() const { return heap_.empty(); }
+        size_t size() const { return heap_.size(); }
+        Node* earliest() const { return static_cast<Node*>(heap_.top()); }
+
+        // Arms the timer, or rearms it with the new deadline and interval if it's already armed. The returned node is
+        // for the caller to fill in the rest of.
+        Node& arm(Key key, uint64_t deadline, uint64_t interval) {
+            Node& node = nodes_.try_emplace(key).first->second;
+            node.deadline = deadline;
+            node.interval = interval;
+            node.sequence = next_sequence_++;
+            if (node.queued()) {
+                heap_.update(&node);
+            }
+            else {
+                heap_.push(&node);
+            }
+            return node;
+        }
+
+        // Returns false if the timer isn't armed, as stopping it fails in libultra.
+        bool stop(Key key) {
+            auto find_it = nodes_.find(key);
+            if (find_it == nodes_.end() || !find_it->second.queued()) {
+                return false;
+            }
+            heap_.remove(&find_it->second);
+            return true;
+        }
+
+        // Fires the earliest timer, whose deadline has passed by `now`. A timer with an interval is reloaded relative to
+        // its previous deadline so periodic timers don't drift. One that has fallen more than an interval behind (e.g.
+        // after the process was suspended) is resynchronized to `now` instead of firing repeatedly to catch up.
+        Node& fire(uint64_t now) {
+            Node& node = *earliest();
+            if (node.interval != 0) {
+                node.deadline += node.interval;
+                if (node.deadline + node.interval <= now) {
+                    node.deadline = now + node.interval;
+                }
+                heap_.update(&node);
+            }
+            else {
+                heap_.remove(&node);
+            }
+            return node;
+        }
+    };
+}
+
+#endif
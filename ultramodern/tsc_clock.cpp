@@ -0,0 +1,79 @@
+#include "tsc_clock.hpp"
+
+#if defined(ULTRAMODERN_HAS_TSC) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+static uint64_t rate_to_fixed(double ticks_per_tsc) {
+    return uint64_t(ticks_per_tsc * double(1ULL << ultramodern::tsc::fixed_shift));
+}
+
+bool ultramodern::tsc::calibrate(uint64_t tsc_start, uint64_t ref_start, uint64_t tsc_end, uint64_t ref_end, Calibration& calibration_out, Params& params_out) {
+    if (tsc_end <= tsc_start || ref_end <= ref_start) {
+        return false;
+    }
+
+    double ticks_per_tsc = double(ref_end - ref_start) / double(tsc_end - tsc_start);
+    calibration_out = Calibration{
+        .origin_tsc = tsc_start,
+        .origin_ref_ticks = ref_start,
+        .last_tsc = tsc_end,
+        .last_ref_ticks = ref_end,
+        .ticks_per_tsc = ticks_per_tsc,
+    };
+    params_out = Params{
+        .base_tsc = tsc_end,
+        .base_ticks = ref_end,
+        .ticks_per_tsc_fixed = rate_to_fixed(ticks_per_tsc),
+    };
+    return true;
+}
+
+ultramodern::tsc::Params ultramodern::tsc::refine(Calibration& calibration, const Params& current, uint64_t tsc_sample, uint64_t ref_sample) {
+    // Samples that went backwards can't be measured against, so just keep the current parameters.
+    if (tsc_sample <= calibration.last_tsc || ref_sample <= calibration.last_ref_ticks) {
+        return current;
+    }
+
+    double measured_rate = double(ref_sample - calibration.origin_ref_ticks) / double(tsc_sample - calibration.origin_tsc);
+    calibration.ticks_per_tsc = std::clamp(measured_rate,
+        calibration.ticks_per_tsc * (1.0 - max_rate_step), calibration.ticks_per_tsc * (1.0 + max_rate_step));
+
+    // Slew away the offset from the reference over roughly the same interval as the one since the last refinement.
+    uint64_t current_ticks = ticks_at(current, tsc_sample);
+    double offset_ticks = double(ref_sample) - double(current_ticks);
+    double interval_ticks = double(ref_sample - calibration.last_ref_ticks);
+    double correction = std::clamp(offset_ticks / interval_ticks, -max_slew, max_slew);
+
+    calibration.last_tsc = tsc_sample;
+    calibration.last_ref_ticks = ref_sample;
+
+    return Params{
+        .base_tsc = tsc_sample,
+        .base_ticks = current_ticks,
+        .ticks_per_tsc_fixed = rate_to_fixed(calibration.ticks_per_tsc * (1.0 + correction)),
+    };
+}
+
+#ifdef ULTRAMODERN_HAS_TSC
+
+bool ultramodern::tsc::is_invariant() {
+    // CPUID leaf 0x80000007 EDX bit 8 reports an invariant TSC.
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0x80000000);
+    if (uint32_t(regs[0]) < 0x80000007) {
+        return false;
+    }
+    __cpuid(regs, 0x80000007);
+    return (regs[3] & (1 << 8)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (edx & (1 << 8)) != 0;
+#endif
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef __TSC_CLOCK_HPP__
+#define __TSC_CLOCK_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ULTRAMODERN_HAS_TSC
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Clock source that converts the CPU's timestamp counter directly to N64 counter ticks, used when the TSC runs at a constant
+// rate regardless of power state. The conversion is a fixed-point multiply and shift relative to a base TSC value, and is
+// calibrated against a reference clock that's already in counter ticks. The calibration math doesn't touch the TSC itself,
+// so it can be driven with simulated samples.
+namespace ultramodern {
+    namespace tsc {
+        constexpr uint32_t fixed_shift = 32;
+        // Largest change a single refinement may make to the measured rate, as a fraction of it. This keeps one bad sample
+        // of the reference clock (e.g. taken right after the process was suspended) from throwing the rate off.
+        constexpr double max_rate_step = 20e-6;
+        // Largest amount the rate may be sped up or slowed down by to steer the clock back to the reference. This keeps the
+        // clock from ever stopping or running backwards.
+        constexpr double max_slew = 0.001;
+
+        struct Params {
+            uint64_t base_tsc;
+            uint64_t base_ticks;
+            uint64_t ticks_per_tsc_fixed; // 32.32 fixed point
+        };
+
+        // State kept between refinements by the thread refining the calibration.
+        struct Calibration {
+            uint64_t origin_tsc;
+            uint64_t origin_ref_ticks;
+            uint64_t last_tsc;
+            uint64_t last_ref_ticks;
+            // Measured rate, not including the slew applied to the published parameters.
+            double ticks_per_tsc;
+        };
+
+        // (value * fixed) >> fixed_shift from 32-bit partial products, for targets without a 128-bit multiply such as 32-bit x86.
+        inline uint64_t mul_shift_fixed_portable(uint64_t value, uint64_t fixed) {
+            uint64_t value_low = uint32_t(value);
+            uint64_t value_high = value >> 32;
+            uint64_t fixed_low = uint32_t(fixed);
+            uint64_t fixed_high = fixed >> 32;
+
+            uint64_t low_low = value_low * fixed_low;
+            uint64_t low_high = value_low * fixed_high;
+            uint64_t high_low = value_high * fixed_low;
+            uint64_t high_high = value_high * fixed_high;
+
+            // Bits 32 to 95 of the product, which is what's left after shifting by 32.
+            uint64_t middle = (low_low >> 32) + uint32_t(low_high) + uint32_t(high_low);
+            uint64_t high = high_high + (low_high >> 32) + (high_low >> 32) + (middle >> 32);
+            static_assert(fixed_shift == 32);
+            return (high << 32) | uint32_t(middle);
+        }
+
+        inline uint64_t mul_shift_fixed(uint64_t value, uint64_t fixed) {
+#if defined(_MSC_VER) && defined(_M_X64)
+            uint64_t high;
+            uint64_t low = _umul128(value, fixed, &high);
+            return __shiftright128(low, high, fixed_shift);
+#elif defined(__SIZEOF_INT128__)
+            return uint64_t((unsigned __int128)value * fixed >> fixed_shift);
+#else
+            return mul_shift_fixed_portable(value, fixed);
+#endif
+        }
+
+        inline uint64_t ticks_at(const Params& params, uint64_t tsc) {
+            // Another core's TSC can read slightly behind the base published from the refining thread, which would wrap around
+            // to a huge unsigned delta. Such reads are clamped to the base instead.
+            int64_t delta = std::max<int64_t>(int64_t(tsc - params.base_tsc), 0);
+            return params.base_ticks + mul_shift_fixed(uint64_t(delta), params.ticks_per_tsc_fixed);
+        }
+
+        // Sets up the initial calibration from two samples of the TSC and the reference clock. Returns false if the samples
+        // can't be used.
+        bool calibrate(uint64_t tsc_start, uint64_t ref_start, uint64_t tsc_end, uint64_t ref_end, Calibration& calibration_out, Params& params_out);
+
+        // Returns the parameters to publish after taking a new sample of the TSC and the reference clock. The rate is measured
+        // over everything since the initial calibration, which gets more accurate the longer the game runs, but each call
+        // only moves it by up to max_rate_step. The new parameters start from the current value of the clock so it stays
+        // continuous, and any offset from the reference is slewed away over the next refinement interval.
+        Params refine(Calibration& calibration, const Params& current, uint64_t tsc_sample, uint64_t ref_sample);
+
+#ifdef ULTRAMODERN_HAS_TSC
+        bool is_invariant();
+
+        inline uint64_t read() {
+            return __rdtsc();
+        }
+
+        // Published clock parameters. They're updated through a sequence lock so that refining them never blocks readers.
+        class Clock {
+        public:
+            bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+            void enable() { enabled_.store(true, std::memory_order_release); }
+
+            Params load() const {
+                uint32_t sequence;
+                Params params;
+                do {
+                    sequence = sequence_.load(std::memory_order_acquire);
+                    params.base_tsc = base_tsc_.load(std::memory_order_relaxed);
+                    params.base_ticks = base_ticks_.load(std::memory_order_relaxed);
+                    params.ticks_per_tsc_fixed = ticks_per_tsc_fixed_.load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                } while ((sequence & 1) != 0 || sequence != sequence_.load(std::memory_order_relaxed));
+                return params;
+            }
+
+            uint64_t now() const {
+                Params params = load();
+                return ticks_at(params, read());
+            }
+
+            void publish(const Params& params) {
+                uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+                sequence_.store(sequence + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                base_tsc_.store(params.base_tsc, std::memory_order_relaxed);
+                base_ticks_.store(params.base_ticks, std::memory_order_relaxed);
+                ticks_per_tsc_fixed_.store(params.ticks_per_tsc_fixed, std::memory_order_relaxed);
+                sequence_.store(sequence + 2, std::memory_order_release);
+            }
+        private:
+            std::atomic_bool enabled_ = false;
+            std::atomic<uint32_t> sequence_ = 0;
+            std::atomic<uint64_t> base_tsc_ = 0;
+            std::atomic<uint64_t> base_ticks_ = 0;
+            std::atomic<uint64_t> ticks_per_tsc_fixed_ = 0;
+        };
+#endif
+    }
+}
+
+#endif
@@ -48,6 +48,15 @@ typedef uint8_t u8;
 #define NULL (PTR(void) 0)
 #endif
 
+// Fields of the structs below that live in RDRAM. In big-endian RDRAM builds (see recomp_rdram.h) the host has to byteswap
+// them on access, which the BigEndian wrapper does.
+#if defined(RECOMP_RDRAM_BIG_ENDIAN) && defined(__cplusplus)
+#  include "recomp_rdram.h"
+#  define RDRAM_FIELD(type) recomp::rdram::Value<type>
+#else
+#  define RDRAM_FIELD(type) type
+#endif
+
 #define OS_MESG_NOBLOCK     0
 #define OS_MESG_BLOCK       1
 
@@ -93,56 +102,61 @@ typedef enum {
 } OSThreadState;
 
 typedef struct OSThread_t {
-    PTR(struct OSThread_t) next; // Next thread in the given queue
-    OSPri priority;
-    PTR(PTR(struct OSThread_t)) queue; // Queue this thread is in, if any
-    uint32_t pad2;
+    RDRAM_FIELD(PTR(struct OSThread_t)) next; // Next thread in the given queue
+    RDRAM_FIELD(OSPri) priority;
+    RDRAM_FIELD(PTR(PTR(struct OSThread_t))) queue; // Queue this thread is in, if any
+    RDRAM_FIELD(uint32_t) pad2;
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+    RDRAM_FIELD(uint16_t) state;
+    RDRAM_FIELD(uint16_t) flags;
+#else
     uint16_t flags; // These two are swapped to reflect rdram byteswapping
     uint16_t state;
-    OSId id;
-    int32_t pad3;
+#endif
+    RDRAM_FIELD(OSId) id;
+    RDRAM_FIELD(int32_t) pad3;
     UltraThreadContext* context; // An actual pointer regardless of platform
-    int32_t sp;
+    RDRAM_FIELD(int32_t) sp;
 } OSThread;
 
 typedef u32 OSEvent;
 typedef PTR(void) OSMesg;
 
 typedef struct OSMesgQueue {
-    PTR(OSThread) blocked_on_recv; /* Linked list of threads blocked on receiving from this queue */
-    PTR(OSThread) blocked_on_send; /* Linked list of threads blocked on sending to this queue */ 
-    s32 validCount;                /* Number of messages in the queue */
-    s32 first;                     /* Index of the first message in the ring buffer */
-    s32 msgCount;                  /* Size of message buffer */
-    PTR(OSMesg) msg;               /* Pointer to circular buffer to store messages */
+    RDRAM_FIELD(PTR(OSThread)) blocked_on_recv; /* Linked list of threads blocked on receiving from this queue */
+    RDRAM_FIELD(PTR(OSThread)) blocked_on_send; /* Linked list of threads blocked on sending to this queue */ 
+    RDRAM_FIELD(s32) validCount;                /* Number of messages in the queue */
+    RDRAM_FIELD(s32) first;                     /* Index of the first message in the ring buffer */
+    RDRAM_FIELD(s32) msgCount;                  /* Size of message buffer */
+    RDRAM_FIELD(PTR(OSMesg)) msg;               /* Pointer to circular buffer to store messages */
 } OSMesgQueue;
 
 // RSP
 
 typedef struct {
-    u32	type;
-    u32	flags;
+    RDRAM_FIELD(u32)	type;
+    RDRAM_FIELD(u32)	flags;
 
-    PTR(u64) ucode_boot;
-    u32	ucode_boot_size;
+    RDRAM_FIELD(PTR(u64)) ucode_boot;
+    RDRAM_FIELD(u32)	ucode_boot_size;
 
-    PTR(u64) ucode;
-    u32	ucode_size;
+    RDRAM_FIELD(PTR(u64)) ucode;
+    RDRAM_FIELD(u32)	ucode_size;
 
-    PTR(u64) ucode_data;
-    u32	ucode_data_size;
+    RDRAM_FIELD(PTR(u64)) ucode_data;
+    RDRAM_FIELD(u32)	ucode_data_size;
 
-    PTR(u64) dram_stack;
-    u32	dram_stack_size;
+    RDRAM_FIELD(PTR(u64)) dram_stack;
+    RDRAM_FIELD(u32)	dram_stack_size;
 
-    PTR(u64) output_buff;
-    PTR(u64) output_buff_size;
+    RDRAM_FIELD(PTR(u64)) output_buff;
+    RDRAM_FIELD(PTR(u64)) output_buff_size;
 
-    PTR(u64) data_ptr;
-    u32	data_size;
+    RDRAM_FIELD(PTR(u64)) data_ptr;
+    RDRAM_FIELD(u32)	data_size;
 
-    PTR(u64) yield_data_ptr;
-    u32	yield_data_size;
+    RDRAM_FIELD(PTR(u64)) yield_data_ptr;
+    RDRAM_FIELD(u32)	yield_data_size;
 } OSTask_s;
 
 typedef union {
@@ -153,23 +167,38 @@ typedef union {
 // PI
 
 struct OSIoMesgHdr {
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+    RDRAM_FIELD(u16) type;                  /* Message type */
+    u8 pri;                                 /* Message priority (High or Normal) */
+    u8 status;                              /* Return status */
+#else
     // These 3 reversed due to endianness
     u8 status;                 /* Return status */
     u8 pri;                    /* Message priority (High or Normal) */
     u16 type;                  /* Message type */
-    PTR(OSMesgQueue) retQueue; /* Return message queue to notify I/O completion */
+#endif
+    RDRAM_FIELD(PTR(OSMesgQueue)) retQueue; /* Return message queue to notify I/O completion */
 };
 
 struct OSIoMesg {
-    OSIoMesgHdr	hdr;    /* Message header */
-    PTR(void) dramAddr;	/* RDRAM buffer address (DMA) */
-    u32 devAddr;	    /* Device buffer address (DMA) */
-    u32 size;		    /* DMA transfer size in bytes */
-    u32 piHandle;	    /* PI device handle */
+    OSIoMesgHdr	hdr;                  /* Message header */
+    RDRAM_FIELD(PTR(void)) dramAddr;  /* RDRAM buffer address (DMA) */
+    RDRAM_FIELD(u32) devAddr;	      /* Device buffer address (DMA) */
+    RDRAM_FIELD(u32) size;		      /* DMA transfer size in bytes */
+    RDRAM_FIELD(u32) piHandle;	      /* PI device handle */
 };
 
 struct OSPiHandle {
-    PTR(OSPiHandle_s)    unused;        /* point to next handle on the table */
+    RDRAM_FIELD(PTR(OSPiHandle_s)) unused;  /* point to next handle on the table */
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+    u8                   type;          /* DEVICE_TYPE_BULK for disk */
+    u8                   latency;       /* domain latency */
+    u8                   pageSize;      /* domain page size */
+    u8                   relDuration;   /* domain release duration */
+    u8                   pulse;         /* domain pulse width */
+    u8                   domain;        /* which domain */
+    RDRAM_FIELD(u16)     padding;       /* struct alignment padding */
+#else
     // These four members reversed due to endianness
     u8                   relDuration;   /* domain release duration */
     u8                   pageSize;      /* domain page size */
@@ -179,35 +208,41 @@ struct OSPiHandle {
     u16                  padding;       /* struct alignment padding */
     u8                   domain;        /* which domain */
     u8                   pulse;         /* domain pulse width */
-    u32                  baseAddress;   /* Domain address */
-    u32                  speed;         /* for roms only */
+#endif
+    RDRAM_FIELD(u32)     baseAddress;   /* Domain address */
+    RDRAM_FIELD(u32)     speed;         /* for roms only */
     /* The following are "private" elements" */
-    u32                  transferInfo[18];  /* for disk only */
+    RDRAM_FIELD(u32)     transferInfo[18];  /* for disk only */
 };
 
 typedef struct {
-    u32	ctrl;
-    u32	width;
-    u32	burst;
-    u32	vSync;
-    u32	hSync;
-    u32	leap;
-    u32	hStart;
-    u32	xScale;
-    u32	vCurrent;
+    RDRAM_FIELD(u32)	ctrl;
+    RDRAM_FIELD(u32)	width;
+    RDRAM_FIELD(u32)	burst;
+    RDRAM_FIELD(u32)	vSync;
+    RDRAM_FIELD(u32)	hSync;
+    RDRAM_FIELD(u32)	leap;
+    RDRAM_FIELD(u32)	hStart;
+    RDRAM_FIELD(u32)	xScale;
+    RDRAM_FIELD(u32)	vCurrent;
 } OSViCommonRegs;
 
 typedef struct {
-    u32	origin;
-    u32	yScale;
-    u32	vStart;
-    u32	vBurst;
-    u32	vIntr;
+    RDRAM_FIELD(u32)	origin;
+    RDRAM_FIELD(u32)	yScale;
+    RDRAM_FIELD(u32)	vStart;
+    RDRAM_FIELD(u32)	vBurst;
+    RDRAM_FIELD(u32)	vIntr;
 } OSViFieldRegs;
 
 typedef struct {
+#if defined(RECOMP_RDRAM_BIG_ENDIAN)
+    u8 type;
+    u8 padding[3];
+#else
     u8 padding[3];
     u8 type;
+#endif
     OSViCommonRegs comRegs;
     OSViFieldRegs  fldRegs[2];
 } OSViMode;
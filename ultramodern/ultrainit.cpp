@@ -3,6 +3,7 @@
 
 void ultramodern::preinit(RDRAM_ARG ultramodern::WindowHandle window_handle) {
     ultramodern::set_main_thread();
+    ultramodern::init_external_messages();
     ultramodern::init_events(PASS_RDRAM window_handle);
     ultramodern::init_timers(PASS_RDRAM1);
     ultramodern::init_audio();
@@ -5,11 +5,13 @@
 #include <cassert>
 #include <stdexcept>
 #include <span>
+#include <filesystem>
 
 #undef MOODYCAMEL_DELETE_FUNCTION
 #define MOODYCAMEL_DELETE_FUNCTION = delete
 #include "lightweightsemaphore.h"
 #include "ultra64.h"
+#include "deadline_sleeper.hpp"
 
 #if defined(_WIN32)
 #   define WIN32_LEAN_AND_MEAN
@@ -62,6 +64,7 @@ void init_saving(RDRAM_ARG1);
 void init_events(RDRAM_ARG WindowHandle window_handle);
 void init_timers(RDRAM_ARG1);
 void init_thread_cleanup();
+void init_external_messages();
 
 // Thread queues.
 constexpr PTR(PTR(OSThread)) running_queue = (PTR(PTR(OSThread)))-1;
@@ -107,19 +110,44 @@ std::chrono::high_resolution_clock::time_point get_start();
 std::chrono::high_resolution_clock::duration time_since_start();
 void measure_input_latency();
 void sleep_milliseconds(uint32_t millis);
+// Refines the rate of the counter's clock source against the system clock. Cheap to call often, as it only does work about once a second.
+void refine_clock_calibration();
 void sleep_until(const std::chrono::high_resolution_clock::time_point& time_point);
 
 // Graphics
 void get_window_size(uint32_t& width, uint32_t& height);
 uint32_t get_target_framerate(uint32_t original);
 uint32_t get_display_refresh_rate();
-void load_shader_cache(std::span<const char> cache_data);
+// Loads the shader list embedded in the executable along with the shaders previously recorded to `user_cache_path`, then
+// records shaders compiled from then on to it. An empty path only loads the embedded list.
+void load_shader_cache(std::span<const char> cache_data, const std::filesystem::path& user_cache_path);
+
+// Depth and latency of the gfx thread's queue. A task's age is the time between the game submitting it and the gfx thread
+// starting to process it, and a frame's age is the time between the game swapping to it and the gfx thread presenting it.
+// Peaks and counts are tracked since startup.
+struct GfxQueueStats {
+    uint32_t tasks_in_flight;
+    uint32_t peak_tasks_in_flight;
+    uint64_t last_task_age_us;
+    uint64_t peak_task_age_us;
+    uint32_t frames_in_flight;
+    uint32_t peak_frames_in_flight;
+    uint64_t last_frame_age_us;
+    uint64_t peak_frame_age_us;
+    // Retrace messages that were held back from the game because too many frames were waiting to be presented.
+    uint64_t held_retraces;
+    // Frames that were never presented because a newer frame was already queued behind them.
+    uint64_t coalesced_frames;
+};
+GfxQueueStats get_gfx_queue_stats();
 
 // Audio
 void init_audio();
 void set_audio_frequency(uint32_t freq);
 void queue_audio_buffer(RDRAM_ARG PTR(s16) audio_data, uint32_t byte_count);
 uint32_t get_remaining_audio_bytes();
+// Time until all of the currently queued audio has been played.
+uint32_t get_audio_latency_us();
 
 struct audio_callbacks_t {
     using queue_samples_t = void(int16_t*, size_t);
@@ -144,16 +172,27 @@ struct gfx_callbacks_t {
     using gfx_data_t = void*;
     using create_gfx_t = gfx_data_t();
     using create_window_t = WindowHandle(gfx_data_t);
+    // Called in a loop on the main thread until the game quits. Should block until there's work to do instead of returning immediately.
     using update_gfx_t = void(gfx_data_t);
+    // Makes a blocked call to update_gfx return so that the main thread can observe a quit request.
+    using wake_gfx_t = void(gfx_data_t);
     create_gfx_t* create_gfx;
     create_window_t* create_window;
     update_gfx_t* update_gfx;
+    wake_gfx_t* wake_gfx;
 };
 bool is_game_started();
+// Requests that the calling thread's instance shuts down.
 void quit();
+bool quit_requested();
+// Wake the runtime's service threads from their blocking waits so that they observe a quit request.
+void wake_event_threads();
+void wake_thread_cleaner_thread();
+void wake_saving_thread();
 void join_event_threads();
 void join_thread_cleaner_thread();
 void join_saving_thread();
+void join_timer_thread();
 
 } // namespace ultramodern
 